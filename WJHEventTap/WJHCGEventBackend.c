@@ -0,0 +1,371 @@
+//
+//  WJHCGEventBackend.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCGEventBackend.h"
+#include "WJHCGEventRecord.h"
+#include "WJHEventTapDiscovery.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct WJHEventBackendTap {
+    WJHCGEventBackendOptions options;
+    ProcessSerialNumber process;
+    uint64_t eventMask;
+    bool passive;
+    WJHEventBackendCallback callback;
+    void *context;
+    CFMachPortRef port;
+    CFRunLoopSourceRef source;
+
+    // Filled in once discovery has identified the tap.
+    CGEventTapInformation info;
+    bool identified;
+
+    // The system usually enables a tap as it creates it, so it can receive events before it is disabled, at least the disable itself.  Those are passed over, up to and including the disable.  Each tap has its own flag, so a tap that is replacing another never affects the events of the other.
+    bool swallowing;
+
+    // The number of events handled since deliver was called.
+    long delivered;
+};
+
+static CGEventRef eventTapCallback(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *userInfo) {
+    WJHEventBackendTap *tap = userInfo;
+    ++tap->delivered;
+    if (tap->swallowing) {
+        if (type == kCGEventTapDisabledByUserInput) {
+            // This should be our manual disable when we created the tap
+            tap->swallowing = false;
+        }
+        return event;
+    }
+    if (tap->options.eventCallback) {
+        return tap->options.eventCallback(proxy, type, event, tap->context);
+    }
+
+    WJHEventRecord record;
+    WJHEventRecordFill(&record, event, type, tap->info.eventTapID);
+    WJHEventRecord const original = record;
+    bool const pass = tap->callback(tap->context, &record);
+    if (tap->passive || event == NULL) {
+        return event;
+    }
+    if (!pass) {
+        return NULL;
+    }
+
+    if (record.type != original.type) {
+        CGEventSetType(event, (CGEventType)record.type);
+    }
+    if (record.flags != original.flags) {
+        CGEventSetFlags(event, (CGEventFlags)record.flags);
+    }
+    if (record.keycode != original.keycode) {
+        CGEventSetIntegerValueField(event, kCGKeyboardEventKeycode, record.keycode);
+    }
+    if (record.x != original.x || record.y != original.y) {
+        CGEventSetLocation(event, CGPointMake(record.x, record.y));
+    }
+    return event;
+}
+
+static bool createPort(void *context) {
+    WJHEventBackendTap *tap = context;
+    CGEventTapPlacement placement = tap->options.beforeOthers ? kCGHeadInsertEventTap : kCGTailAppendEventTap;
+    CGEventTapOptions options = tap->passive ? kCGEventTapOptionListenOnly : kCGEventTapOptionDefault;
+    if (tap->options.process) {
+        tap->port = CGEventTapCreateForPSN(&tap->process, placement, options, (CGEventMask)tap->eventMask, eventTapCallback, tap);
+    } else {
+        tap->port = CGEventTapCreate(tap->options.location, placement, options, (CGEventMask)tap->eventMask, eventTapCallback, tap);
+    }
+    if (tap->port == NULL) {
+        return false;
+    }
+
+    // Nothing reaches the callback until the tap is added to the run loop, so this is in place before the first event.
+    tap->swallowing = CGEventTapIsEnabled(tap->port);
+    CGEventTapEnable(tap->port, false);
+    return true;
+}
+
+static void destroyPort(void *context) {
+    WJHEventBackendTap *tap = context;
+    if (tap->port) {
+        CFMachPortInvalidate(tap->port);
+        CFRelease(tap->port);
+        tap->port = NULL;
+    }
+}
+
+static pid_t pidForPSN(ProcessSerialNumber const *psn) {
+    pid_t pid;
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    OSStatus status = GetProcessPID(psn, &pid);
+#pragma clang diagnostic pop
+    return status == noErr ? pid : -1;
+}
+
+/**
+ The criteria satisfied by the system tap, once it is created.
+ */
+static WJHEventTapMatch discoveryMatch(WJHEventBackendTap const *tap) {
+    WJHEventTapMatch match = {
+        .tappingProcess = getpid(),
+        .processBeingTapped = tap->options.process ? pidForPSN(&tap->process) : -1,
+        .tapPoint = tap->options.location,
+        .options = tap->passive ? kCGEventTapOptionListenOnly : kCGEventTapOptionDefault,
+    };
+    return match;
+}
+
+static int discoveryError(WJHEventTapDiscoveryResult result) {
+    switch (result) {
+        case WJHEventTapDiscoveryFound:
+            return 0;
+        case WJHEventTapDiscoveryCreateFailed:
+            // Almost always a process that is not trusted for accessibility.
+            return EPERM;
+        case WJHEventTapDiscoveryListFailed:
+            return EIO;
+        case WJHEventTapDiscoveryExhausted:
+            return EAGAIN;
+        case WJHEventTapDiscoveryOutOfMemory:
+            return ENOMEM;
+    }
+    return EINVAL;
+}
+
+static void cgDestroy(WJHEventBackendTap *tap);
+
+/**
+ Allocate a tap, without creating its system tap.
+ */
+static WJHEventBackendTap * allocateTap(WJHCGEventBackendOptions const *options, uint64_t eventMask, bool passive, WJHEventBackendCallback callback, void *context) {
+    if (options == NULL || (callback == NULL && options->eventCallback == NULL)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    WJHEventBackendTap *tap = calloc(1, sizeof(*tap));
+    if (tap == NULL) {
+        return NULL;
+    }
+    tap->options = *options;
+    if (options->process) {
+        tap->process = *options->process;
+        tap->options.process = &tap->process;
+    }
+    tap->options.runLoop = (CFRunLoopRef)CFRetain(options->runLoop ? options->runLoop : CFRunLoopGetCurrent());
+    tap->eventMask = eventMask;
+    tap->passive = passive;
+    tap->callback = callback;
+    tap->context = context;
+    return tap;
+}
+
+/**
+ Start servicing a tap whose system tap has been created.
+
+ @return false, with errno set, if there is no system tap, or it can not be serviced.
+ */
+static bool addToRunLoop(WJHEventBackendTap *tap) {
+    if (tap->port == NULL) {
+        errno = EPERM;
+        return false;
+    }
+    tap->source = CFMachPortCreateRunLoopSource(kCFAllocatorDefault, tap->port, 0);
+    if (tap->source == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    CFRunLoopAddSource(tap->options.runLoop, tap->source, kCFRunLoopCommonModes);
+    return true;
+}
+
+static WJHEventBackendTap * cgCreate(void const *options, uint64_t eventMask, bool passive, WJHEventBackendCallback callback, void *context) {
+    WJHCGEventBackendOptions const *cgOptions = options;
+    WJHEventBackendTap *tap = allocateTap(cgOptions, eventMask, passive, callback, context);
+    if (tap == NULL) {
+        return NULL;
+    }
+
+    // I can't find an API to get a tap's unique eventTapID, so we need to grab the list of taps both before and after installing our own, and look for the one new tap.
+    WJHEventTapMatch match = discoveryMatch(tap);
+    WJHEventTapDiscoveryCallbacks callbacks = {
+        .create = createPort,
+        .destroy = destroyPort,
+        .context = tap,
+    };
+    WJHEventTapList list;
+    WJHEventTapListInit(&list, NULL, 0);
+    WJHEventTapListSetProvider(&list, cgOptions->tapListProvider, cgOptions->tapListProviderContext);
+    switch (WJHEventTapDiscover(&list, &match, NULL, &callbacks, &tap->info, NULL)) {
+        case WJHEventTapDiscoveryFound:
+            tap->identified = true;
+            break;
+        case WJHEventTapDiscoveryCreateFailed:
+            break;
+        case WJHEventTapDiscoveryListFailed:
+        case WJHEventTapDiscoveryExhausted:
+        case WJHEventTapDiscoveryOutOfMemory:
+            // The tap works just as well without knowing its ID.
+            createPort(tap);
+            break;
+    }
+    WJHEventTapListDestroy(&list);
+
+    if (!addToRunLoop(tap)) {
+        int const error = errno;
+        cgDestroy(tap);
+        errno = error;
+        return NULL;
+    }
+    return tap;
+}
+
+static void cgDestroy(WJHEventBackendTap *tap) {
+    if (tap == NULL) {
+        return;
+    }
+    if (tap->source) {
+        CFRunLoopRemoveSource(tap->options.runLoop, tap->source, kCFRunLoopCommonModes);
+        CFRunLoopSourceInvalidate(tap->source);
+        CFRelease(tap->source);
+    }
+    destroyPort(tap);
+    CFRelease(tap->options.runLoop);
+    free(tap);
+}
+
+static void cgSetEnabled(WJHEventBackendTap *tap, bool enabled) {
+    CGEventTapEnable(tap->port, enabled);
+}
+
+static bool cgIsEnabled(WJHEventBackendTap const *tap) {
+    return CGEventTapIsEnabled(tap->port);
+}
+
+static size_t cgListTaps(WJHEventBackendTapInfo *taps, size_t capacity) {
+    WJHEventTapList list;
+    WJHEventTapListInit(&list, NULL, 0);
+    CGEventTapInformation const *infos;
+    uint32_t count = 0;
+    if (WJHEventTapListRefresh(&list, &infos, &count) == kCGErrorSuccess) {
+        for (uint32_t i = 0; i < count && i < capacity; ++i) {
+            taps[i] = (WJHEventBackendTapInfo){
+                .tapID = infos[i].eventTapID,
+                .eventMask = infos[i].eventsOfInterest,
+                .passive = infos[i].options == kCGEventTapOptionListenOnly,
+                .enabled = infos[i].enabled,
+            };
+        }
+    }
+    WJHEventTapListDestroy(&list);
+    return count;
+}
+
+static long cgDeliver(WJHEventBackendTap *tap) {
+    if (CFRunLoopGetCurrent() != tap->options.runLoop) {
+        errno = EINVAL;
+        return -1;
+    }
+    tap->delivered = 0;
+    while (tap->delivered == 0 && CFMachPortIsValid(tap->port)) {
+        if (CFRunLoopRunInMode(kCFRunLoopDefaultMode, 1.0e10, true) == kCFRunLoopRunStopped) {
+            break;
+        }
+    }
+    return tap->delivered;
+}
+
+WJHEventBackend const kWJHCGEventBackend = {
+    .name = "coregraphics",
+    .create = cgCreate,
+    .destroy = cgDestroy,
+    .setEnabled = cgSetEnabled,
+    .isEnabled = cgIsEnabled,
+    .listTaps = cgListTaps,
+    .deliver = cgDeliver,
+};
+
+bool WJHCGEventBackendGetTapInformation(WJHEventBackendTap const *tap, CGEventTapInformation *info) {
+    if (!tap->identified) {
+        return false;
+    }
+    *info = tap->info;
+    return true;
+}
+
+
+#pragma mark - Creating Several Taps
+
+static bool bulkCreatePort(void *context, size_t index) {
+    WJHEventBackendTap **taps = context;
+    return createPort(taps[index]);
+}
+
+static void bulkDestroyPort(void *context, size_t index) {
+    WJHEventBackendTap **taps = context;
+    destroyPort(taps[index]);
+}
+
+bool WJHCGEventBackendCreateTaps(WJHCGEventBackendRequest const *requests, size_t count, WJHEventBackendTap **taps) {
+    if (count == 0) {
+        return true;
+    }
+    memset(taps, 0, count * sizeof(*taps));
+    WJHEventTapDiscoveryRequest *discoveryRequests = calloc(count, sizeof(*discoveryRequests));
+    CGEventTapInformation *infos = calloc(count, sizeof(*infos));
+    bool created = discoveryRequests != NULL && infos != NULL;
+    for (size_t i = 0; created && i < count; ++i) {
+        WJHCGEventBackendRequest const *request = requests + i;
+        taps[i] = allocateTap(&request->options, request->eventMask, request->passive, request->callback, request->context);
+        if (taps[i] == NULL) {
+            created = false;
+        } else {
+            discoveryRequests[i] = (WJHEventTapDiscoveryRequest){ discoveryMatch(taps[i]), (CGEventMask)request->eventMask };
+        }
+    }
+
+    if (created) {
+        WJHEventTapBulkDiscoveryCallbacks callbacks = {
+            .create = bulkCreatePort,
+            .destroy = bulkDestroyPort,
+            .context = taps,
+        };
+        WJHEventTapList list;
+        WJHEventTapListInit(&list, NULL, 0);
+        WJHEventTapListSetProvider(&list, requests->options.tapListProvider, requests->options.tapListProviderContext);
+        WJHEventTapDiscoveryResult result = WJHEventTapDiscoverMany(&list, discoveryRequests, count, NULL, &callbacks, infos, NULL);
+        WJHEventTapListDestroy(&list);
+        created = result == WJHEventTapDiscoveryFound;
+        if (!created) {
+            errno = discoveryError(result);
+        }
+    }
+
+    // The taps are only serviced once they have all been identified, so none can see an event unless they all exist.
+    for (size_t i = 0; created && i < count; ++i) {
+        taps[i]->info = infos[i];
+        taps[i]->identified = true;
+        created = addToRunLoop(taps[i]);
+    }
+
+    if (!created) {
+        int const error = errno;
+        for (size_t i = 0; i < count; ++i) {
+            cgDestroy(taps[i]);
+            taps[i] = NULL;
+        }
+        errno = error;
+    }
+    free(discoveryRequests);
+    free(infos);
+    return created;
+}
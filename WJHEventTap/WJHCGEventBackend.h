@@ -0,0 +1,84 @@
+//
+//  WJHCGEventBackend.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHCGEventBackend_h
+#define WJHEventTap_WJHCGEventBackend_h
+
+#include <ApplicationServices/ApplicationServices.h>
+#include "WJHEventBackend.h"
+#include "WJHEventTapList.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Options for kWJHCGEventBackend taps.
+ */
+typedef struct WJHCGEventBackendOptions {
+    /// Where to tap.  A process tap uses kWJHProcessEventTap, which is the tapPoint the system reports for it.
+    CGEventTapLocation location;
+    bool beforeOthers;
+
+    /// The run loop that services the tap, or NULL for the run loop of the creating thread.  The deliver function must be called on it.
+    CFRunLoopRef runLoop;
+
+    /// The process whose events are tapped, or NULL to tap @a location.  It is copied when the tap is created.
+    ProcessSerialNumber const *process;
+
+    /// If not NULL, called with each event itself, in place of the record callback (which may then be NULL), with the context given to create.  What it returns goes back to the window server.  This is for clients that need the CGEventRef, or the proxy, such as WJHEventTap.
+    CGEventTapCallBack eventCallback;
+
+    /// Where the tap lists used to identify a new tap come from, or NULL for CGGetEventTapList.
+    WJHEventTapListProvider tapListProvider;
+    void *tapListProviderContext;
+} WJHCGEventBackendOptions;
+
+/**
+ A backend built on CGEventTap, which intercepts events from the window server.
+
+ An active tap applies changes the callback makes to the type, flags, keycode, and location of an event.  Tap notifications (e.g., disabled by timeout) are delivered with the kWJHEventTypeTapDisabled types, whatever the event mask.  The events the system queues for a new tap before the backend has disabled it are passed over, and never reach the callback.  The tapID is discovered from the system tap list when the tap is created, and is zero if it could not be found.  The deliver function runs the run loop until an event has been handled, or the run loop is stopped (CFRunLoopStop), when it returns zero.
+ */
+extern WJHEventBackend const kWJHCGEventBackend;
+
+/**
+ Get the system's information about a tap, as discovered when the tap was created.
+
+ @param tap a tap created by kWJHCGEventBackend
+ @param info receives the information
+
+ @return false if the tap could not be identified when it was created, in which case @a info is untouched.
+ */
+bool WJHCGEventBackendGetTapInformation(WJHEventBackendTap const *tap, CGEventTapInformation *info);
+
+/**
+ The arguments for creating one of several kWJHCGEventBackend taps together, as given to the backend's create function.
+ */
+typedef struct WJHCGEventBackendRequest {
+    WJHCGEventBackendOptions options;
+    uint64_t eventMask;
+    bool passive;
+    WJHEventBackendCallback callback;
+    void *context;
+} WJHCGEventBackendRequest;
+
+/**
+ Create several taps, and identify them all from one comparison of the tap list (see WJHEventTapDiscoverMany), which takes far fewer tap list calls than creating them one at a time.  The tap lists come from the provider in the options of the first request.
+
+ @param requests the taps to be created
+ @param count the number of requests
+ @param taps receives the new taps, in the same order as @a requests
+
+ @return true if every tap was created and identified.  Otherwise none of them exist, and errno is set.
+ */
+bool WJHCGEventBackendCreateTaps(WJHCGEventBackendRequest const *requests, size_t count, WJHEventBackendTap **taps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+//
+//  WJHCGEventRecord.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHCGEventRecord_h
+#define WJHEventTap_WJHCGEventRecord_h
+
+#include <ApplicationServices/ApplicationServices.h>
+#include "WJHEventRecord.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ The conversions between CGEventRef and WJHEventRecord, for the C files of the framework, which can not import WJHEventTap.h.  They are defined in WJHEventTap.m, and documented, for clients, in WJHEventTap.h.
+ */
+extern void WJHEventRecordFill(WJHEventRecord *record, CGEventRef event, CGEventType type, uint32_t tapID);
+extern CGEventRef WJHEventCreateWithRecord(WJHEventRecord const *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
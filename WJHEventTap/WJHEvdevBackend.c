@@ -0,0 +1,508 @@
+//
+//  WJHEvdevBackend.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "WJHEvdevBackend.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(WJHEvdevInputEvent) == 24, "WJHEvdevInputEvent must match the 64 bit struct input_event");
+
+// From <linux/input-event-codes.h>, which is not available on every platform.
+enum {
+    kEvSyn = 0x00,
+    kEvKey = 0x01,
+    kEvRel = 0x02,
+    kEvAbs = 0x03,
+
+    kSynReport = 0,
+
+    kRelX = 0x00,
+    kRelY = 0x01,
+    kRelHWheel = 0x06,
+    kRelWheel = 0x08,
+
+    kAbsX = 0x00,
+    kAbsY = 0x01,
+
+    kBtnLeft = 0x110,
+    kBtnRight = 0x111,
+    kBtnTask = 0x117,
+
+    kKeyLeftCtrl = 29,
+    kKeyLeftShift = 42,
+    kKeyRightShift = 54,
+    kKeyLeftAlt = 56,
+    kKeyCapsLock = 58,
+    kKeyRightCtrl = 97,
+    kKeyRightAlt = 100,
+    kKeyLeftMeta = 125,
+    kKeyRightMeta = 126,
+};
+
+enum {
+    kReadCount = 64,
+    kFrameCapacity = 64,
+    kOutputCapacity = 2 * kReadCount + kFrameCapacity,
+    kLinuxKeyLimit = 256,
+    kMacKeyLimit = 128,
+};
+
+/**
+ Linux key codes and the macOS virtual keycodes they map to.
+ */
+static uint16_t const kKeycodes[][2] = {
+    { 1, 0x35 }, { 2, 0x12 }, { 3, 0x13 }, { 4, 0x14 }, { 5, 0x15 }, { 6, 0x17 }, { 7, 0x16 }, { 8, 0x1A }, { 9, 0x1C }, { 10, 0x19 }, { 11, 0x1D },
+    { 12, 0x1B }, { 13, 0x18 }, { 14, 0x33 }, { 15, 0x30 },
+    { 16, 0x0C }, { 17, 0x0D }, { 18, 0x0E }, { 19, 0x0F }, { 20, 0x11 }, { 21, 0x10 }, { 22, 0x20 }, { 23, 0x22 }, { 24, 0x1F }, { 25, 0x23 },
+    { 26, 0x21 }, { 27, 0x1E }, { 28, 0x24 }, { kKeyLeftCtrl, 0x3B },
+    { 30, 0x00 }, { 31, 0x01 }, { 32, 0x02 }, { 33, 0x03 }, { 34, 0x05 }, { 35, 0x04 }, { 36, 0x26 }, { 37, 0x28 }, { 38, 0x25 },
+    { 39, 0x29 }, { 40, 0x27 }, { 41, 0x32 }, { kKeyLeftShift, 0x38 }, { 43, 0x2A },
+    { 44, 0x06 }, { 45, 0x07 }, { 46, 0x08 }, { 47, 0x09 }, { 48, 0x0B }, { 49, 0x2D }, { 50, 0x2E },
+    { 51, 0x2B }, { 52, 0x2F }, { 53, 0x2C }, { kKeyRightShift, 0x3C }, { 55, 0x43 }, { kKeyLeftAlt, 0x3A }, { 57, 0x31 }, { kKeyCapsLock, 0x39 },
+    { 59, 0x7A }, { 60, 0x78 }, { 61, 0x63 }, { 62, 0x76 }, { 63, 0x60 }, { 64, 0x61 }, { 65, 0x62 }, { 66, 0x64 }, { 67, 0x65 }, { 68, 0x6D },
+    { 87, 0x67 }, { 88, 0x6F },
+    { kKeyRightCtrl, 0x3E }, { kKeyRightAlt, 0x3D },
+    { 102, 0x73 }, { 103, 0x7E }, { 104, 0x74 }, { 105, 0x7B }, { 106, 0x7C }, { 107, 0x77 }, { 108, 0x7D }, { 109, 0x79 }, { 110, 0x72 }, { 111, 0x75 },
+    { kKeyLeftMeta, 0x37 }, { kKeyRightMeta, 0x36 },
+};
+
+// Both tables hold the mapped code plus one, so zero means there is none.
+static uint16_t linuxToMac[kLinuxKeyLimit];
+static uint16_t macToLinux[kMacKeyLimit];
+static pthread_once_t keycodesOnce = PTHREAD_ONCE_INIT;
+
+static void initKeycodes(void) {
+    for (size_t i = 0; i < sizeof(kKeycodes) / sizeof(*kKeycodes); ++i) {
+        linuxToMac[kKeycodes[i][0]] = kKeycodes[i][1] + 1;
+        macToLinux[kKeycodes[i][1]] = kKeycodes[i][0] + 1;
+    }
+}
+
+uint16_t WJHEvdevKeycodeFromLinux(uint16_t code) {
+    pthread_once(&keycodesOnce, initKeycodes);
+    return code < kLinuxKeyLimit && linuxToMac[code] ? linuxToMac[code] - 1 : UINT16_MAX;
+}
+
+uint16_t WJHEvdevKeycodeToLinux(uint16_t keycode) {
+    pthread_once(&keycodesOnce, initKeycodes);
+    return keycode < kMacKeyLimit && macToLinux[keycode] ? macToLinux[keycode] - 1 : UINT16_MAX;
+}
+
+/**
+ The modifier a key controls, as a bit of the tap's modifier key state, and the flag it contributes to.
+ */
+static bool modifierForKey(uint16_t code, uint32_t *bit, uint64_t *flag) {
+    switch (code) {
+        case kKeyLeftShift: *bit = 1 << 0; *flag = kWJHEventFlagShift; return true;
+        case kKeyRightShift: *bit = 1 << 1; *flag = kWJHEventFlagShift; return true;
+        case kKeyLeftCtrl: *bit = 1 << 2; *flag = kWJHEventFlagControl; return true;
+        case kKeyRightCtrl: *bit = 1 << 3; *flag = kWJHEventFlagControl; return true;
+        case kKeyLeftAlt: *bit = 1 << 4; *flag = kWJHEventFlagAlternate; return true;
+        case kKeyRightAlt: *bit = 1 << 5; *flag = kWJHEventFlagAlternate; return true;
+        case kKeyLeftMeta: *bit = 1 << 6; *flag = kWJHEventFlagCommand; return true;
+        case kKeyRightMeta: *bit = 1 << 7; *flag = kWJHEventFlagCommand; return true;
+        case kKeyCapsLock: *bit = 0; *flag = kWJHEventFlagAlphaShift; return true;
+    }
+    return false;
+}
+
+struct WJHEventBackendTap {
+    WJHEvdevOptions options;
+    uint64_t eventMask;
+    bool passive;
+    atomic_bool enabled;
+    WJHEventBackendCallback callback;
+    void *context;
+    uint32_t tapID;
+    struct WJHEventBackendTap *next;
+
+    // The state of the device, as of the last event read.
+    uint32_t modifierKeys;
+    uint64_t flags;
+    uint32_t buttons;
+    double x;
+    double y;
+
+    // The motion of the report being read, which is delivered as one event when the report ends.
+    int32_t dx;
+    int32_t dy;
+    int32_t wheel;
+    int32_t hwheel;
+    bool moved;
+    WJHEvdevInputEvent frame[kFrameCapacity];
+    size_t frameCount;
+
+    // Bytes of an event split across reads.
+    unsigned char partial[sizeof(WJHEvdevInputEvent)];
+    size_t partialBytes;
+
+    WJHEvdevInputEvent output[kOutputCapacity];
+    size_t outputCount;
+    int outputError;
+};
+
+static pthread_mutex_t registryMutex = PTHREAD_MUTEX_INITIALIZER;
+static WJHEventBackendTap *registry;
+static uint32_t lastTapID;
+
+
+#pragma mark - Output
+
+static void flushOutput(WJHEventBackendTap *tap) {
+    char const *bytes = (char const *)tap->output;
+    size_t remaining = tap->outputCount * sizeof(WJHEvdevInputEvent);
+    tap->outputCount = 0;
+    while (remaining && tap->outputError == 0) {
+        ssize_t written = write(tap->options.outputFD, bytes, remaining);
+        if (written < 0) {
+            if (errno != EINTR) {
+                tap->outputError = errno;
+            }
+            continue;
+        }
+        bytes += written;
+        remaining -= (size_t)written;
+    }
+}
+
+static void emit(WJHEventBackendTap *tap, WJHEvdevInputEvent const *event) {
+    if (tap->passive || tap->options.outputFD < 0) {
+        return;
+    }
+    if (tap->outputCount == kOutputCapacity) {
+        flushOutput(tap);
+    }
+    tap->output[tap->outputCount++] = *event;
+}
+
+
+#pragma mark - Events
+
+static uint64_t timestampOf(WJHEvdevInputEvent const *event) {
+    return (uint64_t)event->seconds * 1000000000u + (uint64_t)event->microseconds * 1000u;
+}
+
+static WJHEventRecord makeRecord(WJHEventBackendTap const *tap, WJHEvdevInputEvent const *event, uint32_t type) {
+    WJHEventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = timestampOf(event);
+    record.type = type;
+    record.tapID = tap->tapID;
+    record.flags = tap->flags;
+    record.x = tap->x;
+    record.y = tap->y;
+    return record;
+}
+
+/**
+ Hand a record to the callback, if the tap is interested in it.
+
+ @return whether the event passes.
+ */
+static bool deliverRecord(WJHEventBackendTap *tap, WJHEventRecord *record) {
+    if (!atomic_load_explicit(&tap->enabled, memory_order_relaxed) || record->type >= 64 || (tap->eventMask & (UINT64_C(1) << record->type)) == 0) {
+        return true;
+    }
+    return tap->callback(tap->context, record) || tap->passive;
+}
+
+static void handleButton(WJHEventBackendTap *tap, WJHEvdevInputEvent const *event) {
+    uint16_t button = (uint16_t)(event->code - kBtnLeft);
+    if (event->value == 2) {
+        emit(tap, event);
+        return;
+    }
+    bool down = event->value != 0;
+    if (down) {
+        tap->buttons |= 1u << button;
+    } else {
+        tap->buttons &= ~(1u << button);
+    }
+
+    uint32_t type;
+    switch (event->code) {
+        case kBtnLeft:
+            type = down ? kWJHEventTypeLeftMouseDown : kWJHEventTypeLeftMouseUp;
+            break;
+        case kBtnRight:
+            type = down ? kWJHEventTypeRightMouseDown : kWJHEventTypeRightMouseUp;
+            break;
+        default:
+            type = down ? kWJHEventTypeOtherMouseDown : kWJHEventTypeOtherMouseUp;
+            break;
+    }
+    WJHEventRecord record = makeRecord(tap, event, type);
+    record.button = button;
+    if (deliverRecord(tap, &record)) {
+        emit(tap, event);
+    }
+}
+
+static void handleKey(WJHEventBackendTap *tap, WJHEvdevInputEvent const *event) {
+    if (event->code >= kBtnLeft && event->code <= kBtnTask) {
+        handleButton(tap, event);
+        return;
+    }
+    uint16_t keycode = WJHEvdevKeycodeFromLinux(event->code);
+    if (keycode == UINT16_MAX) {
+        emit(tap, event);
+        return;
+    }
+
+    uint32_t type;
+    uint32_t bit;
+    uint64_t flag;
+    if (modifierForKey(event->code, &bit, &flag)) {
+        if (event->value == 2) {
+            emit(tap, event);
+            return;
+        }
+        if (bit == 0) {
+            if (event->value) {
+                tap->flags ^= flag;
+            }
+        } else {
+            tap->modifierKeys = event->value ? tap->modifierKeys | bit : tap->modifierKeys & ~bit;
+            uint32_t const pair = (bit & 0x55) ? bit | bit << 1 : bit | bit >> 1;
+            tap->flags = (tap->modifierKeys & pair) ? tap->flags | flag : tap->flags & ~flag;
+        }
+        type = kWJHEventTypeFlagsChanged;
+    } else {
+        type = event->value ? kWJHEventTypeKeyDown : kWJHEventTypeKeyUp;
+    }
+
+    WJHEventRecord record = makeRecord(tap, event, type);
+    record.keycode = keycode;
+    if (!deliverRecord(tap, &record)) {
+        return;
+    }
+
+    WJHEvdevInputEvent output = *event;
+    if (record.keycode != keycode) {
+        uint16_t code = WJHEvdevKeycodeToLinux(record.keycode);
+        if (code != UINT16_MAX) {
+            output.code = code;
+        }
+    }
+    if (record.type != type) {
+        if (record.type == kWJHEventTypeKeyUp) {
+            output.value = 0;
+        } else if (record.type == kWJHEventTypeKeyDown && output.value == 0) {
+            output.value = 1;
+        }
+    }
+    emit(tap, &output);
+}
+
+static void handleMotion(WJHEventBackendTap *tap, WJHEvdevInputEvent const *event) {
+    if (event->type == kEvRel) {
+        switch (event->code) {
+            case kRelX: tap->x += event->value; tap->dx += event->value; tap->moved = true; break;
+            case kRelY: tap->y += event->value; tap->dy += event->value; tap->moved = true; break;
+            case kRelWheel: tap->wheel += event->value; break;
+            case kRelHWheel: tap->hwheel += event->value; break;
+        }
+    } else {
+        switch (event->code) {
+            case kAbsX: tap->dx += (int32_t)(event->value - tap->x); tap->x = event->value; tap->moved = true; break;
+            case kAbsY: tap->dy += (int32_t)(event->value - tap->y); tap->y = event->value; tap->moved = true; break;
+        }
+    }
+    if (tap->frameCount < kFrameCapacity) {
+        tap->frame[tap->frameCount++] = *event;
+    } else {
+        emit(tap, event);
+    }
+}
+
+static bool isWheel(WJHEvdevInputEvent const *event) {
+    return event->type == kEvRel && (event->code == kRelWheel || event->code == kRelHWheel);
+}
+
+/**
+ Deliver the motion of the report that @a event ends.
+ */
+static void handleReport(WJHEventBackendTap *tap, WJHEvdevInputEvent const *event) {
+    bool passMotion = true;
+    bool passWheel = true;
+
+    if (tap->moved) {
+        uint32_t type = kWJHEventTypeMouseMoved;
+        if (tap->buttons & 1) {
+            type = kWJHEventTypeLeftMouseDragged;
+        } else if (tap->buttons & 2) {
+            type = kWJHEventTypeRightMouseDragged;
+        } else if (tap->buttons) {
+            type = kWJHEventTypeOtherMouseDragged;
+        }
+        WJHEventRecord record = makeRecord(tap, event, type);
+        record.deltaX = tap->dx;
+        record.deltaY = tap->dy;
+        passMotion = deliverRecord(tap, &record);
+    }
+    if (tap->wheel || tap->hwheel) {
+        WJHEventRecord record = makeRecord(tap, event, kWJHEventTypeScrollWheel);
+        record.deltaX = tap->hwheel;
+        record.deltaY = tap->wheel;
+        passWheel = deliverRecord(tap, &record);
+    }
+
+    for (size_t i = 0; i < tap->frameCount; ++i) {
+        if (isWheel(tap->frame + i) ? passWheel : passMotion) {
+            emit(tap, tap->frame + i);
+        }
+    }
+    emit(tap, event);
+
+    tap->dx = tap->dy = tap->wheel = tap->hwheel = 0;
+    tap->moved = false;
+    tap->frameCount = 0;
+}
+
+static void handleEvent(WJHEventBackendTap *tap, WJHEvdevInputEvent const *event) {
+    switch (event->type) {
+        case kEvKey:
+            handleKey(tap, event);
+            break;
+        case kEvRel:
+        case kEvAbs:
+            handleMotion(tap, event);
+            break;
+        case kEvSyn:
+            if (event->code == kSynReport) {
+                handleReport(tap, event);
+            } else {
+                emit(tap, event);
+            }
+            break;
+        default:
+            emit(tap, event);
+            break;
+    }
+}
+
+
+#pragma mark - Backend
+
+static WJHEventBackendTap * evdevCreate(void const *options, uint64_t eventMask, bool passive, WJHEventBackendCallback callback, void *context) {
+    WJHEvdevOptions const *evdevOptions = options;
+    if (evdevOptions == NULL || evdevOptions->inputFD < 0 || callback == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    WJHEventBackendTap *tap = calloc(1, sizeof(*tap));
+    if (tap == NULL) {
+        return NULL;
+    }
+    tap->options = *evdevOptions;
+    tap->eventMask = eventMask;
+    tap->passive = passive;
+    tap->callback = callback;
+    tap->context = context;
+    tap->x = evdevOptions->x;
+    tap->y = evdevOptions->y;
+
+    pthread_mutex_lock(&registryMutex);
+    tap->tapID = ++lastTapID;
+    tap->next = registry;
+    registry = tap;
+    pthread_mutex_unlock(&registryMutex);
+    return tap;
+}
+
+static void evdevDestroy(WJHEventBackendTap *tap) {
+    if (tap == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&registryMutex);
+    WJHEventBackendTap **link = &registry;
+    while (*link != tap) {
+        link = &(*link)->next;
+    }
+    *link = tap->next;
+    pthread_mutex_unlock(&registryMutex);
+    free(tap);
+}
+
+static void evdevSetEnabled(WJHEventBackendTap *tap, bool enabled) {
+    atomic_store(&tap->enabled, enabled);
+}
+
+static bool evdevIsEnabled(WJHEventBackendTap const *tap) {
+    return atomic_load(&((WJHEventBackendTap *)tap)->enabled);
+}
+
+static size_t evdevListTaps(WJHEventBackendTapInfo *taps, size_t capacity) {
+    size_t count = 0;
+    pthread_mutex_lock(&registryMutex);
+    for (WJHEventBackendTap const *tap = registry; tap; tap = tap->next, ++count) {
+        if (count < capacity) {
+            taps[count] = (WJHEventBackendTapInfo){
+                .tapID = tap->tapID,
+                .eventMask = tap->eventMask,
+                .passive = tap->passive,
+                .enabled = atomic_load(&((WJHEventBackendTap *)tap)->enabled),
+            };
+        }
+    }
+    pthread_mutex_unlock(&registryMutex);
+    return count;
+}
+
+static long evdevDeliver(WJHEventBackendTap *tap) {
+    unsigned char buffer[(kReadCount + 1) * sizeof(WJHEvdevInputEvent)];
+    size_t available = tap->partialBytes;
+    memcpy(buffer, tap->partial, available);
+
+    // Wait for at least one whole event, as pipes may split them.
+    while (available < sizeof(WJHEvdevInputEvent)) {
+        ssize_t bytes = read(tap->options.inputFD, buffer + available, kReadCount * sizeof(WJHEvdevInputEvent));
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            tap->partialBytes = available;
+            memcpy(tap->partial, buffer, available);
+            return bytes;
+        }
+        available += (size_t)bytes;
+    }
+
+    size_t const count = available / sizeof(WJHEvdevInputEvent);
+    for (size_t i = 0; i < count; ++i) {
+        WJHEvdevInputEvent event;
+        memcpy(&event, buffer + i * sizeof(event), sizeof(event));
+        handleEvent(tap, &event);
+    }
+    tap->partialBytes = available - count * sizeof(WJHEvdevInputEvent);
+    memcpy(tap->partial, buffer + count * sizeof(WJHEvdevInputEvent), tap->partialBytes);
+
+    flushOutput(tap);
+    if (tap->outputError) {
+        errno = tap->outputError;
+        tap->outputError = 0;
+        return -1;
+    }
+    return (long)count;
+}
+
+WJHEventBackend const kWJHEvdevBackend = {
+    .name = "evdev",
+    .create = evdevCreate,
+    .destroy = evdevDestroy,
+    .setEnabled = evdevSetEnabled,
+    .isEnabled = evdevIsEnabled,
+    .listTaps = evdevListTaps,
+    .deliver = evdevDeliver,
+};
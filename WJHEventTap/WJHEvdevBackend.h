@@ -0,0 +1,70 @@
+//
+//  WJHEvdevBackend.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEvdevBackend_h
+#define WJHEventTap_WJHEvdevBackend_h
+
+#include "WJHEventBackend.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ A Linux input event (struct input_event from <linux/input.h>), as laid out on 64 bit systems, so evdev streams can be read, and written, on any platform.
+ */
+typedef struct WJHEvdevInputEvent {
+    int64_t seconds;
+    int64_t microseconds;
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+} WJHEvdevInputEvent;
+
+/**
+ Options for kWJHEvdevBackend taps.
+ */
+typedef struct WJHEvdevOptions {
+    /// A file descriptor to read struct input_event from, such as an opened /dev/input/event* device, a capture file, or a pipe.  The tap does not close it.
+    int inputFD;
+
+    /// A file descriptor to write the events that pass an active tap to, such as a uinput device or a pipe, or -1 to discard them.  The tap does not close it.  Passive taps never write.
+    int outputFD;
+
+    /// The pointer location that relative motion starts from.
+    double x;
+    double y;
+} WJHEvdevOptions;
+
+/**
+ A backend that reads Linux evdev event streams.
+
+ Events are mapped onto the CoreGraphics event types, and keycodes onto macOS virtual keycodes, so the same record-based code runs on both platforms.
+ - Key presses, autorepeats, and releases become key down and key up events.  Keys with no macOS equivalent are passed through untouched.
+ - Modifier keys become flags changed events, and keep the flags of every event up to date.
+ - Mouse buttons become mouse down and up events, for the left, right, and other buttons.
+ - Relative or absolute motion within a report becomes a single mouse moved or dragged event, at the end of the report.  Wheel motion becomes a scroll wheel event.
+
+ Events are only read when the deliver function is called, on the calling thread.  A disabled tap still reads, and passes every event through.  An active tap writes each report to its output as it comes in, less the events whose records were dropped, with any key up or down, and keycode, changes made by the callback.  Dropping an event drops the input events it was made from.
+ */
+extern WJHEventBackend const kWJHEvdevBackend;
+
+/**
+ The macOS virtual keycode for a Linux key code, or UINT16_MAX if there is none.
+ */
+uint16_t WJHEvdevKeycodeFromLinux(uint16_t code);
+
+/**
+ The Linux key code for a macOS virtual keycode, or UINT16_MAX if there is none.
+ */
+uint16_t WJHEvdevKeycodeToLinux(uint16_t keycode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
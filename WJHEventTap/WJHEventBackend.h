@@ -0,0 +1,128 @@
+//
+//  WJHEventBackend.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventBackend_h
+#define WJHEventTap_WJHEventBackend_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "WJHEventRecord.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Event types, with the same values as the CGEventType constants, for code that must build without CoreGraphics.
+ */
+enum {
+    kWJHEventTypeLeftMouseDown = 1,
+    kWJHEventTypeLeftMouseUp = 2,
+    kWJHEventTypeRightMouseDown = 3,
+    kWJHEventTypeRightMouseUp = 4,
+    kWJHEventTypeMouseMoved = 5,
+    kWJHEventTypeLeftMouseDragged = 6,
+    kWJHEventTypeRightMouseDragged = 7,
+    kWJHEventTypeKeyDown = 10,
+    kWJHEventTypeKeyUp = 11,
+    kWJHEventTypeFlagsChanged = 12,
+    kWJHEventTypeScrollWheel = 22,
+    kWJHEventTypeOtherMouseDown = 25,
+    kWJHEventTypeOtherMouseUp = 26,
+    kWJHEventTypeOtherMouseDragged = 27,
+};
+
+// Too large for an enum constant.
+#define kWJHEventTypeTapDisabledByTimeout UINT32_C(0xFFFFFFFE)
+#define kWJHEventTypeTapDisabledByUserInput UINT32_C(0xFFFFFFFF)
+
+/**
+ Modifier flags, with the same values as the CGEventFlags constants.
+ */
+enum {
+    kWJHEventFlagAlphaShift = 0x00010000,
+    kWJHEventFlagShift = 0x00020000,
+    kWJHEventFlagControl = 0x00040000,
+    kWJHEventFlagAlternate = 0x00080000,
+    kWJHEventFlagCommand = 0x00100000,
+};
+
+/**
+ Called with each event a backend tap intercepts, on the thread that calls the backend's deliver function.
+
+ @param context the context given when the tap was created
+ @param record the event.  An active tap passes on the event as changed by the callback, to the extent the backend can change it, as described by each backend.
+
+ @return false to drop the event, true to pass it on.  Ignored by passive taps.
+ */
+typedef bool (*WJHEventBackendCallback)(void *context, WJHEventRecord *record);
+
+/**
+ A tap created by a backend.  Each backend has its own representation.
+ */
+typedef struct WJHEventBackendTap WJHEventBackendTap;
+
+/**
+ What a backend reports about each of the taps it knows of.
+ */
+typedef struct WJHEventBackendTapInfo {
+    uint32_t tapID;
+    uint64_t eventMask;
+    bool passive;
+    bool enabled;
+} WJHEventBackendTapInfo;
+
+/**
+ The operations the tap core needs from an event source.
+
+ A backend turns the events of some source (the window server, a Linux input device, a capture file) into WJHEventRecord, so everything built on records (filters, coalescing, hotkeys, hubs, recording, latency histograms) runs unchanged on top of it.
+ */
+typedef struct WJHEventBackend {
+    /// A short name for the backend, such as "coregraphics" or "evdev".
+    char const *name;
+
+    /**
+     Create a tap, which starts out disabled.
+
+     @param options backend-specific options, described by each backend
+     @param eventMask the event types of interest, as a mask of (1 << type)
+     @param passive true for a tap that only listens, false for one that may change or drop events
+     @param callback called with each event of interest while the tap is enabled
+     @param context passed to each call of @a callback
+
+     @return a new tap, or NULL on failure, with errno set.
+     */
+    WJHEventBackendTap * (*create)(void const *options, uint64_t eventMask, bool passive, WJHEventBackendCallback callback, void *context);
+
+    void (*destroy)(WJHEventBackendTap *tap);
+    void (*setEnabled)(WJHEventBackendTap *tap, bool enabled);
+    bool (*isEnabled)(WJHEventBackendTap const *tap);
+
+    /**
+     List the taps the backend knows of.
+
+     @param taps where to store information about the taps, which may be NULL if @a capacity is zero
+     @param capacity the number of entries available at @a taps
+
+     @return the total number of taps, which may be more than @a capacity.
+     */
+    size_t (*listTaps)(WJHEventBackendTapInfo *taps, size_t capacity);
+
+    /**
+     Deliver pending events to the tap callback, waiting for some if there are none.
+
+     @return the number of events read from the source, zero if the source is exhausted, or -1 on error, with errno set.
+     */
+    long (*deliver)(WJHEventBackendTap *tap);
+} WJHEventBackend;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
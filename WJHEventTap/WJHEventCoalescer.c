@@ -0,0 +1,107 @@
+//
+//  WJHEventCoalescer.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHEventCoalescer.h"
+
+#include <math.h>
+#include <string.h>
+
+// CGEventType values, repeated here so this file does not depend on CoreGraphics.
+enum {
+    kMouseMoved = 5,
+    kLeftMouseDragged = 6,
+    kRightMouseDragged = 7,
+    kScrollWheel = 22,
+    kTabletPointer = 23,
+    kOtherMouseDragged = 27,
+};
+
+void WJHEventCoalescerInit(WJHEventCoalescer *coalescer, uint64_t window, WJHEventCoalescerCallback callback, void *context) {
+    memset(coalescer, 0, sizeof(*coalescer));
+    coalescer->window = window;
+    coalescer->callback = callback;
+    coalescer->context = context;
+}
+
+bool WJHEventCoalescerCanMerge(uint32_t type) {
+    switch (type) {
+        case kMouseMoved:
+        case kLeftMouseDragged:
+        case kRightMouseDragged:
+        case kOtherMouseDragged:
+        case kScrollWheel:
+        case kTabletPointer:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isPointer(uint32_t type) {
+    return type != kScrollWheel;
+}
+
+bool WJHEventCoalescerFlush(WJHEventCoalescer *coalescer) {
+    if (!coalescer->hasPending) {
+        return false;
+    }
+    coalescer->hasPending = false;
+    coalescer->callback(coalescer->context, &coalescer->pending);
+    return true;
+}
+
+/**
+ The distance from the last pointer position to @a record, which becomes the last position.
+ */
+static double advancePosition(WJHEventCoalescer *coalescer, WJHEventRecord const *record) {
+    double distance = 0;
+    if (coalescer->hasLastPosition) {
+        distance = hypot(record->x - coalescer->lastX, record->y - coalescer->lastY);
+    }
+    coalescer->hasLastPosition = true;
+    coalescer->lastX = record->x;
+    coalescer->lastY = record->y;
+    return distance;
+}
+
+static bool canJoinPending(WJHEventCoalescer const *coalescer, WJHEventRecord const *record) {
+    WJHEventRecord const *last = &coalescer->pending.record;
+    return coalescer->hasPending
+        && record->type == last->type
+        && record->flags == last->flags
+        && record->button == last->button
+        && record->timestamp >= coalescer->pending.firstTimestamp
+        && record->timestamp - coalescer->pending.firstTimestamp < coalescer->window;
+}
+
+WJHEventCoalescerResult WJHEventCoalescerAdd(WJHEventCoalescer *coalescer, WJHEventRecord const *record) {
+    if (!WJHEventCoalescerCanMerge(record->type)) {
+        WJHEventCoalescerFlush(coalescer);
+        return WJHEventCoalescerPassed;
+    }
+
+    double distance = isPointer(record->type) ? advancePosition(coalescer, record) : 0;
+    if (canJoinPending(coalescer, record)) {
+        WJHCoalescedEvent *pending = &coalescer->pending;
+        int32_t deltaX = pending->record.deltaX + record->deltaX;
+        int32_t deltaY = pending->record.deltaY + record->deltaY;
+        pending->record = *record;
+        pending->record.deltaX = deltaX;
+        pending->record.deltaY = deltaY;
+        pending->pathLength += distance;
+        ++pending->count;
+        return WJHEventCoalescerMerged;
+    }
+
+    WJHEventCoalescerFlush(coalescer);
+    coalescer->pending.record = *record;
+    coalescer->pending.firstTimestamp = record->timestamp;
+    coalescer->pending.count = 1;
+    coalescer->pending.pathLength = distance;
+    coalescer->hasPending = true;
+    return WJHEventCoalescerStarted;
+}
@@ -0,0 +1,109 @@
+//
+//  WJHEventCoalescer.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventCoalescer_h
+#define WJHEventTap_WJHEventCoalescer_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "WJHEventRecord.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ A run of consecutive events of the same kind, merged into one.
+ */
+typedef struct WJHCoalescedEvent {
+    /// The most recent event of the run, except that deltaX and deltaY are the sums over the whole run.
+    WJHEventRecord record;
+
+    /// The timestamp of the first event of the run.
+    uint64_t firstTimestamp;
+
+    /// The number of events merged.
+    uint32_t count;
+
+    /// For pointer events, the distance travelled by the pointer, from the position of the event preceding the run (if any) through each event of the run.
+    double pathLength;
+} WJHCoalescedEvent;
+
+/**
+ Called with each completed run.  Events that can not be merged are not reported through this callback.
+ */
+typedef void (*WJHEventCoalescerCallback)(void *context, WJHCoalescedEvent const *event);
+
+/**
+ What happened to a record given to WJHEventCoalescerAdd.
+ */
+typedef enum WJHEventCoalescerResult {
+    /// The record was merged into the pending run.
+    WJHEventCoalescerMerged = 0,
+
+    /// The record started a new pending run.  Any previous run was completed first.  The caller should arrange for WJHEventCoalescerFlush to be called once the window has passed.
+    WJHEventCoalescerStarted,
+
+    /// The record can not be merged.  Any pending run was completed, so the caller can now handle the record itself, in order.
+    WJHEventCoalescerPassed,
+} WJHEventCoalescerResult;
+
+/**
+ Merges consecutive high-frequency events: mouse moves, drags, scroll wheel and tablet pointer events.
+
+ A record is merged into the pending run if it has the same type, flags, and button as the run, and arrived within the window of the first event of the run.  Anything else completes the run, so events are always reported in the order they arrived.  Scroll and mouse deltas are summed; pointer positions keep the latest value, and the distance travelled is accumulated.
+
+ A coalescer is a plain struct, and does not allocate.  It is not thread safe.  It does not depend on any Apple framework.
+ */
+typedef struct WJHEventCoalescer {
+    WJHCoalescedEvent pending;
+    bool hasPending;
+
+    /// The position of the last pointer event seen, for measuring the path length.
+    bool hasLastPosition;
+    double lastX;
+    double lastY;
+
+    /// The longest span, in timestamp units, from the first to the last event of a run.
+    uint64_t window;
+
+    WJHEventCoalescerCallback callback;
+    void *context;
+} WJHEventCoalescer;
+
+/**
+ Initialize a coalescer.
+
+ @param coalescer the coalescer
+ @param window events are only merged if their timestamp is less than @a window after the first event of the run
+ @param callback called with each completed run
+ @param context passed to @a callback
+ */
+void WJHEventCoalescerInit(WJHEventCoalescer *coalescer, uint64_t window, WJHEventCoalescerCallback callback, void *context);
+
+/**
+ Whether events of @a type (a CGEventType) can be merged.
+ */
+bool WJHEventCoalescerCanMerge(uint32_t type);
+
+/**
+ Feed a record to the coalescer.
+ */
+WJHEventCoalescerResult WJHEventCoalescerAdd(WJHEventCoalescer *coalescer, WJHEventRecord const *record);
+
+/**
+ Complete the pending run, if any.
+
+ @return true if a run was completed.
+ */
+bool WJHEventCoalescerFlush(WJHEventCoalescer *coalescer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
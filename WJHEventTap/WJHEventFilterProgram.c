@@ -0,0 +1,191 @@
+//
+//  WJHEventFilterProgram.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHEventFilterProgram.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kBitmapWords = kWJHEventFilterKeycodeLimit / 64,
+    kNoBitmap = UINT32_MAX,
+};
+
+typedef struct CompiledRule {
+    uint64_t flagsMask;
+    uint64_t flagsValue;
+    uint32_t buttonMask;
+    uint32_t keycodeBitmap;
+    uint32_t rectStart;
+    uint32_t rectCount;
+} CompiledRule;
+
+typedef struct KeycodeBitmap {
+    uint64_t words[kBitmapWords];
+} KeycodeBitmap;
+
+/*
+ Everything lives in a single allocation, laid out as:
+
+     WJHEventFilterProgram
+     CompiledRule rules[ruleCount]
+     KeycodeBitmap bitmaps[bitmapCount]
+     WJHEventFilterRect rects[rectCount]
+     uint32_t candidates[candidateCount]
+
+ The rules that can match events of type t are candidates[start[t]] through candidates[start[t + 1] - 1], in their original order.
+ */
+struct WJHEventFilterProgram {
+    uint32_t start[kWJHEventFilterTypeLimit + 1];
+    uint32_t fields[kWJHEventFilterTypeLimit];
+    CompiledRule const *rules;
+    KeycodeBitmap const *bitmaps;
+    WJHEventFilterRect const *rects;
+    uint32_t const *candidates;
+};
+
+static uint32_t ruleFields(WJHEventFilterRule const *rule) {
+    return (rule->flagsMask ? WJHEventFilterFieldFlags : 0)
+        | (rule->keycodeCount ? WJHEventFilterFieldKeycode : 0)
+        | (rule->buttonMask ? WJHEventFilterFieldButton : 0)
+        | (rule->rectCount ? WJHEventFilterFieldLocation : 0);
+}
+
+static bool ruleMatchesType(WJHEventFilterRule const *rule, uint32_t type) {
+    return rule->typeMask == 0 || (rule->typeMask & (UINT32_C(1) << type));
+}
+
+WJHEventFilterProgram * WJHEventFilterProgramCreate(WJHEventFilterRule const *rules, size_t count) {
+    size_t bitmapCount = 0, rectCount = 0, candidateCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventFilterRule const *rule = rules + i;
+        if (rule->flagsValue & ~rule->flagsMask) {
+            return NULL;
+        }
+        for (size_t k = 0; k < rule->keycodeCount; ++k) {
+            if (rule->keycodes[k] >= kWJHEventFilterKeycodeLimit) {
+                return NULL;
+            }
+        }
+        bitmapCount += rule->keycodeCount ? 1 : 0;
+        rectCount += rule->rectCount;
+        for (uint32_t type = 0; type < kWJHEventFilterTypeLimit; ++type) {
+            candidateCount += ruleMatchesType(rule, type);
+        }
+    }
+    if (count > UINT32_MAX || rectCount > UINT32_MAX || candidateCount > UINT32_MAX) {
+        return NULL;
+    }
+
+    size_t size = sizeof(WJHEventFilterProgram) + count * sizeof(CompiledRule) + bitmapCount * sizeof(KeycodeBitmap) + rectCount * sizeof(WJHEventFilterRect) + candidateCount * sizeof(uint32_t);
+    WJHEventFilterProgram *program = calloc(1, size);
+    if (program == NULL) {
+        return NULL;
+    }
+    CompiledRule *compiledRules = (CompiledRule *)(program + 1);
+    KeycodeBitmap *bitmaps = (KeycodeBitmap *)(compiledRules + count);
+    WJHEventFilterRect *rects = (WJHEventFilterRect *)(bitmaps + bitmapCount);
+    uint32_t *candidates = (uint32_t *)(rects + rectCount);
+    program->rules = compiledRules;
+    program->bitmaps = bitmaps;
+    program->rects = rects;
+    program->candidates = candidates;
+
+    uint32_t bitmapIndex = 0, rectIndex = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventFilterRule const *rule = rules + i;
+        CompiledRule *compiled = compiledRules + i;
+        compiled->flagsMask = rule->flagsMask;
+        compiled->flagsValue = rule->flagsValue;
+        compiled->buttonMask = rule->buttonMask;
+        compiled->keycodeBitmap = kNoBitmap;
+        if (rule->keycodeCount) {
+            compiled->keycodeBitmap = bitmapIndex;
+            for (size_t k = 0; k < rule->keycodeCount; ++k) {
+                uint16_t keycode = rule->keycodes[k];
+                bitmaps[bitmapIndex].words[keycode / 64] |= UINT64_C(1) << (keycode % 64);
+            }
+            ++bitmapIndex;
+        }
+        compiled->rectStart = rectIndex;
+        compiled->rectCount = (uint32_t)rule->rectCount;
+        if (rule->rectCount) {
+            memcpy(rects + rectIndex, rule->rects, rule->rectCount * sizeof(*rects));
+            rectIndex += (uint32_t)rule->rectCount;
+        }
+    }
+
+    uint32_t candidateIndex = 0;
+    for (uint32_t type = 0; type < kWJHEventFilterTypeLimit; ++type) {
+        program->start[type] = candidateIndex;
+        for (size_t i = 0; i < count; ++i) {
+            if (ruleMatchesType(rules + i, type)) {
+                candidates[candidateIndex++] = (uint32_t)i;
+                program->fields[type] |= ruleFields(rules + i);
+            }
+        }
+    }
+    program->start[kWJHEventFilterTypeLimit] = candidateIndex;
+    return program;
+}
+
+void WJHEventFilterProgramDestroy(WJHEventFilterProgram *program) {
+    free(program);
+}
+
+uint32_t WJHEventFilterProgramFields(WJHEventFilterProgram const *program, uint32_t type) {
+    return type < kWJHEventFilterTypeLimit ? program->fields[type] : 0;
+}
+
+uint64_t WJHEventFilterProgramTypeMask(WJHEventFilterProgram const *program) {
+    uint64_t mask = ~UINT64_C(0) << kWJHEventFilterTypeLimit;
+    for (uint32_t type = 0; type < kWJHEventFilterTypeLimit; ++type) {
+        if (program->start[type + 1] > program->start[type]) {
+            mask |= UINT64_C(1) << type;
+        }
+    }
+    return mask;
+}
+
+static bool ruleMatches(WJHEventFilterProgram const *program, CompiledRule const *rule, WJHEventRecord const *record) {
+    if ((record->flags & rule->flagsMask) != rule->flagsValue) {
+        return false;
+    }
+    if (rule->keycodeBitmap != kNoBitmap) {
+        uint16_t keycode = record->keycode;
+        if (keycode >= kWJHEventFilterKeycodeLimit || !(program->bitmaps[rule->keycodeBitmap].words[keycode / 64] & (UINT64_C(1) << (keycode % 64)))) {
+            return false;
+        }
+    }
+    if (rule->buttonMask && (record->button >= 32 || !(rule->buttonMask & (UINT32_C(1) << record->button)))) {
+        return false;
+    }
+    if (rule->rectCount) {
+        WJHEventFilterRect const *rect = program->rects + rule->rectStart;
+        WJHEventFilterRect const *end = rect + rule->rectCount;
+        for (; rect != end; ++rect) {
+            if (record->x >= rect->x && record->x < rect->x + rect->width && record->y >= rect->y && record->y < rect->y + rect->height) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+bool WJHEventFilterProgramMatches(WJHEventFilterProgram const *program, WJHEventRecord const *record) {
+    uint32_t type = record->type;
+    if (type >= kWJHEventFilterTypeLimit) {
+        return true;
+    }
+    for (uint32_t i = program->start[type], end = program->start[type + 1]; i < end; ++i) {
+        if (ruleMatches(program, program->rules + program->candidates[i], record)) {
+            return true;
+        }
+    }
+    return false;
+}
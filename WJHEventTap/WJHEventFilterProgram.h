@@ -0,0 +1,116 @@
+//
+//  WJHEventFilterProgram.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventFilterProgram_h
+#define WJHEventTap_WJHEventFilterProgram_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "WJHEventRecord.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    /// Keycodes in a rule must be less than this.
+    kWJHEventFilterKeycodeLimit = 1024,
+
+    /// Only events of a type less than this are filtered.  Tap notifications (e.g., disabled by timeout) always pass.
+    kWJHEventFilterTypeLimit = 32,
+};
+
+/**
+ The record fields a compiled filter reads, so callers only need to fill in those fields.  The type is always read.
+ */
+typedef enum WJHEventFilterField {
+    WJHEventFilterFieldFlags = 1 << 0,
+    WJHEventFilterFieldKeycode = 1 << 1,
+    WJHEventFilterFieldButton = 1 << 2,
+    WJHEventFilterFieldLocation = 1 << 3,
+} WJHEventFilterField;
+
+/**
+ A rectangle in global display coordinates.  A point is inside if x <= point.x < x + width, and likewise for y.
+ */
+typedef struct WJHEventFilterRect {
+    double x;
+    double y;
+    double width;
+    double height;
+} WJHEventFilterRect;
+
+/**
+ One way for an event to pass a filter.  An event matches the rule if it satisfies every constraint of the rule.  A constraint that is zero, or empty, matches every event.
+ */
+typedef struct WJHEventFilterRule {
+    /// The event types that match, as a mask of CGEventMaskBit(type).  Zero matches every type.
+    uint32_t typeMask;
+
+    /// The event matches if (flags & flagsMask) == flagsValue.
+    uint64_t flagsMask;
+    uint64_t flagsValue;
+
+    /// The virtual keycodes that match.  No keycodes matches every keycode.
+    uint16_t const *keycodes;
+    size_t keycodeCount;
+
+    /// The mouse buttons that match, as a mask of (1 << button).  Zero matches every button.
+    uint32_t buttonMask;
+
+    /// The event location must be inside one of these.  No rectangles matches every location.
+    WJHEventFilterRect const *rects;
+    size_t rectCount;
+} WJHEventFilterRule;
+
+/**
+ A set of rules compiled into a flat decision table.
+
+ For each event type, the table lists only the rules that can match that type, along with the fields those rules read.  Each rule is a handful of mask tests, a bit lookup for its keycode set, and a scan of its rectangles.  Evaluation never allocates, and only depends on the C standard library, so it can be built and tested anywhere.
+
+ A compiled program is immutable, so it may be evaluated from any number of threads.
+ */
+typedef struct WJHEventFilterProgram WJHEventFilterProgram;
+
+/**
+ Compile a set of rules.  An event passes the filter if it matches any of the rules.
+
+ @param rules the rules, which are copied
+ @param count the number of rules
+
+ @return a new program, which must be released with WJHEventFilterProgramDestroy, or NULL if a rule has a keycode of kWJHEventFilterKeycodeLimit or more, sets bits of flagsValue outside of flagsMask, or memory could not be allocated.
+ */
+WJHEventFilterProgram * WJHEventFilterProgramCreate(WJHEventFilterRule const *rules, size_t count);
+
+/**
+ Destroy a compiled program.
+ */
+void WJHEventFilterProgramDestroy(WJHEventFilterProgram *program);
+
+/**
+ The fields of a record of type @a type that are read by WJHEventFilterProgramMatches, as a combination of WJHEventFilterField values.
+ */
+uint32_t WJHEventFilterProgramFields(WJHEventFilterProgram const *program, uint32_t type);
+
+/**
+ The event types that can pass the filter, as a mask of CGEventMaskBit(type).  Types of kWJHEventFilterTypeLimit or more always pass, so their bits are always set.
+ */
+uint64_t WJHEventFilterProgramTypeMask(WJHEventFilterProgram const *program);
+
+/**
+ Whether an event passes the filter.  Events with a type of kWJHEventFilterTypeLimit or more always pass.
+
+ @param record the event; only the type, and the fields reported by WJHEventFilterProgramFields, need to be filled in
+ */
+bool WJHEventFilterProgramMatches(WJHEventFilterProgram const *program, WJHEventRecord const *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
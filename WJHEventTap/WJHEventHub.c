@@ -0,0 +1,166 @@
+//
+//  WJHEventHub.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHEventHub.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Entry {
+    uint64_t id;
+    uint64_t eventMask;
+    WJHEventHubCallback callback;
+    void *context;
+} Entry;
+
+/**
+ An immutable snapshot of the subscriber chain.  Changes replace the whole chain, so a dispatch in progress keeps walking the chain it started with.
+ */
+typedef struct Chain {
+    struct Chain *retired;
+    size_t count;
+    Entry entries[];
+} Chain;
+
+struct WJHEventHub {
+    Chain *chain;
+    uint64_t eventMask;
+    uint64_t nextID;
+    unsigned dispatchDepth;
+    bool passive;
+
+    // Chains replaced during a dispatch, freed once the outermost dispatch is done.
+    Chain *retired;
+};
+
+static Chain * createChain(size_t count) {
+    Chain *chain = malloc(sizeof(Chain) + count * sizeof(Entry));
+    if (chain) {
+        chain->retired = NULL;
+        chain->count = count;
+    }
+    return chain;
+}
+
+static void freeRetired(WJHEventHub *hub) {
+    while (hub->retired) {
+        Chain *chain = hub->retired;
+        hub->retired = chain->retired;
+        free(chain);
+    }
+}
+
+static void replaceChain(WJHEventHub *hub, Chain *chain) {
+    Chain *old = hub->chain;
+    hub->chain = chain;
+    hub->eventMask = 0;
+    for (size_t i = 0; i < chain->count; ++i) {
+        hub->eventMask |= chain->entries[i].eventMask;
+    }
+
+    if (hub->dispatchDepth > 0) {
+        old->retired = hub->retired;
+        hub->retired = old;
+    } else {
+        free(old);
+    }
+}
+
+WJHEventHub * WJHEventHubCreate(bool passive) {
+    WJHEventHub *hub = calloc(1, sizeof(*hub));
+    if (hub == NULL) {
+        return NULL;
+    }
+    if ((hub->chain = createChain(0)) == NULL) {
+        free(hub);
+        return NULL;
+    }
+    hub->nextID = 1;
+    hub->passive = passive;
+    return hub;
+}
+
+void WJHEventHubDestroy(WJHEventHub *hub) {
+    if (hub) {
+        freeRetired(hub);
+        free(hub->chain);
+        free(hub);
+    }
+}
+
+uint64_t WJHEventHubAdd(WJHEventHub *hub, WJHEventHubSubscriber const *subscriber) {
+    Chain const *old = hub->chain;
+    Chain *chain = createChain(old->count + 1);
+    if (chain == NULL) {
+        return 0;
+    }
+
+    Entry entry = {
+        .id = hub->nextID++,
+        .eventMask = subscriber->eventMask,
+        .callback = subscriber->callback,
+        .context = subscriber->context,
+    };
+    if (subscriber->beforeOthers) {
+        chain->entries[0] = entry;
+        memcpy(chain->entries + 1, old->entries, old->count * sizeof(Entry));
+    } else {
+        memcpy(chain->entries, old->entries, old->count * sizeof(Entry));
+        chain->entries[old->count] = entry;
+    }
+    replaceChain(hub, chain);
+    return entry.id;
+}
+
+bool WJHEventHubRemove(WJHEventHub *hub, uint64_t subscriberID) {
+    Chain const *old = hub->chain;
+    size_t index = 0;
+    while (index < old->count && old->entries[index].id != subscriberID) {
+        ++index;
+    }
+    if (index == old->count) {
+        return false;
+    }
+
+    Chain *chain = createChain(old->count - 1);
+    if (chain == NULL) {
+        return false;
+    }
+    memcpy(chain->entries, old->entries, index * sizeof(Entry));
+    memcpy(chain->entries + index, old->entries + index + 1, (old->count - index - 1) * sizeof(Entry));
+    replaceChain(hub, chain);
+    return true;
+}
+
+size_t WJHEventHubCount(WJHEventHub const *hub) {
+    return hub->chain->count;
+}
+
+uint64_t WJHEventHubEventMask(WJHEventHub const *hub) {
+    return hub->eventMask;
+}
+
+void * WJHEventHubDispatch(WJHEventHub *hub, uint32_t type, void *event, void *info) {
+    Chain const *chain = hub->chain;
+    uint64_t const bit = type < 64 ? UINT64_C(1) << type : ~UINT64_C(0);
+
+    ++hub->dispatchDepth;
+    for (size_t i = 0; i < chain->count; ++i) {
+        Entry const *entry = chain->entries + i;
+        if ((entry->eventMask & bit) == 0) {
+            continue;
+        }
+        void *result = entry->callback(entry->context, type, event, info);
+        if (!hub->passive && (event = result) == NULL) {
+            break;
+        }
+    }
+    if (--hub->dispatchDepth == 0) {
+        freeRetired(hub);
+    }
+    return event;
+}
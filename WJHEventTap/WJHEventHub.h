@@ -0,0 +1,101 @@
+//
+//  WJHEventHub.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventHub_h
+#define WJHEventTap_WJHEventHub_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Called with each event a subscriber is interested in.
+
+ @param context the subscriber context
+ @param type the event type
+ @param event the event, as returned by the previous subscriber in the chain
+ @param info passed through from WJHEventHubDispatch (e.g., the tap proxy)
+
+ @return the event to hand to the next subscriber, or NULL to drop the event.  Ignored by passive hubs.
+ */
+typedef void * (*WJHEventHubCallback)(void *context, uint32_t type, void *event, void *info);
+
+/**
+ Describes a logical subscriber to a hub.
+ */
+typedef struct WJHEventHubSubscriber {
+    /// The event types the subscriber is interested in, as a mask of (1 << type).  Events with a type of 64 or more (e.g., tap notifications) go to every subscriber.
+    uint64_t eventMask;
+
+    /// Whether the subscriber is placed before all current subscribers, or after them, as kCGHeadInsertEventTap and kCGTailAppendEventTap place system taps.
+    bool beforeOthers;
+
+    WJHEventHubCallback callback;
+    void *context;
+} WJHEventHubSubscriber;
+
+/**
+ Fans the events of a single event source out to an ordered chain of logical subscribers.
+
+ The chain is ordered the way the system orders taps at a single location: subscribers placed before others run first, the most recently added first, followed by subscribers placed after others, in the order they were added.  In an active hub, each subscriber sees the event returned by the one before it, and a subscriber may drop the event, ending the chain.  In a passive hub, every subscriber sees the original event.
+
+ A hub is not thread safe; it must only be used from the thread servicing its event source.  Subscribers may be added or removed from within a callback; the change takes effect with the next event.  Dispatch never allocates.  The hub only depends on the C standard library, so it can be built and tested anywhere.
+ */
+typedef struct WJHEventHub WJHEventHub;
+
+/**
+ Create a hub with no subscribers.
+
+ @return a new hub, which must be released with WJHEventHubDestroy, or NULL if memory could not be allocated.
+ */
+WJHEventHub * WJHEventHubCreate(bool passive);
+
+/**
+ Destroy a hub.  It must not be dispatching.
+ */
+void WJHEventHubDestroy(WJHEventHub *hub);
+
+/**
+ Add a subscriber to the chain.
+
+ @return a non-zero identifier for the subscriber, or zero if memory could not be allocated.
+ */
+uint64_t WJHEventHubAdd(WJHEventHub *hub, WJHEventHubSubscriber const *subscriber);
+
+/**
+ Remove a subscriber from the chain.
+
+ @return true if the subscriber was removed, false if there is no such subscriber, or memory could not be allocated.
+ */
+bool WJHEventHubRemove(WJHEventHub *hub, uint64_t subscriberID);
+
+/**
+ The number of subscribers.
+ */
+size_t WJHEventHubCount(WJHEventHub const *hub);
+
+/**
+ The union of the event masks of all subscribers, which is the mask the event source needs.
+ */
+uint64_t WJHEventHubEventMask(WJHEventHub const *hub);
+
+/**
+ Hand an event to each interested subscriber, in chain order.
+
+ @return the event as returned by the last subscriber, or NULL if it was dropped.  Passive hubs always return @a event.
+ */
+void * WJHEventHubDispatch(WJHEventHub *hub, uint32_t type, void *event, void *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+//
+//  WJHEventRecord.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventRecord_h
+#define WJHEventTap_WJHEventRecord_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ A compact, self-contained copy of the interesting parts of a tapped event.
+
+ Records hold no references to CoreGraphics objects, so they can be copied freely, stored in preallocated memory, and handed to other threads.  This header does not depend on any Apple framework, so code built on records can be compiled and tested on any platform.
+ */
+typedef struct WJHEventRecord {
+    /// The event timestamp (CGEventTimestamp), in nanoseconds.
+    uint64_t timestamp;
+
+    /// The location of the event, in global display coordinates.
+    double x;
+    double y;
+
+    /// The event flags (CGEventFlags).
+    uint64_t flags;
+
+    /// The event type (CGEventType).
+    uint32_t type;
+
+    /// The eventTapID of the tap that intercepted the event.
+    uint32_t tapID;
+
+    /// For scroll wheel events, the point deltas for the vertical (Y) and horizontal (X) axes.  For mouse events, the mouse deltas.
+    int32_t deltaX;
+    int32_t deltaY;
+
+    /// For keyboard events, the virtual keycode.
+    uint16_t keycode;
+
+    /// For mouse events, the mouse button number.
+    uint16_t button;
+} WJHEventRecord;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
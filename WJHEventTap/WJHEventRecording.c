@@ -0,0 +1,232 @@
+//
+//  WJHEventRecording.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+// ftruncate, mmap, and clock_gettime, when built with a strict C standard on other platforms.
+#define _POSIX_C_SOURCE 200809L
+
+#include "WJHEventRecording.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static char const kMagic[8] = { 'W', 'J', 'H', 'E', 'V', 'R', 'E', 'C' };
+
+typedef struct WJHEventRecordingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    uint32_t capacity;
+    _Atomic uint64_t count;
+    uint8_t reserved[32];
+} WJHEventRecordingHeader;
+
+// Records are stored in the file exactly as they are laid out in memory, so the layout is pinned down here.
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The recording format is little-endian");
+_Static_assert(sizeof(WJHEventRecordingHeader) == kWJHEventRecordingHeaderSize, "Unexpected recording header layout");
+_Static_assert(sizeof(WJHEventRecord) == kWJHEventRecordingRecordSize, "Unexpected event record layout");
+_Static_assert(offsetof(WJHEventRecord, flags) == 24 && offsetof(WJHEventRecord, type) == 32 && offsetof(WJHEventRecord, deltaX) == 40 && offsetof(WJHEventRecord, keycode) == 48 && offsetof(WJHEventRecord, button) == 50, "Unexpected event record layout");
+
+
+#pragma mark - Recorder
+
+struct WJHEventRecorder {
+    WJHEventRecordingHeader *header;
+    WJHEventRecord *records;
+    size_t mapSize;
+    uint32_t capacity;
+    int fd;
+    _Atomic uint64_t dropped;
+};
+
+WJHEventRecorder * WJHEventRecorderCreate(char const *path, uint32_t capacity) {
+    WJHEventRecorder *recorder = calloc(1, sizeof(*recorder));
+    if (recorder == NULL) {
+        return NULL;
+    }
+
+    recorder->capacity = capacity;
+    recorder->mapSize = kWJHEventRecordingHeaderSize + (size_t)capacity * kWJHEventRecordingRecordSize;
+    recorder->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (recorder->fd < 0) {
+        free(recorder);
+        return NULL;
+    }
+
+    // Reserve the whole file up front, so appending never has to grow it.
+    void *map = MAP_FAILED;
+    if (ftruncate(recorder->fd, (off_t)recorder->mapSize) == 0) {
+        map = mmap(NULL, recorder->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, recorder->fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        int error = errno;
+        close(recorder->fd);
+        unlink(path);
+        free(recorder);
+        errno = error;
+        return NULL;
+    }
+
+    recorder->header = map;
+    recorder->records = (WJHEventRecord *)((char *)map + kWJHEventRecordingHeaderSize);
+    memcpy(recorder->header->magic, kMagic, sizeof(kMagic));
+    recorder->header->version = kWJHEventRecordingVersion;
+    recorder->header->headerSize = kWJHEventRecordingHeaderSize;
+    recorder->header->recordSize = kWJHEventRecordingRecordSize;
+    recorder->header->capacity = capacity;
+    atomic_init(&recorder->header->count, 0);
+    atomic_init(&recorder->dropped, 0);
+    return recorder;
+}
+
+void WJHEventRecorderDestroy(WJHEventRecorder *recorder) {
+    if (recorder == NULL) {
+        return;
+    }
+    uint64_t count = atomic_load_explicit(&recorder->header->count, memory_order_relaxed);
+    munmap(recorder->header, recorder->mapSize);
+    ftruncate(recorder->fd, (off_t)(kWJHEventRecordingHeaderSize + count * kWJHEventRecordingRecordSize));
+    close(recorder->fd);
+    free(recorder);
+}
+
+bool WJHEventRecorderAppend(WJHEventRecorder *recorder, WJHEventRecord const *record) {
+    uint64_t count = atomic_load_explicit(&recorder->header->count, memory_order_relaxed);
+    if (count == recorder->capacity) {
+        atomic_store_explicit(&recorder->dropped, atomic_load_explicit(&recorder->dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+        return false;
+    }
+    recorder->records[count] = *record;
+    // Publish the record only once it has been completely written.
+    atomic_store_explicit(&recorder->header->count, count + 1, memory_order_release);
+    return true;
+}
+
+uint64_t WJHEventRecorderCount(WJHEventRecorder const *recorder) {
+    return atomic_load_explicit(&recorder->header->count, memory_order_acquire);
+}
+
+uint64_t WJHEventRecorderDropped(WJHEventRecorder const *recorder) {
+    return atomic_load_explicit(&recorder->dropped, memory_order_relaxed);
+}
+
+
+#pragma mark - Replay
+
+struct WJHEventReplay {
+    void *map;
+    size_t mapSize;
+    WJHEventRecord const *records;
+    uint64_t count;
+};
+
+WJHEventReplay * WJHEventReplayOpen(char const *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat info;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &info) == 0) {
+        if (info.st_size < kWJHEventRecordingHeaderSize) {
+            errno = EINVAL;
+        } else {
+            map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+    }
+    int error = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = error;
+        return NULL;
+    }
+
+    WJHEventRecordingHeader const *header = map;
+    uint64_t available = ((uint64_t)info.st_size - kWJHEventRecordingHeaderSize) / kWJHEventRecordingRecordSize;
+    uint64_t count = atomic_load_explicit((_Atomic uint64_t *)&header->count, memory_order_acquire);
+    WJHEventReplay *replay = NULL;
+    if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0
+        || header->version != kWJHEventRecordingVersion
+        || header->headerSize != kWJHEventRecordingHeaderSize
+        || header->recordSize != kWJHEventRecordingRecordSize
+        || count > available) {
+        error = EINVAL;
+    } else if ((replay = malloc(sizeof(*replay))) == NULL) {
+        error = ENOMEM;
+    }
+    if (replay == NULL) {
+        munmap(map, (size_t)info.st_size);
+        errno = error;
+        return NULL;
+    }
+
+    replay->map = map;
+    replay->mapSize = (size_t)info.st_size;
+    replay->records = (WJHEventRecord const *)((char const *)map + kWJHEventRecordingHeaderSize);
+    replay->count = count;
+    return replay;
+}
+
+void WJHEventReplayClose(WJHEventReplay *replay) {
+    if (replay) {
+        munmap(replay->map, replay->mapSize);
+        free(replay);
+    }
+}
+
+uint64_t WJHEventReplayCount(WJHEventReplay const *replay) {
+    return replay->count;
+}
+
+WJHEventRecord const * WJHEventReplayRecords(WJHEventReplay const *replay) {
+    return replay->records;
+}
+
+static uint64_t monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void sleepUntil(uint64_t deadline) {
+    uint64_t now;
+    while ((now = monotonicNanoseconds()) < deadline) {
+        uint64_t remaining = deadline - now;
+        struct timespec duration = { (time_t)(remaining / 1000000000), (long)(remaining % 1000000000) };
+        nanosleep(&duration, NULL);
+    }
+}
+
+uint64_t WJHEventReplayRun(WJHEventReplay const *replay, WJHEventReplayTiming timing, WJHEventReplayCallback callback, void *context) {
+    if (replay->count == 0) {
+        return 0;
+    }
+
+    uint64_t const firstTimestamp = replay->records[0].timestamp;
+    uint64_t const start = monotonicNanoseconds();
+    uint64_t delivered = 0;
+    while (delivered < replay->count) {
+        WJHEventRecord const *record = replay->records + delivered;
+        if (timing == WJHEventReplayOriginalTiming && record->timestamp > firstTimestamp) {
+            sleepUntil(start + (record->timestamp - firstTimestamp));
+        }
+        ++delivered;
+        if (!callback(context, record)) {
+            break;
+        }
+    }
+    return delivered;
+}
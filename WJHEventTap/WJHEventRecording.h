@@ -0,0 +1,136 @@
+//
+//  WJHEventRecording.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventRecording_h
+#define WJHEventTap_WJHEventRecording_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "WJHEventRecord.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Recording file layout, all values little-endian:
+
+     offset  size  field
+          0     8  magic, "WJHEVREC"
+          8     4  version (kWJHEventRecordingVersion)
+         12     4  header size in bytes (kWJHEventRecordingHeaderSize)
+         16     4  record size in bytes (kWJHEventRecordingRecordSize)
+         20     4  capacity, in records, of the file when it was created
+         24     8  number of records written
+         32    32  reserved, zero
+         64     *  records, each laid out exactly as a WJHEventRecord
+
+ The record count is updated after each record is written, so a file is readable at any time, even if the recorder never closed it.
+ */
+enum {
+    kWJHEventRecordingVersion = 1,
+    kWJHEventRecordingHeaderSize = 64,
+    kWJHEventRecordingRecordSize = 56,
+};
+
+/**
+ How a replay paces the records it delivers.
+ */
+typedef enum WJHEventReplayTiming {
+    /// Deliver each record as soon as the previous one has been handled.
+    WJHEventReplayAsFastAsPossible = 0,
+
+    /// Deliver each record at the same offset from the start of the replay as it had from the first record when it was recorded.
+    WJHEventReplayOriginalTiming = 1,
+} WJHEventReplayTiming;
+
+/**
+ Appends event records to a preallocated, memory-mapped file.
+
+ Appending copies the record into the mapped file, and never allocates, locks, or makes a system call.  Only one thread may append to a recorder at any given time.
+ */
+typedef struct WJHEventRecorder WJHEventRecorder;
+
+/**
+ Create a recording file, replacing any existing file at @a path, with room for @a capacity records.
+
+ @return a new recorder, which must be released with WJHEventRecorderDestroy, or NULL, with errno set, if the file could not be created and mapped.
+ */
+WJHEventRecorder * WJHEventRecorderCreate(char const *path, uint32_t capacity);
+
+/**
+ Finish the recording, trimming the file to the records that were written, and destroy the recorder.
+ */
+void WJHEventRecorderDestroy(WJHEventRecorder *recorder);
+
+/**
+ Append a copy of @a record to the recording.
+
+ @return true if the record was written, false if the file is full.
+ */
+bool WJHEventRecorderAppend(WJHEventRecorder *recorder, WJHEventRecord const *record);
+
+/**
+ The number of records written.  May be called from any thread.
+ */
+uint64_t WJHEventRecorderCount(WJHEventRecorder const *recorder);
+
+/**
+ The number of records that did not fit in the file.  May be called from any thread.
+ */
+uint64_t WJHEventRecorderDropped(WJHEventRecorder const *recorder);
+
+/**
+ A recording file, memory-mapped for reading.
+ */
+typedef struct WJHEventReplay WJHEventReplay;
+
+/**
+ Map a recording file written by WJHEventRecorder.
+
+ @return a new replay, which must be released with WJHEventReplayClose, or NULL, with errno set, if the file could not be mapped.  errno is EINVAL if the file is not a recording of a supported version.
+ */
+WJHEventReplay * WJHEventReplayOpen(char const *path);
+
+/**
+ Unmap the file.  Records obtained from the replay are no longer valid.
+ */
+void WJHEventReplayClose(WJHEventReplay *replay);
+
+/**
+ The number of records in the recording.
+ */
+uint64_t WJHEventReplayCount(WJHEventReplay const *replay);
+
+/**
+ The records of the recording, oldest first, read directly from the mapped file.
+ */
+WJHEventRecord const * WJHEventReplayRecords(WJHEventReplay const *replay);
+
+/**
+ Called for each replayed record.
+
+ @return true to continue the replay, false to stop it.
+ */
+typedef bool (*WJHEventReplayCallback)(void *context, WJHEventRecord const *record);
+
+/**
+ Hand each record of the recording, in order, to @a callback, on the calling thread.
+
+ @param timing how the records are paced
+ @param callback called with each record
+ @param context passed to each call of @a callback
+
+ @return the number of records delivered.
+ */
+uint64_t WJHEventReplayRun(WJHEventReplay const *replay, WJHEventReplayTiming timing, WJHEventReplayCallback callback, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
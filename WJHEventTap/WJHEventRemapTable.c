@@ -0,0 +1,282 @@
+//
+//  WJHEventRemapTable.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHEventRemapTable.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The CGEventType values of the events a table remaps.
+enum {
+    kLeftMouseDown = 1,
+    kLeftMouseUp = 2,
+    kRightMouseDown = 3,
+    kRightMouseUp = 4,
+    kLeftMouseDragged = 6,
+    kRightMouseDragged = 7,
+    kKeyDown = 10,
+    kKeyUp = 11,
+    kScrollWheel = 22,
+    kOtherMouseDown = 25,
+    kOtherMouseUp = 26,
+    kOtherMouseDragged = 27,
+};
+
+typedef enum ButtonAction {
+    ButtonNone,
+    ButtonDown,
+    ButtonUp,
+    ButtonDragged,
+} ButtonAction;
+
+/*
+ Everything lives in a single allocation, laid out as:
+
+     WJHEventRemapTable
+     WJHEventRemapKeyRule keyRules[keyRuleCount]
+
+ The rules for keycode k are keyRules[keyStart[k]] through keyRules[keyStart[k + 1] - 1], in their original order.
+ */
+struct WJHEventRemapTable {
+    uint32_t keyStart[kWJHEventRemapKeycodeLimit + 1];
+    uint8_t buttons[kWJHEventRemapButtonLimit];
+    bool hasScroll;
+    WJHEventRemapScroll scroll;
+    WJHEventRemapKeyRule keyRules[];
+};
+
+static ButtonAction buttonAction(uint32_t type) {
+    switch (type) {
+        case kLeftMouseDown:
+        case kRightMouseDown:
+        case kOtherMouseDown:
+            return ButtonDown;
+        case kLeftMouseUp:
+        case kRightMouseUp:
+        case kOtherMouseUp:
+            return ButtonUp;
+        case kLeftMouseDragged:
+        case kRightMouseDragged:
+        case kOtherMouseDragged:
+            return ButtonDragged;
+        default:
+            return ButtonNone;
+    }
+}
+
+static uint32_t buttonType(ButtonAction action, uint16_t button) {
+    static uint32_t const types[3][3] = {
+        { kLeftMouseDown, kRightMouseDown, kOtherMouseDown },
+        { kLeftMouseUp, kRightMouseUp, kOtherMouseUp },
+        { kLeftMouseDragged, kRightMouseDragged, kOtherMouseDragged },
+    };
+    return types[action - ButtonDown][button < 2 ? button : 2];
+}
+
+static WJHEventRemapTable * reject(WJHEventRemapError *error, WJHEventRemapInvalid invalid, size_t index) {
+    if (error) {
+        error->invalid = invalid;
+        error->index = index;
+    }
+    return NULL;
+}
+
+WJHEventRemapTable * WJHEventRemapTableCreate(WJHEventRemapSpec const *spec, WJHEventRemapError *error) {
+    reject(error, WJHEventRemapInvalidNone, 0);
+    for (size_t i = 0; i < spec->keyRuleCount; ++i) {
+        WJHEventRemapKeyRule const *rule = spec->keyRules + i;
+        if (rule->keycode >= kWJHEventRemapKeycodeLimit || rule->toKeycode >= kWJHEventRemapKeycodeLimit) {
+            return reject(error, WJHEventRemapInvalidKeyRule, i);
+        }
+    }
+    if (spec->scroll && !(isfinite(spec->scroll->scaleX) && isfinite(spec->scroll->scaleY))) {
+        return reject(error, WJHEventRemapInvalidScroll, 0);
+    }
+    if (spec->keyRuleCount > UINT32_MAX) {
+        return NULL;
+    }
+
+    WJHEventRemapTable *table = calloc(1, sizeof(*table) + spec->keyRuleCount * sizeof(WJHEventRemapKeyRule));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    bool remapped[kWJHEventRemapButtonLimit] = { false };
+    for (uint16_t button = 0; button < kWJHEventRemapButtonLimit; ++button) {
+        table->buttons[button] = (uint8_t)button;
+    }
+    for (size_t i = 0; i < spec->buttonRuleCount; ++i) {
+        WJHEventRemapButtonRule const *rule = spec->buttonRules + i;
+        if (rule->button >= kWJHEventRemapButtonLimit || rule->toButton >= kWJHEventRemapButtonLimit || remapped[rule->button]) {
+            free(table);
+            return reject(error, WJHEventRemapInvalidButtonRule, i);
+        }
+        remapped[rule->button] = true;
+        table->buttons[rule->button] = (uint8_t)rule->toButton;
+    }
+    if (spec->scroll) {
+        table->scroll = *spec->scroll;
+        table->hasScroll = true;
+    }
+
+    // A counting sort by keycode, which keeps the rules for each key in their original order.
+    for (size_t i = 0; i < spec->keyRuleCount; ++i) {
+        ++table->keyStart[spec->keyRules[i].keycode + 1];
+    }
+    for (uint32_t keycode = 0; keycode < kWJHEventRemapKeycodeLimit; ++keycode) {
+        table->keyStart[keycode + 1] += table->keyStart[keycode];
+    }
+    uint32_t next[kWJHEventRemapKeycodeLimit];
+    memcpy(next, table->keyStart, sizeof(next));
+    for (size_t i = 0; i < spec->keyRuleCount; ++i) {
+        table->keyRules[next[spec->keyRules[i].keycode]++] = spec->keyRules[i];
+    }
+    return table;
+}
+
+void WJHEventRemapTableDestroy(WJHEventRemapTable *table) {
+    free(table);
+}
+
+static uint32_t remapKey(WJHEventRemapTable const *table, WJHEventRemapState *state, WJHEventRecord *record) {
+    uint16_t const keycode = record->keycode;
+    if (keycode >= kWJHEventRemapKeycodeLimit) {
+        return 0;
+    }
+
+    uint16_t toKeycode = keycode;
+    uint64_t flags = record->flags;
+    for (uint32_t i = table->keyStart[keycode]; i < table->keyStart[keycode + 1]; ++i) {
+        WJHEventRemapKeyRule const *rule = table->keyRules + i;
+        if ((flags & rule->flagsMask) == rule->flagsValue) {
+            toKeycode = rule->toKeycode;
+            flags = (flags & ~rule->clearFlags) | rule->setFlags;
+            break;
+        }
+    }
+
+    if (state) {
+        if (record->type == kKeyDown) {
+            state->keys[keycode] = (uint16_t)(toKeycode + 1);
+        } else if (state->keys[keycode]) {
+            toKeycode = (uint16_t)(state->keys[keycode] - 1);
+            state->keys[keycode] = 0;
+        }
+    }
+
+    uint32_t changes = 0;
+    if (toKeycode != keycode) {
+        record->keycode = toKeycode;
+        changes |= WJHEventRemapChangedKeycode;
+    }
+    if (flags != record->flags) {
+        record->flags = flags;
+        changes |= WJHEventRemapChangedFlags;
+    }
+    return changes;
+}
+
+static uint32_t remapButton(WJHEventRemapTable const *table, WJHEventRemapState *state, WJHEventRecord *record, ButtonAction action) {
+    uint16_t const button = record->button;
+    if (button >= kWJHEventRemapButtonLimit) {
+        return 0;
+    }
+
+    uint16_t toButton = table->buttons[button];
+    if (state) {
+        if (action == ButtonDown) {
+            state->buttons[button] = (uint8_t)(toButton + 1);
+        } else if (state->buttons[button]) {
+            toButton = (uint16_t)(state->buttons[button] - 1);
+            if (action == ButtonUp) {
+                state->buttons[button] = 0;
+            }
+        }
+    }
+    if (toButton == button) {
+        return 0;
+    }
+
+    uint32_t changes = WJHEventRemapChangedButton;
+    record->button = toButton;
+    uint32_t const type = buttonType(action, toButton);
+    if (type != record->type) {
+        record->type = type;
+        changes |= WJHEventRemapChangedType;
+    }
+    return changes;
+}
+
+bool WJHEventRemapTableTransformScroll(WJHEventRemapTable const *table, double *deltaX, double *deltaY) {
+    if (!table->hasScroll) {
+        return false;
+    }
+    double x = *deltaX, y = *deltaY;
+    if (table->scroll.swapAxes) {
+        double const swapped = x;
+        x = y;
+        y = swapped;
+    }
+    *deltaX = x * table->scroll.scaleX;
+    *deltaY = y * table->scroll.scaleY;
+    return true;
+}
+
+static int32_t roundDelta(double delta) {
+    double const rounded = round(delta);
+    return rounded >= INT32_MAX ? INT32_MAX : (rounded <= INT32_MIN ? INT32_MIN : (int32_t)rounded);
+}
+
+uint32_t WJHEventRemapTableApply(WJHEventRemapTable const *table, WJHEventRemapState *state, WJHEventRecord *record) {
+    uint32_t const type = record->type;
+    if (type == kKeyDown || type == kKeyUp) {
+        return remapKey(table, state, record);
+    }
+    if (type == kScrollWheel) {
+        double x = record->deltaX, y = record->deltaY;
+        if (!WJHEventRemapTableTransformScroll(table, &x, &y)) {
+            return 0;
+        }
+        int32_t const deltaX = roundDelta(x), deltaY = roundDelta(y);
+        if (deltaX == record->deltaX && deltaY == record->deltaY) {
+            return 0;
+        }
+        record->deltaX = deltaX;
+        record->deltaY = deltaY;
+        return WJHEventRemapChangedScroll;
+    }
+    ButtonAction const action = buttonAction(type);
+    return action == ButtonNone ? 0 : remapButton(table, state, record, action);
+}
+
+uint64_t WJHEventRemapTableTypeMask(WJHEventRemapTable const *table) {
+    uint64_t mask = 0;
+    if (table->keyStart[kWJHEventRemapKeycodeLimit] > 0) {
+        mask |= UINT64_C(1) << kKeyDown | UINT64_C(1) << kKeyUp;
+    }
+    for (unsigned button = 0; button < kWJHEventRemapButtonLimit; ++button) {
+        if (table->buttons[button] == button) {
+            continue;
+        }
+        switch (button) {
+            case 0:
+                mask |= UINT64_C(1) << kLeftMouseDown | UINT64_C(1) << kLeftMouseUp | UINT64_C(1) << kLeftMouseDragged;
+                break;
+            case 1:
+                mask |= UINT64_C(1) << kRightMouseDown | UINT64_C(1) << kRightMouseUp | UINT64_C(1) << kRightMouseDragged;
+                break;
+            default:
+                mask |= UINT64_C(1) << kOtherMouseDown | UINT64_C(1) << kOtherMouseUp | UINT64_C(1) << kOtherMouseDragged;
+                break;
+        }
+    }
+    if (table->hasScroll) {
+        mask |= UINT64_C(1) << kScrollWheel;
+    }
+    return mask;
+}
@@ -0,0 +1,177 @@
+//
+//  WJHEventRemapTable.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventRemapTable_h
+#define WJHEventTap_WJHEventRemapTable_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "WJHEventRecord.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    /// Keycodes in a rule must be less than this.  Events with larger keycodes are never remapped.
+    kWJHEventRemapKeycodeLimit = 1024,
+
+    /// Mouse buttons in a rule must be less than this.  Events with larger buttons are never remapped.
+    kWJHEventRemapButtonLimit = 32,
+};
+
+/**
+ Sends a key, pressed with a set of modifiers, to another key.
+ */
+typedef struct WJHEventRemapKeyRule {
+    /// The virtual keycode the rule applies to.
+    uint16_t keycode;
+
+    /// The rule applies if (flags & flagsMask) == flagsValue.  Zero applies to every key press.
+    uint64_t flagsMask;
+    uint64_t flagsValue;
+
+    /// The keycode to send instead, which may be the same keycode, to only rewrite the modifiers.
+    uint16_t toKeycode;
+
+    /// The flags of the event become (flags & ~clearFlags) | setFlags.
+    uint64_t setFlags;
+    uint64_t clearFlags;
+} WJHEventRemapKeyRule;
+
+/**
+ Sends a mouse button to another button.  Button 0 is the left button, and 1 the right one.
+ */
+typedef struct WJHEventRemapButtonRule {
+    uint16_t button;
+    uint16_t toButton;
+} WJHEventRemapButtonRule;
+
+/**
+ Transforms scroll wheel deltas.  The axes are swapped first, then scaled; a negative scale reverses the direction.
+ */
+typedef struct WJHEventRemapScroll {
+    bool swapAxes;
+    double scaleX;
+    double scaleY;
+} WJHEventRemapScroll;
+
+/**
+ What a remapping table does, in the form it is written in.
+ */
+typedef struct WJHEventRemapSpec {
+    WJHEventRemapKeyRule const *keyRules;
+    size_t keyRuleCount;
+
+    WJHEventRemapButtonRule const *buttonRules;
+    size_t buttonRuleCount;
+
+    /// The scroll transform, or NULL to leave scrolling alone.
+    WJHEventRemapScroll const *scroll;
+} WJHEventRemapSpec;
+
+/**
+ The fields WJHEventRemapTableApply changed.
+ */
+typedef enum WJHEventRemapChange {
+    WJHEventRemapChangedType = 1 << 0,
+    WJHEventRemapChangedFlags = 1 << 1,
+    WJHEventRemapChangedKeycode = 1 << 2,
+    WJHEventRemapChangedButton = 1 << 3,
+    WJHEventRemapChangedScroll = 1 << 4,
+} WJHEventRemapChange;
+
+/**
+ A remapping specification compiled into dense lookup arrays.
+
+ Key rules are grouped by keycode, behind an array of offsets indexed by keycode, so a key event only looks at the rules for its own key; the first of them that applies wins.  Buttons are a direct lookup.  Key rules apply to key down and key up events; button rules to mouse down, up, and dragged events, whose type changes along with the button (e.g., a left mouse down sent to button 1 becomes a right mouse down).
+
+ A table is immutable, so it may be shared by any number of taps, on any number of threads.  Applying it never allocates.  It only depends on the C standard library, so it can be built and tested anywhere.
+ */
+typedef struct WJHEventRemapTable WJHEventRemapTable;
+
+/**
+ Where the keys and buttons that are down were sent, so their releases go to the same place, even if the table changes, or the modifiers that selected a rule are released first.
+
+ Zero it before first use.  It must only be used for one stream of events, on one thread at a time.
+ */
+typedef struct WJHEventRemapState {
+    /// One more than the keycode each key that is down was sent to, or zero.
+    uint16_t keys[kWJHEventRemapKeycodeLimit];
+
+    /// One more than the button each button that is down was sent to, or zero.
+    uint8_t buttons[kWJHEventRemapButtonLimit];
+} WJHEventRemapState;
+
+/**
+ What part of a specification WJHEventRemapTableCreate rejected.
+ */
+typedef enum WJHEventRemapInvalid {
+    /// Nothing was rejected: the table was created, or memory could not be allocated.
+    WJHEventRemapInvalidNone = 0,
+
+    /// The key rule at the index.
+    WJHEventRemapInvalidKeyRule,
+
+    /// The button rule at the index.
+    WJHEventRemapInvalidButtonRule,
+
+    /// The scroll transform.  The index is zero.
+    WJHEventRemapInvalidScroll,
+} WJHEventRemapInvalid;
+
+/**
+ Why a specification could not be compiled.
+ */
+typedef struct WJHEventRemapError {
+    WJHEventRemapInvalid invalid;
+
+    /// The index of the rejected rule among the key rules, or among the button rules, as given by invalid.
+    size_t index;
+} WJHEventRemapError;
+
+/**
+ Compile a remapping specification.
+
+ @param spec the rules, which are copied
+ @param error if not NULL, receives what was rejected, if anything
+
+ @return a new table, which must be released with WJHEventRemapTableDestroy, or NULL if memory could not be allocated, or a rule is invalid.  A key rule is invalid if either keycode is kWJHEventRemapKeycodeLimit or more.  A button rule is invalid if either button is kWJHEventRemapButtonLimit or more, or an earlier rule remaps the same button.  A scroll transform is invalid if a scale is not finite.
+ */
+WJHEventRemapTable * WJHEventRemapTableCreate(WJHEventRemapSpec const *spec, WJHEventRemapError *error);
+
+/**
+ Destroy a table.
+ */
+void WJHEventRemapTableDestroy(WJHEventRemapTable *table);
+
+/**
+ Remap a record in place.  Only the type, flags, keycode, button, and scroll deltas (deltaX and deltaY) are read.
+
+ @param state the keys and buttons that are down, or NULL to remap each event on its own
+ @return the fields that changed, as a mask of WJHEventRemapChange
+ */
+uint32_t WJHEventRemapTableApply(WJHEventRemapTable const *table, WJHEventRemapState *state, WJHEventRecord *record);
+
+/**
+ Apply the scroll transform to a pair of deltas, such as the line, point, or fixed point deltas of a scroll wheel event.
+
+ @return true if the table has a scroll transform
+ */
+bool WJHEventRemapTableTransformScroll(WJHEventRemapTable const *table, double *deltaX, double *deltaY);
+
+/**
+ The event types the table can change, as a mask of CGEventMaskBit(type): key down and key up if it has key rules, the mouse down, up, and dragged types of every button it sends elsewhere, and the scroll wheel if it has a scroll transform.
+ */
+uint64_t WJHEventRemapTableTypeMask(WJHEventRemapTable const *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,176 @@
+//
+//  WJHEventRingBuffer.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHEventRingBuffer.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WJH_CACHE_LINE_SIZE 64
+
+enum { kRecordWords = sizeof(WJHEventRecord) / sizeof(uint64_t) };
+_Static_assert(sizeof(WJHEventRecord) % sizeof(uint64_t) == 0, "records are copied a word at a time");
+
+/**
+ Where one record is kept.  A drop-oldest producer may overwrite the slot the consumer is copying out of, and the consumer then throws its copy away.  Copying with relaxed atomic words makes that race well defined, where a plain copy would not be, and costs no more.
+ */
+typedef struct Slot {
+    _Atomic uint64_t words[kRecordWords];
+} Slot;
+
+struct WJHEventRingBuffer {
+    // Position of the next record to be consumed.  Normally only advanced by the consumer, but a drop-oldest producer advances it too, so it is always updated with compare-and-swap.
+    _Alignas(WJH_CACHE_LINE_SIZE) _Atomic uint64_t head;
+
+    // Position of the next record to be produced.  Only written by the producer.
+    _Alignas(WJH_CACHE_LINE_SIZE) _Atomic uint64_t tail;
+    _Atomic uint64_t dropped;
+    _Atomic uint64_t overflows;
+
+    _Alignas(WJH_CACHE_LINE_SIZE) _Atomic uint64_t popped;
+
+    _Alignas(WJH_CACHE_LINE_SIZE) _Atomic bool closed;
+    uint32_t capacity;
+    uint64_t mask;
+    WJHEventRingBufferPolicy policy;
+
+    _Alignas(WJH_CACHE_LINE_SIZE) Slot slots[];
+};
+
+static inline void storeSlot(Slot *slot, WJHEventRecord const *record) {
+    for (size_t i = 0; i < kRecordWords; ++i) {
+        uint64_t word;
+        memcpy(&word, (char const *)record + i * sizeof(word), sizeof(word));
+        atomic_store_explicit(&slot->words[i], word, memory_order_relaxed);
+    }
+}
+
+static inline void loadSlot(Slot *slot, WJHEventRecord *record) {
+    // Each word goes straight to the record, as bouncing them through a local array stalls the loads that read it back.
+    for (size_t i = 0; i < kRecordWords; ++i) {
+        uint64_t word = atomic_load_explicit(&slot->words[i], memory_order_relaxed);
+        memcpy((char *)record + i * sizeof(word), &word, sizeof(word));
+    }
+}
+
+static uint32_t roundUpToPowerOfTwo(uint32_t value) {
+    uint32_t result = 1;
+    while (result < value && result < (UINT32_C(1) << 31)) {
+        result <<= 1;
+    }
+    return result;
+}
+
+WJHEventRingBuffer * WJHEventRingBufferCreate(uint32_t capacity, WJHEventRingBufferPolicy policy) {
+    capacity = roundUpToPowerOfTwo(capacity ? capacity : 1);
+
+    void *memory = NULL;
+    size_t size = sizeof(WJHEventRingBuffer) + (size_t)capacity * sizeof(Slot);
+    if (posix_memalign(&memory, WJH_CACHE_LINE_SIZE, size) != 0) {
+        return NULL;
+    }
+    memset(memory, 0, size);
+
+    WJHEventRingBuffer *buffer = memory;
+    atomic_init(&buffer->head, 0);
+    atomic_init(&buffer->tail, 0);
+    atomic_init(&buffer->dropped, 0);
+    atomic_init(&buffer->overflows, 0);
+    atomic_init(&buffer->popped, 0);
+    atomic_init(&buffer->closed, false);
+    buffer->capacity = capacity;
+    buffer->mask = capacity - 1;
+    buffer->policy = policy;
+    return buffer;
+}
+
+void WJHEventRingBufferDestroy(WJHEventRingBuffer *buffer) {
+    free(buffer);
+}
+
+uint32_t WJHEventRingBufferCapacity(WJHEventRingBuffer const *buffer) {
+    return buffer->capacity;
+}
+
+bool WJHEventRingBufferPush(WJHEventRingBuffer *buffer, WJHEventRecord const *record) {
+    if (atomic_load_explicit(&buffer->closed, memory_order_relaxed)) {
+        return false;
+    }
+
+    uint64_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+    if (tail - head >= buffer->capacity) {
+        atomic_fetch_add_explicit(&buffer->overflows, 1, memory_order_relaxed);
+        if (buffer->policy == WJHEventRingBufferBlock) {
+            do {
+                if (atomic_load_explicit(&buffer->closed, memory_order_relaxed)) {
+                    return false;
+                }
+                sched_yield();
+                head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+            } while (tail - head >= buffer->capacity);
+        } else {
+            // Claim the oldest slot by advancing head past it.  If the consumer advances head first, there is room and nothing needs to be dropped.
+            while (tail - head >= buffer->capacity) {
+                if (atomic_compare_exchange_weak_explicit(&buffer->head, &head, head + 1, memory_order_acq_rel, memory_order_acquire)) {
+                    atomic_fetch_add_explicit(&buffer->dropped, 1, memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+    }
+
+    // The acquire of claiming the oldest slot keeps this after the claim, so a consumer whose copy survives never saw it.
+    storeSlot(&buffer->slots[tail & buffer->mask], record);
+    atomic_store_explicit(&buffer->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+size_t WJHEventRingBufferPop(WJHEventRingBuffer *buffer, WJHEventRecord *records, size_t maxCount) {
+    for (;;) {
+        uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+        uint64_t available = tail - head;
+        size_t count = available < maxCount ? (size_t)available : maxCount;
+        if (count == 0) {
+            return 0;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            loadSlot(&buffer->slots[(head + i) & buffer->mask], records + i);
+        }
+
+        // If a drop-oldest producer moved head while we were copying, some of what we copied may have been overwritten, so throw it away and try again.
+        if (atomic_compare_exchange_strong_explicit(&buffer->head, &head, head + count, memory_order_acq_rel, memory_order_acquire)) {
+            atomic_fetch_add_explicit(&buffer->popped, count, memory_order_relaxed);
+            return count;
+        }
+    }
+}
+
+size_t WJHEventRingBufferCount(WJHEventRingBuffer const *buffer) {
+    WJHEventRingBuffer *b = (WJHEventRingBuffer *)buffer;
+    uint64_t head = atomic_load_explicit(&b->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&b->tail, memory_order_acquire);
+    return (size_t)(tail - head);
+}
+
+void WJHEventRingBufferClose(WJHEventRingBuffer *buffer) {
+    atomic_store_explicit(&buffer->closed, true, memory_order_relaxed);
+}
+
+WJHEventRingBufferStatistics WJHEventRingBufferGetStatistics(WJHEventRingBuffer const *buffer) {
+    WJHEventRingBuffer *b = (WJHEventRingBuffer *)buffer;
+    WJHEventRingBufferStatistics result;
+    result.pushed = atomic_load_explicit(&b->tail, memory_order_relaxed);
+    result.popped = atomic_load_explicit(&b->popped, memory_order_relaxed);
+    result.dropped = atomic_load_explicit(&b->dropped, memory_order_relaxed);
+    result.overflows = atomic_load_explicit(&b->overflows, memory_order_relaxed);
+    return result;
+}
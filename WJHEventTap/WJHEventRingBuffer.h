@@ -0,0 +1,108 @@
+//
+//  WJHEventRingBuffer.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventRingBuffer_h
+#define WJHEventTap_WJHEventRingBuffer_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "WJHEventRecord.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ What a producer does when it finds the ring buffer full.
+ */
+typedef enum WJHEventRingBufferPolicy {
+    /// Discard the oldest unconsumed record to make room for the new one.
+    WJHEventRingBufferDropOldest = 0,
+
+    /// Wait for the consumer to make room.
+    WJHEventRingBufferBlock = 1,
+} WJHEventRingBufferPolicy;
+
+/**
+ Counters describing the traffic through a ring buffer.
+ */
+typedef struct WJHEventRingBufferStatistics {
+    /// The number of records written by the producer.
+    uint64_t pushed;
+
+    /// The number of records handed to the consumer.
+    uint64_t popped;
+
+    /// The number of records that were discarded, unconsumed, to make room for newer records.
+    uint64_t dropped;
+
+    /// The number of pushes that found the buffer full.
+    uint64_t overflows;
+} WJHEventRingBufferStatistics;
+
+/**
+ A preallocated, lock-free, single-producer/single-consumer queue of event records.
+
+ Exactly one thread may push, and exactly one thread may pop, at any given time.  Pushing never allocates, and never blocks unless the buffer is full and was created with WJHEventRingBufferBlock.
+ */
+typedef struct WJHEventRingBuffer WJHEventRingBuffer;
+
+/**
+ Create a ring buffer.
+
+ @param capacity the minimum number of records the buffer can hold.  It is rounded up to the next power of two.
+ @param policy what to do when a push finds the buffer full
+
+ @return a new ring buffer, which must be released with WJHEventRingBufferDestroy, or NULL if memory could not be allocated.
+ */
+WJHEventRingBuffer * WJHEventRingBufferCreate(uint32_t capacity, WJHEventRingBufferPolicy policy);
+
+/**
+ Destroy a ring buffer.  Neither the producer nor the consumer may be using the buffer.
+ */
+void WJHEventRingBufferDestroy(WJHEventRingBuffer *buffer);
+
+/**
+ The actual number of records the buffer can hold.
+ */
+uint32_t WJHEventRingBufferCapacity(WJHEventRingBuffer const *buffer);
+
+/**
+ Copy a record into the buffer.  May only be called from the producer.
+
+ @return true if the record was stored, false if the buffer has been closed.
+ */
+bool WJHEventRingBufferPush(WJHEventRingBuffer *buffer, WJHEventRecord const *record);
+
+/**
+ Copy up to @a maxCount of the oldest records out of the buffer.  May only be called from the consumer.
+
+ @return the number of records copied into @a records.
+ */
+size_t WJHEventRingBufferPop(WJHEventRingBuffer *buffer, WJHEventRecord *records, size_t maxCount);
+
+/**
+ The number of records waiting to be consumed.  The value is only a snapshot when called while the producer or consumer are active.
+ */
+size_t WJHEventRingBufferCount(WJHEventRingBuffer const *buffer);
+
+/**
+ Close the buffer.  Subsequent pushes fail, and a producer blocked waiting for room returns immediately.  Records already in the buffer can still be popped.  May be called from any thread.
+ */
+void WJHEventRingBufferClose(WJHEventRingBuffer *buffer);
+
+/**
+ A snapshot of the buffer counters.  May be called from any thread.
+ */
+WJHEventRingBufferStatistics WJHEventRingBufferGetStatistics(WJHEventRingBuffer const *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
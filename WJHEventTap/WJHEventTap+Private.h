@@ -0,0 +1,105 @@
+//
+//  WJHEventTap+Private.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <WJHEventTap/WJHEventTap.h>
+#import <WJHEventTap/WJHEventTapDiscovery.h>
+#import <WJHEventTap/WJHSnapshotCell.h>
+#import <WJHEventTap/WJHEventHub.h>
+#import <WJHEventTap/WJHEventBackend.h>
+#import <WJHEventTap/WJHCGEventBackend.h>
+#import <WJHEventTap/WJHEvdevBackend.h>
+
+/**
+ Interfaces that are not part of the public API, but are needed to exercise the tap machinery without a live window server (e.g., from tests and benchmarks).
+ */
+@interface WJHEventTap (Private)
+
+/**
+ Initialize a tap object that is not attached to any system event tap.
+
+ No CGEventTap is created, and nothing is added to a run loop.  Events can be delivered to the object with WJHEventTapDispatchEvent, and they will be processed exactly as if they had come from the window server.  The enabled property is kept by the object itself, and starts out NO.
+
+ @param eventMask the mask reported by both the eventMask and requestedEventMask properties
+ @param passive YES to behave as a passive (listen only) tap, NO to behave as an active tap
+ @param delegate the delegate to be notified of tap events
+ */
+- (instancetype)initDetachedWithEventMask:(CGEventMask)eventMask passive:(BOOL)passive delegate:(id<WJHEventTapDelegate>)delegate;
+
+/**
+ Initialize a detached tap object that reports the given location and placement, and whose timers (e.g., for coalescing or batching) run on @a thread.
+
+ The caller is responsible for delivering events to the object with WJHEventTapDispatchEvent, on @a thread.
+
+ @param thread the thread that delivers events to the object, or nil if it has no thread, in which case the object has no timers
+ */
+- (instancetype)initDetachedWithLocation:(CGEventTapLocation)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive thread:(WJHEventTapThread *)thread delegate:(id<WJHEventTapDelegate>)delegate;
+
+/**
+ The identifier of a hub subscriber in its hub's chain, or zero if the tap does not belong to a hub.
+ */
+@property (nonatomic, assign) uint64_t hubSubscriberID;
+
+@end
+
+@interface WJHEventTapHub (Private)
+
+/**
+ Initialize a hub that never creates a system tap.
+
+ Events can be delivered to the hub with WJHEventTapHubDispatchEvent, and they will be fanned out exactly as if they had come from the window server.  Subscribers have no thread, and thus no timers.
+ */
+- (instancetype)initDetachedWithPassive:(BOOL)passive;
+
+@end
+
+/**
+ Deliver an event to the subscribers of a hub, through the same code path used by the hub's system tap.
+
+ @return the event, as it would be returned to the system event processor.
+ */
+extern CGEventRef WJHEventTapHubDispatchEvent(WJHEventTapHub *hub, CGEventTapProxy proxy, CGEventType type, CGEventRef event);
+
+/**
+ Deliver an event to a tap, through the same code path used by the CGEventTap callback.
+
+ @param tap the tap that is to process the event
+ @param proxy the tap proxy to hand to the delegate, which may be NULL for synthetic events
+ @param type the type of the event
+ @param event the event
+
+ @return the event, as it would be returned to the system event processor.
+ */
+extern CGEventRef WJHEventTapDispatchEvent(WJHEventTap *tap, CGEventTapProxy proxy, CGEventType type, CGEventRef event);
+
+/**
+ Deliver an event to a detached tap, as WJHEventTapDispatchEvent does, if the tap is enabled.  Whether it is enabled comes from the same read of the configuration that handles the event, so it costs no message.
+
+ @return the event, as it would be returned to the system event processor, which is @a event itself if the tap is disabled.
+ */
+extern CGEventRef WJHEventTapDispatchEventIfEnabled(WJHEventTap *tap, CGEventTapProxy proxy, CGEventType type, CGEventRef event);
+
+/**
+ Deliver the pending run of coalesced events, if any, to the delegate, as the coalescing timer would.
+
+ @param tap the tap, which must be serviced on the calling thread
+ */
+extern void WJHEventTapFlushCoalescedEvents(WJHEventTap *tap);
+
+/**
+ Deliver the pending batch of events, if any, to the delegate, as the batch timer would.
+
+ @param tap the tap, which must be serviced on the calling thread
+ */
+extern void WJHEventTapFlushBatchedEvents(WJHEventTap *tap);
+
+/**
+ Replace the source of the system tap list used by WJHEventTap initializers to discover the eventTapID of a new tap.
+
+ @param provider the new source of tap information, or NULL to use CGGetEventTapList
+ @param context passed to each call of @a provider
+ */
+extern void WJHEventTapSetTapListProvider(WJHEventTapListProvider provider, void *context);
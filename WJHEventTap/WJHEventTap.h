@@ -9,6 +9,18 @@
 #import <WJHEventTap/WJHEventTapDelegate.h>
 #import <WJHEventTap/NSDictionary+WJHEventTap.h>
 #import <WJHEventTap/NSValue+WJHEventTap.h>
+#import <WJHEventTap/WJHEventRecord.h>
+#import <WJHEventTap/WJHEventRingBuffer.h>
+#import <WJHEventTap/WJHEventTapList.h>
+#import <WJHEventTap/WJHEventTapThread.h>
+#import <WJHEventTap/WJHLatencyHistogram.h>
+#import <WJHEventTap/WJHEventCoalescer.h>
+#import <WJHEventTap/WJHEventRecording.h>
+#import <WJHEventTap/WJHEventFilterProgram.h>
+#import <WJHEventTap/WJHHotkeyMatcher.h>
+#import <WJHEventTap/WJHEventRemapTable.h>
+#import <WJHEventTap/WJHMetricsSegment.h>
+#import <WJHEventTap/WJHWatchdog.h>
 
 extern double WJHEventTapVersionNumber();
 extern unsigned char const * WJHEventTapVersionString();
@@ -19,6 +31,180 @@ enum {
 };
 
 
+#pragma mark - Event Records
+
+/**
+ Copy the interesting fields of an event into a record.
+
+ @param record the record to be filled
+ @param event the event to copy
+ @param type the type of the event
+ @param tapID the eventTapID of the tap that intercepted the event
+ */
+extern void WJHEventRecordFill(WJHEventRecord *record, CGEventRef event, CGEventType type, uint32_t tapID);
+
+/**
+ Create a new event from a record.
+
+ @param record the record describing the event
+
+ @return a new event, which the caller must release, with all the fields of @a record applied.
+ */
+extern CGEventRef WJHEventCreateWithRecord(WJHEventRecord const *record);
+
+
+#pragma mark - WJHEventTapSpecification
+
+/**
+ Describes an event tap to be created by +[WJHEventTap tapsWithSpecifications:runLoop:] or +[WJHEventTap tapsWithSpecifications:thread:].
+
+ The parameters have the same meaning as those of the WJHEventTap initializers.
+ */
+@interface WJHEventTapSpecification : NSObject
+
+/**
+ Describe a tap at a tap location.
+ */
++ (instancetype)specificationWithLocation:(CGEventTapLocation)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive delegate:(id<WJHEventTapDelegate>)delegate;
+
+/**
+ Describe a tap targeted at a process, or at the current process if @a process is NULL.
+ */
++ (instancetype)specificationWithProcess:(ProcessSerialNumber*)process eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive delegate:(id<WJHEventTapDelegate>)delegate;
+
+@property (nonatomic, assign, readonly) CGEventTapLocation location;
+@property (nonatomic, assign, readonly) ProcessSerialNumber processSerialNumber;
+@property (nonatomic, assign, readonly) CGEventMask eventMask;
+@property (nonatomic, assign, readonly) BOOL beforeOthers;
+@property (nonatomic, assign, readonly) BOOL passive;
+@property (nonatomic, strong, readonly) id<WJHEventTapDelegate> delegate;
+
+@end
+
+
+#pragma mark - WJHEventFilter
+
+/**
+ A declarative filter, which decides which events reach a tap's delegate.
+
+ The filter is a set of WJHEventFilterRule, each constraining the event type, modifier flags, keycode, mouse button, and location.  An event passes if it matches any of the rules.  The rules are compiled, once, into a flat decision table that is evaluated in plain C, reading only the event fields the rules for that event type need.
+
+ Filters are immutable, so one filter may be shared by any number of taps.
+ */
+@interface WJHEventFilter : NSObject
+
+/**
+ Compile a filter.
+
+ @param rules the rules, which are copied
+ @param count the number of rules.  A filter with no rules passes no events, other than tap notifications.
+
+ @return a new filter, or nil if the rules are invalid.
+
+ @see WJHEventFilterProgramCreate
+ */
++ (instancetype)filterWithRules:(WJHEventFilterRule const *)rules count:(NSUInteger)count;
+
+/**
+ The compiled rules.
+ */
+@property (nonatomic, assign, readonly) WJHEventFilterProgram const *program;
+
+/**
+ Whether an event passes the filter.
+ */
+- (BOOL)matchesEvent:(CGEventRef)event type:(CGEventType)type;
+
+@end
+
+
+#pragma mark - WJHHotkeys
+
+/**
+ Called, on the thread that services the tap, when a hotkey is typed.
+
+ @param binding the index of the binding, in the array the hotkeys were created with
+ */
+typedef void (^WJHHotkeyHandler)(NSUInteger binding);
+
+/**
+ A set of global hotkeys, including sequences such as "Ctrl-K then Ctrl-S", watched by a tap.
+
+ The bindings are compiled, once, into a WJHHotkeyMatcher, so the cost of a key event does not depend on how many hotkeys there are.  Only the Shift, Control, Option, and Command modifiers are significant.
+
+ Hotkeys keep track of the sequence being typed, so an object must only be given to one tap.
+ */
+@interface WJHHotkeys : NSObject
+
+/**
+ Compile a set of hotkeys.
+
+ @param bindings the bindings, which are copied
+ @param count the number of bindings
+ @param handler called with the index of each binding that is typed
+
+ @return new hotkeys, or nil if a binding is invalid.
+
+ @see WJHHotkeyMatcherCreate
+ */
++ (instancetype)hotkeysWithBindings:(WJHHotkeyBinding const *)bindings count:(NSUInteger)count handler:(WJHHotkeyHandler)handler;
+
+/**
+ The compiled bindings, along with the state of the sequence being typed.
+ */
+@property (nonatomic, assign, readonly) WJHHotkeyMatcher *matcher;
+
+@property (nonatomic, copy, readonly) WJHHotkeyHandler handler;
+
+/**
+ Feed a key event to the matcher, calling the handler if it completes a binding.
+
+ @return YES if the event belongs to a binding, either because it is the press that completes it, or the release of a key whose press did.  The presses of a sequence before its last chord are not consumed, so an abandoned sequence loses no keys.
+ */
+- (BOOL)handleEvent:(CGEventRef)event type:(CGEventType)type;
+
+@end
+
+
+#pragma mark - WJHEventRemap
+
+/**
+ A compiled table of key, mouse button, and scroll remappings, applied by a tap to each event, in place, before any delegate sees it.
+
+ Remapping changes the fields of the incoming event, rather than creating a replacement, so it never allocates.  A remap is immutable, so one object may be shared by any number of taps.
+ */
+@interface WJHEventRemap : NSObject
+
+/**
+ Compile a remapping table.
+
+ @param spec the rules, which are copied
+
+ @return a new remap, or nil if a rule is invalid.
+
+ @see WJHEventRemapTableCreate
+ */
++ (instancetype)remapWithSpec:(WJHEventRemapSpec const *)spec;
+
+/**
+ The compiled table.
+ */
+@property (nonatomic, assign, readonly) WJHEventRemapTable const *table;
+
+/**
+ Remap an event in place.
+
+ @param event the event, whose type, flags, keycode, button number, and scroll deltas may be changed
+ @param type the type of the event
+ @param state the keys and buttons that are down, or NULL
+
+ @return the type of the event, which changes when a mouse button is remapped to a button of another kind.
+ */
+- (CGEventType)remapEvent:(CGEventRef)event type:(CGEventType)type state:(WJHEventRemapState *)state;
+
+@end
+
+
 #pragma mark - WJHEventTap
 
 /**
@@ -57,11 +243,25 @@ enum {
  */
 + (NSArray *)systemTapsWithTransform:(id(^)(CGEventTapInformation const *tapInfo))transform;
 
+/**
+ Call a block for each system tap, without creating any objects.
+
+ @param block the block to call for each tap.  The pointer passed into @a block is guaranteed to be non-NULL, and is only valid for the duration of the call.  Set *stop to YES to end the enumeration.
+
+ @note Code that polls the tap list frequently should use a WJHEventTapList directly, which reuses its buffer from one poll to the next.
+ */
++ (void)enumerateSystemTapsUsingBlock:(void(^)(CGEventTapInformation const *tapInfo, BOOL *stop))block;
+
 /**
  The runLoop to which the tap is attached.
  */
 @property (nonatomic, strong, readonly) NSRunLoop *runLoop;
 
+/**
+ The dedicated thread servicing the tap, or nil if the tap was attached to a caller-provided run loop.
+ */
+@property (nonatomic, strong, readonly) WJHEventTapThread *thread;
+
 /**
  The actual event mask used to create the event tap.
 
@@ -70,7 +270,7 @@ enum {
 @property (nonatomic, assign, readonly) CGEventMask eventMask;
 
 /**
- The event mask as requested in the initializer.
+ The event mask the system tap was created with: the mask given to the initializer, unless automaticEventMask has narrowed it since.
  */
 @property (nonatomic, assign, readonly) CGEventMask requestedEventMask;
 
@@ -91,6 +291,8 @@ enum {
 
 /**
  The unique event tap ID
+
+ The ID is discovered by comparing the system tap list before and after the tap is created.  If it can not be determined within the bounds of kWJHEventTapDefaultDiscoveryPolicy, initialization fails, and the initializer returns nil.
  */
 @property (nonatomic, assign, readonly) uint32_t eventTapID;
 
@@ -116,9 +318,259 @@ enum {
  The tap delegate, which will be notified for any action on the tap.
 
  @note The delegate is held strongly by the tap.  The delegate can be changed, and set to nil.
+
+ The delegate, filter, hotkeys, remap, and enabled state form one immutable configuration, which the tap replaces whenever any of them is set.  The callback reads the configuration once per event, without locks or reference counting, and never waits for a change, nor does a change wait for the callback; each event sees one configuration from start to finish.
  */
 @property (atomic, strong) id<WJHEventTapDelegate> delegate;
 
+/**
+ Events that do not pass the filter never reach the delegate.  They are still remapped, matched against the hotkeys, and recorded, as the filter only decides what the delegate sees, and are then returned to the system event processor.  Tap notifications are never filtered.
+
+ The coarse eventMask is applied by the system, before the tap sees an event.  The filter refines it with conditions the mask can not express, such as a keycode and modifier combination, or a screen rectangle.  The filter can be changed, and set to nil, at any time.
+ */
+@property (atomic, strong) WJHEventFilter *filter;
+
+/**
+ Key events that belong to one of the hotkeys are consumed by the tap: an active tap removes them from the event stream, so they never reach the delegate or any application.  A passive tap can not remove events, so it calls the handler and goes on to deliver them as usual.
+
+ Hotkeys are checked before the filter, so they work whatever it passes.  The hotkeys can be changed, and set to nil, at any time.
+ */
+@property (atomic, strong) WJHHotkeys *hotkeys;
+
+/**
+ Remaps keys, mouse buttons, and scrolling.  An active tap applies the remap to each event before the hotkeys, the filter, and the delegate, which all see the remapped event.  A passive tap can not change events, so it ignores the remap.
+
+ The remap can be changed, and set to nil, at any time, without recreating the tap; the new table applies from the next event.  The tap remembers where each key and button that is down was sent, so its release goes to the same place, whatever the table says by then.
+ */
+@property (atomic, strong) WJHEventRemap *remap;
+
+/**
+ Whether the tap asks the system for only the events it uses, so events nothing wants never wake the tap, and never wait for it.
+
+ While this is set, the tap keeps its mask at minimalEventMask: setting it, or setting the delegate, filter, hotkeys, remap, or event handler while it is set, replaces the system tap with one created for the new mask, if the mask has changed.  The replacement has the same location, placement, and enabled state; only eventTapID, eventMask, and requestedEventMask change.  Clearing it goes back to the mask given to the initializer, which is also the most the tap ever asks for.
+
+ The tap can not see a delegate change itself, such as a block of a WJHEventTapDelegate being set, so call updateEventMask after one.  A tap that belongs to a hub only updates its own masks; the hub goes on delivering what the tap subscribed to.
+ */
+@property (atomic, assign) BOOL automaticEventMask;
+
+/**
+ The narrowest event mask that delivers every event the tap uses: the events the delegate and event handler (see WJHEventTapSetEventHandler) handle that the filter can pass, key down and key up for the hotkeys, and the events the remap changes, if the tap is active; or every event, if the tap records events.  That is then limited to the mask given to the initializer.
+ */
+@property (nonatomic, assign, readonly) CGEventMask minimalEventMask;
+
+/**
+ The events @a delegate handles, as used by minimalEventMask.
+
+ That is whatever eventMaskForEventTap: returns, if the delegate implements it.  Otherwise, it is every event if the delegate implements eventTap:receivedEvent:type:proxy:, or eventTap:receivedRecords:count: and the tap delivers batches.  Otherwise, it is the events of the type-specific methods it implements; the types without one, if it implements eventTap:unknownEvent:type:proxy:; and the types the tap coalesces, if it implements eventTap:coalescedEvent: and the tap coalesces events.
+ */
+- (CGEventMask)eventMaskForDelegate:(id<WJHEventTapDelegate>)delegate;
+
+/**
+ Bring the system tap up to date with the mask it should have, which is minimalEventMask if automaticEventMask is set, or the mask given to the initializer if it is not.  The work is done on the tap thread, if there is one; otherwise, it must be called on the thread of the tap's run loop.
+
+ @return YES if the tap has the mask it should have, or NO if a system tap could not be created for it, in which case the tap keeps its current system tap.
+ */
+- (BOOL)updateEventMask;
+
+/**
+ Whether events are handed to the delegate asynchronously.
+
+ @see enableAsynchronousDeliveryWithCapacity:overflowPolicy:queue:
+ */
+@property (nonatomic, assign, readonly) BOOL deliversAsynchronously;
+
+/**
+ The counters for the queue used for asynchronous delivery.  All values are zero if the tap does not deliver asynchronously.
+ */
+@property (nonatomic, assign, readonly) WJHEventRingBufferStatistics asynchronousDeliveryStatistics;
+
+/**
+ Move delegate processing off of the thread servicing the tap.
+
+ From then on, the tap callback only copies each event into a WJHEventRecord, and places it into a preallocated ring buffer.  The records are drained, in batches, on @a queue, where a new event is created from each record and given to the delegate.  The tap callback never waits on the delegate, so a slow delegate can not cause the tap to be disabled by timeout.
+
+ Since the delegate sees a copy of the event, only passive taps may deliver asynchronously.  The events seen by the delegate only carry the fields kept in a WJHEventRecord, and the proxy is always NULL.
+
+ @param capacity the minimum number of records that can be waiting for delivery
+ @param policy what the tap callback does when the buffer is full
+ @param queue the queue on which the delegate will be called, or nil to use a private serial queue
+
+ @return YES if asynchronous delivery was enabled.  NO if the tap is not passive, already delivers asynchronously, coalesces or batches events, or the buffer could not be allocated.
+
+ @note This must be called before the tap is enabled.
+ */
+- (BOOL)enableAsynchronousDeliveryWithCapacity:(uint32_t)capacity overflowPolicy:(WJHEventRingBufferPolicy)policy queue:(dispatch_queue_t)queue;
+
+/**
+ Whether high-frequency events are merged before they reach the delegate.
+
+ @see enableCoalescingWithWindow:
+ */
+@property (nonatomic, assign, readonly) BOOL coalescesEvents;
+
+/**
+ Merge runs of consecutive mouse move, drag, scroll wheel, and tablet pointer events, so the delegate sees one event per run instead of hundreds per second.
+
+ Events of the same type, with the same flags and button, that arrive within @a window of the first event of a run, are merged.  Scroll and mouse deltas are summed, the location is that of the latest event, and the distance travelled by the pointer is accumulated.  A run is delivered as soon as an event that does not belong to it arrives, or when the window has passed, so events always reach the delegate in order.  Any other event is delivered as usual.
+
+ A run is delivered to eventTap:coalescedEvent: if the delegate implements it.  Otherwise, an event is created from the run, and delivered through the usual type-specific delegate method.
+
+ @param window the longest span of a run, e.g., a display frame interval such as 1.0/60
+
+ @return YES if coalescing was enabled.  NO if the tap is not passive, delivers asynchronously, batches events, already coalesces events, or @a window is not positive.
+
+ @note This must be called before the tap is enabled.
+ */
+- (BOOL)enableCoalescingWithWindow:(NSTimeInterval)window;
+
+/**
+ Whether events are handed to the delegate in batches.
+
+ @see enableBatchedDeliveryWithBatchSize:interval:
+ */
+@property (nonatomic, assign, readonly) BOOL deliversBatches;
+
+/**
+ Collect events into batches, and hand each batch to the delegate with a single call, instead of calling the delegate once for every event.
+
+ The tap callback copies each event into a preallocated array of WJHEventRecord, and returns the event, untouched, to the system event processor.  The batch is delivered, on the thread servicing the tap, when it holds @a batchSize records, or when @a interval has passed since its first record was collected, whichever comes first.  Tap notifications (disabled by timeout or user input) are not batched; the pending batch is delivered first, so the delegate still sees everything in order.
+
+ A batch is delivered to eventTap:receivedRecords:count: if the delegate implements it.  Otherwise, an event is created from each record, and delivered through the usual type-specific delegate method.
+
+ @param batchSize the most records handed to the delegate in one call
+ @param interval the longest a record waits for its batch to be delivered
+
+ @return YES if batched delivery was enabled.  NO if the tap is not passive, delivers asynchronously, coalesces events, already batches events, or either argument is zero.
+
+ @note This must be called before the tap is enabled.
+ */
+- (BOOL)enableBatchedDeliveryWithBatchSize:(uint32_t)batchSize interval:(NSTimeInterval)interval;
+
+/**
+ Whether the time spent in delegate code is being recorded.
+
+ @see enableLatencyRecording
+ */
+@property (nonatomic, assign, readonly) BOOL recordsLatency;
+
+/**
+ Start recording how long the delegate takes to handle each event.
+
+ CGEventTapInformation only reports latency for the tap as a whole.  Once recording is enabled, the time spent in the delegate for every event is added to a log-linear histogram for the event's type, so tail latency can be traced to the event types, and thus the delegate methods, responsible for it.  Recording costs two clock reads and a few stores per event; when it is not enabled, it costs nothing.
+
+ @return YES if recording was enabled.  NO if it was already enabled, or the histograms could not be allocated.
+
+ @note This must be called before the tap is enabled.
+ */
+- (BOOL)enableLatencyRecording;
+
+/**
+ Summarize the time the delegate has spent handling events of one type.
+
+ This may be called from any thread, and never blocks the tap.
+
+ @param type the event type.  Types without a type-specific delegate method share a single histogram.
+
+ @return the latency summary, in nanoseconds.  All values are zero if latency is not being recorded.
+ */
+- (WJHLatencyHistogramSnapshot)latencySnapshotForEventType:(CGEventType)type;
+
+/**
+ Whether the events seen by the tap are being written to a recording file.
+
+ @see enableRecordingToPath:capacity:
+ */
+@property (nonatomic, assign, readonly) BOOL recordsEvents;
+
+/**
+ The number of events written to the recording file, and the number that did not fit.  Both are zero if the tap is not recording.  This may be called from any thread.
+ */
+@property (nonatomic, assign, readonly) uint64_t recordedEventCount;
+@property (nonatomic, assign, readonly) uint64_t droppedRecordingEventCount;
+
+/**
+ Write a copy of every event that reaches the tap callback to a recording file, so it can later be replayed with replayRecordingAtPath:delegate:timing:.
+
+ The file, which is created with room for @a capacity events, is memory-mapped, and each event is copied into it as a fixed-size WJHEventRecord, so recording never allocates or makes a system call.  Events that arrive once the file is full are not recorded.  The file is readable at any time, and is trimmed to the recorded events when the tap is deallocated.
+
+ @param path the path of the file, which is replaced if it exists
+ @param capacity the most events the file can hold
+
+ @return YES if recording was enabled.  NO if the tap is already recording, or the file could not be created.
+
+ @note This must be called before the tap is enabled.
+ */
+- (BOOL)enableRecordingToPath:(NSString *)path capacity:(uint32_t)capacity;
+
+/**
+ Replay a recording file to a delegate, on the calling thread, as if the events were arriving at a passive tap.
+
+ The file is memory-mapped, and an event is created from each record and handed to the delegate through the same type-specific methods a live tap uses.  The events only carry the fields kept in a WJHEventRecord, and the proxy is always NULL.
+
+ @param path the recording file
+ @param delegate the delegate to be given the events
+ @param timing whether to reproduce the original spacing of the events, or deliver them as fast as possible
+
+ @return YES if the file was replayed.  NO if it could not be read, or is not a recording file.
+ */
++ (BOOL)replayRecordingAtPath:(NSString *)path delegate:(id<WJHEventTapDelegate>)delegate timing:(WJHEventReplayTiming)timing;
+
+/**
+ Whether the tap publishes its counters for external monitoring.
+
+ @see enableMetricsWithName:
+ */
+@property (nonatomic, assign, readonly) BOOL publishesMetrics;
+
+/**
+ Publish the tap's counters in a named shared memory segment, where a monitor in another process, such as the wjh-monitor tool, can read them at any time, without asking the tap for anything.
+
+ The tap counts every event by type, and by whether it was passed, replaced, or dropped; the time spent in the callback; ring buffer overflows; and the times the system disabled the tap.  Updating the counters costs the callback a few stores, and never waits for a reader.  The segment also names the tap's eventTapID; when the tap replaces its system tap, as it does for minimalEventMask, the new ID is published, and the counters carry on.  The segment is removed when the tap is deallocated.
+
+ @param name the name of the segment, which replaces any segment left with that name.  Keep it to 30 characters, which is all some systems allow.  A sandboxed app must use a name its sandbox allows, such as one that starts with its application group.
+
+ @return YES if the counters are being published.  NO if they already are, or the segment could not be created.
+
+ @note This must be called before the tap is enabled.
+
+ @see WJHMetricsWriter
+ */
+- (BOOL)enableMetricsWithName:(NSString *)name;
+
+/**
+ Whether the tap watches how long its callback takes, and sheds load to keep the system from timing it out.
+
+ @see enableWatchdogWithPolicy:queue:handler:
+ */
+@property (nonatomic, assign, readonly) BOOL hasWatchdog;
+
+/**
+ How much work the tap is shedding, or WJHWatchdogLevelNormal if it has no watchdog.  This may be read from any thread.
+ */
+@property (nonatomic, assign, readonly) WJHWatchdogLevel watchdogLevel;
+
+/**
+ The watchdog's counters, which are all zero if the tap has no watchdog.  This may be read from any thread.
+ */
+@property (nonatomic, assign, readonly) WJHWatchdogStatistics watchdogStatistics;
+
+/**
+ Watch the time the callback takes to handle each event, and shed work as it nears the point where the system would disable the tap.
+
+ The tap steps down through the levels of WJHWatchdogLevel, as the policy decides: first it stops recording events and latency, then it passes motion events (mouse moves and drags, and scrolling) on untouched, without remapping them or telling the delegate, and finally it passes every event on untouched.  It steps back up a level at a time, once the callback is fast again.  Tap notifications are always delivered.
+
+ If the system does disable the tap because the callback took too long, the tap enables itself again at once, so as little input as possible is missed, and sheds another level.  The delegate is still sent eventTap:eventTapDisabledByTimeoutEvent:proxy:.  A tap disabled by user input is left disabled.
+
+ @param policy when to shed and recover, or NULL for WJHWatchdogDefaultPolicy()
+ @param queue the queue @a handler is called on, or nil to call it on the thread that handles events, from within the callback
+ @param handler called with each level change, or nil
+
+ @return YES if the watchdog was enabled.  NO if the tap already has one, or the policy is not valid.
+
+ @note This must be called before the tap is enabled.
+ */
+- (BOOL)enableWatchdogWithPolicy:(WJHWatchdogPolicy const *)policy queue:(dispatch_queue_t)queue handler:(void(^)(WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason))handler;
+
 /**
  Initialize an event tap
 
@@ -151,4 +603,100 @@ enum {
  */
 - (instancetype)initWithProcess:(ProcessSerialNumber*)process eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive runLoop:(NSRunLoop *)runLoop delegate:(id<WJHEventTapDelegate>)delegate;
 
+/**
+ Initialize an event tap that is serviced by a dedicated thread
+
+ @param location specifies at what point in event processing the tap is to be inserted.  If @a location is equal to kWJHProcessEventTap, then the tap will be installed at the currently running process.
+ @param eventMask a bitmask that specifies which events are to be intercepted
+ @param beforeOthers YES means that the tap will be inserted before any existing taps at the same location.  NO means that the tap will be inserted after any existing taps at the same location.
+ @param passive YES for a passive (listen only) tap, NO for an active tap that can change the event being processed.
+ @param thread the thread on which the tap callback and the delegate will run.  Pass the same thread to several taps to have them share it.  If nil, the tap starts, and owns, a thread of its own.
+ @param delegate the delegate to be notified of tap events.
+
+ @note The event tap is created in a disabled state, and must be manually enabled.
+
+ @note The delegate is called on the tap thread, not on the thread that created the tap.
+ */
+- (instancetype)initWithLocation:(CGEventTapLocation)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive thread:(WJHEventTapThread *)thread delegate:(id<WJHEventTapDelegate>)delegate;
+
+/**
+ Initialize an event tap, targeted at a process, that is serviced by a dedicated thread
+
+ @param process a pointer to serial number for the process to be tapped, or NULL for the current process.
+ @param eventMask a bitmask that specifies which events are to be intercepted
+ @param beforeOthers YES means that the tap will be inserted before any existing taps at the same location.  NO means that the tap will be inserted after any existing taps at the same location.
+ @param passive YES for a passive (listen only) tap, NO for an active tap that can change the event being processed.
+ @param thread the thread on which the tap callback and the delegate will run.  Pass the same thread to several taps to have them share it.  If nil, the tap starts, and owns, a thread of its own.
+ @param delegate the delegate to be notified of tap events.
+
+ @note The event tap is created in a disabled state, and must be manually enabled.
+
+ @note The delegate is called on the tap thread, not on the thread that created the tap.
+ */
+- (instancetype)initWithProcess:(ProcessSerialNumber*)process eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive thread:(WJHEventTapThread *)thread delegate:(id<WJHEventTapDelegate>)delegate;
+
+/**
+ Create several event taps at once.
+
+ Creating taps one at a time takes two snapshots of the system tap list for each tap, to discover its eventTapID.  Here, all the taps are created between a single pair of snapshots, and each tap's eventTapID and eventMask are resolved from the one comparison.  If the comparison is ambiguous for some of the taps, only those taps are created again.
+
+ @param specifications an array of WJHEventTapSpecification objects
+ @param runLoop the run loop to which every tap will be attached, or nil for the current run loop
+
+ @return an array of new taps, in the same order as @a specifications, or nil if any of the taps could not be created or identified, in which case none of the taps exist.
+
+ @note The event taps are created in a disabled state, and must be manually enabled.
+ */
++ (NSArray*)tapsWithSpecifications:(NSArray*)specifications runLoop:(NSRunLoop *)runLoop;
+
+/**
+ Create several event taps at once, all serviced by the same dedicated thread.
+
+ @param specifications an array of WJHEventTapSpecification objects
+ @param thread the thread on which every tap callback and delegate will run.  If nil, the taps share a thread of their own.
+
+ @return an array of new taps, in the same order as @a specifications, or nil if any of the taps could not be created or identified, in which case none of the taps exist.
+
+ @see tapsWithSpecifications:runLoop:
+ */
++ (NSArray*)tapsWithSpecifications:(NSArray*)specifications thread:(WJHEventTapThread *)thread;
+
 @end
+
+/**
+ Deliver events, recreated from records, to a tap's delegate through the usual type-specific delegate methods.
+
+ This is what a batched tap does when its delegate does not implement eventTap:receivedRecords:count:, and is useful to delegates that only want to handle some batches themselves.
+
+ @param tap the tap whose delegate is to receive the events
+ @param records the records, in the order in which they are to be delivered
+ @param count the number of records
+ */
+extern void WJHEventTapDispatchRecords(WJHEventTap *tap, WJHEventRecord const *records, size_t count);
+
+/**
+ Called by a tap with each event, from the tap callback, ahead of the delegate.
+
+ @param context the context given to WJHEventTapSetEventHandler
+ @param proxy the tap proxy, which is NULL for events delivered by WJHEventTapDispatchEvent without one
+ @param type the type of the event, after any remapping
+ @param event the event, which may be changed in place
+
+ @return the event to go on to the delegate, and then back to the system event processor, which may be @a event or a replacement; or NULL to drop the event, in which case the delegate never sees it.
+ */
+typedef CGEventRef (*WJHEventTapEventHandler)(void *context, CGEventTapProxy proxy, CGEventType type, CGEventRef event);
+
+/**
+ Set a function that a tap calls with each event, ahead of the delegate, for clients (such as the C++ wjh::Tap in WJHEventTap.hpp) that want no message send between the event and their code.
+
+ The handler is part of the configuration, along with the delegate, so it can be changed at any time, and applies from the next event.  It sees events after the remap, the hotkeys, recording, and the filter, and is shed and timed by the watchdog along with the rest of the callback.  It is always called from the callback, whether or not the delegate's events are delivered asynchronously, in batches, or coalesced.
+
+ @param tap the tap
+ @param handler the function, or NULL to remove it
+ @param context passed to @a handler, and not retained.  It must stay valid until the handler is removed, and no event can still be in the callback, which is certain once the handler has been removed on the thread that services the tap.
+ @param eventMask the events the handler handles, which minimalEventMask includes
+ */
+extern void WJHEventTapSetEventHandler(WJHEventTap *tap, WJHEventTapEventHandler handler, void *context, CGEventMask eventMask);
+
+// The hub is part of the umbrella, but its interface is written in terms of WJHEventTap, so it can only come after it.
+#import <WJHEventTap/WJHEventTapHub.h>
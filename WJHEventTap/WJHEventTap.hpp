@@ -0,0 +1,393 @@
+//
+//  WJHEventTap.hpp
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventTap_hpp
+#define WJHEventTap_WJHEventTap_hpp
+
+#include "WJHEventBackend.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <future>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#ifdef __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+
+#ifdef __OBJC__
+#import "WJHEventTap.h"
+#endif
+
+/**
+ A C++17 interface to event taps, whose handlers are bound at compile time.
+
+ A handler is any class with member functions named after the event types it handles, each taking the event:
+
+     struct Typist {
+         void keyDown(CGEventRef &event);
+         bool scrollWheel(CGEventRef &event);
+         bool unknownEvent(CGEventRef &event);
+     };
+
+ A function that returns bool drops the event by returning false; one that returns void always passes it on.  The names are those of the WJHEventTapDelegate methods, without the "Event" (leftMouseDown, mouseMoved, modifierFlagsChanged, eventTapDisabledByTimeout, and so on), and, as with the delegate, unknownEvent is called for any event without a function of its own.
+
+ Dispatch is a switch generated from the handler's type.  Each type the handler handles calls its function directly, where the compiler can inline it, and every other type returns at once.  There is no message send, block, or function pointer between the event and the handler, which is what the Objective-C delegate costs on every event.
+
+ There are two kinds of tap:
+
+ - Tap, in Objective-C++ on macOS, owns a WJHEventTap, and is called from its callback with the CGEventRef itself, which the handler may change in place, or replace.  Everything else the tap does (the remap, hotkeys, filter, recording, watchdog, and metrics) works as usual, through tap().
+ - EventTap, and EventTapThread, own a WJHEventBackend tap, and are called with a WJHEventRecord, whose changes are applied to the event as far as the backend can apply them.  They only need a C++ compiler, and run on any backend: CoreGraphics on macOS, and evdev anywhere; but none of WJHEventTap's features are there.
+ */
+namespace wjh {
+
+/// Every handler function, and the event type it handles.
+#define WJH_EVENT_TAP_HANDLERS(X) \
+    X(leftMouseDown, kWJHEventTypeLeftMouseDown) \
+    X(leftMouseUp, kWJHEventTypeLeftMouseUp) \
+    X(rightMouseDown, kWJHEventTypeRightMouseDown) \
+    X(rightMouseUp, kWJHEventTypeRightMouseUp) \
+    X(mouseMoved, kWJHEventTypeMouseMoved) \
+    X(leftMouseDragged, kWJHEventTypeLeftMouseDragged) \
+    X(rightMouseDragged, kWJHEventTypeRightMouseDragged) \
+    X(keyDown, kWJHEventTypeKeyDown) \
+    X(keyUp, kWJHEventTypeKeyUp) \
+    X(modifierFlagsChanged, kWJHEventTypeFlagsChanged) \
+    X(scrollWheel, kWJHEventTypeScrollWheel) \
+    X(otherMouseDown, kWJHEventTypeOtherMouseDown) \
+    X(otherMouseUp, kWJHEventTypeOtherMouseUp) \
+    X(otherMouseDragged, kWJHEventTypeOtherMouseDragged) \
+    X(eventTapDisabledByTimeout, kWJHEventTypeTapDisabledByTimeout) \
+    X(eventTapDisabledByUserInput, kWJHEventTypeTapDisabledByUserInput)
+
+namespace detail {
+
+#define WJH_EVENT_TAP_DETECT(name, type) \
+    template <class Handler, class Event, class = void> struct has_##name : std::false_type {}; \
+    template <class Handler, class Event> struct has_##name<Handler, Event, std::void_t<decltype(std::declval<Handler &>().name(std::declval<Event &>()))>> : std::true_type {};
+WJH_EVENT_TAP_HANDLERS(WJH_EVENT_TAP_DETECT)
+WJH_EVENT_TAP_DETECT(unknownEvent, 0)
+#undef WJH_EVENT_TAP_DETECT
+
+/// Call a handler function, treating void as passing the event on.
+template <class Call>
+inline bool pass(Call &&call) {
+    if constexpr (std::is_void_v<decltype(call())>) {
+        call();
+        return true;
+    } else {
+        return static_cast<bool>(call());
+    }
+}
+
+} // namespace detail
+
+/**
+ Hand an event of @a type to the function of @a handler for that type, or to its unknownEvent function.
+
+ @return false if the handler dropped the event, true if it passed it on, or does not handle it.
+ */
+template <class Handler, class Event>
+inline bool dispatch(Handler &handler, uint32_t type, Event &event) {
+    switch (type) {
+#define WJH_EVENT_TAP_CASE(name, type) \
+        case type: \
+            if constexpr (detail::has_##name<Handler, Event>::value) { \
+                return detail::pass([&] { return handler.name(event); }); \
+            } \
+            break;
+        WJH_EVENT_TAP_HANDLERS(WJH_EVENT_TAP_CASE)
+#undef WJH_EVENT_TAP_CASE
+        default:
+            break;
+    }
+    if constexpr (detail::has_unknownEvent<Handler, Event>::value) {
+        return detail::pass([&] { return handler.unknownEvent(event); });
+    } else {
+        return true;
+    }
+}
+
+/**
+ Hand a backend's event record to @a handler.
+ */
+template <class Handler>
+inline bool dispatch(Handler &handler, WJHEventRecord &record) {
+    return dispatch(handler, record.type, record);
+}
+
+/**
+ The events a handler handles, when called with an @a Event, as a mask of (1 << type): every event if it has an unknownEvent function, and otherwise the types of its functions.  Tap notifications are not in the mask, as taps deliver them whatever the mask.
+ */
+template <class Handler, class Event = WJHEventRecord>
+constexpr uint64_t eventMaskFor() {
+    if constexpr (detail::has_unknownEvent<Handler, Event>::value) {
+        return ~UINT64_C(0);
+    } else {
+        uint64_t mask = 0;
+#define WJH_EVENT_TAP_BIT(name, type) \
+        if (detail::has_##name<Handler, Event>::value && (type) < 64) { \
+            mask |= UINT64_C(1) << ((type) & 63); \
+        }
+        WJH_EVENT_TAP_HANDLERS(WJH_EVENT_TAP_BIT)
+#undef WJH_EVENT_TAP_BIT
+        return mask;
+    }
+}
+
+#ifdef __OBJC__
+#if __has_feature(objc_arc)
+
+/**
+ Owns a WJHEventTap whose events go to a handler, whose functions take a CGEventRef &.
+
+ The handler is called from the tap callback, ahead of the delegate, if there is one (see WJHEventTapSetEventHandler).  It sees each event after the remap, the hotkeys, and the filter, so it only sees the events the filter passes, already remapped, and never the keys the hotkeys consume.  It may change the event in place with the CGEventSet functions, or replace it by assigning another; what it passes on goes to the delegate, and then back to the system.  An active tap removes the events it drops from the event stream.
+
+     struct Typist {
+         bool keyDown(CGEventRef &event);
+     };
+     Typist typist;
+     wjh::Tap<Typist> tap(typist, [[WJHEventTap alloc] initWithLocation:kCGSessionEventTap eventMask:wjh::eventMaskFor<Typist, CGEventRef>() beforeOthers:YES passive:NO runLoop:nil delegate:nil]);
+     tap.tap().hotkeys = hotkeys;
+     tap.tap().enabled = YES;
+
+ The handler is not owned, and must outlive the Tap.  The Tap must be destroyed on the thread that services the tap, so no event is still being handled when it lets go of the handler.  The WJHEventTap, along with its system tap and run loop source, goes once nothing else holds it.
+ */
+template <class Handler>
+class Tap {
+public:
+    /**
+     Take over a tap, and send its events to @a handler.  Check that it succeeded with operator bool.
+
+     @param handler receives the events
+     @param tap the tap, created with a mask that includes eventMaskFor<Handler, CGEventRef>(), or with automaticEventMask set, or nil, in which case the Tap is empty
+     */
+    Tap(Handler &handler, WJHEventTap *tap)
+    : tap_(tap) {
+        if (tap_) {
+            WJHEventTapSetEventHandler(tap_, &callback, &handler, eventMaskFor<Handler, CGEventRef>());
+        }
+    }
+
+    ~Tap() {
+        if (tap_) {
+            WJHEventTapSetEventHandler(tap_, nullptr, nullptr, 0);
+        }
+    }
+
+    Tap(Tap &&other) noexcept
+    : tap_(other.tap_) {
+        other.tap_ = nil;
+    }
+
+    Tap & operator=(Tap &&other) noexcept {
+        std::swap(tap_, other.tap_);
+        return *this;
+    }
+
+    Tap(Tap const &) = delete;
+    Tap & operator=(Tap const &) = delete;
+
+    explicit operator bool() const {
+        return tap_ != nil;
+    }
+
+    /// The tap, for everything else it does: the filter, hotkeys, remap, watchdog, metrics, and so on.
+    WJHEventTap * tap() const {
+        return tap_;
+    }
+
+private:
+    static CGEventRef callback(void *context, CGEventTapProxy, CGEventType type, CGEventRef event) {
+        return dispatch(*static_cast<Handler *>(context), type, event) ? event : nullptr;
+    }
+
+    WJHEventTap *tap_;
+};
+
+#endif
+#endif
+
+/**
+ Owns a backend tap whose events go to a handler, whose functions take a WJHEventRecord &.
+
+ The handler is not owned, and must outlive the tap.  A class can be its own handler, CRTP style, by deriving from EventTap<itself> and passing *this; such a tap must not be moved, as the backend keeps a pointer to the handler.
+
+     class Typist : public wjh::EventTap<Typist> {
+     public:
+         explicit Typist(WJHEvdevOptions const &options) : EventTap(*this, kWJHEvdevBackend, &options) {}
+         bool keyDown(WJHEventRecord &record);
+     };
+
+ Like the backend taps, an EventTap starts out disabled, and events only arrive when deliver is called.
+ */
+template <class Handler>
+class EventTap {
+public:
+    /**
+     Create a tap.  Check that it succeeded with operator bool; if not, errno says why.
+
+     @param handler receives the events
+     @param backend the backend that creates the tap
+     @param options the backend's options for the tap
+     @param passive true for a tap that only listens
+     @param eventMask the events of interest, which are by default those the handler handles
+     */
+    EventTap(Handler &handler, WJHEventBackend const &backend, void const *options, bool passive = false, uint64_t eventMask = eventMaskFor<Handler>())
+    : backend_(&backend)
+    , tap_(backend.create(options, eventMask, passive, &callback, &handler)) {
+    }
+
+    ~EventTap() {
+        if (tap_) {
+            backend_->destroy(tap_);
+        }
+    }
+
+    EventTap(EventTap &&other) noexcept
+    : backend_(other.backend_)
+    , tap_(std::exchange(other.tap_, nullptr)) {
+    }
+
+    EventTap & operator=(EventTap &&other) noexcept {
+        std::swap(backend_, other.backend_);
+        std::swap(tap_, other.tap_);
+        return *this;
+    }
+
+    EventTap(EventTap const &) = delete;
+    EventTap & operator=(EventTap const &) = delete;
+
+    explicit operator bool() const {
+        return tap_ != nullptr;
+    }
+
+    void setEnabled(bool enabled) {
+        backend_->setEnabled(tap_, enabled);
+    }
+
+    bool isEnabled() const {
+        return backend_->isEnabled(tap_);
+    }
+
+    /**
+     Deliver pending events to the handler, waiting for some if there are none.
+
+     @return the number of events read, zero if the source is exhausted, or -1 on error, with errno set.
+     */
+    long deliver() {
+        return backend_->deliver(tap_);
+    }
+
+    WJHEventBackendTap * backendTap() const {
+        return tap_;
+    }
+
+private:
+    static bool callback(void *context, WJHEventRecord *record) {
+        return dispatch(*static_cast<Handler *>(context), *record);
+    }
+
+    WJHEventBackend const *backend_;
+    WJHEventBackendTap *tap_;
+};
+
+/**
+ Owns a thread, with a tap on it, that delivers events to a handler until it is destroyed.
+
+ The tap is created, and enabled, on the thread, so a CoreGraphics tap is serviced by the thread's own run loop; leave the run loop in its options NULL.  The handler is called on the thread, and must outlive it.
+
+ Destroying the thread stops it, and waits for it to finish.  On macOS its run loop is stopped.  Elsewhere, a thread blocked reading its source only stops once the source has more events, or ends, so close the source (e.g., the write end of a pipe) before destroying the thread.
+ */
+template <class Handler>
+class EventTapThread {
+public:
+    /**
+     Start the thread, and wait for its tap to be created.  Check that it succeeded with operator bool; if not, error() says why.
+
+     @param options the backend's options for the tap, which are copied to the thread
+     */
+    template <class Options>
+    EventTapThread(Handler &handler, WJHEventBackend const &backend, Options const &options, bool passive = false, uint64_t eventMask = eventMaskFor<Handler>()) {
+        std::promise<int> created;
+        std::future<int> result = created.get_future();
+        WJHEventBackend const *backendPointer = &backend;
+        thread_ = std::thread([this, &handler, backendPointer, options, passive, eventMask, &created] {
+            EventTap<Handler> tap(handler, *backendPointer, &options, passive, eventMask);
+            if (!tap) {
+                created.set_value(errno ? errno : EINVAL);
+                return;
+            }
+#ifdef __APPLE__
+            runLoop_ = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+#endif
+            tap.setEnabled(true);
+            created.set_value(0);
+            while (!stopped_.load(std::memory_order_relaxed) && tap.deliver() > 0) {
+            }
+        });
+        error_ = result.get();
+        if (error_) {
+            thread_.join();
+        }
+    }
+
+    ~EventTapThread() {
+        stop();
+    }
+
+    EventTapThread(EventTapThread const &) = delete;
+    EventTapThread & operator=(EventTapThread const &) = delete;
+
+    explicit operator bool() const {
+        return error_ == 0;
+    }
+
+    /// The errno from creating the tap, or zero if it was created.
+    int error() const {
+        return error_;
+    }
+
+    /**
+     Stop the thread, and wait for it to finish.  Does nothing if it has already been stopped.
+     */
+    void stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        stopped_.store(true, std::memory_order_relaxed);
+#ifdef __APPLE__
+        // Stopping the run loop from inside makes the backend's deliver return, whether or not it is running yet.
+        CFRunLoopPerformBlock(runLoop_, kCFRunLoopDefaultMode, ^{
+            CFRunLoopStop(CFRunLoopGetCurrent());
+        });
+        CFRunLoopWakeUp(runLoop_);
+#endif
+        thread_.join();
+#ifdef __APPLE__
+        CFRelease(runLoop_);
+        runLoop_ = nullptr;
+#endif
+    }
+
+private:
+    std::thread thread_;
+    std::atomic<bool> stopped_{false};
+    int error_ = 0;
+#ifdef __APPLE__
+    CFRunLoopRef runLoop_ = nullptr;
+#endif
+};
+
+#undef WJH_EVENT_TAP_HANDLERS
+
+} // namespace wjh
+
+#endif
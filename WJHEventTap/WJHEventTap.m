@@ -8,9 +8,17 @@
 #import "WJHEventTap.h"
 #import "NSValue+WJHEventTap.h"
 #import "NSDictionary+WJHEventTap.h"
+#import "WJHEventTap+Private.h"
+#import "WJHCGEventBackend.h"
+#import <mach/mach_time.h>
+
+@class WJHEventTapDispatchTable;
 
 static ProcessSerialNumber currentPSN();
 static CGEventRef eventTapCallback(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *userData);
+static CGEventRef dispatchToDelegate(WJHEventTap *tap, __unsafe_unretained WJHEventTapDispatchTable *table, CGEventTapProxy proxy, CGEventType type, CGEventRef event);
+static CGEventRef timedDispatchToDelegate(WJHEventTap *tap, __unsafe_unretained WJHEventTapDispatchTable *table, CGEventTapProxy proxy, CGEventType type, CGEventRef event);
+static void deliverCoalescedEvent(void *context, WJHCoalescedEvent const *coalesced);
 
 
 #pragma mark - Framework Initialization
@@ -27,6 +35,13 @@ unsigned char const * WJHEventTapVersionString()
     return (unsigned char *)versionString;
 }
 
+/// For converting callback times to nanoseconds, without asking the system on every event.
+static mach_timebase_info_data_t machTimebase;
+
+static inline uint64_t machNanoseconds(uint64_t machTime) {
+    return machTime * machTimebase.numer / machTimebase.denom;
+}
+
 __attribute__((constructor))
 static void init()
 {
@@ -39,6 +54,7 @@ static void init()
         versionNumber = [buildVersion doubleValue];
         versionString = strdup([releaseVersion cStringUsingEncoding:NSUTF8StringEncoding]);
     }
+    mach_timebase_info(&machTimebase);
 }
 
 __attribute__((destructor))
@@ -51,277 +67,1756 @@ static void fini()
 }
 
 
-#pragma mark - WJHEventTap Private API
+#pragma mark - Delegate Dispatch Table
+
+typedef BOOL (*WJHReceivedEventIMP)(id, SEL, WJHEventTap*, CGEventRef*, CGEventType, CGEventTapProxy);
+typedef CGEventRef (*WJHEventIMP)(id, SEL, WJHEventTap*, CGEventRef, CGEventTapProxy);
+typedef CGEventRef (*WJHUnknownEventIMP)(id, SEL, WJHEventTap*, CGEventRef, CGEventType, CGEventTapProxy);
+typedef void (*WJHCoalescedEventIMP)(id, SEL, WJHEventTap*, WJHCoalescedEvent const *);
+typedef void (*WJHReceivedRecordsIMP)(id, SEL, WJHEventTap*, WJHEventRecord const *, NSUInteger);
+
+enum {
+    /// Slots [0, 32) are indexed directly by CGEventType.
+    kWJHDispatchSlotDisabledByTimeout = 32,
+    kWJHDispatchSlotDisabledByUserInput = 33,
+    /// Any other event type that does not fit in the table.
+    kWJHDispatchSlotOther = 34,
+    kWJHDispatchSlotCount = 35,
+};
+
+static inline unsigned dispatchSlot(CGEventType type) {
+    if (type < kWJHDispatchSlotDisabledByTimeout) return type;
+    if (type == kCGEventTapDisabledByTimeout) return kWJHDispatchSlotDisabledByTimeout;
+    if (type == kCGEventTapDisabledByUserInput) return kWJHDispatchSlotDisabledByUserInput;
+    return kWJHDispatchSlotOther;
+}
+
+static inline CGEventType dispatchSlotType(unsigned slot) {
+    switch (slot) {
+        case kWJHDispatchSlotDisabledByTimeout: return kCGEventTapDisabledByTimeout;
+        case kWJHDispatchSlotDisabledByUserInput: return kCGEventTapDisabledByUserInput;
+        default: return (CGEventType)slot;
+    }
+}
 
-@interface WJHEventTap()
 /**
- When an event is created in the system, it is usually automatically enabled.  However, we want to start with it disabled.  Between the time we create the tap and when it is disabled, it is possible for it to have received events.  At minimum, it will have received the user-disabled event.  These events are eventually delivered (because the tap was enabled) to the callback handler.  We use this flag to indicate whether or not we are in the initial event-swallowing mode.
+ The selector of the type-specific delegate method for @a type, or NULL if events of that type are delivered through eventTap:unknownEvent:type:proxy:.
  */
-@property (nonatomic, assign) BOOL swallowEvents;
-@end
+static SEL selectorForEventType(CGEventType type) {
+    switch (type) {
+        case kCGEventNull: return @selector(eventTap:nullEvent:proxy:);
+        case kCGEventLeftMouseDown: return @selector(eventTap:leftMouseDownEvent:proxy:);
+        case kCGEventLeftMouseDragged: return @selector(eventTap:leftMouseDraggedEvent:proxy:);
+        case kCGEventLeftMouseUp: return @selector(eventTap:leftMouseUpEvent:proxy:);
+        case kCGEventRightMouseDown: return @selector(eventTap:rightMouseDownEvent:proxy:);
+        case kCGEventRightMouseDragged: return @selector(eventTap:rightMouseDraggedEvent:proxy:);
+        case kCGEventRightMouseUp: return @selector(eventTap:rightMouseUpEvent:proxy:);
+        case kCGEventOtherMouseDown: return @selector(eventTap:otherMouseDownEvent:proxy:);
+        case kCGEventOtherMouseDragged: return @selector(eventTap:otherMouseDraggedEvent:proxy:);
+        case kCGEventOtherMouseUp: return @selector(eventTap:otherMouseUpEvent:proxy:);
+        case kCGEventMouseMoved: return @selector(eventTap:mouseMovedEvent:proxy:);
+        case kCGEventKeyDown: return @selector(eventTap:keyDownEvent:proxy:);
+        case kCGEventKeyUp: return @selector(eventTap:keyUpEvent:proxy:);
+        case kCGEventFlagsChanged: return @selector(eventTap:modifierFlagsChangedEvent:proxy:);
+        case kCGEventScrollWheel: return @selector(eventTap:scrollWheelEvent:proxy:);
+        case kCGEventTabletPointer: return @selector(eventTap:tabletPointerEvent:proxy:);
+        case kCGEventTabletProximity: return @selector(eventTap:tabletProximityEvent:proxy:);
+        case kCGEventTapDisabledByTimeout: return @selector(eventTap:eventTapDisabledByTimeoutEvent:proxy:);
+        case kCGEventTapDisabledByUserInput: return @selector(eventTap:eventTapDisabledByUserInputEvent:proxy:);
+        default: return NULL;
+    }
+}
 
+typedef struct {
+    SEL selector;
+    IMP imp;
+    BOOL unknown;
+} WJHDispatchSlot;
 
-#pragma mark - WJHEventTap Class
+/**
+ An immutable snapshot of the delegate, along with the method implementations it provides for each event type.
 
-@implementation WJHEventTap {
-    CFMachPortRef _tap;
-    CFRunLoopSourceRef _runLoopSource;
+ The table is built once, whenever the delegate is set, so that the event callback never has to ask the delegate what it responds to.  A slot with a NULL imp means the delegate does not handle that event type, and the event is returned to the system untouched.
+ */
+@interface WJHEventTapDispatchTable : NSObject {
+@public
+    id<WJHEventTapDelegate> _delegate;
+    WJHReceivedEventIMP _receivedEvent;
+    WJHCoalescedEventIMP _coalescedEvent;
+    WJHReceivedRecordsIMP _receivedRecords;
+    WJHDispatchSlot _slots[kWJHDispatchSlotCount];
 }
+- (instancetype)initWithDelegate:(id<WJHEventTapDelegate>)delegate;
+@end
 
-#pragma mark Obtain System Tap Info
+@implementation WJHEventTapDispatchTable
 
-+ (uint32_t)systemTapCount {
-    uint32_t tapCount;
-    CGGetEventTapList(0, NULL, &tapCount);
-    return tapCount;
+static IMP lookupIMP(id object, SEL selector) {
+    return [object respondsToSelector:selector] ? [object methodForSelector:selector] : NULL;
+}
+
+- (instancetype)initWithDelegate:(id<WJHEventTapDelegate>)delegate {
+    if (self = [super init]) {
+        _delegate = delegate;
+        _receivedEvent = (WJHReceivedEventIMP)lookupIMP(delegate, @selector(eventTap:receivedEvent:type:proxy:));
+        _coalescedEvent = (WJHCoalescedEventIMP)lookupIMP(delegate, @selector(eventTap:coalescedEvent:));
+        _receivedRecords = (WJHReceivedRecordsIMP)lookupIMP(delegate, @selector(eventTap:receivedRecords:count:));
+
+        SEL unknownSelector = @selector(eventTap:unknownEvent:type:proxy:);
+        IMP unknownIMP = lookupIMP(delegate, unknownSelector);
+        for (unsigned slot = 0; slot < kWJHDispatchSlotCount; ++slot) {
+            SEL selector = selectorForEventType(dispatchSlotType(slot));
+            if (selector) {
+                _slots[slot] = (WJHDispatchSlot){ selector, lookupIMP(delegate, selector), NO };
+            } else {
+                _slots[slot] = (WJHDispatchSlot){ unknownSelector, unknownIMP, YES };
+            }
+        }
+    }
+    return self;
 }
 
-static inline void myfree(void *ptr) {
-    free(*(void**)ptr);
+@end
+
+
+#pragma mark - System Tap Backend
+
+/**
+ Creates, and services, the system tap of every tap that is not detached, which it is handed WJHCGEventBackendOptions for.
+ */
+static WJHEventBackend const * const systemTapBackend = &kWJHCGEventBackend;
+
+static WJHEventTapListProvider tapListProvider;
+static void *tapListProviderContext;
+
+void WJHEventTapSetTapListProvider(WJHEventTapListProvider provider, void *context) {
+    tapListProvider = provider;
+    tapListProviderContext = context;
 }
 
-+ (NSArray *)systemTapsWithTransform:(id(^)(CGEventTapInformation const *tapInfo))block {
-    uint32_t count = [self systemTapCount];
-    if (count == 0) return [NSArray array];
+#pragma mark - WJHEventFilter
 
-    if (block == nil) {
-        block = ^id(CGEventTapInformation const *tapInfo) {
-            return [NSValue wjh_valueWithCGEventTapInformation:*tapInfo];
-        };
+/**
+ Fill in the record fields that @a program reads for events of @a type, and evaluate it.
+ */
+static inline BOOL filterProgramMatchesEvent(WJHEventFilterProgram const *program, CGEventRef event, CGEventType type) {
+    WJHEventRecord record = { .type = type };
+    uint32_t fields = WJHEventFilterProgramFields(program, type);
+    if (fields & WJHEventFilterFieldFlags) {
+        record.flags = CGEventGetFlags(event);
     }
+    if (fields & WJHEventFilterFieldKeycode) {
+        BOOL keyboard = type == kCGEventKeyDown || type == kCGEventKeyUp || type == kCGEventFlagsChanged;
+        record.keycode = keyboard ? (uint16_t)CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode) : 0;
+    }
+    if (fields & WJHEventFilterFieldButton) {
+        record.button = (uint16_t)CGEventGetIntegerValueField(event, kCGMouseEventButtonNumber);
+    }
+    if (fields & WJHEventFilterFieldLocation) {
+        CGPoint location = CGEventGetLocation(event);
+        record.x = location.x;
+        record.y = location.y;
+    }
+    return WJHEventFilterProgramMatches(program, &record);
+}
 
-    // Want bytes to be zero, so padding bytes are in a known state.
-    __attribute__ ((cleanup(myfree))) CGEventTapInformation *tapInfo = calloc(count, sizeof(*tapInfo));
+@implementation WJHEventFilter {
+@public
+    WJHEventFilterProgram const *_program;
+}
 
-    NSMutableArray *result = [NSMutableArray arrayWithCapacity:count];
-    if (CGGetEventTapList(count, tapInfo, &count) == kCGErrorSuccess) {
-        for (uint32_t i = 0; i < count; ++i) {
-            id object = block(tapInfo + i);
-            if (object) {
-                [result addObject:object];
-            }
-        }
++ (instancetype)filterWithRules:(WJHEventFilterRule const *)rules count:(NSUInteger)count {
+    WJHEventFilterProgram *program = WJHEventFilterProgramCreate(rules, count);
+    if (program == NULL) {
+        return nil;
     }
+    WJHEventFilter *filter = [[self alloc] init];
+    filter->_program = program;
+    return filter;
+}
 
-    return [result copy];
+- (void)dealloc {
+    WJHEventFilterProgramDestroy((WJHEventFilterProgram *)_program);
 }
 
-+ (NSArray*)systemTaps {
-    return [self systemTapsWithTransform:nil];
+- (BOOL)matchesEvent:(CGEventRef)event type:(CGEventType)type {
+    return filterProgramMatchesEvent(_program, event, type);
 }
 
+@end
 
-# pragma Init/Fini
 
-- (void)setupLocation:(id)location {
-    NSAssert(_tap == nil, @"Tap should not be created");
-    if ([location isKindOfClass:[NSNumber class]]) {
-        _location = (CGEventTapLocation)[location unsignedIntegerValue];
-        if (_location == kWJHProcessEventTap) {
-            _processSerialNumber = currentPSN();
-        } else {
-            memset(&_processSerialNumber, 0, sizeof(_processSerialNumber));
-        }
-    } else {
-        _location = kWJHProcessEventTap;
-        _processSerialNumber = *(ProcessSerialNumber*)[location pointerValue];
+#pragma mark - WJHHotkeys
+
+static CGEventFlags const kHotkeyModifierMask = kCGEventFlagMaskShift | kCGEventFlagMaskControl | kCGEventFlagMaskAlternate | kCGEventFlagMaskCommand;
+
+/**
+ Feed a key event to @a matcher, calling @a handler if it completes a binding.  The callback calls this directly, rather than sending handleEvent:type:, to save a message for every key.
+ */
+static BOOL hotkeysHandleEvent(WJHHotkeyMatcher *matcher, __unsafe_unretained WJHHotkeyHandler handler, CGEventRef event, CGEventType type) {
+    if (type != kCGEventKeyDown && type != kCGEventKeyUp) {
+        return NO;
+    }
+    uint16_t keycode = (uint16_t)CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode);
+    if (type == kCGEventKeyUp) {
+        return WJHHotkeyMatcherKeyUp(matcher, keycode);
+    }
+
+    size_t binding;
+    switch (WJHHotkeyMatcherKeyDown(matcher, keycode, CGEventGetFlags(event), CGEventGetTimestamp(event), &binding)) {
+        case WJHHotkeyUnmatched:
+        case WJHHotkeyPending:
+            // A prefix goes on to the delegate and applications, as nothing would give it back if the sequence were abandoned.
+            return NO;
+        case WJHHotkeyMatched:
+            if (handler) {
+                handler(binding);
+            }
+            return YES;
     }
+    return NO;
 }
 
-- (void)setupTap {
-    CGEventTapPlacement placement = self.beforeOthers ? kCGHeadInsertEventTap : kCGTailAppendEventTap;
-    CGEventTapOptions options = self.passive ? kCGEventTapOptionListenOnly : kCGEventTapOptionDefault;
-    if (_location == kWJHProcessEventTap) {
-        _tap = CGEventTapCreateForPSN(&_processSerialNumber, placement, options, self.requestedEventMask, eventTapCallback, (__bridge void*)self);
-    } else {
-        _tap = CGEventTapCreate(self.location, placement, options, self.requestedEventMask, eventTapCallback, (__bridge void*)self);
+@implementation WJHHotkeys {
+@public
+    WJHHotkeyMatcher *_matcher;
+    WJHHotkeyHandler _handler;
+}
+
++ (instancetype)hotkeysWithBindings:(WJHHotkeyBinding const *)bindings count:(NSUInteger)count handler:(WJHHotkeyHandler)handler {
+    WJHHotkeyMatcher *matcher = WJHHotkeyMatcherCreate(bindings, count, kHotkeyModifierMask, NULL);
+    if (matcher == NULL) {
+        return nil;
     }
+    WJHHotkeys *hotkeys = [[self alloc] init];
+    hotkeys->_matcher = matcher;
+    hotkeys->_handler = [handler copy];
+    return hotkeys;
 }
 
-- (instancetype)initWithGenericLocation:(id)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive runLoop:(NSRunLoop *)runLoop delegate:(id<WJHEventTapDelegate>)delegate {
-    if (self = [super init]) {
-        _requestedEventMask = eventMask;
-        _runLoop = runLoop ?: [NSRunLoop currentRunLoop];
-        _beforeOthers = beforeOthers;
-        _passive = passive;
-        _delegate = delegate;
-        _swallowEvents = YES;
-        [self setupLocation:location];
+- (void)dealloc {
+    WJHHotkeyMatcherDestroy(_matcher);
+}
 
-        // I can't find an API to get my own tap's unique eventTapID, so we will need to grab the list of taps both before and after installing our own, and hope that there is only one new tap in the list.  Since we can't guarantee that another tap was inserted at the same time, we need to loop until we see only our tap as the new tap.
-        for (;;) {
-            NSSet *before = [NSSet setWithArray:[self.class systemTaps]];
-            [self setupTap];
-            if (_tap == nil) {
-                return self = nil;
-            }
+- (BOOL)handleEvent:(CGEventRef)event type:(CGEventType)type {
+    return hotkeysHandleEvent(_matcher, _handler, event, type);
+}
 
-            if (CGEventTapIsEnabled(_tap)) {
-                CGEventTapEnable(_tap, false);
-            } else {
-                self.swallowEvents = NO;
-            }
+@end
 
-            NSMutableSet *after = [NSMutableSet setWithArray:[self.class systemTaps]];
-            [after minusSet:before];
-            if (after.count == 1) {
-                CGEventTapInformation info = [[after anyObject] wjh_CGEventTapInformationValue];
-                _eventTapID = info.eventTapID;
-                _eventMask = info.eventsOfInterest;
-                break;
-            } else {
-                // Could not find our tap... try again.
-                CFMachPortInvalidate(_tap);
-                CFRelease(_tap);
-                _tap = nil;
+
+#pragma mark - WJHEventRemap
+
+/**
+ Apply the scroll transform of @a table to the pair of integer fields of @a event that hold the horizontal and vertical deltas.
+ */
+static void transformScrollFields(WJHEventRemapTable const *table, CGEventRef event, CGEventField xField, CGEventField yField) {
+    double x = CGEventGetIntegerValueField(event, xField);
+    double y = CGEventGetIntegerValueField(event, yField);
+    WJHEventRemapTableTransformScroll(table, &x, &y);
+    CGEventSetIntegerValueField(event, xField, (int64_t)round(x));
+    CGEventSetIntegerValueField(event, yField, (int64_t)round(y));
+}
+
+/**
+ Remap @a event in place with @a table.  The callback calls this directly, rather than sending remapEvent:type:state:, to save a message for every event.
+
+ @return the type of the remapped event.
+ */
+static CGEventType remapTableApplyToEvent(WJHEventRemapTable const *table, CGEventRef event, CGEventType type, WJHEventRemapState *state) {
+    WJHEventRecord record = { .type = type };
+    switch (type) {
+        case kCGEventKeyDown:
+        case kCGEventKeyUp:
+            record.keycode = (uint16_t)CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode);
+            record.flags = CGEventGetFlags(event);
+            break;
+        case kCGEventLeftMouseDown:
+        case kCGEventLeftMouseUp:
+        case kCGEventLeftMouseDragged:
+        case kCGEventRightMouseDown:
+        case kCGEventRightMouseUp:
+        case kCGEventRightMouseDragged:
+        case kCGEventOtherMouseDown:
+        case kCGEventOtherMouseUp:
+        case kCGEventOtherMouseDragged:
+            record.button = (uint16_t)CGEventGetIntegerValueField(event, kCGMouseEventButtonNumber);
+            break;
+        case kCGEventScrollWheel: {
+            // A scroll wheel event carries its deltas three ways, which must agree, so transform them all.  Axis 1 is vertical.
+            double x = CGEventGetDoubleValueField(event, kCGScrollWheelEventFixedPtDeltaAxis2);
+            double y = CGEventGetDoubleValueField(event, kCGScrollWheelEventFixedPtDeltaAxis1);
+            if (WJHEventRemapTableTransformScroll(table, &x, &y)) {
+                CGEventSetDoubleValueField(event, kCGScrollWheelEventFixedPtDeltaAxis2, x);
+                CGEventSetDoubleValueField(event, kCGScrollWheelEventFixedPtDeltaAxis1, y);
+                transformScrollFields(table, event, kCGScrollWheelEventDeltaAxis2, kCGScrollWheelEventDeltaAxis1);
+                transformScrollFields(table, event, kCGScrollWheelEventPointDeltaAxis2, kCGScrollWheelEventPointDeltaAxis1);
             }
+            return type;
         }
+        default:
+            return type;
+    }
 
-        NSAssert(_tap != nil, @"BUG: Should have already bailed");
-        _runLoopSource = CFMachPortCreateRunLoopSource(kCFAllocatorDefault, _tap, 0);
-        CFRunLoopAddSource([_runLoop getCFRunLoop], _runLoopSource, kCFRunLoopCommonModes);
+    uint32_t changes = WJHEventRemapTableApply(table, state, &record);
+    if (changes & WJHEventRemapChangedKeycode) {
+        CGEventSetIntegerValueField(event, kCGKeyboardEventKeycode, record.keycode);
     }
-    return self;
+    if (changes & WJHEventRemapChangedFlags) {
+        CGEventSetFlags(event, (CGEventFlags)record.flags);
+    }
+    if (changes & WJHEventRemapChangedButton) {
+        CGEventSetIntegerValueField(event, kCGMouseEventButtonNumber, record.button);
+    }
+    if (changes & WJHEventRemapChangedType) {
+        CGEventSetType(event, (CGEventType)record.type);
+    }
+    return (CGEventType)record.type;
 }
 
-- (instancetype)initWithLocation:(CGEventTapLocation)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive runLoop:(NSRunLoop *)runLoop delegate:(id<WJHEventTapDelegate>)delegate {
-    NSNumber *locNum = [NSNumber numberWithUnsignedInteger:(NSUInteger)location];
-    return [self initWithGenericLocation:locNum eventMask:eventMask beforeOthers:beforeOthers passive:passive runLoop:runLoop delegate:delegate];
+@implementation WJHEventRemap {
+@public
+    WJHEventRemapTable const *_table;
 }
 
-- (instancetype)initWithProcess:(ProcessSerialNumber *)process eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive runLoop:(NSRunLoop *)runLoop delegate:(id<WJHEventTapDelegate>)delegate {
-    ProcessSerialNumber psn;
-    if (process) {
-        psn = *process;
-    } else {
-        psn = currentPSN();
++ (instancetype)remapWithSpec:(WJHEventRemapSpec const *)spec {
+    WJHEventRemapTable *table = WJHEventRemapTableCreate(spec, NULL);
+    if (table == NULL) {
+        return nil;
     }
-    return [self initWithGenericLocation:[NSValue valueWithPointer:&psn] eventMask:eventMask beforeOthers:beforeOthers passive:passive runLoop:runLoop delegate:delegate];
+    WJHEventRemap *remap = [[self alloc] init];
+    remap->_table = table;
+    return remap;
 }
 
 - (void)dealloc {
-    _delegate = nil;
-    if (_runLoopSource) {
-        CFRunLoopSourceInvalidate(_runLoopSource);
-        CFRelease(_runLoopSource);
-        _runLoopSource = NULL;
-    }
-    if (_tap) {
-        CFMachPortInvalidate(_tap);
-        CFRelease(_tap);
-        _tap = NULL;
-    }
+    WJHEventRemapTableDestroy((WJHEventRemapTable *)_table);
 }
 
-#pragma mark Is Enabled
+- (CGEventType)remapEvent:(CGEventRef)event type:(CGEventType)type state:(WJHEventRemapState *)state {
+    return remapTableApplyToEvent(_table, event, type, state);
+}
 
-- (BOOL)isEnabled {
-    return _tap ? CGEventTapIsEnabled(_tap) : NO;
+@end
+
+
+#pragma mark - WJHEventTapSpecification
+
+@implementation WJHEventTapSpecification
+
+- (instancetype)initWithLocation:(CGEventTapLocation)location process:(ProcessSerialNumber const *)process eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive delegate:(id<WJHEventTapDelegate>)delegate {
+    if (self = [super init]) {
+        _location = location;
+        if (process) {
+            _processSerialNumber = *process;
+        }
+        _eventMask = eventMask;
+        _beforeOthers = beforeOthers;
+        _passive = passive;
+        _delegate = delegate;
+    }
+    return self;
 }
 
-- (void)setEnabled:(BOOL)enabled {
-    NSAssert(_tap != nil, @"Tap has disappeared");
-    enabled = !!enabled;
-    BOOL current = !!self.isEnabled;
-    if (current != enabled) {
-        CGEventTapEnable(_tap, enabled);
++ (instancetype)specificationWithLocation:(CGEventTapLocation)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive delegate:(id<WJHEventTapDelegate>)delegate {
+    if (location == kWJHProcessEventTap) {
+        return [self specificationWithProcess:NULL eventMask:eventMask beforeOthers:beforeOthers passive:passive delegate:delegate];
     }
+    return [[self alloc] initWithLocation:location process:NULL eventMask:eventMask beforeOthers:beforeOthers passive:passive delegate:delegate];
+}
+
++ (instancetype)specificationWithProcess:(ProcessSerialNumber *)process eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive delegate:(id<WJHEventTapDelegate>)delegate {
+    ProcessSerialNumber psn = process ? *process : currentPSN();
+    return [[self alloc] initWithLocation:kWJHProcessEventTap process:&psn eventMask:eventMask beforeOthers:beforeOthers passive:passive delegate:delegate];
 }
 
 @end
 
 
+#pragma mark - Event Batches
 
+/**
+ The records collected for the next batched delivery.
+ */
+typedef struct WJHEventBatch {
+    uint32_t count;
+    uint32_t capacity;
+    WJHEventRecord records[];
+} WJHEventBatch;
 
-#pragma mark - Implementation Details
 
-static ProcessSerialNumber currentPSN() {
-    // Argh.  GetCurrentProcess() is deprecated in favor of [NSRunningApplication currentApplication].  However, it provides no API to get the ProcessSerialNumber, which is required to create an application tap.  Hopefully, this gets fixed in a future release, where we either gain access to ProcessSerialNumber, or we get another API to install process taps.
-    ProcessSerialNumber psn;
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
-    GetCurrentProcess(&psn);
-#pragma clang diagnostic pop
-    return psn;
-}
+#pragma mark - Tap Configuration
 
-static CGEventRef eventTapCallback(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *userData) {
-    WJHEventTap *tap = (__bridge WJHEventTap *)(userData);
-    id<WJHEventTapDelegate> delegate = tap.delegate;
+/**
+ Everything about a tap that may change while it runs, and that the callback reads for every event.  A configuration is never changed once it is published: a setter publishes a changed copy, so the callback sees all of one configuration or all of another, and reads it without locks or reference counting.
 
-    if (tap.swallowEvents) {
-        if (type == kCGEventTapDisabledByUserInput) {
-            // This should be our manual disable when we created the tap
-            tap.swallowEvents = NO;
-        }
-        return event;
+ Each configuration retains its objects, and releases them when it is destroyed, which the snapshot cell only does once no callback can still be using it.
+ */
+typedef struct WJHEventTapConfiguration {
+    WJHSnapshot header;
+    __unsafe_unretained WJHEventTapDispatchTable *dispatchTable;
+    __unsafe_unretained WJHEventFilter *filter;
+    __unsafe_unretained WJHHotkeys *hotkeys;
+    __unsafe_unretained WJHEventRemap *remap;
+
+    /// Called with each event ahead of the delegate, or NULL.  See WJHEventTapSetEventHandler.
+    WJHEventTapEventHandler eventHandler;
+    void *eventHandlerContext;
+    CGEventMask eventHandlerMask;
+
+    /// Whether the tap was last asked to be enabled.  For a detached tap, this is the whole truth; a system tap can also be disabled by the system.
+    BOOL enabled;
+
+    /// Copied from the tap, which never changes it, to save the callback a message.
+    BOOL passive;
+} WJHEventTapConfiguration;
+
+static void retainConfigurationObject(__unsafe_unretained id object) {
+    if (object) {
+        CFRetain((__bridge CFTypeRef)object);
     }
+}
 
-    if (type == kCGEventTapDisabledByTimeout || type == kCGEventTapDisabledByUserInput) {
-        if (tap.isEnabled) {
-            // The "Disable" event was enqueued, but the tap has since been re-enabled, so ignore the event.
-            return event;
-        }
-        tap.enabled = NO;
+static void releaseConfigurationObject(__unsafe_unretained id object) {
+    if (object) {
+        CFRelease((__bridge CFTypeRef)object);
     }
+}
 
-    if ([delegate respondsToSelector:@selector(eventTap:receivedEvent:type:proxy:)]) {
-        CGEventRef tmpEvent = event;
-        if ([delegate eventTap:tap receivedEvent:&tmpEvent type:type proxy:proxy]) {
-            return tmpEvent;
-        }
+static void destroyConfiguration(WJHSnapshot *snapshot, void *context) {
+    WJHEventTapConfiguration *configuration = (WJHEventTapConfiguration *)snapshot;
+    releaseConfigurationObject(configuration->dispatchTable);
+    releaseConfigurationObject(configuration->filter);
+    releaseConfigurationObject(configuration->hotkeys);
+    releaseConfigurationObject(configuration->remap);
+    free(configuration);
+}
+
+/**
+ Copy the current configuration, let the change block given as @a context modify the copy, and retain whatever the copy ends up with.
+ */
+static WJHSnapshot * applyConfigurationChange(WJHSnapshot const *current, void *context) {
+    void (^change)(WJHEventTapConfiguration *configuration) = (__bridge id)context;
+    WJHEventTapConfiguration *configuration = malloc(sizeof(*configuration));
+    if (configuration == NULL) {
+        return NULL;
     }
+    *configuration = *(WJHEventTapConfiguration const *)current;
+    change(configuration);
+    retainConfigurationObject(configuration->dispatchTable);
+    retainConfigurationObject(configuration->filter);
+    retainConfigurationObject(configuration->hotkeys);
+    retainConfigurationObject(configuration->remap);
+    return &configuration->header;
+}
 
-#define invokeDelegate(_name_) \
-if ([delegate respondsToSelector:@selector(eventTap:_name_:proxy:)]) { \
-return [delegate eventTap:tap _name_:event proxy:proxy]; \
-} break
 
-    switch (type) {
-        case kCGEventNull:
-            invokeDelegate(nullEvent);
-        case kCGEventLeftMouseDown:
-            invokeDelegate(leftMouseDownEvent);
-        case kCGEventLeftMouseDragged:
-            invokeDelegate(leftMouseDraggedEvent);
-        case kCGEventLeftMouseUp:
-            invokeDelegate(leftMouseUpEvent);
-        case kCGEventRightMouseDown:
-            invokeDelegate(rightMouseDownEvent);
-        case kCGEventRightMouseDragged:
-            invokeDelegate(rightMouseDraggedEvent);
-        case kCGEventRightMouseUp:
-            invokeDelegate(rightMouseUpEvent);
-        case kCGEventOtherMouseDown:
-            invokeDelegate(otherMouseDownEvent);
-        case kCGEventOtherMouseDragged:
-            invokeDelegate(otherMouseDraggedEvent);
-        case kCGEventOtherMouseUp:
-            invokeDelegate(otherMouseUpEvent);
-        case kCGEventMouseMoved:
-            invokeDelegate(mouseMovedEvent);
-        case kCGEventKeyDown:
-            invokeDelegate(keyDownEvent);
-        case kCGEventKeyUp:
-            invokeDelegate(keyUpEvent);
-        case kCGEventFlagsChanged:
-            invokeDelegate(modifierFlagsChangedEvent);
-        case kCGEventScrollWheel:
-            invokeDelegate(scrollWheelEvent);
-        case kCGEventTabletPointer:
-            invokeDelegate(tabletPointerEvent);
-        case kCGEventTabletProximity:
-            invokeDelegate(tabletProximityEvent);
-        case kCGEventTapDisabledByTimeout:
-            invokeDelegate(eventTapDisabledByTimeoutEvent);
-        case kCGEventTapDisabledByUserInput:
-            invokeDelegate(eventTapDisabledByUserInputEvent);
-        default:
-            if ([delegate respondsToSelector:@selector(eventTap:unknownEvent:type:proxy:)]) {
-                return [delegate eventTap:tap unknownEvent:event type:type proxy:proxy];
-            }
+#pragma mark - WJHEventTap Private API
+
+@interface WJHEventTap()
+/**
+ Publish a copy of the current configuration, changed by @a change.  Changes are serialized, so concurrent changes to different parts of the configuration are not lost.  This never waits for the callback, so it is safe to call from the callback itself.
+ */
+- (void)changeConfiguration:(void (^)(WJHEventTapConfiguration *configuration))change;
+
+/**
+ The queue between the tap callback and the delegate, or NULL if the delegate is called from the tap callback.
+ */
+@property (nonatomic, assign, readonly) WJHEventRingBuffer *ringBuffer;
+
+/**
+ Signalled by the tap callback whenever it adds records to the ring buffer.
+ */
+@property (nonatomic, strong, readonly) dispatch_source_t ringBufferSource;
+
+/**
+ One histogram per dispatch table slot, or NULL if latency is not being recorded.  Values are in mach_absolute_time units.
+ */
+@property (nonatomic, assign, readonly) WJHLatencyHistogram * const *latencyHistograms;
+
+/**
+ Merges high-frequency events before they reach the delegate, or NULL if events are not coalesced.
+ */
+@property (nonatomic, assign, readonly) WJHEventCoalescer *coalescer;
+
+/**
+ The records waiting for batched delivery, or NULL if events are not batched.
+ */
+@property (nonatomic, assign, readonly) WJHEventBatch *batch;
+
+/**
+ The recording file to which every event is written, or NULL if events are not recorded.
+ */
+@property (nonatomic, assign, readonly) WJHEventRecorder *recorder;
+
+/**
+ The shared memory segment the tap publishes its counters in, or NULL if it does not publish them.  Only the tap callback writes to it.
+ */
+@property (nonatomic, assign, readonly) WJHMetricsWriter *metrics;
+
+/**
+ Decides how much work the callback sheds, or NULL if the tap has no watchdog.  Only the tap callback changes it.
+ */
+@property (nonatomic, assign, readonly) WJHWatchdog *watchdog;
+
+/**
+ Called with each change of the watchdog's level, on watchdogQueue, or from the callback if that is nil.
+ */
+@property (nonatomic, copy, readonly) void (^watchdogHandler)(WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason);
+@property (nonatomic, strong, readonly) dispatch_queue_t watchdogQueue;
+
+/**
+ Arrange for the pending coalesced run, or batch, to be delivered once the coalescing window, or batch interval, has passed.
+ */
+- (void)scheduleFlush;
+@end
+
+
+#pragma mark - WJHEventTap Class
+
+@implementation WJHEventTap {
+    WJHEventBackendTap *_systemTap;
+    CFRunLoopTimerRef _flushTimer;
+    NSTimeInterval _flushInterval;
+    BOOL _detached;
+    uint64_t _hubSubscriberID;
+    CGEventMask _initialEventMask;
+    BOOL _automaticEventMask;
+@public
+    WJHSnapshotCell *_configuration;
+    WJHEventRemapState _remapState;
+
+    // The callback reads these directly, as a message for each would cost more than the work they guard.
+    uint32_t _eventTapID;
+    WJHEventRingBuffer *_ringBuffer;
+    dispatch_source_t _ringBufferSource;
+    WJHLatencyHistogram * const *_latencyHistograms;
+    WJHEventCoalescer *_coalescer;
+    WJHEventBatch *_batch;
+    WJHEventRecorder *_recorder;
+    WJHMetricsWriter *_metrics;
+    WJHWatchdog *_watchdog;
+}
+
+/**
+ Begin using the current configuration of @a tap, which stays valid, even if it is replaced, until endReadingConfiguration.
+ */
+static inline WJHEventTapConfiguration const * beginReadingConfiguration(WJHEventTap *tap, unsigned *token) {
+    return (WJHEventTapConfiguration const *)WJHSnapshotCellReadBegin(tap->_configuration, token);
+}
+
+static inline void endReadingConfiguration(WJHEventTap *tap, unsigned token) {
+    WJHSnapshotCellReadEnd(tap->_configuration, token);
+}
+
+#pragma mark Obtain System Tap Info
+
++ (uint32_t)systemTapCount {
+    uint32_t tapCount;
+    CGGetEventTapList(0, NULL, &tapCount);
+    return tapCount;
+}
+
++ (void)enumerateSystemTapsUsingBlock:(void(^)(CGEventTapInformation const *tapInfo, BOOL *stop))block {
+    // Most systems have a handful of taps, so try to avoid the heap altogether.
+    enum { kStackCapacity = 64 };
+    CGEventTapInformation storage[kStackCapacity];
+    WJHEventTapList list;
+    WJHEventTapListInit(&list, storage, kStackCapacity);
+    WJHEventTapListRefresh(&list, NULL, NULL);
+    if (list.truncated) {
+        WJHEventTapListInit(&list, NULL, 0);
+        WJHEventTapListRefresh(&list, NULL, NULL);
+    }
+
+    BOOL stop = NO;
+    for (uint32_t i = 0; i < list.count && !stop; ++i) {
+        block(list.taps + i, &stop);
+    }
+    WJHEventTapListDestroy(&list);
+}
+
++ (NSArray *)systemTapsWithTransform:(id(^)(CGEventTapInformation const *tapInfo))block {
+    if (block == nil) {
+        block = ^id(CGEventTapInformation const *tapInfo) {
+            return [NSValue wjh_valueWithCGEventTapInformation:*tapInfo];
+        };
+    }
+
+    NSMutableArray *result = [NSMutableArray array];
+    [self enumerateSystemTapsUsingBlock:^(CGEventTapInformation const *tapInfo, BOOL *stop) {
+        id object = block(tapInfo);
+        if (object) {
+            [result addObject:object];
+        }
+    }];
+    return [result copy];
+}
+
++ (NSArray*)systemTaps {
+    return [self systemTapsWithTransform:nil];
+}
+
+
+# pragma Init/Fini
+
+- (void)setupConfiguration {
+    WJHEventTapConfiguration *configuration = calloc(1, sizeof(*configuration));
+    NSAssert(configuration != NULL, @"Can not allocate the tap configuration");
+    configuration->passive = _passive;
+    _configuration = WJHSnapshotCellCreate(&configuration->header, destroyConfiguration, NULL);
+    NSAssert(_configuration != NULL, @"Can not allocate the tap configuration");
+}
+
+- (void)setupLocation:(id)location {
+    NSAssert(_systemTap == NULL, @"Tap should not be created");
+    if ([location isKindOfClass:[NSNumber class]]) {
+        _location = (CGEventTapLocation)[location unsignedIntegerValue];
+        if (_location == kWJHProcessEventTap) {
+            _processSerialNumber = currentPSN();
+        } else {
+            memset(&_processSerialNumber, 0, sizeof(_processSerialNumber));
+        }
+    } else {
+        _location = kWJHProcessEventTap;
+        _processSerialNumber = *(ProcessSerialNumber*)[location pointerValue];
+    }
+}
+
+/**
+ Initialize everything except the system tap itself, which is created, and identified, by the backend.
+ */
+- (instancetype)initUndiscoveredWithGenericLocation:(id)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive runLoop:(NSRunLoop *)runLoop thread:(WJHEventTapThread *)thread delegate:(id<WJHEventTapDelegate>)delegate {
+    if (self = [super init]) {
+        _initialEventMask = eventMask;
+        _requestedEventMask = eventMask;
+        _thread = thread;
+        _runLoop = thread ? thread.runLoop : (runLoop ?: [NSRunLoop currentRunLoop]);
+        _beforeOthers = beforeOthers;
+        _passive = passive;
+        [self setupConfiguration];
+        self.delegate = delegate;
+        [self setupLocation:location];
+    }
+    return self;
+}
+
+/**
+ The options of the system tap, whose events go to eventTapCallback.
+ */
+- (WJHCGEventBackendOptions)systemTapOptions {
+    WJHCGEventBackendOptions options = {
+        .location = _location,
+        .beforeOthers = _beforeOthers,
+        .runLoop = [_runLoop getCFRunLoop],
+        .process = _location == kWJHProcessEventTap ? &_processSerialNumber : NULL,
+        .eventCallback = eventTapCallback,
+        .tapListProvider = tapListProvider,
+        .tapListProviderContext = tapListProviderContext,
+    };
+    return options;
+}
+
+/**
+ Create a system tap for @a eventMask, which starts out disabled.
+
+ @return the new tap, or NULL if it could not be created, or identified, in which case there is no tap.
+ */
+- (WJHEventBackendTap *)createSystemTapWithEventMask:(CGEventMask)eventMask {
+    WJHCGEventBackendOptions options = [self systemTapOptions];
+    WJHEventBackendTap *systemTap = systemTapBackend->create(&options, eventMask, _passive, NULL, (__bridge void *)self);
+    CGEventTapInformation info;
+    if (systemTap && !WJHCGEventBackendGetTapInformation(systemTap, &info)) {
+        // Without its eventTapID, there is no telling the tap apart from the others in the system tap list.
+        systemTapBackend->destroy(systemTap);
+        systemTap = NULL;
+    }
+    return systemTap;
+}
+
+/**
+ Make @a systemTap, which must have been identified, the system tap.
+ */
+- (void)attachSystemTap:(WJHEventBackendTap *)systemTap {
+    CGEventTapInformation info;
+    BOOL identified = WJHCGEventBackendGetTapInformation(systemTap, &info);
+    NSAssert(identified, @"BUG: Should have already bailed");
+    (void)identified;
+    _systemTap = systemTap;
+    _eventTapID = info.eventTapID;
+    _eventMask = info.eventsOfInterest;
+    if (_metrics) {
+        WJHMetricsWriterSetEventTapID(_metrics, _eventTapID);
+    }
+}
+
+- (instancetype)initWithGenericLocation:(id)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive runLoop:(NSRunLoop *)runLoop thread:(WJHEventTapThread *)thread delegate:(id<WJHEventTapDelegate>)delegate {
+    if (self = [self initUndiscoveredWithGenericLocation:location eventMask:eventMask beforeOthers:beforeOthers passive:passive runLoop:runLoop thread:thread delegate:delegate]) {
+        WJHEventBackendTap *systemTap = [self createSystemTapWithEventMask:eventMask];
+        if (systemTap == NULL) {
+            return self = nil;
+        }
+        [self attachSystemTap:systemTap];
+    }
+    return self;
+}
+
+- (instancetype)initWithLocation:(CGEventTapLocation)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive runLoop:(NSRunLoop *)runLoop delegate:(id<WJHEventTapDelegate>)delegate {
+    NSNumber *locNum = [NSNumber numberWithUnsignedInteger:(NSUInteger)location];
+    return [self initWithGenericLocation:locNum eventMask:eventMask beforeOthers:beforeOthers passive:passive runLoop:runLoop thread:nil delegate:delegate];
+}
+
+- (instancetype)initWithLocation:(CGEventTapLocation)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive thread:(WJHEventTapThread *)thread delegate:(id<WJHEventTapDelegate>)delegate {
+    NSNumber *locNum = [NSNumber numberWithUnsignedInteger:(NSUInteger)location];
+    return [self initWithGenericLocation:locNum eventMask:eventMask beforeOthers:beforeOthers passive:passive runLoop:nil thread:(thread ?: [WJHEventTapThread new]) delegate:delegate];
+}
+
+- (instancetype)initWithProcess:(ProcessSerialNumber *)process eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive runLoop:(NSRunLoop *)runLoop delegate:(id<WJHEventTapDelegate>)delegate {
+    ProcessSerialNumber psn;
+    if (process) {
+        psn = *process;
+    } else {
+        psn = currentPSN();
+    }
+    return [self initWithGenericLocation:[NSValue valueWithPointer:&psn] eventMask:eventMask beforeOthers:beforeOthers passive:passive runLoop:runLoop thread:nil delegate:delegate];
+}
+
+- (instancetype)initWithProcess:(ProcessSerialNumber *)process eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive thread:(WJHEventTapThread *)thread delegate:(id<WJHEventTapDelegate>)delegate {
+    ProcessSerialNumber psn;
+    if (process) {
+        psn = *process;
+    } else {
+        psn = currentPSN();
+    }
+    return [self initWithGenericLocation:[NSValue valueWithPointer:&psn] eventMask:eventMask beforeOthers:beforeOthers passive:passive runLoop:nil thread:(thread ?: [WJHEventTapThread new]) delegate:delegate];
+}
+
+- (instancetype)initDetachedWithEventMask:(CGEventMask)eventMask passive:(BOOL)passive delegate:(id<WJHEventTapDelegate>)delegate {
+    return [self initDetachedWithLocation:kCGSessionEventTap eventMask:eventMask beforeOthers:NO passive:passive thread:nil delegate:delegate];
+}
+
+- (instancetype)initDetachedWithLocation:(CGEventTapLocation)location eventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers passive:(BOOL)passive thread:(WJHEventTapThread *)thread delegate:(id<WJHEventTapDelegate>)delegate {
+    if (self = [super init]) {
+        _initialEventMask = eventMask;
+        _requestedEventMask = eventMask;
+        _eventMask = eventMask;
+        _beforeOthers = beforeOthers;
+        _passive = passive;
+        _location = location;
+        _thread = thread;
+        _runLoop = thread.runLoop;
+        _detached = YES;
+        [self setupConfiguration];
+        self.delegate = delegate;
+    }
+    return self;
+}
+
+- (uint64_t)hubSubscriberID {
+    return _hubSubscriberID;
+}
+
+- (void)setHubSubscriberID:(uint64_t)hubSubscriberID {
+    _hubSubscriberID = hubSubscriberID;
+}
+
+- (void)dealloc {
+    if (_ringBuffer) {
+        // A blocked callback must not wait on a consumer that is going away.
+        WJHEventRingBufferClose(_ringBuffer);
+    }
+    if (_thread && _systemTap) {
+        // Destroy the system tap on the tap thread, so the callback can not be running while the rest of the object is torn down.
+        WJHEventBackendTap *systemTap = _systemTap;
+        CFRunLoopTimerRef flushTimer = _flushTimer;
+        [_thread performBlockAndWait:^{
+            systemTapBackend->destroy(systemTap);
+            if (flushTimer) {
+                CFRunLoopTimerInvalidate(flushTimer);
+            }
+        }];
+        _systemTap = NULL;
+    }
+    if (_flushTimer) {
+        CFRunLoopTimerInvalidate(_flushTimer);
+        CFRelease(_flushTimer);
+        _flushTimer = NULL;
+    }
+    if (_coalescer) {
+        free(_coalescer);
+        _coalescer = NULL;
+    }
+    if (_batch) {
+        free(_batch);
+        _batch = NULL;
+    }
+    if (_recorder) {
+        WJHEventRecorderDestroy(_recorder);
+        _recorder = NULL;
+    }
+    if (_metrics) {
+        WJHMetricsWriterDestroy(_metrics);
+        _metrics = NULL;
+    }
+    if (_watchdog) {
+        WJHWatchdogDestroy(_watchdog);
+        _watchdog = NULL;
+    }
+    if (_systemTap) {
+        systemTapBackend->destroy(_systemTap);
+        _systemTap = NULL;
+    }
+    if (_ringBufferSource) {
+        // The cancel handler runs once any in-flight drain has finished, and releases the buffer.
+        dispatch_source_cancel(_ringBufferSource);
+        _ringBufferSource = nil;
+        _ringBuffer = NULL;
+    }
+    if (_latencyHistograms) {
+        for (unsigned slot = 0; slot < kWJHDispatchSlotCount; ++slot) {
+            WJHLatencyHistogramDestroy(_latencyHistograms[slot]);
+        }
+        free((void *)_latencyHistograms);
+        _latencyHistograms = NULL;
+    }
+    // Nothing can be reading the configuration any longer.
+    WJHSnapshotCellDestroy(_configuration);
+    _configuration = NULL;
+}
+
+#pragma mark Bulk Creation
+
++ (NSArray*)tapsWithSpecifications:(NSArray*)specifications runLoop:(NSRunLoop *)runLoop thread:(WJHEventTapThread *)thread {
+    NSUInteger count = specifications.count;
+    if (count == 0) {
+        return @[];
+    }
+
+    NSMutableArray *taps = [NSMutableArray arrayWithCapacity:count];
+    WJHCGEventBackendRequest *requests = calloc(count, sizeof(*requests));
+    WJHEventBackendTap **systemTaps = calloc(count, sizeof(*systemTaps));
+    if (requests == NULL || systemTaps == NULL) {
+        free(requests);
+        free(systemTaps);
+        return nil;
+    }
+
+    for (WJHEventTapSpecification *specification in specifications) {
+        ProcessSerialNumber psn = specification.processSerialNumber;
+        id location = specification.location == kWJHProcessEventTap ? [NSValue valueWithPointer:&psn] : @(specification.location);
+        WJHEventTap *tap = [[self alloc] initUndiscoveredWithGenericLocation:location eventMask:specification.eventMask beforeOthers:specification.beforeOthers passive:specification.passive runLoop:runLoop thread:thread delegate:specification.delegate];
+        requests[taps.count] = (WJHCGEventBackendRequest){ [tap systemTapOptions], specification.eventMask, specification.passive, NULL, (__bridge void *)tap };
+        [taps addObject:tap];
+    }
+
+    // All the taps are identified from one comparison of the system tap list, instead of one for each.
+    BOOL created = WJHCGEventBackendCreateTaps(requests, count, systemTaps);
+    if (created) {
+        for (NSUInteger i = 0; i < count; ++i) {
+            [taps[i] attachSystemTap:systemTaps[i]];
+        }
+    }
+    free(requests);
+    free(systemTaps);
+    return created ? [taps copy] : nil;
+}
+
++ (NSArray*)tapsWithSpecifications:(NSArray*)specifications runLoop:(NSRunLoop *)runLoop {
+    return [self tapsWithSpecifications:specifications runLoop:runLoop thread:nil];
+}
+
++ (NSArray*)tapsWithSpecifications:(NSArray*)specifications thread:(WJHEventTapThread *)thread {
+    return [self tapsWithSpecifications:specifications runLoop:nil thread:(thread ?: [WJHEventTapThread new])];
+}
+
+#pragma mark Delegate
+
+- (id<WJHEventTapDelegate>)delegate {
+    unsigned token;
+    WJHEventTapConfiguration const *configuration = beginReadingConfiguration(self, &token);
+    id<WJHEventTapDelegate> delegate = configuration->dispatchTable ? configuration->dispatchTable->_delegate : nil;
+    endReadingConfiguration(self, token);
+    return delegate;
+}
+
+- (void)setDelegate:(id<WJHEventTapDelegate>)delegate {
+    WJHEventTapDispatchTable *table = [[WJHEventTapDispatchTable alloc] initWithDelegate:delegate];
+    [self changeConfiguration:^(WJHEventTapConfiguration *configuration) {
+        configuration->dispatchTable = table;
+    }];
+    if (self.automaticEventMask) {
+        [self updateEventMask];
+    }
+}
+
+#pragma mark Configuration
+
+- (void)changeConfiguration:(void (^)(WJHEventTapConfiguration *configuration))change {
+    BOOL changed = WJHSnapshotCellUpdate(_configuration, applyConfigurationChange, (__bridge void *)change);
+    NSAssert(changed, @"Can not allocate the tap configuration");
+    (void)changed;
+}
+
+- (WJHEventFilter *)filter {
+    unsigned token;
+    WJHEventFilter *filter = beginReadingConfiguration(self, &token)->filter;
+    endReadingConfiguration(self, token);
+    return filter;
+}
+
+- (void)setFilter:(WJHEventFilter *)filter {
+    [self changeConfiguration:^(WJHEventTapConfiguration *configuration) {
+        configuration->filter = filter;
+    }];
+    if (self.automaticEventMask) {
+        [self updateEventMask];
+    }
+}
+
+- (WJHHotkeys *)hotkeys {
+    unsigned token;
+    WJHHotkeys *hotkeys = beginReadingConfiguration(self, &token)->hotkeys;
+    endReadingConfiguration(self, token);
+    return hotkeys;
+}
+
+- (void)setHotkeys:(WJHHotkeys *)hotkeys {
+    [self changeConfiguration:^(WJHEventTapConfiguration *configuration) {
+        configuration->hotkeys = hotkeys;
+    }];
+    if (self.automaticEventMask) {
+        [self updateEventMask];
+    }
+}
+
+- (WJHEventRemap *)remap {
+    unsigned token;
+    WJHEventRemap *remap = beginReadingConfiguration(self, &token)->remap;
+    endReadingConfiguration(self, token);
+    return remap;
+}
+
+- (void)setRemap:(WJHEventRemap *)remap {
+    [self changeConfiguration:^(WJHEventTapConfiguration *configuration) {
+        configuration->remap = remap;
+    }];
+    if (self.automaticEventMask) {
+        [self updateEventMask];
+    }
+}
+
+#pragma mark Event Mask
+
+- (BOOL)automaticEventMask {
+    return _automaticEventMask;
+}
+
+- (void)setAutomaticEventMask:(BOOL)automaticEventMask {
+    _automaticEventMask = automaticEventMask;
+    [self updateEventMask];
+}
+
+- (CGEventMask)eventMaskForDelegate:(id<WJHEventTapDelegate>)delegate {
+    if (delegate == nil) {
+        return 0;
+    }
+    if ([delegate respondsToSelector:@selector(eventMaskForEventTap:)]) {
+        return [delegate eventMaskForEventTap:self];
+    }
+    if ([delegate respondsToSelector:@selector(eventTap:receivedEvent:type:proxy:)] || (_batch && [delegate respondsToSelector:@selector(eventTap:receivedRecords:count:)])) {
+        return kCGEventMaskForAllEvents;
+    }
+
+    BOOL const unknown = [delegate respondsToSelector:@selector(eventTap:unknownEvent:type:proxy:)];
+    BOOL const coalesced = _coalescer && [delegate respondsToSelector:@selector(eventTap:coalescedEvent:)];
+    CGEventMask mask = 0;
+    for (CGEventType type = 0; type < 64; ++type) {
+        SEL selector = selectorForEventType(type);
+        if ((selector ? [delegate respondsToSelector:selector] : unknown) || (coalesced && WJHEventCoalescerCanMerge(type))) {
+            mask |= CGEventMaskBit(type);
+        }
+    }
+    return mask;
+}
+
+- (CGEventMask)minimalEventMask {
+    unsigned token;
+    WJHEventTapConfiguration const *configuration = beginReadingConfiguration(self, &token);
+    CGEventMask mask = configuration->dispatchTable ? [self eventMaskForDelegate:configuration->dispatchTable->_delegate] : 0;
+    mask |= configuration->eventHandlerMask;
+    if (configuration->filter) {
+        mask &= WJHEventFilterProgramTypeMask(configuration->filter.program);
+    }
+    if (configuration->hotkeys) {
+        mask |= CGEventMaskBit(kCGEventKeyDown) | CGEventMaskBit(kCGEventKeyUp);
+    }
+    if (configuration->remap && !configuration->passive) {
+        mask |= WJHEventRemapTableTypeMask(configuration->remap.table);
+    }
+    if (_recorder) {
+        mask = kCGEventMaskForAllEvents;
+    }
+    endReadingConfiguration(self, token);
+    return mask & _initialEventMask;
+}
+
+- (BOOL)updateEventMask {
+    __block BOOL updated;
+    void (^update)(void) = ^{
+        updated = [self applyEventMask:self.automaticEventMask ? self.minimalEventMask : self->_initialEventMask];
+    };
+    // Every change of the system tap happens on the tap thread, which also keeps concurrent updates in order.
+    if (_thread) {
+        [_thread performBlockAndWait:update];
+    } else {
+        update();
+    }
+    return updated;
+}
+
+/**
+ Make @a eventMask the mask of the tap, replacing the system tap if it has one.
+ */
+- (BOOL)applyEventMask:(CGEventMask)eventMask {
+    if (eventMask == 0) {
+        // A tap for no events is of no use, and the system may refuse to create one, so settle for null events, which are rare.
+        eventMask = CGEventMaskBit(kCGEventNull);
+    }
+    if (eventMask == _requestedEventMask) {
+        return YES;
+    }
+    if (_detached) {
+        _requestedEventMask = eventMask;
+        _eventMask = eventMask;
+        return YES;
+    }
+
+    // The old tap stays in place until the new one is known to work, and goes on handling events while the new one passes over its startup events.
+    NSAssert(_systemTap != NULL, @"Tap has disappeared");
+    WJHEventBackendTap *systemTap = [self createSystemTapWithEventMask:eventMask];
+    if (systemTap == NULL) {
+        return NO;
+    }
+
+    BOOL const enabled = systemTapBackend->isEnabled(_systemTap);
+    systemTapBackend->destroy(_systemTap);
+    _requestedEventMask = eventMask;
+    [self attachSystemTap:systemTap];
+    if (enabled) {
+        systemTapBackend->setEnabled(_systemTap, true);
+    }
+    return YES;
+}
+
+#pragma mark Asynchronous Delivery
+
+- (BOOL)deliversAsynchronously {
+    return _ringBuffer != NULL;
+}
+
+- (WJHEventRingBufferStatistics)asynchronousDeliveryStatistics {
+    if (_ringBuffer) {
+        return WJHEventRingBufferGetStatistics(_ringBuffer);
+    }
+    WJHEventRingBufferStatistics result;
+    memset(&result, 0, sizeof(result));
+    return result;
+}
+
+- (BOOL)enableAsynchronousDeliveryWithCapacity:(uint32_t)capacity overflowPolicy:(WJHEventRingBufferPolicy)policy queue:(dispatch_queue_t)queue {
+    NSAssert(!self.isEnabled, @"Asynchronous delivery must be configured before the tap is enabled");
+    if (!self.passive || _ringBuffer || _coalescer || _batch) {
+        return NO;
+    }
+
+    WJHEventRingBuffer *ringBuffer = WJHEventRingBufferCreate(capacity, policy);
+    if (ringBuffer == NULL) {
+        return NO;
+    }
+
+    if (queue == nil) {
+        queue = dispatch_queue_create("com.thinksolutions.WJHEventTap.delivery", DISPATCH_QUEUE_SERIAL);
+    }
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, queue);
+    __weak WJHEventTap *weakSelf = self;
+    dispatch_source_set_event_handler(source, ^{
+        [weakSelf drainRingBuffer];
+    });
+    dispatch_source_set_cancel_handler(source, ^{
+        WJHEventRingBufferDestroy(ringBuffer);
+    });
+
+    _ringBuffer = ringBuffer;
+    _ringBufferSource = source;
+    dispatch_resume(source);
+    return YES;
+}
+
+- (void)drainRingBuffer {
+    enum { kBatchSize = 64 };
+    WJHEventRecord records[kBatchSize];
+    size_t count;
+    while ((count = WJHEventRingBufferPop(_ringBuffer, records, kBatchSize)) > 0) {
+        WJHEventTapDispatchRecords(self, records, count);
+    }
+}
+
+#pragma mark Flush Timer
+
+static void flushTimerFired(CFRunLoopTimerRef timer, void *info) {
+    WJHEventTap *tap = (__bridge WJHEventTap *)info;
+    WJHEventTapFlushCoalescedEvents(tap);
+    WJHEventTapFlushBatchedEvents(tap);
+}
+
+/**
+ Add a timer that delivers a pending coalesced run, or batch, that is not completed by another event.
+
+ The timer only fires once something is pending, and it runs on the same thread as the tap callback, so pending events are never touched from two threads.  Detached taps have no run loop, and no timer.
+ */
+- (void)addFlushTimerWithInterval:(NSTimeInterval)interval {
+    _flushInterval = interval;
+    if (_runLoop) {
+        CFRunLoopTimerContext context = { .info = (__bridge void *)self };
+        _flushTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, DBL_MAX, DBL_MAX, 0, 0, flushTimerFired, &context);
+        CFRunLoopAddTimer([_runLoop getCFRunLoop], _flushTimer, kCFRunLoopCommonModes);
+    }
+}
+
+- (void)scheduleFlush {
+    if (_flushTimer) {
+        CFRunLoopTimerSetNextFireDate(_flushTimer, CFAbsoluteTimeGetCurrent() + _flushInterval);
+    }
+}
+
+#pragma mark Coalescing
+
+- (BOOL)coalescesEvents {
+    return _coalescer != NULL;
+}
+
+- (BOOL)enableCoalescingWithWindow:(NSTimeInterval)window {
+    NSAssert(!self.isEnabled, @"Coalescing must be enabled before the tap is enabled");
+    if (!self.passive || _ringBuffer || _coalescer || _batch || window <= 0) {
+        return NO;
+    }
+
+    WJHEventCoalescer *coalescer = malloc(sizeof(*coalescer));
+    if (coalescer == NULL) {
+        return NO;
+    }
+    WJHEventCoalescerInit(coalescer, (uint64_t)(window * NSEC_PER_SEC), deliverCoalescedEvent, (__bridge void *)self);
+    [self addFlushTimerWithInterval:window];
+    _coalescer = coalescer;
+    return YES;
+}
+
+#pragma mark Batching
+
+- (BOOL)deliversBatches {
+    return _batch != NULL;
+}
+
+- (BOOL)enableBatchedDeliveryWithBatchSize:(uint32_t)batchSize interval:(NSTimeInterval)interval {
+    NSAssert(!self.isEnabled, @"Batched delivery must be enabled before the tap is enabled");
+    if (!self.passive || _ringBuffer || _coalescer || _batch || batchSize == 0 || interval <= 0) {
+        return NO;
+    }
+
+    WJHEventBatch *batch = malloc(sizeof(*batch) + batchSize * sizeof(WJHEventRecord));
+    if (batch == NULL) {
+        return NO;
+    }
+    batch->count = 0;
+    batch->capacity = batchSize;
+    [self addFlushTimerWithInterval:interval];
+    _batch = batch;
+    return YES;
+}
+
+#pragma mark Recording
+
+- (BOOL)recordsEvents {
+    return _recorder != NULL;
+}
+
+- (uint64_t)recordedEventCount {
+    return _recorder ? WJHEventRecorderCount(_recorder) : 0;
+}
+
+- (uint64_t)droppedRecordingEventCount {
+    return _recorder ? WJHEventRecorderDropped(_recorder) : 0;
+}
+
+- (BOOL)enableRecordingToPath:(NSString *)path capacity:(uint32_t)capacity {
+    NSAssert(!self.isEnabled, @"Recording must be enabled before the tap is enabled");
+    if (_recorder) {
+        return NO;
+    }
+    _recorder = WJHEventRecorderCreate(path.fileSystemRepresentation, capacity);
+    return _recorder != NULL;
+}
+
+static bool replayRecord(void *context, WJHEventRecord const *record) {
+    WJHEventTapDispatchRecords((__bridge WJHEventTap *)context, record, 1);
+    return true;
+}
+
++ (BOOL)replayRecordingAtPath:(NSString *)path delegate:(id<WJHEventTapDelegate>)delegate timing:(WJHEventReplayTiming)timing {
+    WJHEventReplay *replay = WJHEventReplayOpen(path.fileSystemRepresentation);
+    if (replay == NULL) {
+        return NO;
+    }
+
+    WJHEventTap *tap = [[self alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    if (timing == WJHEventReplayOriginalTiming) {
+        WJHEventReplayRun(replay, timing, replayRecord, (__bridge void *)tap);
+    } else {
+        // Straight from the mapped file, in chunks, so autoreleased objects do not pile up.
+        enum { kChunkSize = 1024 };
+        WJHEventRecord const *records = WJHEventReplayRecords(replay);
+        uint64_t count = WJHEventReplayCount(replay);
+        for (uint64_t i = 0; i < count; i += kChunkSize) {
+            WJHEventTapDispatchRecords(tap, records + i, (size_t)MIN(count - i, (uint64_t)kChunkSize));
+        }
+    }
+    WJHEventReplayClose(replay);
+    return YES;
+}
+
+#pragma mark Metrics
+
+- (BOOL)publishesMetrics {
+    return _metrics != NULL;
+}
+
+- (BOOL)enableMetricsWithName:(NSString *)name {
+    NSAssert(!self.isEnabled, @"Metrics must be enabled before the tap is enabled");
+    if (_metrics) {
+        return NO;
+    }
+    _metrics = WJHMetricsWriterCreate(name.fileSystemRepresentation, _eventTapID);
+    return _metrics != NULL;
+}
+
+#pragma mark Watchdog
+
+- (BOOL)hasWatchdog {
+    return _watchdog != NULL;
+}
+
+- (WJHWatchdogLevel)watchdogLevel {
+    return _watchdog ? WJHWatchdogGetLevel(_watchdog) : WJHWatchdogLevelNormal;
+}
+
+- (WJHWatchdogStatistics)watchdogStatistics {
+    WJHWatchdogStatistics statistics;
+    memset(&statistics, 0, sizeof(statistics));
+    return _watchdog ? WJHWatchdogGetStatistics(_watchdog) : statistics;
+}
+
+static void watchdogLevelChanged(void *context, WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason, uint64_t now) {
+    // The watchdog belongs to the tap, so the tap outlives every call.
+    WJHEventTap *tap = (__bridge WJHEventTap *)context;
+    void (^handler)(WJHWatchdogLevel, WJHWatchdogLevel, WJHWatchdogReason) = tap.watchdogHandler;
+    if (handler == nil) {
+        return;
+    }
+    dispatch_queue_t queue = tap.watchdogQueue;
+    if (queue) {
+        dispatch_async(queue, ^{
+            handler(from, to, reason);
+        });
+    } else {
+        handler(from, to, reason);
+    }
+}
+
+- (BOOL)enableWatchdogWithPolicy:(WJHWatchdogPolicy const *)policy queue:(dispatch_queue_t)queue handler:(void(^)(WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason))handler {
+    NSAssert(!self.isEnabled, @"The watchdog must be enabled before the tap is enabled");
+    if (_watchdog) {
+        return NO;
+    }
+    WJHWatchdogPolicy defaultPolicy = WJHWatchdogDefaultPolicy();
+    _watchdog = WJHWatchdogCreate(policy ? policy : &defaultPolicy, watchdogLevelChanged, (__bridge void *)self);
+    if (_watchdog == NULL) {
+        return NO;
+    }
+    _watchdogHandler = [handler copy];
+    _watchdogQueue = queue;
+    return YES;
+}
+
+#pragma mark Latency
+
+- (BOOL)recordsLatency {
+    return _latencyHistograms != NULL;
+}
+
+- (BOOL)enableLatencyRecording {
+    NSAssert(!self.isEnabled, @"Latency recording must be enabled before the tap is enabled");
+    if (_latencyHistograms) {
+        return NO;
+    }
+
+    WJHLatencyHistogram **histograms = calloc(kWJHDispatchSlotCount, sizeof(*histograms));
+    if (histograms == NULL) {
+        return NO;
+    }
+    for (unsigned slot = 0; slot < kWJHDispatchSlotCount; ++slot) {
+        if ((histograms[slot] = WJHLatencyHistogramCreate()) == NULL) {
+            for (unsigned i = 0; i < slot; ++i) {
+                WJHLatencyHistogramDestroy(histograms[i]);
+            }
+            free(histograms);
+            return NO;
+        }
+    }
+    _latencyHistograms = histograms;
+    return YES;
+}
+
+- (WJHLatencyHistogramSnapshot)latencySnapshotForEventType:(CGEventType)type {
+    WJHLatencyHistogramSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    if (_latencyHistograms == NULL) {
+        return snapshot;
+    }
+
+    WJHLatencyHistogramGetSnapshot(_latencyHistograms[dispatchSlot(type)], &snapshot);
+    snapshot.mean = machNanoseconds(snapshot.mean);
+    snapshot.p50 = machNanoseconds(snapshot.p50);
+    snapshot.p99 = machNanoseconds(snapshot.p99);
+    snapshot.p999 = machNanoseconds(snapshot.p999);
+    snapshot.max = machNanoseconds(snapshot.max);
+    return snapshot;
+}
+
+#pragma mark Is Enabled
+
+- (BOOL)isEnabled {
+    if (_detached) {
+        unsigned token;
+        BOOL enabled = beginReadingConfiguration(self, &token)->enabled;
+        endReadingConfiguration(self, token);
+        return enabled;
+    }
+    return _systemTap ? systemTapBackend->isEnabled(_systemTap) : NO;
+}
+
+- (void)setEnabled:(BOOL)enabled {
+    enabled = !!enabled;
+    if (!_detached) {
+        NSAssert(_systemTap != NULL, @"Tap has disappeared");
+        BOOL current = !!self.isEnabled;
+        if (current != enabled) {
+            systemTapBackend->setEnabled(_systemTap, enabled);
+        }
+    }
+    // There is no system tap to enable for a detached tap, so the configuration is all there is.
+    [self changeConfiguration:^(WJHEventTapConfiguration *configuration) {
+        configuration->enabled = enabled;
+    }];
+}
+
+@end
+
+
+
+
+#pragma mark - Implementation Details
+
+static ProcessSerialNumber currentPSN() {
+    // Argh.  GetCurrentProcess() is deprecated in favor of [NSRunningApplication currentApplication].  However, it provides no API to get the ProcessSerialNumber, which is required to create an application tap.  Hopefully, this gets fixed in a future release, where we either gain access to ProcessSerialNumber, or we get another API to install process taps.
+    ProcessSerialNumber psn;
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    GetCurrentProcess(&psn);
+#pragma clang diagnostic pop
+    return psn;
+}
+
+/**
+ Handle one event, with the configuration the callback read for it, shedding the work the watchdog @a level calls for.
+ */
+static CGEventRef handleEvent(__unsafe_unretained WJHEventTap *tap, WJHEventTapConfiguration const *configuration, WJHWatchdogLevel level, CGEventTapProxy proxy, CGEventType type, CGEventRef event) {
+    if (type == kCGEventTapDisabledByTimeout || type == kCGEventTapDisabledByUserInput) {
+        // Only the system knows whether it has since been re-enabled, so ask it, on this rare path.
+        if (tap.isEnabled) {
+            // The "Disable" event was enqueued, but the tap has since been re-enabled, so ignore the event.
+            return event;
+        }
+        WJHWatchdog *watchdog = tap->_watchdog;
+        if (watchdog && type == kCGEventTapDisabledByTimeout) {
+            // Input goes unseen for as long as the tap is off, so turn it straight back on, and shed load so it is not timed out again.
+            tap.enabled = YES;
+            WJHWatchdogRecordTimeout(watchdog, machNanoseconds(mach_absolute_time()));
+        } else {
+            tap.enabled = NO;
+        }
+        WJHMetricsWriter *metrics = tap->_metrics;
+        if (metrics) {
+            WJHMetricsWriterRecordDisable(metrics, type == kCGEventTapDisabledByTimeout);
+        }
+    }
+
+    if (configuration->remap && !configuration->passive) {
+        type = remapTableApplyToEvent(configuration->remap->_table, event, type, &tap->_remapState);
+    }
+
+    if (type == kCGEventKeyDown || type == kCGEventKeyUp) {
+        __unsafe_unretained WJHHotkeys *hotkeys = configuration->hotkeys;
+        if (hotkeys && hotkeysHandleEvent(hotkeys->_matcher, hotkeys->_handler, event, type) && !configuration->passive) {
+            return NULL;
+        }
+    }
+
+    WJHEventRecorder *recorder = tap->_recorder;
+    if (recorder && level < WJHWatchdogLevelSkipOptional) {
+        WJHEventRecord record;
+        WJHEventRecordFill(&record, event, type, tap->_eventTapID);
+        WJHEventRecorderAppend(recorder, &record);
+    }
+
+    // The filter only decides what reaches the delegate, so it never gets in the way of the remap, the hotkeys, or recording.
+    if (configuration->filter && !filterProgramMatchesEvent(configuration->filter->_program, event, type)) {
+        return event;
+    }
+
+    if (configuration->eventHandler) {
+        event = configuration->eventHandler(configuration->eventHandlerContext, proxy, type, event);
+        if (event == NULL) {
+            return NULL;
+        }
+    }
+
+    WJHEventRingBuffer *ringBuffer = tap->_ringBuffer;
+    if (ringBuffer) {
+        WJHEventRecord record;
+        WJHEventRecordFill(&record, event, type, tap->_eventTapID);
+        if (WJHEventRingBufferPush(ringBuffer, &record)) {
+            dispatch_source_merge_data(tap->_ringBufferSource, 1);
+        }
+        return event;
+    }
+
+    WJHEventBatch *batch = tap->_batch;
+    if (batch) {
+        if (dispatchSlot(type) < kWJHDispatchSlotDisabledByTimeout) {
+            WJHEventRecordFill(batch->records + batch->count, event, type, tap->_eventTapID);
+            if (++batch->count == batch->capacity) {
+                WJHEventTapFlushBatchedEvents(tap);
+            } else if (batch->count == 1) {
+                [tap scheduleFlush];
+            }
+            return event;
+        }
+        // Tap notifications go to their own delegate methods, after everything that came before them.
+        WJHEventTapFlushBatchedEvents(tap);
+    }
+
+    WJHEventCoalescer *coalescer = tap->_coalescer;
+    if (coalescer) {
+        WJHEventRecord record;
+        WJHEventRecordFill(&record, event, type, tap->_eventTapID);
+        switch (WJHEventCoalescerAdd(coalescer, &record)) {
+            case WJHEventCoalescerStarted:
+                [tap scheduleFlush];
+                return event;
+            case WJHEventCoalescerMerged:
+                return event;
+            case WJHEventCoalescerPassed:
+                // Any pending run has been delivered, so this event is handled in order.
+                break;
+        }
+    }
+
+    if (level >= WJHWatchdogLevelSkipOptional) {
+        return dispatchToDelegate(tap, configuration->dispatchTable, proxy, type, event);
+    }
+    return timedDispatchToDelegate(tap, configuration->dispatchTable, proxy, type, event);
+}
+
+/**
+ Count an event the callback has finished with.  Tap notifications are not events; the disables among them were counted when they were handled.
+ */
+static void recordMetrics(WJHEventTap *tap, WJHMetricsWriter *metrics, CGEventType type, CGEventRef event, CGEventRef result, uint64_t start) {
+    if (type == kCGEventTapDisabledByTimeout || type == kCGEventTapDisabledByUserInput) {
+        return;
+    }
+    WJHMetricsOutcome outcome = result == event ? WJHMetricsPassed : (result ? WJHMetricsModified : WJHMetricsDropped);
+    uint64_t nanoseconds = machNanoseconds(mach_absolute_time() - start);
+    WJHMetricsWriterRecordEvent(metrics, type, outcome, nanoseconds);
+
+    WJHEventRingBuffer *ringBuffer = tap->_ringBuffer;
+    if (ringBuffer) {
+        WJHMetricsWriterSetRingBufferOverflows(metrics, WJHEventRingBufferGetStatistics(ringBuffer).overflows);
+    }
+}
+
+static bool isMotionEvent(CGEventType type) {
+    switch (type) {
+        case kCGEventMouseMoved:
+        case kCGEventLeftMouseDragged:
+        case kCGEventRightMouseDragged:
+        case kCGEventOtherMouseDragged:
+        case kCGEventScrollWheel:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ Everything the callback does with an event, given the configuration it read for it.
+ */
+static CGEventRef processEvent(__unsafe_unretained WJHEventTap *tap, WJHEventTapConfiguration const *configuration, CGEventTapProxy proxy, CGEventType type, CGEventRef event) {
+    WJHMetricsWriter *metrics = tap->_metrics;
+    WJHWatchdog *watchdog = tap->_watchdog;
+    uint64_t start = metrics || watchdog ? mach_absolute_time() : 0;
+
+    // Tap notifications are neither shed nor timed, as they are rare, and must reach the delegate.
+    bool watched = watchdog && type != kCGEventTapDisabledByTimeout && type != kCGEventTapDisabledByUserInput;
+    WJHWatchdogLevel level = WJHWatchdogLevelNormal;
+    CGEventRef result = event;
+    if (watched) {
+        level = WJHWatchdogBeginEvent(watchdog, machNanoseconds(start));
+    }
+    if (level == WJHWatchdogLevelPassThrough || (level >= WJHWatchdogLevelShedMotion && isMotionEvent(type))) {
+        // Shed events cost next to nothing, and say nothing about how long handling one takes, so they are not timed.
+        watched = false;
+    } else {
+        result = handleEvent(tap, configuration, level, proxy, type, event);
+    }
+
+    if (watched) {
+        uint64_t end = mach_absolute_time();
+        WJHWatchdogRecordCall(watchdog, machNanoseconds(end), machNanoseconds(end - start));
+    }
+    if (metrics) {
+        recordMetrics(tap, metrics, type, event, result, start);
+    }
+    return result;
+}
+
+static CGEventRef eventTapCallback(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *userData) {
+    // The tap owns the system tap, so it outlives every callback, and need not be retained for one.
+    __unsafe_unretained WJHEventTap *tap = (__bridge WJHEventTap *)(userData);
+
+    // One read of the configuration covers the whole event, so a concurrent reconfiguration can neither stall it, nor split it between two configurations.
+    unsigned token;
+    WJHEventTapConfiguration const *configuration = beginReadingConfiguration(tap, &token);
+    CGEventRef result = processEvent(tap, configuration, proxy, type, event);
+    endReadingConfiguration(tap, token);
+    return result;
+}
+
+static void deliverCoalescedEvent(void *context, WJHCoalescedEvent const *coalesced) {
+    WJHEventTap *tap = (__bridge WJHEventTap *)context;
+    unsigned token;
+    __unsafe_unretained WJHEventTapDispatchTable *table = beginReadingConfiguration(tap, &token)->dispatchTable;
+    CGEventType type = (CGEventType)coalesced->record.type;
+
+    if (table->_coalescedEvent == NULL) {
+        // The delegate does not know about coalescing, so hand it the merged event through the usual type-specific method.
+        CGEventRef event = WJHEventCreateWithRecord(&coalesced->record);
+        timedDispatchToDelegate(tap, table, NULL, type, event);
+        if (event) {
+            CFRelease(event);
+        }
+    } else {
+        WJHLatencyHistogram * const *histograms = tap->_latencyHistograms;
+        uint64_t start = histograms ? mach_absolute_time() : 0;
+        table->_coalescedEvent(table->_delegate, @selector(eventTap:coalescedEvent:), tap, coalesced);
+        if (histograms) {
+            WJHLatencyHistogramRecord(histograms[dispatchSlot(type)], mach_absolute_time() - start);
+        }
+    }
+    endReadingConfiguration(tap, token);
+}
+
+void WJHEventTapFlushCoalescedEvents(WJHEventTap *tap) {
+    WJHEventCoalescer *coalescer = tap->_coalescer;
+    if (coalescer) {
+        WJHEventCoalescerFlush(coalescer);
+    }
+}
+
+void WJHEventTapFlushBatchedEvents(WJHEventTap *tap) {
+    WJHEventBatch *batch = tap->_batch;
+    if (batch == NULL || batch->count == 0) {
+        return;
+    }
+
+    unsigned token;
+    __unsafe_unretained WJHEventTapDispatchTable *table = beginReadingConfiguration(tap, &token)->dispatchTable;
+    if (table->_receivedRecords) {
+        table->_receivedRecords(table->_delegate, @selector(eventTap:receivedRecords:count:), tap, batch->records, batch->count);
+    } else {
+        WJHEventTapDispatchRecords(tap, batch->records, batch->count);
+    }
+    endReadingConfiguration(tap, token);
+    batch->count = 0;
+}
+
+void WJHEventTapDispatchRecords(WJHEventTap *tap, WJHEventRecord const *records, size_t count) {
+    unsigned token;
+    __unsafe_unretained WJHEventTapDispatchTable *table = beginReadingConfiguration(tap, &token)->dispatchTable;
+    @autoreleasepool {
+        for (size_t i = 0; i < count; ++i) {
+            CGEventRef event = WJHEventCreateWithRecord(records + i);
+            timedDispatchToDelegate(tap, table, NULL, (CGEventType)records[i].type, event);
+            if (event) {
+                CFRelease(event);
+            }
+        }
+    }
+    endReadingConfiguration(tap, token);
+}
+
+static CGEventRef timedDispatchToDelegate(WJHEventTap *tap, __unsafe_unretained WJHEventTapDispatchTable *table, CGEventTapProxy proxy, CGEventType type, CGEventRef event) {
+    WJHLatencyHistogram * const *histograms = tap->_latencyHistograms;
+    if (histograms == NULL) {
+        return dispatchToDelegate(tap, table, proxy, type, event);
+    }
+
+    // Only one thread ever calls the delegate for a given tap (the tap thread, or the delivery queue), so it is the only writer of the histograms.
+    uint64_t start = mach_absolute_time();
+    CGEventRef result = dispatchToDelegate(tap, table, proxy, type, event);
+    WJHLatencyHistogramRecord(histograms[dispatchSlot(type)], mach_absolute_time() - start);
+    return result;
+}
+
+/**
+ Call the delegate held by @a table, which the caller keeps alive by reading it from the configuration, so neither it nor the delegate is retained here.
+ */
+static CGEventRef dispatchToDelegate(WJHEventTap *tap, __unsafe_unretained WJHEventTapDispatchTable *table, CGEventTapProxy proxy, CGEventType type, CGEventRef event) {
+    __unsafe_unretained id delegate = table->_delegate;
+
+    if (table->_receivedEvent) {
+        CGEventRef tmpEvent = event;
+        if (table->_receivedEvent(delegate, @selector(eventTap:receivedEvent:type:proxy:), tap, &tmpEvent, type, proxy)) {
+            return tmpEvent;
+        }
+    }
+
+    WJHDispatchSlot const *slot = &table->_slots[dispatchSlot(type)];
+    if (slot->imp == NULL) {
+        return event;
+    }
+    if (slot->unknown) {
+        return ((WJHUnknownEventIMP)slot->imp)(delegate, slot->selector, tap, event, type, proxy);
+    }
+    return ((WJHEventIMP)slot->imp)(delegate, slot->selector, tap, event, proxy);
+}
+
+CGEventRef WJHEventTapDispatchEvent(WJHEventTap *tap, CGEventTapProxy proxy, CGEventType type, CGEventRef event) {
+    return eventTapCallback(proxy, type, event, (__bridge void *)tap);
+}
+
+void WJHEventTapSetEventHandler(WJHEventTap *tap, WJHEventTapEventHandler handler, void *context, CGEventMask eventMask) {
+    [tap changeConfiguration:^(WJHEventTapConfiguration *configuration) {
+        configuration->eventHandler = handler;
+        configuration->eventHandlerContext = handler ? context : NULL;
+        configuration->eventHandlerMask = handler ? eventMask : 0;
+    }];
+    if (tap.automaticEventMask) {
+        [tap updateEventMask];
+    }
+}
+
+CGEventRef WJHEventTapDispatchEventIfEnabled(WJHEventTap *tap, CGEventTapProxy proxy, CGEventType type, CGEventRef event) {
+    unsigned token;
+    WJHEventTapConfiguration const *configuration = beginReadingConfiguration(tap, &token);
+    CGEventRef result = configuration->enabled ? processEvent(tap, configuration, proxy, type, event) : event;
+    endReadingConfiguration(tap, token);
+    return result;
+}
+
+
+#pragma mark - Event Records
+
+void WJHEventRecordFill(WJHEventRecord *record, CGEventRef event, CGEventType type, uint32_t tapID) {
+    memset(record, 0, sizeof(*record));
+    record->type = type;
+    record->tapID = tapID;
+    if (event == NULL) {
+        return;
+    }
+
+    CGPoint location = CGEventGetLocation(event);
+    record->timestamp = CGEventGetTimestamp(event);
+    record->x = location.x;
+    record->y = location.y;
+    record->flags = CGEventGetFlags(event);
+
+    switch (type) {
+        case kCGEventKeyDown:
+        case kCGEventKeyUp:
+        case kCGEventFlagsChanged:
+            record->keycode = (uint16_t)CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode);
+            break;
+        case kCGEventScrollWheel:
+            record->deltaY = (int32_t)CGEventGetIntegerValueField(event, kCGScrollWheelEventPointDeltaAxis1);
+            record->deltaX = (int32_t)CGEventGetIntegerValueField(event, kCGScrollWheelEventPointDeltaAxis2);
+            break;
+        case kCGEventLeftMouseDown:
+        case kCGEventLeftMouseUp:
+        case kCGEventRightMouseDown:
+        case kCGEventRightMouseUp:
+        case kCGEventOtherMouseDown:
+        case kCGEventOtherMouseUp:
+        case kCGEventMouseMoved:
+        case kCGEventLeftMouseDragged:
+        case kCGEventRightMouseDragged:
+        case kCGEventOtherMouseDragged:
+            record->button = (uint16_t)CGEventGetIntegerValueField(event, kCGMouseEventButtonNumber);
+            record->deltaX = (int32_t)CGEventGetIntegerValueField(event, kCGMouseEventDeltaX);
+            record->deltaY = (int32_t)CGEventGetIntegerValueField(event, kCGMouseEventDeltaY);
+            break;
+        default:
+            break;
+    }
+}
+
+CGEventRef WJHEventCreateWithRecord(WJHEventRecord const *record) {
+    CGEventRef event = CGEventCreate(NULL);
+    if (event == NULL) {
+        return NULL;
+    }
+
+    CGEventType type = (CGEventType)record->type;
+    CGEventSetType(event, type);
+    CGEventSetTimestamp(event, record->timestamp);
+    CGEventSetLocation(event, CGPointMake(record->x, record->y));
+    CGEventSetFlags(event, (CGEventFlags)record->flags);
+
+    switch (type) {
+        case kCGEventKeyDown:
+        case kCGEventKeyUp:
+        case kCGEventFlagsChanged:
+            CGEventSetIntegerValueField(event, kCGKeyboardEventKeycode, record->keycode);
+            break;
+        case kCGEventScrollWheel:
+            CGEventSetIntegerValueField(event, kCGScrollWheelEventPointDeltaAxis1, record->deltaY);
+            CGEventSetIntegerValueField(event, kCGScrollWheelEventPointDeltaAxis2, record->deltaX);
+            break;
+        case kCGEventLeftMouseDown:
+        case kCGEventLeftMouseUp:
+        case kCGEventRightMouseDown:
+        case kCGEventRightMouseUp:
+        case kCGEventOtherMouseDown:
+        case kCGEventOtherMouseUp:
+        case kCGEventMouseMoved:
+        case kCGEventLeftMouseDragged:
+        case kCGEventRightMouseDragged:
+        case kCGEventOtherMouseDragged:
+            CGEventSetIntegerValueField(event, kCGMouseEventButtonNumber, record->button);
+            CGEventSetIntegerValueField(event, kCGMouseEventDeltaX, record->deltaX);
+            CGEventSetIntegerValueField(event, kCGMouseEventDeltaY, record->deltaY);
+            break;
+        default:
             break;
     }
-    
     return event;
 }
@@ -7,6 +7,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import <WJHEventTap/WJHEventCoalescer.h>
 
 @class WJHEventTap;
 
@@ -247,6 +248,31 @@
  */
 - (CGEventRef)eventTap:(WJHEventTap*)eventTap eventTapDisabledByUserInputEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy;
 
+/**
+ Called with a run of merged events, when the tap coalesces events.
+
+ @param eventTap the tap for which the events were processed
+ @param event the merged run.  The pointer is only valid for the duration of the call.
+
+ @note The events of the run have already been returned, untouched, to the system event processor.
+
+ @see -[WJHEventTap enableCoalescingWithWindow:]
+ */
+- (void)eventTap:(WJHEventTap*)eventTap coalescedEvent:(WJHCoalescedEvent const *)event;
+
+/**
+ Called with a batch of events, when the tap delivers events in batches.
+
+ @param eventTap the tap for which the events were processed
+ @param records the events, oldest first.  The array is only valid for the duration of the call.
+ @param count the number of records in the batch
+
+ @note The events have already been returned, untouched, to the system event processor.
+
+ @see -[WJHEventTap enableBatchedDeliveryWithBatchSize:interval:]
+ */
+- (void)eventTap:(WJHEventTap*)eventTap receivedRecords:(WJHEventRecord const *)records count:(NSUInteger)count;
+
 /**
  Called when an unknown event type is received by the tap.
 
@@ -259,6 +285,17 @@
  */
 - (CGEventRef)eventTap:(WJHEventTap*)eventTap unknownEvent:(CGEventRef)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy;
 
+/**
+ Called when a tap that derives its event mask wants to know which events the delegate handles.  Without it, the tap goes by the methods the delegate responds to, which is wrong for a delegate that responds to everything, and only handles some of it.
+
+ @param eventTap the tap whose event mask is being derived, or nil if the question is not about a particular tap
+
+ @return the events the delegate handles, as a mask of CGEventMaskBit(type).
+
+ @see -[WJHEventTap automaticEventMask]
+ */
+- (CGEventMask)eventMaskForEventTap:(WJHEventTap*)eventTap;
+
 @end
 
 
@@ -299,12 +336,23 @@ typedef CGEventRef (^WJHEventTapEventBlock)(WJHEventTap *eventTap, CGEventRef ev
  */
 typedef CGEventRef (^WJHEventTapUnknownEventBlock)(WJHEventTap *eventTap, CGEventRef event, CGEventType type, CGEventTapProxy proxy);
 
+/**
+ Block for handling a batch of events from an event tap that delivers events in batches.
+
+ @param eventTap the tap for which the events were processed
+ @param records the events, oldest first, only valid for the duration of the call
+ @param count the number of records in the batch
+ */
+typedef void (^WJHEventTapRecordsBlock)(WJHEventTap *eventTap, WJHEventRecord const *records, NSUInteger count);
+
 /**
  A concrete class that implements all delegate methods of the @a WJHEventTapDelegate protocol by forwarding the call to the similarly named block property.
 
  If the event handler block is nil, the resulting behavior is the same as if the delegate method had not been overridden.
 
  Otherwise, the delegate method forwards the call to the block, and returns the return value of the block.
+
+ The event mask it reports covers the events whose blocks are set, or every event if receivedEvent, or unknownEvent, is set, or receivedRecords is set and the tap delivers batches.  A tap that derives its event mask only asks when it is told to, so call -[WJHEventTap updateEventMask] after changing the blocks of a delegate that is in use.
  */
 @interface WJHEventTapDelegate : NSObject<WJHEventTapDelegate>
 
@@ -329,5 +377,6 @@ typedef CGEventRef (^WJHEventTapUnknownEventBlock)(WJHEventTap *eventTap, CGEven
 @property (strong) WJHEventTapEventBlock eventTapDisabledByTimeoutEvent;
 @property (strong) WJHEventTapEventBlock eventTapDisabledByUserInputEvent;
 @property (strong) WJHEventTapUnknownEventBlock unknownEvent;
+@property (strong) WJHEventTapRecordsBlock receivedRecords;
 
 @end
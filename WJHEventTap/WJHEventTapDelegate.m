@@ -7,6 +7,7 @@
 //
 
 #import "WJHEventTapDelegate.h"
+#import "WJHEventTap.h"
 
 @implementation WJHEventTapDelegate
 
@@ -16,6 +17,40 @@
 - (CGEventRef)eventTap:(WJHEventTap*)eventTap unknownEvent:(CGEventRef)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
     return self.unknownEvent ? self.unknownEvent(eventTap, event, type, proxy) : event;
 }
+- (void)eventTap:(WJHEventTap*)eventTap receivedRecords:(WJHEventRecord const *)records count:(NSUInteger)count {
+    if (self.receivedRecords) {
+        self.receivedRecords(eventTap, records, count);
+    } else {
+        WJHEventTapDispatchRecords(eventTap, records, count);
+    }
+}
+
+- (CGEventMask)eventMaskForEventTap:(WJHEventTap*)eventTap {
+    if (self.receivedEvent || self.unknownEvent || (self.receivedRecords && eventTap.deliversBatches)) {
+        return kCGEventMaskForAllEvents;
+    }
+    CGEventMask mask = 0;
+#define EventMaskBit(_name_, _type_) if (self._name_) mask |= CGEventMaskBit(_type_)
+    EventMaskBit(nullEvent, kCGEventNull);
+    EventMaskBit(leftMouseDownEvent, kCGEventLeftMouseDown);
+    EventMaskBit(leftMouseDraggedEvent, kCGEventLeftMouseDragged);
+    EventMaskBit(leftMouseUpEvent, kCGEventLeftMouseUp);
+    EventMaskBit(rightMouseDownEvent, kCGEventRightMouseDown);
+    EventMaskBit(rightMouseDraggedEvent, kCGEventRightMouseDragged);
+    EventMaskBit(rightMouseUpEvent, kCGEventRightMouseUp);
+    EventMaskBit(otherMouseDownEvent, kCGEventOtherMouseDown);
+    EventMaskBit(otherMouseDraggedEvent, kCGEventOtherMouseDragged);
+    EventMaskBit(otherMouseUpEvent, kCGEventOtherMouseUp);
+    EventMaskBit(mouseMovedEvent, kCGEventMouseMoved);
+    EventMaskBit(keyDownEvent, kCGEventKeyDown);
+    EventMaskBit(keyUpEvent, kCGEventKeyUp);
+    EventMaskBit(modifierFlagsChangedEvent, kCGEventFlagsChanged);
+    EventMaskBit(scrollWheelEvent, kCGEventScrollWheel);
+    EventMaskBit(tabletPointerEvent, kCGEventTabletPointer);
+    EventMaskBit(tabletProximityEvent, kCGEventTabletProximity);
+#undef EventMaskBit
+    return mask;
+}
 
 #define EventHandler(_name_) \
 - (CGEventRef)eventTap:(WJHEventTap*)eventTap _name_:(CGEventRef)event proxy:(CGEventTapProxy)proxy { \
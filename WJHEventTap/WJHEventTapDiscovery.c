@@ -0,0 +1,264 @@
+//
+//  WJHEventTapDiscovery.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHEventTapDiscovery.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+WJHEventTapDiscoveryPolicy const kWJHEventTapDefaultDiscoveryPolicy = {
+    .maxAttempts = 16,
+    .initialBackoffMicroseconds = 50,
+    .maxBackoffMicroseconds = 10000,
+    .jitterPercent = 50,
+};
+
+bool WJHEventTapMatches(WJHEventTapMatch const *match, CGEventTapInformation const *tapInfo) {
+    return tapInfo->tappingProcess == match->tappingProcess
+        && (match->processBeingTapped < 0 || tapInfo->processBeingTapped == match->processBeingTapped)
+        && tapInfo->tapPoint == match->tapPoint
+        && tapInfo->options == match->options;
+}
+
+static int compareIDs(void const *lhs, void const *rhs) {
+    uint32_t a = *(uint32_t const *)lhs;
+    uint32_t b = *(uint32_t const *)rhs;
+    return (a > b) - (a < b);
+}
+
+uint32_t WJHEventTapCollectIDs(WJHEventTapList const *list, WJHEventTapMatch const *match, uint32_t *ids) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < list->count; ++i) {
+        if (match == NULL || WJHEventTapMatches(match, list->taps + i)) {
+            ids[count++] = list->taps[i].eventTapID;
+        }
+    }
+    qsort(ids, count, sizeof(*ids), compareIDs);
+    return count;
+}
+
+uint32_t WJHEventTapDiffIDs(uint32_t const *before, uint32_t beforeCount, uint32_t const *after, uint32_t afterCount, uint32_t *added) {
+    uint32_t b = 0, count = 0;
+    for (uint32_t a = 0; a < afterCount; ++a) {
+        while (b < beforeCount && before[b] < after[a]) {
+            ++b;
+        }
+        if (b == beforeCount || before[b] != after[a]) {
+            added[count++] = after[a];
+        }
+    }
+    return count;
+}
+
+static int compareTapIDs(void const *lhs, void const *rhs) {
+    return compareIDs(&(*(CGEventTapInformation const * const *)lhs)->eventTapID, &(*(CGEventTapInformation const * const *)rhs)->eventTapID);
+}
+
+static bool sameMatch(WJHEventTapMatch const *lhs, WJHEventTapMatch const *rhs) {
+    return lhs->tappingProcess == rhs->tappingProcess
+        && lhs->processBeingTapped == rhs->processBeingTapped
+        && lhs->tapPoint == rhs->tapPoint
+        && lhs->options == rhs->options;
+}
+
+/**
+ Snapshot the IDs of every tap in the system into @a ids, growing it as needed.
+
+ @return WJHEventTapDiscoveryFound if the snapshot was taken, or why it was not
+ */
+static WJHEventTapDiscoveryResult snapshot(WJHEventTapList *list, uint32_t **ids, uint32_t *capacity, uint32_t *count) {
+    if (WJHEventTapListRefresh(list, NULL, NULL) != kCGErrorSuccess) {
+        return WJHEventTapDiscoveryListFailed;
+    }
+    if (list->count > *capacity) {
+        uint32_t *newIDs = realloc(*ids, list->count * sizeof(**ids));
+        if (newIDs == NULL) {
+            return WJHEventTapDiscoveryOutOfMemory;
+        }
+        *ids = newIDs;
+        *capacity = list->count;
+    }
+    *count = WJHEventTapCollectIDs(list, NULL, *ids);
+    return WJHEventTapDiscoveryFound;
+}
+
+/**
+ The pause before the next attempt: the backoff, less a random amount of up to the policy's jitter.
+ */
+static uint32_t jittered(WJHEventTapDiscoveryPolicy const *policy, uint32_t backoff) {
+    uint32_t percent = policy->jitterPercent < 100 ? policy->jitterPercent : 100;
+    uint32_t range = (uint32_t)((uint64_t)backoff * percent / 100);
+    return range ? backoff - arc4random_uniform(range + 1) : backoff;
+}
+
+enum {
+    kTapPending = 0,
+    kTapCreated,
+    kTapResolved,
+};
+
+WJHEventTapDiscoveryResult WJHEventTapDiscoverMany(WJHEventTapList *list, WJHEventTapDiscoveryRequest const *requests, size_t count, WJHEventTapDiscoveryPolicy const *policy, WJHEventTapBulkDiscoveryCallbacks const *callbacks, CGEventTapInformation *infos, uint32_t *rounds) {
+    if (policy == NULL) {
+        policy = &kWJHEventTapDefaultDiscoveryPolicy;
+    }
+
+    WJHEventTapDiscoveryResult result = WJHEventTapDiscoveryFound;
+    uint32_t *before = NULL, *after = NULL;
+    uint32_t beforeCapacity = 0, afterCapacity = 0;
+    CGEventTapInformation const **added = NULL;
+    uint32_t addedCapacity = 0;
+    uint8_t *state = calloc(count, sizeof(*state));
+    size_t *group = malloc(count * sizeof(*group));
+    size_t unresolved = count;
+    uint32_t backoff = policy->initialBackoffMicroseconds;
+    uint32_t round = 0;
+
+    if (count && (state == NULL || group == NULL)) {
+        result = WJHEventTapDiscoveryOutOfMemory;
+        goto done;
+    }
+
+    while (unresolved > 0) {
+        if (round == policy->maxAttempts) {
+            result = WJHEventTapDiscoveryExhausted;
+            goto done;
+        }
+        if (round > 0 && backoff > 0) {
+            uint32_t pause = jittered(policy, backoff);
+            if (callbacks->sleep) {
+                callbacks->sleep(callbacks->context, pause);
+            } else {
+                usleep(pause);
+            }
+            backoff = backoff > policy->maxBackoffMicroseconds / 2 ? policy->maxBackoffMicroseconds : backoff * 2;
+        }
+        ++round;
+
+        uint32_t beforeCount, afterCount;
+        if ((result = snapshot(list, &before, &beforeCapacity, &beforeCount)) != WJHEventTapDiscoveryFound) {
+            goto done;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (state[i] == kTapPending) {
+                if (!callbacks->create(callbacks->context, i)) {
+                    result = WJHEventTapDiscoveryCreateFailed;
+                    goto done;
+                }
+                state[i] = kTapCreated;
+            }
+        }
+        if ((result = snapshot(list, &after, &afterCapacity, &afterCount)) != WJHEventTapDiscoveryFound) {
+            goto done;
+        }
+
+        // Gather the information for the new taps, in eventTapID order.
+        uint32_t addedIDCount = WJHEventTapDiffIDs(before, beforeCount, after, afterCount, after);
+        if (addedIDCount > addedCapacity) {
+            CGEventTapInformation const **newAdded = realloc(added, addedIDCount * sizeof(*added));
+            if (newAdded == NULL) {
+                result = WJHEventTapDiscoveryOutOfMemory;
+                goto done;
+            }
+            added = newAdded;
+            addedCapacity = addedIDCount;
+        }
+        uint32_t addedCount = 0;
+        for (uint32_t t = 0; t < list->count && addedCount < addedIDCount; ++t) {
+            if (bsearch(&list->taps[t].eventTapID, after, addedIDCount, sizeof(*after), compareIDs)) {
+                added[addedCount++] = list->taps + t;
+            }
+        }
+        qsort(added, addedCount, sizeof(*added), compareTapIDs);
+
+        for (size_t i = 0; i < count; ++i) {
+            if (state[i] != kTapCreated) {
+                continue;
+            }
+
+            // The taps created this round that can only be told apart by the order in which they were created.
+            size_t groupCount = 0;
+            for (size_t j = i; j < count; ++j) {
+                if (state[j] == kTapCreated && sameMatch(&requests[i].match, &requests[j].match)) {
+                    group[groupCount++] = j;
+                }
+            }
+
+            size_t candidateCount = 0;
+            bool resolved = true;
+            for (uint32_t a = 0; a < addedCount && resolved; ++a) {
+                if (WJHEventTapMatches(&requests[i].match, added[a])) {
+                    resolved = candidateCount < groupCount
+                        && (added[a]->eventsOfInterest & ~requests[group[candidateCount]].eventMask) == 0;
+                    ++candidateCount;
+                }
+            }
+            resolved = resolved && candidateCount == groupCount;
+
+            candidateCount = 0;
+            for (size_t k = 0; k < groupCount; ++k) {
+                size_t j = group[k];
+                if (resolved) {
+                    while (!WJHEventTapMatches(&requests[i].match, added[candidateCount])) {
+                        ++candidateCount;
+                    }
+                    infos[j] = *added[candidateCount++];
+                    state[j] = kTapResolved;
+                    --unresolved;
+                } else {
+                    // Another tap, with the same characteristics, was created by this process at the same time, or ours have not shown up yet.  Either way, we can't tell which ones are ours.
+                    callbacks->destroy(callbacks->context, j);
+                    state[j] = kTapPending;
+                }
+            }
+        }
+    }
+
+done:
+    if (result != WJHEventTapDiscoveryFound && state) {
+        for (size_t i = 0; i < count; ++i) {
+            if (state[i] != kTapPending) {
+                callbacks->destroy(callbacks->context, i);
+            }
+        }
+    }
+    free(state);
+    free(group);
+    free(added);
+    free(before);
+    free(after);
+    if (rounds) {
+        *rounds = round;
+    }
+    return result;
+}
+
+static bool createSingle(void *context, size_t index) {
+    WJHEventTapDiscoveryCallbacks const *callbacks = context;
+    return callbacks->create(callbacks->context);
+}
+
+static void destroySingle(void *context, size_t index) {
+    WJHEventTapDiscoveryCallbacks const *callbacks = context;
+    callbacks->destroy(callbacks->context);
+}
+
+static void sleepSingle(void *context, uint32_t microseconds) {
+    WJHEventTapDiscoveryCallbacks const *callbacks = context;
+    callbacks->sleep(callbacks->context, microseconds);
+}
+
+WJHEventTapDiscoveryResult WJHEventTapDiscover(WJHEventTapList *list, WJHEventTapMatch const *match, WJHEventTapDiscoveryPolicy const *policy, WJHEventTapDiscoveryCallbacks const *callbacks, CGEventTapInformation *info, uint32_t *attempts) {
+    WJHEventTapDiscoveryRequest request = { *match, ~(CGEventMask)0 };
+    WJHEventTapBulkDiscoveryCallbacks bulkCallbacks = {
+        .create = createSingle,
+        .destroy = destroySingle,
+        .sleep = callbacks->sleep ? sleepSingle : NULL,
+        .context = (void *)callbacks,
+    };
+    return WJHEventTapDiscoverMany(list, &request, 1, policy, &bulkCallbacks, info, attempts);
+}
@@ -0,0 +1,176 @@
+//
+//  WJHEventTapDiscovery.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventTapDiscovery_h
+#define WJHEventTap_WJHEventTapDiscovery_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "WJHEventTapList.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Describes the system taps that could possibly be the one being created.
+
+ There is no API to get the eventTapID of a tap we create, so it has to be discovered by comparing the tap list before and after the tap is created.  Only taps that match these criteria take part in the comparison, which means taps being created by other processes can never make the comparison ambiguous.
+ */
+typedef struct WJHEventTapMatch {
+    /// The process creating the tap, normally getpid().
+    pid_t tappingProcess;
+
+    /// The process being tapped, or -1 to accept any process.
+    pid_t processBeingTapped;
+
+    /// The tap location, as reported in CGEventTapInformation.tapPoint.
+    uint32_t tapPoint;
+
+    /// The tap options (CGEventTapOptions).
+    uint32_t options;
+} WJHEventTapMatch;
+
+/**
+ Whether a tap satisfies the match criteria.
+ */
+bool WJHEventTapMatches(WJHEventTapMatch const *match, CGEventTapInformation const *tapInfo);
+
+/**
+ How hard to try before giving up on discovering a new tap's eventTapID.
+
+ If a snapshot diff does not identify exactly one new tap, the tap is destroyed, and, after a pause, created again.  The pause starts at initialBackoffMicroseconds, and doubles after each attempt, up to maxBackoffMicroseconds.  Each pause is shortened by a random amount, up to jitterPercent of it, so threads that collided once do not retry in lockstep, and collide again.
+ */
+typedef struct WJHEventTapDiscoveryPolicy {
+    uint32_t maxAttempts;
+    uint32_t initialBackoffMicroseconds;
+    uint32_t maxBackoffMicroseconds;
+
+    /// At most 100.  Zero makes every pause exactly the backoff.
+    uint32_t jitterPercent;
+} WJHEventTapDiscoveryPolicy;
+
+/**
+ The policy used when none is specified: 16 attempts, backing off from 50us to 10ms, with up to 50% jitter.
+ */
+extern WJHEventTapDiscoveryPolicy const kWJHEventTapDefaultDiscoveryPolicy;
+
+typedef enum WJHEventTapDiscoveryResult {
+    /// The new tap was identified.
+    WJHEventTapDiscoveryFound = 0,
+
+    /// The tap could not be created.
+    WJHEventTapDiscoveryCreateFailed,
+
+    /// The tap list could not be obtained.
+    WJHEventTapDiscoveryListFailed,
+
+    /// Every attempt was ambiguous; the tap has been destroyed.
+    WJHEventTapDiscoveryExhausted,
+
+    /// Memory for the snapshots could not be allocated; the tap has been destroyed.
+    WJHEventTapDiscoveryOutOfMemory,
+} WJHEventTapDiscoveryResult;
+
+/**
+ The operations discovery performs on the tap being created.
+ */
+typedef struct WJHEventTapDiscoveryCallbacks {
+    /// Create the tap.  Return false if the tap could not be created.
+    bool (*create)(void *context);
+
+    /// Destroy the tap made by the most recent call to create.
+    void (*destroy)(void *context);
+
+    /// Pause between attempts.  If NULL, usleep is used.
+    void (*sleep)(void *context, uint32_t microseconds);
+
+    void *context;
+} WJHEventTapDiscoveryCallbacks;
+
+/**
+ One of several taps being created together.
+ */
+typedef struct WJHEventTapDiscoveryRequest {
+    /// The criteria satisfied by the tap.
+    WJHEventTapMatch match;
+
+    /// The requested event mask.  The system may strip bits from it, but never adds any, so a new tap is only attributed to this request if its eventsOfInterest are a subset.
+    CGEventMask eventMask;
+} WJHEventTapDiscoveryRequest;
+
+/**
+ The operations discovery performs on each of several taps being created together.
+ */
+typedef struct WJHEventTapBulkDiscoveryCallbacks {
+    /// Create the tap for the request at @a index.  Return false if the tap could not be created.
+    bool (*create)(void *context, size_t index);
+
+    /// Destroy the tap for the request at @a index.
+    void (*destroy)(void *context, size_t index);
+
+    /// Pause between attempts.  If NULL, usleep is used.
+    void (*sleep)(void *context, uint32_t microseconds);
+
+    void *context;
+} WJHEventTapBulkDiscoveryCallbacks;
+
+/**
+ Collect the sorted eventTapIDs of the taps in @a list that satisfy @a match.
+
+ @param list a refreshed tap list
+ @param match the criteria, or NULL to collect every tap
+ @param ids where to store the IDs; it must have room for list->count entries
+
+ @return the number of IDs stored
+ */
+uint32_t WJHEventTapCollectIDs(WJHEventTapList const *list, WJHEventTapMatch const *match, uint32_t *ids);
+
+/**
+ Find the IDs in @a after that are not in @a before.  Both inputs must be sorted, and the output is sorted.
+
+ @return the number of IDs stored in @a added, which must have room for @a afterCount entries.  @a added may be the same as @a after.
+ */
+uint32_t WJHEventTapDiffIDs(uint32_t const *before, uint32_t beforeCount, uint32_t const *after, uint32_t afterCount, uint32_t *added);
+
+/**
+ Create a tap, and discover its system tap information.
+
+ @param list the list used to take snapshots, which determines where tap information comes from
+ @param match the criteria satisfied by the tap being created
+ @param policy how many times to try, and how long to wait between attempts, or NULL for the default policy
+ @param callbacks the operations that create and destroy the tap
+ @param info receives the system information for the new tap
+ @param attempts if not NULL, receives the number of times the tap was created
+
+ @return WJHEventTapDiscoveryFound if the tap exists and was identified.  For any other result, the tap does not exist.
+ */
+WJHEventTapDiscoveryResult WJHEventTapDiscover(WJHEventTapList *list, WJHEventTapMatch const *match, WJHEventTapDiscoveryPolicy const *policy, WJHEventTapDiscoveryCallbacks const *callbacks, CGEventTapInformation *info, uint32_t *attempts);
+
+/**
+ Create several taps, and discover the system tap information of each, from a single before/after comparison.
+
+ Every unresolved tap is created between one pair of snapshots.  The new taps that satisfy a request's match are attributed to the requests with that same match, in the order they were created, which relies on the window server handing out eventTapIDs in increasing order.  If the number of new taps in a group does not equal the number of taps the group created, or a new tap has events that were not requested, the group is ambiguous: only its taps are destroyed, and created again in the next round.  Resolved taps are never touched again.
+
+ @param list the list used to take snapshots, which determines where tap information comes from
+ @param requests the taps to be created
+ @param count the number of requests
+ @param policy how many rounds to try, and how long to wait between them, or NULL for the default policy
+ @param callbacks the operations that create and destroy each tap
+ @param infos receives the system information for each tap, in the same order as @a requests
+ @param rounds if not NULL, receives the number of before/after comparisons made
+
+ @return WJHEventTapDiscoveryFound if every tap exists and was identified.  For any other result, none of the taps exist.
+ */
+WJHEventTapDiscoveryResult WJHEventTapDiscoverMany(WJHEventTapList *list, WJHEventTapDiscoveryRequest const *requests, size_t count, WJHEventTapDiscoveryPolicy const *policy, WJHEventTapBulkDiscoveryCallbacks const *callbacks, CGEventTapInformation *infos, uint32_t *rounds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+//
+//  WJHEventTapHub.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <WJHEventTap/WJHEventTap.h>
+
+/**
+ Multiplexes any number of logical taps onto a single system event tap.
+
+ Every WJHEventTap creates its own system tap, so each event crosses the window server boundary once per tap, and every tap adds to the system tap list.  A hub holds one system tap for a location and mode (active or passive), and fans each event out to its subscribers, in process.
+
+ Subscribers are WJHEventTap objects, with their own delegate, event mask, and placement, that are not attached to a system tap of their own.  They are ordered among themselves the way the system orders taps: those placed before others run first, the most recently subscribed first, followed by those placed after others, in the order they subscribed.  In an active hub, each subscriber sees the event as returned by the one before it, and a subscriber that returns NULL drops the event for the rest of the chain and the system.
+
+ The system tap is created with the union of the subscriber event masks, and is replaced with a wider or narrower one as subscribers come and go.  It is destroyed when the last subscriber leaves.  If the system disables the tap, the hub enables it again; subscribers are not notified.
+ */
+@interface WJHEventTapHub : NSObject
+
+/**
+ The hub shared by the whole process for a location and mode, which services its tap on a dedicated thread of its own.
+
+ @param location the tap location; kWJHProcessEventTap is not supported
+ @param passive YES for a passive (listen only) hub, NO for an active hub
+ */
++ (instancetype)hubForLocation:(CGEventTapLocation)location passive:(BOOL)passive;
+
+/**
+ Initialize a private hub.
+
+ @param location the tap location; kWJHProcessEventTap is not supported
+ @param passive YES for a passive (listen only) hub, NO for an active hub
+ @param thread the thread that services the system tap, and on which every subscriber delegate runs.  If nil, the hub gets a thread of its own.
+ */
+- (instancetype)initWithLocation:(CGEventTapLocation)location passive:(BOOL)passive thread:(WJHEventTapThread *)thread;
+
+@property (nonatomic, assign, readonly) CGEventTapLocation location;
+@property (nonatomic, assign, readonly) BOOL passive;
+@property (nonatomic, strong, readonly) WJHEventTapThread *thread;
+
+/**
+ The union of the event masks of the current subscribers.
+ */
+@property (nonatomic, assign, readonly) CGEventMask eventMask;
+
+/**
+ The current subscribers, in chain order.
+ */
+@property (nonatomic, copy, readonly) NSArray *subscribers;
+
+/**
+ The system tap that feeds the hub, or nil if there are no subscribers.
+ */
+@property (nonatomic, strong, readonly) WJHEventTap *tap;
+
+/**
+ Add a logical tap to the hub.
+
+ The subscriber is created disabled, and must be enabled before it sees any events, just like a tap of its own.  It supports everything a WJHEventTap does, except that its eventTapID is zero, and it must not be given to another hub.
+
+ @param eventMask the events the subscriber is interested in
+ @param beforeOthers YES to place the subscriber before all current subscribers, NO to place it after them
+ @param delegate the delegate to be notified of events
+
+ @return the new subscriber, or nil if the system tap could not be created with the wider mask.
+ */
+- (WJHEventTap *)subscribeWithEventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers delegate:(id<WJHEventTapDelegate>)delegate;
+
+/**
+ Remove a subscriber from the hub.  The hub holds a strong reference to each subscriber until it is removed.
+ */
+- (void)unsubscribe:(WJHEventTap *)subscriber;
+
+@end
@@ -0,0 +1,213 @@
+//
+//  WJHEventTapHub.m
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import "WJHEventTapHub.h"
+#import "WJHEventTap+Private.h"
+
+static void * deliverToSubscriber(void *context, uint32_t type, void *event, void *info) {
+    // Subscribers are detached, so the enabled state in their configuration is the whole truth.
+    __unsafe_unretained WJHEventTap *subscriber = (__bridge WJHEventTap *)context;
+    return WJHEventTapDispatchEventIfEnabled(subscriber, info, (CGEventType)type, event);
+}
+
+
+#pragma mark - WJHEventTapHubRouter
+
+/**
+ The delegate of the system tap.  It does not retain the hub, which owns the tap.
+ */
+@interface WJHEventTapHubRouter : NSObject<WJHEventTapDelegate>
+@property (nonatomic, unsafe_unretained) WJHEventTapHub *hub;
+@end
+
+@implementation WJHEventTapHubRouter
+- (BOOL)eventTap:(WJHEventTap*)eventTap receivedEvent:(CGEventRef*)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    if (type == kCGEventTapDisabledByTimeout || type == kCGEventTapDisabledByUserInput) {
+        // The hub only stops when its last subscriber leaves.
+        eventTap.enabled = YES;
+        return YES;
+    }
+    *event = WJHEventTapHubDispatchEvent(_hub, proxy, type, *event);
+    return YES;
+}
+@end
+
+
+#pragma mark - WJHEventTapHub
+
+@implementation WJHEventTapHub {
+    WJHEventHub *_hub;
+    WJHEventTapHubRouter *_router;
+    NSMutableArray *_subscribers;
+    NSMutableArray *_unsubscribedDuringDispatch;
+    NSUInteger _dispatchDepth;
+    BOOL _detached;
+}
+
++ (instancetype)hubForLocation:(CGEventTapLocation)location passive:(BOOL)passive {
+    static NSMutableDictionary *hubs;
+    @synchronized(self) {
+        if (hubs == nil) {
+            hubs = [NSMutableDictionary dictionary];
+        }
+        NSArray *key = @[@(location), @(passive)];
+        WJHEventTapHub *hub = hubs[key];
+        if (hub == nil) {
+            hub = [[self alloc] initWithLocation:location passive:passive thread:nil];
+            hubs[key] = hub;
+        }
+        return hub;
+    }
+}
+
+- (instancetype)initWithLocation:(CGEventTapLocation)location passive:(BOOL)passive thread:(WJHEventTapThread *)thread {
+    NSAssert(location != kWJHProcessEventTap, @"Hubs can not tap a process");
+    if (self = [super init]) {
+        _location = location;
+        _passive = passive;
+        _thread = thread ?: [[WJHEventTapThread alloc] initWithName:@"WJHEventTapHub"];
+        _hub = WJHEventHubCreate(passive);
+        _router = [WJHEventTapHubRouter new];
+        _router.hub = self;
+        _subscribers = [NSMutableArray array];
+        _unsubscribedDuringDispatch = [NSMutableArray array];
+        if (_hub == NULL) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (instancetype)initDetachedWithPassive:(BOOL)passive {
+    if (self = [super init]) {
+        _location = kCGSessionEventTap;
+        _passive = passive;
+        _detached = YES;
+        _hub = WJHEventHubCreate(passive);
+        _subscribers = [NSMutableArray array];
+        _unsubscribedDuringDispatch = [NSMutableArray array];
+        if (_hub == NULL) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    // Stop the system tap first, so no event can reach the chain while it is destroyed.
+    _tap = nil;
+    WJHEventHubDestroy(_hub);
+}
+
+/**
+ Run a block that changes the chain, on the thread that walks it.
+ */
+- (void)performChange:(void(^)(void))block {
+    if (_thread) {
+        [_thread performBlockAndWait:block];
+    } else {
+        block();
+    }
+}
+
+- (CGEventMask)eventMask {
+    __block CGEventMask eventMask;
+    [self performChange:^{
+        eventMask = (CGEventMask)WJHEventHubEventMask(_hub);
+    }];
+    return eventMask;
+}
+
+- (NSArray *)subscribers {
+    __block NSArray *subscribers;
+    [self performChange:^{
+        subscribers = [_subscribers copy];
+    }];
+    return subscribers;
+}
+
+/**
+ Make the system tap match the union of the subscriber masks.
+
+ @return NO if a tap with the new mask could not be created, in which case the current tap is left in place.
+ */
+- (BOOL)updateTap {
+    CGEventMask eventMask = (CGEventMask)WJHEventHubEventMask(_hub);
+    if (_detached) {
+        return YES;
+    }
+    if (WJHEventHubCount(_hub) == 0) {
+        _tap = nil;
+        return YES;
+    }
+    if (_tap && _tap.requestedEventMask == eventMask) {
+        return YES;
+    }
+
+    // Both taps are serviced by this thread, so no event can be handled by both.
+    WJHEventTap *tap = [[WJHEventTap alloc] initWithLocation:_location eventMask:eventMask beforeOthers:NO passive:_passive thread:_thread delegate:_router];
+    if (tap == nil) {
+        return NO;
+    }
+    tap.enabled = YES;
+    _tap = tap;
+    return YES;
+}
+
+- (WJHEventTap *)subscribeWithEventMask:(CGEventMask)eventMask beforeOthers:(BOOL)beforeOthers delegate:(id<WJHEventTapDelegate>)delegate {
+    WJHEventTap *subscriber = [[WJHEventTap alloc] initDetachedWithLocation:_location eventMask:eventMask beforeOthers:beforeOthers passive:_passive thread:_thread delegate:delegate];
+    __block BOOL subscribed = NO;
+    [self performChange:^{
+        WJHEventHubSubscriber entry = {
+            .eventMask = eventMask,
+            .beforeOthers = beforeOthers,
+            .callback = deliverToSubscriber,
+            .context = (__bridge void *)subscriber,
+        };
+        uint64_t subscriberID = WJHEventHubAdd(_hub, &entry);
+        if (subscriberID == 0) {
+            return;
+        }
+        if (![self updateTap]) {
+            WJHEventHubRemove(_hub, subscriberID);
+            return;
+        }
+        subscriber.hubSubscriberID = subscriberID;
+        if (beforeOthers) {
+            [_subscribers insertObject:subscriber atIndex:0];
+        } else {
+            [_subscribers addObject:subscriber];
+        }
+        subscribed = YES;
+    }];
+    return subscribed ? subscriber : nil;
+}
+
+- (void)unsubscribe:(WJHEventTap *)subscriber {
+    [self performChange:^{
+        if (![_subscribers containsObject:subscriber] || !WJHEventHubRemove(_hub, subscriber.hubSubscriberID)) {
+            return;
+        }
+        if (_dispatchDepth > 0) {
+            // The chain being walked may still call the subscriber.
+            [_unsubscribedDuringDispatch addObject:subscriber];
+        }
+        [_subscribers removeObjectIdenticalTo:subscriber];
+        [self updateTap];
+    }];
+}
+
+CGEventRef WJHEventTapHubDispatchEvent(WJHEventTapHub *hub, CGEventTapProxy proxy, CGEventType type, CGEventRef event) {
+    ++hub->_dispatchDepth;
+    event = WJHEventHubDispatch(hub->_hub, type, event, proxy);
+    if (--hub->_dispatchDepth == 0 && hub->_unsubscribedDuringDispatch.count) {
+        [hub->_unsubscribedDuringDispatch removeAllObjects];
+    }
+    return event;
+}
+
+@end
@@ -0,0 +1,99 @@
+//
+//  WJHEventTapList.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHEventTapList.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static CGError systemProvider(void *context, uint32_t maxNumberOfTaps, CGEventTapInformation *tapList, uint32_t *eventTapCount) {
+    return CGGetEventTapList(maxNumberOfTaps, tapList, eventTapCount);
+}
+
+void WJHEventTapListInit(WJHEventTapList *list, CGEventTapInformation *storage, uint32_t capacity) {
+    memset(list, 0, sizeof(*list));
+    list->provider = systemProvider;
+    if (storage) {
+        list->taps = storage;
+        list->capacity = capacity;
+    } else {
+        list->ownsStorage = true;
+        if (capacity) {
+            list->taps = calloc(capacity, sizeof(*list->taps));
+            list->capacity = list->taps ? capacity : 0;
+        }
+    }
+}
+
+void WJHEventTapListSetProvider(WJHEventTapList *list, WJHEventTapListProvider provider, void *context) {
+    list->provider = provider ? provider : systemProvider;
+    list->providerContext = provider ? context : NULL;
+}
+
+void WJHEventTapListDestroy(WJHEventTapList *list) {
+    if (list->ownsStorage) {
+        free(list->taps);
+    }
+    memset(list, 0, sizeof(*list));
+}
+
+static bool grow(WJHEventTapList *list, uint32_t needed) {
+    // Leave some headroom, so a few taps coming and going does not cause another allocation.
+    uint32_t capacity = needed + needed / 2 + 8;
+    CGEventTapInformation *taps = realloc(list->taps, capacity * sizeof(*taps));
+    if (taps == NULL) {
+        return false;
+    }
+    list->taps = taps;
+    list->capacity = capacity;
+    return true;
+}
+
+CGError WJHEventTapListRefresh(WJHEventTapList *list, CGEventTapInformation const **taps, uint32_t *count) {
+    CGError error;
+    list->count = 0;
+    list->truncated = false;
+
+    for (;;) {
+        uint32_t filled = 0;
+        if (list->capacity) {
+            memset(list->taps, 0, list->capacity * sizeof(*list->taps));
+            error = list->provider(list->providerContext, list->capacity, list->taps, &filled);
+            if (error != kCGErrorSuccess) {
+                break;
+            }
+            if (filled < list->capacity) {
+                list->count = filled;
+                break;
+            }
+        }
+
+        // The buffer is full, so there may be more taps than we have room for.
+        uint32_t total = 0;
+        error = list->provider(list->providerContext, 0, NULL, &total);
+        if (error != kCGErrorSuccess) {
+            break;
+        }
+        if (total <= filled) {
+            list->count = filled;
+            break;
+        }
+        if (!list->ownsStorage || !grow(list, total)) {
+            list->count = filled;
+            list->truncated = true;
+            break;
+        }
+    }
+
+    if (taps) {
+        *taps = list->taps;
+    }
+    if (count) {
+        *count = list->count;
+    }
+    return error;
+}
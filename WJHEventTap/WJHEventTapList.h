@@ -0,0 +1,111 @@
+//
+//  WJHEventTapList.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHEventTapList_h
+#define WJHEventTap_WJHEventTapList_h
+
+#include <ApplicationServices/ApplicationServices.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ A source of system event tap information, with the same semantics as CGGetEventTapList.
+
+ @param context the context given when the provider was installed
+ @param maxNumberOfTaps the number of entries available at @a tapList
+ @param tapList where to store tap information, or NULL to only count the taps
+ @param eventTapCount receives the number of entries stored, or the number of taps if @a tapList is NULL
+ */
+typedef CGError (*WJHEventTapListProvider)(void *context, uint32_t maxNumberOfTaps, CGEventTapInformation *tapList, uint32_t *eventTapCount);
+
+/**
+ A reusable buffer for snapshots of the system event tap list.
+
+ Refreshing a list fills its buffer in place, so a list that is polled repeatedly costs a single CGGetEventTapList call per poll, with no allocation, once the buffer is large enough to hold every tap.  No Objective-C objects are involved.
+
+ A list either borrows storage provided by the caller, in which case it never allocates and simply reports truncation, or owns its storage, in which case it grows as needed.
+
+ @code
+ WJHEventTapList list;
+ WJHEventTapListInit(&list, NULL, 0);
+ for (;;) {
+     CGEventTapInformation const *taps;
+     uint32_t count;
+     if (WJHEventTapListRefresh(&list, &taps, &count) == kCGErrorSuccess) {
+         for (uint32_t i = 0; i < count; ++i) {
+             // use taps[i]
+         }
+     }
+ }
+ WJHEventTapListDestroy(&list);
+ @endcode
+ */
+typedef struct WJHEventTapList {
+    /// The tap information from the most recent refresh.
+    CGEventTapInformation *taps;
+
+    /// The number of valid entries in taps.
+    uint32_t count;
+
+    /// The number of entries that fit in taps.
+    uint32_t capacity;
+
+    /// Whether the list allocated taps, and may grow it.
+    bool ownsStorage;
+
+    /// Whether the most recent refresh had more taps than fit in caller-provided storage.
+    bool truncated;
+
+    /// Where tap information comes from.  Uses CGGetEventTapList unless replaced with WJHEventTapListSetProvider.
+    WJHEventTapListProvider provider;
+    void *providerContext;
+} WJHEventTapList;
+
+/**
+ Initialize a tap list.
+
+ @param list the list to be initialized
+ @param storage caller-provided storage for the list, which must remain valid for the lifetime of the list.  If NULL, the list allocates and grows its own storage.
+ @param capacity the number of entries available at @a storage, or, if @a storage is NULL, the initial number of entries to allocate (which may be zero).
+ */
+void WJHEventTapListInit(WJHEventTapList *list, CGEventTapInformation *storage, uint32_t capacity);
+
+/**
+ Replace the source of tap information, e.g., to simulate a busy system in tests.
+
+ @param list the list
+ @param provider the new source of tap information, or NULL to restore CGGetEventTapList
+ @param context passed to each call of @a provider
+ */
+void WJHEventTapListSetProvider(WJHEventTapList *list, WJHEventTapListProvider provider, void *context);
+
+/**
+ Release any storage owned by the list.
+ */
+void WJHEventTapListDestroy(WJHEventTapList *list);
+
+/**
+ Fill the list with the current system event taps.
+
+ Every entry of the buffer is zeroed before it is filled, so padding bytes are in a known state and entries can be compared with memcmp.
+
+ @param list the list to be refreshed
+ @param taps if not NULL, receives a pointer to the first entry.  The pointer is borrowed from the list, and is valid until the next refresh or destroy.
+ @param count if not NULL, receives the number of entries
+
+ @return the error from the tap list provider.  On error, the list is empty.
+ */
+CGError WJHEventTapListRefresh(WJHEventTapList *list, CGEventTapInformation const **taps, uint32_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+//
+//  WJHEventTapThread.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ A thread, with its own run loop, dedicated to servicing event taps.
+
+ Event tap callbacks run on the thread of the run loop to which the tap is attached.  When that is the main thread, any stall in the user interface delays every tapped event, and a long enough stall gets the tap disabled by timeout.  Attaching taps to a WJHEventTapThread instead keeps their callbacks isolated from whatever else the application is doing.
+
+ The thread is started when the object is initialized, and runs at an elevated priority.  Any number of taps may share one thread; each tap holds a strong reference to its thread, and the thread is stopped when the last reference goes away.  Releasing the last reference from another thread waits for the tap thread to exit.
+ */
+@interface WJHEventTapThread : NSObject
+
+/**
+ The run loop of the thread.  It is only meant to be used to add and remove run loop sources; it should not be run by anyone else.
+ */
+@property (nonatomic, strong, readonly) NSRunLoop *runLoop;
+
+/**
+ The name given to the thread.
+ */
+@property (nonatomic, copy, readonly) NSString *name;
+
+/**
+ Start a new tap thread, running with user-interactive quality of service.
+
+ @param name the name of the thread, or nil for a default name
+ */
+- (instancetype)initWithName:(NSString *)name;
+
+/**
+ Start a new tap thread.
+
+ @param name the name of the thread, or nil for a default name
+ @param qualityOfService the quality of service for the thread.  On systems that do not support quality of service, the thread priority is raised to the maximum instead.
+ */
+- (instancetype)initWithName:(NSString *)name qualityOfService:(NSQualityOfService)qualityOfService;
+
+/**
+ Whether the calling thread is the tap thread.
+ */
+- (BOOL)isCurrentThread;
+
+/**
+ Run a block on the tap thread, and wait for it to complete.  If called from the tap thread, the block is run immediately.
+ */
+- (void)performBlockAndWait:(void(^)(void))block;
+
+@end
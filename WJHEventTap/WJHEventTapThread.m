@@ -0,0 +1,122 @@
+//
+//  WJHEventTapThread.m
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import "WJHEventTapThread.h"
+
+/**
+ The state shared between a WJHEventTapThread and the thread it runs.  The thread only references this object, and never the WJHEventTapThread itself, so the thread does not keep its owner alive.
+ */
+@interface WJHEventTapThreadState : NSObject
+@property (atomic, strong) NSRunLoop *runLoop;
+@property (atomic, assign) BOOL stopped;
+@property (nonatomic, strong, readonly) dispatch_semaphore_t started;
+@property (nonatomic, strong, readonly) dispatch_semaphore_t finished;
+@end
+
+@implementation WJHEventTapThreadState
+- (instancetype)init {
+    if (self = [super init]) {
+        _started = dispatch_semaphore_create(0);
+        _finished = dispatch_semaphore_create(0);
+    }
+    return self;
+}
+@end
+
+
+@implementation WJHEventTapThread {
+    NSThread *_thread;
+    WJHEventTapThreadState *_state;
+    CFRunLoopRef _cfRunLoop;
+}
+
++ (void)threadMain:(WJHEventTapThreadState *)state {
+    @autoreleasepool {
+        NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+
+        // A run loop with no sources returns immediately, and tap sources come and go, so keep a port in it for the lifetime of the thread.
+        [runLoop addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+        state.runLoop = runLoop;
+        dispatch_semaphore_signal(state.started);
+    }
+
+    while (!state.stopped) {
+        @autoreleasepool {
+            [state.runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+        }
+    }
+    dispatch_semaphore_signal(state.finished);
+}
+
+- (instancetype)init {
+    return [self initWithName:nil];
+}
+
+- (instancetype)initWithName:(NSString *)name {
+    return [self initWithName:name qualityOfService:NSQualityOfServiceUserInteractive];
+}
+
+- (instancetype)initWithName:(NSString *)name qualityOfService:(NSQualityOfService)qualityOfService {
+    if (self = [super init]) {
+        _name = [name copy] ?: @"com.thinksolutions.WJHEventTap.thread";
+        _state = [WJHEventTapThreadState new];
+        _thread = [[NSThread alloc] initWithTarget:[self class] selector:@selector(threadMain:) object:_state];
+        _thread.name = _name;
+        if ([_thread respondsToSelector:@selector(setQualityOfService:)]) {
+            _thread.qualityOfService = qualityOfService;
+        } else {
+            _thread.threadPriority = 1.0;
+        }
+        [_thread start];
+
+        dispatch_semaphore_wait(_state.started, DISPATCH_TIME_FOREVER);
+        _runLoop = _state.runLoop;
+        _cfRunLoop = [_runLoop getCFRunLoop];
+        CFRetain(_cfRunLoop);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    WJHEventTapThreadState *state = _state;
+    if ([self isCurrentThread]) {
+        // The thread can not wait for itself.  Whatever released the last reference is the only thing running on it, and the thread exits when that returns to the run loop.
+        state.stopped = YES;
+        CFRunLoopStop(_cfRunLoop);
+    } else {
+        CFRunLoopPerformBlock(_cfRunLoop, kCFRunLoopDefaultMode, ^{
+            state.stopped = YES;
+            CFRunLoopStop(CFRunLoopGetCurrent());
+        });
+        CFRunLoopWakeUp(_cfRunLoop);
+
+        // No tap callback may still be running on the thread once its owner is gone.
+        dispatch_semaphore_wait(state.finished, DISPATCH_TIME_FOREVER);
+    }
+    CFRelease(_cfRunLoop);
+}
+
+- (BOOL)isCurrentThread {
+    return [NSThread currentThread] == _thread;
+}
+
+- (void)performBlockAndWait:(void(^)(void))block {
+    if ([self isCurrentThread]) {
+        block();
+        return;
+    }
+
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    CFRunLoopPerformBlock(_cfRunLoop, kCFRunLoopCommonModes, ^{
+        block();
+        dispatch_semaphore_signal(done);
+    });
+    CFRunLoopWakeUp(_cfRunLoop);
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+}
+
+@end
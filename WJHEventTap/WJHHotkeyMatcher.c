@@ -0,0 +1,211 @@
+//
+//  WJHHotkeyMatcher.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHHotkeyMatcher.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    kRootState = 0,
+};
+
+static size_t const kNoBinding = SIZE_MAX;
+static uint64_t const kForever = UINT64_MAX;
+
+/**
+ An edge of the trie.  A next state of zero marks an empty slot, as no edge leads back to the root.
+ */
+typedef struct Edge {
+    uint64_t modifiers;
+    uint32_t state;
+    uint32_t next;
+    uint16_t keycode;
+} Edge;
+
+typedef struct State {
+    /// The binding completed by reaching this state, or kNoBinding.
+    size_t binding;
+
+    /// How long to wait for the next chord, for states in the middle of a sequence.
+    uint64_t timeout;
+
+    bool hasEdges;
+} State;
+
+struct WJHHotkeyMatcher {
+    uint64_t modifierMask;
+    Edge *edges;
+    size_t edgeMask;
+    State *states;
+    uint32_t stateCount;
+
+    // The sequence being typed.
+    uint32_t state;
+    uint64_t deadline;
+
+    // The keys whose press was matched, so their release is too.
+    uint64_t keysDown[kWJHHotkeyKeycodeLimit / 64];
+};
+
+static inline size_t hashEdge(uint32_t state, uint16_t keycode, uint64_t modifiers) {
+    uint64_t h = ((uint64_t)state << 16 | keycode) * UINT64_C(0x9E3779B97F4A7C15);
+    h ^= modifiers * UINT64_C(0xC2B2AE3D27D4EB4F);
+    return (size_t)(h ^ (h >> 29));
+}
+
+/**
+ Find the slot of an edge, which is empty if there is no such edge.
+ */
+static inline Edge * findEdge(WJHHotkeyMatcher const *matcher, uint32_t state, uint16_t keycode, uint64_t modifiers) {
+    size_t index = hashEdge(state, keycode, modifiers) & matcher->edgeMask;
+    for (;;) {
+        Edge *edge = matcher->edges + index;
+        if (edge->next == 0 || (edge->state == state && edge->keycode == keycode && edge->modifiers == modifiers)) {
+            return edge;
+        }
+        index = (index + 1) & matcher->edgeMask;
+    }
+}
+
+static bool addBinding(WJHHotkeyMatcher *matcher, WJHHotkeyBinding const *binding, size_t index) {
+    if (binding->chordCount == 0) {
+        return false;
+    }
+    uint64_t const timeout = binding->timeout ? binding->timeout : kForever;
+    uint32_t state = kRootState;
+    for (size_t i = 0; i < binding->chordCount; ++i) {
+        WJHHotkeyChord const *chord = binding->chords + i;
+        if (chord->keycode >= kWJHHotkeyKeycodeLimit || matcher->states[state].binding != kNoBinding) {
+            return false;
+        }
+        uint64_t const modifiers = chord->modifiers & matcher->modifierMask;
+        Edge *edge = findEdge(matcher, state, chord->keycode, modifiers);
+        if (edge->next == 0) {
+            uint32_t next = matcher->stateCount++;
+            matcher->states[next] = (State){ .binding = kNoBinding };
+            *edge = (Edge){ .modifiers = modifiers, .state = state, .next = next, .keycode = chord->keycode };
+            matcher->states[state].hasEdges = true;
+        }
+        if (state != kRootState && matcher->states[state].timeout < timeout) {
+            matcher->states[state].timeout = timeout;
+        }
+        state = edge->next;
+    }
+
+    State *last = matcher->states + state;
+    if (last->binding != kNoBinding || last->hasEdges) {
+        return false;
+    }
+    last->binding = index;
+    return true;
+}
+
+WJHHotkeyMatcher * WJHHotkeyMatcherCreate(WJHHotkeyBinding const *bindings, size_t count, uint64_t modifierMask, size_t *invalidBinding) {
+    size_t chordCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        chordCount += bindings[i].chordCount;
+    }
+    if (chordCount >= UINT32_MAX / 2) {
+        return NULL;
+    }
+
+    // Keep the table at most half full, so probe sequences stay short.
+    size_t edgeCapacity = 16;
+    while (edgeCapacity < 2 * chordCount) {
+        edgeCapacity *= 2;
+    }
+
+    WJHHotkeyMatcher *matcher = calloc(1, sizeof(*matcher));
+    if (matcher == NULL) {
+        return NULL;
+    }
+    matcher->modifierMask = modifierMask;
+    matcher->edges = calloc(edgeCapacity, sizeof(Edge));
+    matcher->edgeMask = edgeCapacity - 1;
+    matcher->states = malloc((chordCount + 1) * sizeof(State));
+    if (matcher->edges == NULL || matcher->states == NULL) {
+        WJHHotkeyMatcherDestroy(matcher);
+        return NULL;
+    }
+    matcher->states[kRootState] = (State){ .binding = kNoBinding };
+    matcher->stateCount = 1;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!addBinding(matcher, bindings + i, i)) {
+            if (invalidBinding) {
+                *invalidBinding = i;
+            }
+            WJHHotkeyMatcherDestroy(matcher);
+            return NULL;
+        }
+    }
+    return matcher;
+}
+
+void WJHHotkeyMatcherDestroy(WJHHotkeyMatcher *matcher) {
+    if (matcher) {
+        free(matcher->edges);
+        free(matcher->states);
+        free(matcher);
+    }
+}
+
+WJHHotkeyResult WJHHotkeyMatcherKeyDown(WJHHotkeyMatcher *matcher, uint16_t keycode, uint64_t modifiers, uint64_t timestamp, size_t *binding) {
+    if (keycode >= kWJHHotkeyKeycodeLimit) {
+        matcher->state = kRootState;
+        return WJHHotkeyUnmatched;
+    }
+    modifiers &= matcher->modifierMask;
+    if (matcher->state != kRootState && timestamp > matcher->deadline) {
+        matcher->state = kRootState;
+    }
+
+    Edge const *edge = findEdge(matcher, matcher->state, keycode, modifiers);
+    if (edge->next == 0 && matcher->state != kRootState) {
+        // The sequence is broken, but the key may start another.
+        matcher->state = kRootState;
+        edge = findEdge(matcher, kRootState, keycode, modifiers);
+    }
+    if (edge->next == 0) {
+        return WJHHotkeyUnmatched;
+    }
+
+    State const *state = matcher->states + edge->next;
+    if (state->binding != kNoBinding) {
+        matcher->keysDown[keycode / 64] |= UINT64_C(1) << (keycode % 64);
+        matcher->state = kRootState;
+        if (binding) {
+            *binding = state->binding;
+        }
+        return WJHHotkeyMatched;
+    }
+
+    matcher->state = edge->next;
+    matcher->deadline = state->timeout > kForever - timestamp ? kForever : timestamp + state->timeout;
+    return WJHHotkeyPending;
+}
+
+bool WJHHotkeyMatcherKeyUp(WJHHotkeyMatcher *matcher, uint16_t keycode) {
+    if (keycode >= kWJHHotkeyKeycodeLimit) {
+        return false;
+    }
+    uint64_t const bit = UINT64_C(1) << (keycode % 64);
+    uint64_t *word = matcher->keysDown + keycode / 64;
+    bool const down = (*word & bit) != 0;
+    *word &= ~bit;
+    return down;
+}
+
+bool WJHHotkeyMatcherIsPending(WJHHotkeyMatcher const *matcher) {
+    return matcher->state != kRootState;
+}
+
+void WJHHotkeyMatcherReset(WJHHotkeyMatcher *matcher) {
+    matcher->state = kRootState;
+    memset(matcher->keysDown, 0, sizeof(matcher->keysDown));
+}
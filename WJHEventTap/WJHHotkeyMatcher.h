@@ -0,0 +1,120 @@
+//
+//  WJHHotkeyMatcher.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHHotkeyMatcher_h
+#define WJHEventTap_WJHHotkeyMatcher_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    /// Keycodes in a binding must be less than this.
+    kWJHHotkeyKeycodeLimit = 1024,
+};
+
+/**
+ A key pressed with a set of modifiers, such as Ctrl-K.
+ */
+typedef struct WJHHotkeyChord {
+    uint16_t keycode;
+
+    /// The modifiers that must be down, and no others, among those the matcher looks at.
+    uint64_t modifiers;
+} WJHHotkeyChord;
+
+/**
+ A hotkey, which is a single chord, or a sequence of chords such as "Ctrl-K then Ctrl-S".
+ */
+typedef struct WJHHotkeyBinding {
+    WJHHotkeyChord const *chords;
+    size_t chordCount;
+
+    /// The longest time, in nanoseconds, allowed between consecutive chords of a sequence.  Zero waits forever.
+    uint64_t timeout;
+} WJHHotkeyBinding;
+
+/**
+ What a matcher made of a key press.
+ */
+typedef enum WJHHotkeyResult {
+    /// The key press is not part of any binding, and should be passed along.
+    WJHHotkeyUnmatched,
+
+    /// The key press advanced a sequence, which needs more chords.  It should still be passed along, as the sequence may never be completed.
+    WJHHotkeyPending,
+
+    /// The key press completed a binding.
+    WJHHotkeyMatched,
+} WJHHotkeyResult;
+
+/**
+ A set of bindings compiled into a state machine.
+
+ Each binding is a path in a trie, whose edges are kept in a single open addressed hash table keyed by (state, keycode, modifiers).  A key press is one hash lookup from the current state, or two if it breaks a sequence and is retried from the start, so the cost of an event does not depend on the number of bindings.
+
+ A matcher holds the state of the sequence being typed, so it must only be used from one thread at a time, and only for one stream of events.  Pressing and releasing modifiers between the chords of a sequence does not break it; any other key press that does not continue the sequence abandons it, and starts over.  Key presses are never buffered: those that advance a sequence are reported as pending, whether or not the sequence is completed, so that they can be passed along, and only the press that completes a binding is consumed.
+
+ Key presses never allocate.  The matcher only depends on the C standard library, so it can be built and tested anywhere.
+ */
+typedef struct WJHHotkeyMatcher WJHHotkeyMatcher;
+
+/**
+ Compile a set of bindings.
+
+ @param bindings the bindings, whose indexes identify them to WJHHotkeyMatcherKeyDown
+ @param count the number of bindings
+ @param modifierMask the modifier bits the matcher looks at.  Other bits, in bindings and key presses alike, are ignored.
+ @param invalidBinding if not NULL, and compilation fails because of a binding, receives its index
+
+ @return a new matcher, which must be released with WJHHotkeyMatcherDestroy, or NULL if memory could not be allocated, or a binding is invalid.  A binding is invalid if it has no chords, has a keycode of kWJHHotkeyKeycodeLimit or more, or is the same as, or a prefix of, an earlier binding, or the other way round.
+ */
+WJHHotkeyMatcher * WJHHotkeyMatcherCreate(WJHHotkeyBinding const *bindings, size_t count, uint64_t modifierMask, size_t *invalidBinding);
+
+/**
+ Destroy a matcher.
+ */
+void WJHHotkeyMatcherDestroy(WJHHotkeyMatcher *matcher);
+
+/**
+ Feed a key press to the matcher.
+
+ @param keycode the virtual keycode
+ @param modifiers the modifiers that are down
+ @param timestamp the time of the key press, in nanoseconds, used to expire sequences
+ @param binding receives the index of the binding, if the result is WJHHotkeyMatched
+
+ @return what the key press did.  The key release for a press that is WJHHotkeyMatched is reported by WJHHotkeyMatcherKeyUp.
+ */
+WJHHotkeyResult WJHHotkeyMatcherKeyDown(WJHHotkeyMatcher *matcher, uint16_t keycode, uint64_t modifiers, uint64_t timestamp, size_t *binding);
+
+/**
+ Feed a key release to the matcher.
+
+ @return true if the press of the key completed a binding, in which case the release belongs to the binding as well.
+ */
+bool WJHHotkeyMatcherKeyUp(WJHHotkeyMatcher *matcher, uint16_t keycode);
+
+/**
+ Whether the matcher is in the middle of a sequence.
+ */
+bool WJHHotkeyMatcherIsPending(WJHHotkeyMatcher const *matcher);
+
+/**
+ Abandon any sequence in progress, and forget which keys are down.
+ */
+void WJHHotkeyMatcherReset(WJHHotkeyMatcher *matcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
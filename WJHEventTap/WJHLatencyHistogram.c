@@ -0,0 +1,126 @@
+//
+//  WJHLatencyHistogram.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHLatencyHistogram.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define WJH_SUB_BUCKET_COUNT (UINT64_C(1) << kWJHLatencyHistogramSubBucketBits)
+
+struct WJHLatencyHistogram {
+    _Atomic uint64_t count;
+    _Atomic uint64_t total;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[kWJHLatencyHistogramBucketCount];
+};
+
+WJHLatencyHistogram * WJHLatencyHistogramCreate(void) {
+    WJHLatencyHistogram *histogram = calloc(1, sizeof(*histogram));
+    return histogram;
+}
+
+void WJHLatencyHistogramDestroy(WJHLatencyHistogram *histogram) {
+    free(histogram);
+}
+
+uint32_t WJHLatencyHistogramBucketIndex(uint64_t value) {
+    if (value < WJH_SUB_BUCKET_COUNT) {
+        return (uint32_t)value;
+    }
+    if (value >> kWJHLatencyHistogramValueBits) {
+        return kWJHLatencyHistogramBucketCount - 1;
+    }
+
+    // The first sub-bucket range is linear, and each following power of two gets the same number of sub-buckets.
+    uint32_t msb = 63 - (uint32_t)__builtin_clzll(value);
+    uint32_t shift = msb - kWJHLatencyHistogramSubBucketBits;
+    return ((shift + 1) << kWJHLatencyHistogramSubBucketBits) + (uint32_t)((value >> shift) & (WJH_SUB_BUCKET_COUNT - 1));
+}
+
+uint64_t WJHLatencyHistogramBucketMaxValue(uint32_t bucket) {
+    if (bucket < WJH_SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    if (bucket >= kWJHLatencyHistogramBucketCount - 1) {
+        return UINT64_MAX;
+    }
+    uint32_t shift = (bucket >> kWJHLatencyHistogramSubBucketBits) - 1;
+    uint64_t subBucket = bucket & (WJH_SUB_BUCKET_COUNT - 1);
+    return ((WJH_SUB_BUCKET_COUNT + subBucket + 1) << shift) - 1;
+}
+
+void WJHLatencyHistogramRecord(WJHLatencyHistogram *histogram, uint64_t value) {
+    // There is only one writer, so plain load/store pairs are enough, and avoid the cost of locked instructions.
+    _Atomic uint64_t *bucket = histogram->buckets + WJHLatencyHistogramBucketIndex(value);
+    atomic_store_explicit(bucket, atomic_load_explicit(bucket, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&histogram->total, atomic_load_explicit(&histogram->total, memory_order_relaxed) + value, memory_order_relaxed);
+    if (value > atomic_load_explicit(&histogram->max, memory_order_relaxed)) {
+        atomic_store_explicit(&histogram->max, value, memory_order_relaxed);
+    }
+    atomic_store_explicit(&histogram->count, atomic_load_explicit(&histogram->count, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/**
+ Copy the bucket counts, so every percentile is computed from the same data.
+
+ @return the sum of the copied counts
+ */
+static uint64_t copyBuckets(WJHLatencyHistogram const *histogram, uint64_t *buckets) {
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < kWJHLatencyHistogramBucketCount; ++i) {
+        buckets[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        count += buckets[i];
+    }
+    return count;
+}
+
+static uint64_t valueAtPercentile(uint64_t const *buckets, uint64_t count, uint64_t max, double percentile) {
+    if (count == 0) {
+        return 0;
+    }
+    if (percentile < 0) {
+        percentile = 0;
+    } else if (percentile > 100) {
+        percentile = 100;
+    }
+
+    uint64_t rank = (uint64_t)ceil(percentile / 100 * (double)count);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < kWJHLatencyHistogramBucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t value = WJHLatencyHistogramBucketMaxValue(i);
+            return value < max ? value : max;
+        }
+    }
+    return max;
+}
+
+void WJHLatencyHistogramGetSnapshot(WJHLatencyHistogram const *histogram, WJHLatencyHistogramSnapshot *snapshot) {
+    uint64_t buckets[kWJHLatencyHistogramBucketCount];
+    uint64_t count = copyBuckets(histogram, buckets);
+    uint64_t total = atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+
+    snapshot->count = count;
+    snapshot->mean = count ? total / count : 0;
+    snapshot->p50 = valueAtPercentile(buckets, count, max, 50);
+    snapshot->p99 = valueAtPercentile(buckets, count, max, 99);
+    snapshot->p999 = valueAtPercentile(buckets, count, max, 99.9);
+    snapshot->max = max;
+}
+
+uint64_t WJHLatencyHistogramValueAtPercentile(WJHLatencyHistogram const *histogram, double percentile) {
+    uint64_t buckets[kWJHLatencyHistogramBucketCount];
+    uint64_t count = copyBuckets(histogram, buckets);
+    return valueAtPercentile(buckets, count, atomic_load_explicit(&histogram->max, memory_order_relaxed), percentile);
+}
@@ -0,0 +1,91 @@
+//
+//  WJHLatencyHistogram.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHLatencyHistogram_h
+#define WJHEventTap_WJHLatencyHistogram_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    /// Each power of two is split into 2^kWJHLatencyHistogramSubBucketBits linear buckets, so a recorded value is reported within 1/16 (6.25%) of its true value.
+    kWJHLatencyHistogramSubBucketBits = 4,
+
+    /// Values of 2^kWJHLatencyHistogramValueBits or more are counted in the last bucket.
+    kWJHLatencyHistogramValueBits = 40,
+
+    kWJHLatencyHistogramBucketCount = (kWJHLatencyHistogramValueBits - kWJHLatencyHistogramSubBucketBits + 1) << kWJHLatencyHistogramSubBucketBits,
+};
+
+/**
+ A summary of a histogram, in the units that were recorded.
+ */
+typedef struct WJHLatencyHistogramSnapshot {
+    uint64_t count;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} WJHLatencyHistogramSnapshot;
+
+/**
+ A fixed-size, log-linear histogram of latencies.
+
+ Recording is a handful of relaxed atomic loads and stores: no allocation, no locks, and no read-modify-write instructions.  The price is that only one thread may record into a histogram at any given time.  Any number of threads may take snapshots concurrently with the recording thread, without ever blocking it; a snapshot may miss values recorded while it is being taken.
+
+ The histogram is unit-agnostic.  It only depends on the C standard library, so it can be built and tested anywhere.
+ */
+typedef struct WJHLatencyHistogram WJHLatencyHistogram;
+
+/**
+ Create an empty histogram.
+
+ @return a new histogram, which must be released with WJHLatencyHistogramDestroy, or NULL if memory could not be allocated.
+ */
+WJHLatencyHistogram * WJHLatencyHistogramCreate(void);
+
+/**
+ Destroy a histogram.  No thread may be using it.
+ */
+void WJHLatencyHistogramDestroy(WJHLatencyHistogram *histogram);
+
+/**
+ Add a value to the histogram.  May only be called by one thread at a time.
+ */
+void WJHLatencyHistogramRecord(WJHLatencyHistogram *histogram, uint64_t value);
+
+/**
+ Summarize the histogram.  May be called from any thread.
+
+ Percentiles are reported as the largest value that falls in the same bucket as the value at that rank, but never more than the largest value recorded.  All values are zero if nothing has been recorded.
+ */
+void WJHLatencyHistogramGetSnapshot(WJHLatencyHistogram const *histogram, WJHLatencyHistogramSnapshot *snapshot);
+
+/**
+ The value at @a percentile (in [0, 100]), with the same precision as the values in a snapshot.
+ */
+uint64_t WJHLatencyHistogramValueAtPercentile(WJHLatencyHistogram const *histogram, double percentile);
+
+/**
+ The bucket into which @a value is counted.
+ */
+uint32_t WJHLatencyHistogramBucketIndex(uint64_t value);
+
+/**
+ The largest value counted in @a bucket.
+ */
+uint64_t WJHLatencyHistogramBucketMaxValue(uint32_t bucket);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
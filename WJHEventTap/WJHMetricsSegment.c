@@ -0,0 +1,336 @@
+//
+//  WJHMetricsSegment.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHMetricsSegment.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {
+    kCacheLineSize = 64,
+    kNameLimit = 256,
+    kCounterCount = sizeof(WJHMetricsCounters) / sizeof(uint64_t),
+
+    /// A reader gives up after this many copies that raced with the writer.
+    kReadAttempts = 1000,
+
+    /// ...and starts yielding to the writer after this many.
+    kReadSpins = 8,
+};
+
+_Static_assert(sizeof(WJHMetricsCounters) % sizeof(uint64_t) == 0, "Every counter must be a uint64_t");
+
+static uint32_t const kMagic = 0x4D484A57; // "WJHM", little-endian
+
+/**
+ The fixed part of the segment, which never changes once the magic number is set, except for eventTapID, which is replaced when the tap replaces its system tap.
+ */
+typedef struct SegmentHeader {
+    atomic_uint magic;
+    uint32_t version;
+    uint32_t countersOffset;
+    uint32_t countersSize;
+    int32_t pid;
+    atomic_uint eventTapID;
+    uint32_t typeLimit;
+    uint32_t timeBucketCount;
+} SegmentHeader;
+
+/*
+ The segment, as it is laid out in shared memory.  The header has a line to itself; the sequence number shares the next with the first counters, since the writer stores to both.
+ */
+typedef struct Segment {
+    SegmentHeader header;
+    char padding[kCacheLineSize - sizeof(SegmentHeader)];
+    atomic_uint sequence;
+    uint32_t reserved;
+    _Atomic uint64_t counters[kCounterCount];
+} Segment;
+
+#define COUNTER(_member_) (offsetof(WJHMetricsCounters, _member_) / sizeof(uint64_t))
+
+struct WJHMetricsWriter {
+    Segment *segment;
+    uint64_t ringBufferOverflows;
+    char name[kNameLimit];
+};
+
+struct WJHMetricsReader {
+    Segment const *segment;
+    size_t size;
+    uint32_t counterCount;
+};
+
+static bool copyName(char *buffer, char const *name) {
+    int length = snprintf(buffer, kNameLimit, "%s%s", name[0] == '/' ? "" : "/", name);
+    if (length < 0 || length >= kNameLimit) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    return true;
+}
+
+
+#pragma mark - Writer
+
+WJHMetricsWriter * WJHMetricsWriterCreate(char const *name, uint32_t eventTapID) {
+    WJHMetricsWriter *writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        return NULL;
+    }
+    if (!copyName(writer->name, name)) {
+        free(writer);
+        return NULL;
+    }
+
+    // A segment left behind by a process that died is replaced, rather than reused, so no reader can mistake its counters for ours.
+    shm_unlink(writer->name);
+    int fd = shm_open(writer->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        free(writer);
+        return NULL;
+    }
+    Segment *segment = MAP_FAILED;
+    if (ftruncate(fd, sizeof(Segment)) == 0) {
+        segment = mmap(NULL, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    close(fd);
+    if (segment == MAP_FAILED) {
+        shm_unlink(writer->name);
+        free(writer);
+        errno = error;
+        return NULL;
+    }
+
+    // The segment is zero filled, so only the header needs to be written.  The magic number goes last, so a reader never sees half a header.
+    segment->header.version = kWJHMetricsVersion;
+    segment->header.countersOffset = offsetof(Segment, counters);
+    segment->header.countersSize = sizeof(WJHMetricsCounters);
+    segment->header.pid = (int32_t)getpid();
+    atomic_init(&segment->header.eventTapID, eventTapID);
+    segment->header.typeLimit = kWJHMetricsTypeLimit;
+    segment->header.timeBucketCount = kWJHMetricsTimeBucketCount;
+    atomic_store_explicit(&segment->header.magic, kMagic, memory_order_release);
+    writer->segment = segment;
+    return writer;
+}
+
+void WJHMetricsWriterDestroy(WJHMetricsWriter *writer) {
+    if (writer == NULL) {
+        return;
+    }
+    shm_unlink(writer->name);
+    munmap(writer->segment, sizeof(Segment));
+    free(writer);
+}
+
+static inline void beginWrite(Segment *segment) {
+    unsigned sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+}
+
+static inline void endWrite(Segment *segment) {
+    unsigned sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_release);
+}
+
+/**
+ There is only one writer, so a load and a store is enough, and much cheaper than an atomic add.  The store releases the odd sequence number before it: a reader that acquires the new count is bound to see the sequence number changed when it checks again.  On x86 that costs nothing over a relaxed store.
+ */
+static inline void add(Segment *segment, size_t counter, uint64_t value) {
+    _Atomic uint64_t *word = segment->counters + counter;
+    atomic_store_explicit(word, atomic_load_explicit(word, memory_order_relaxed) + value, memory_order_release);
+}
+
+static inline unsigned timeBucket(uint64_t nanoseconds) {
+    if (nanoseconds == 0) {
+        return 0;
+    }
+    unsigned bucket = 63 - (unsigned)__builtin_clzll(nanoseconds);
+    return bucket < kWJHMetricsTimeBucketCount ? bucket : kWJHMetricsTimeBucketCount - 1;
+}
+
+void WJHMetricsWriterRecordEvent(WJHMetricsWriter *writer, uint32_t type, WJHMetricsOutcome outcome, uint64_t nanoseconds) {
+    Segment *segment = writer->segment;
+    beginWrite(segment);
+    add(segment, type < kWJHMetricsTypeLimit ? COUNTER(eventsByType) + type : COUNTER(otherEvents), 1);
+    switch (outcome) {
+        case WJHMetricsPassed: add(segment, COUNTER(passed), 1); break;
+        case WJHMetricsModified: add(segment, COUNTER(modified), 1); break;
+        case WJHMetricsDropped: add(segment, COUNTER(dropped), 1); break;
+    }
+    add(segment, COUNTER(callbackNanoseconds), nanoseconds);
+    add(segment, COUNTER(callbackTimes) + timeBucket(nanoseconds), 1);
+    endWrite(segment);
+}
+
+void WJHMetricsWriterRecordDisable(WJHMetricsWriter *writer, bool timeout) {
+    Segment *segment = writer->segment;
+    beginWrite(segment);
+    add(segment, timeout ? COUNTER(timeoutDisables) : COUNTER(userInputDisables), 1);
+    endWrite(segment);
+}
+
+void WJHMetricsWriterSetRingBufferOverflows(WJHMetricsWriter *writer, uint64_t overflows) {
+    if (overflows == writer->ringBufferOverflows) {
+        return;
+    }
+    Segment *segment = writer->segment;
+    beginWrite(segment);
+    add(segment, COUNTER(ringBufferOverflows), overflows - writer->ringBufferOverflows);
+    endWrite(segment);
+    writer->ringBufferOverflows = overflows;
+}
+
+void WJHMetricsWriterSetEventTapID(WJHMetricsWriter *writer, uint32_t eventTapID) {
+    atomic_store_explicit(&writer->segment->header.eventTapID, eventTapID, memory_order_relaxed);
+}
+
+
+#pragma mark - Reader
+
+WJHMetricsOpenResult WJHMetricsReaderOpen(char const *name, WJHMetricsReader **reader) {
+    char path[kNameLimit];
+    if (!copyName(path, name)) {
+        return WJHMetricsOpenFailed;
+    }
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        return errno == ENOENT ? WJHMetricsNotFound : WJHMetricsOpenFailed;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return WJHMetricsOpenFailed;
+    }
+    if ((size_t)status.st_size < sizeof(SegmentHeader)) {
+        // The writer has not sized it yet.
+        close(fd);
+        return WJHMetricsNotFound;
+    }
+    size_t size = (size_t)status.st_size;
+    Segment const *segment = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (segment == MAP_FAILED) {
+        errno = error;
+        return WJHMetricsOpenFailed;
+    }
+
+    WJHMetricsOpenResult result = WJHMetricsOpened;
+    SegmentHeader const *header = &segment->header;
+    if (atomic_load_explicit((atomic_uint *)&header->magic, memory_order_acquire) != kMagic) {
+        result = WJHMetricsNotFound;
+    } else if (header->version != kWJHMetricsVersion || header->typeLimit != kWJHMetricsTypeLimit || header->timeBucketCount != kWJHMetricsTimeBucketCount || header->countersOffset != offsetof(Segment, counters) || header->countersSize % sizeof(uint64_t) != 0 || (size_t)header->countersOffset + header->countersSize > size) {
+        result = WJHMetricsIncompatible;
+    } else if ((*reader = calloc(1, sizeof(**reader))) == NULL) {
+        result = WJHMetricsOpenFailed;
+    } else {
+        (*reader)->segment = segment;
+        (*reader)->size = size;
+        // A writer built with more counters, added at the end without changing the version, has a larger countersSize; this reader copies the ones it knows about.  One built with fewer leaves the rest zero.
+        uint32_t counterCount = header->countersSize / sizeof(uint64_t);
+        (*reader)->counterCount = counterCount < kCounterCount ? counterCount : kCounterCount;
+        return WJHMetricsOpened;
+    }
+    munmap((void *)segment, size);
+    return result;
+}
+
+void WJHMetricsReaderClose(WJHMetricsReader *reader) {
+    if (reader == NULL) {
+        return;
+    }
+    munmap((void *)reader->segment, reader->size);
+    free(reader);
+}
+
+bool WJHMetricsReaderRead(WJHMetricsReader *reader, WJHMetricsSnapshot *snapshot) {
+    // The mapping is read-only, but atomic loads never store.
+    Segment *segment = (Segment *)reader->segment;
+    uint64_t counters[kCounterCount] = { 0 };
+    for (unsigned attempt = 0; attempt < kReadAttempts; ++attempt) {
+        if (attempt >= kReadSpins) {
+            sched_yield();
+        }
+        unsigned before = atomic_load_explicit(&segment->sequence, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        // Each load acquires, so the check of the sequence number can not be satisfied before it, and sees any write whose counts it copied.
+        for (uint32_t i = 0; i < reader->counterCount; ++i) {
+            counters[i] = atomic_load_explicit(segment->counters + i, memory_order_acquire);
+        }
+        if (atomic_load_explicit(&segment->sequence, memory_order_relaxed) == before) {
+            snapshot->pid = segment->header.pid;
+            snapshot->eventTapID = atomic_load_explicit(&segment->header.eventTapID, memory_order_relaxed);
+            memcpy(&snapshot->counters, counters, sizeof(snapshot->counters));
+            return true;
+        }
+    }
+    return false;
+}
+
+
+#pragma mark - Counters
+
+uint64_t WJHMetricsCountersEvents(WJHMetricsCounters const *counters) {
+    uint64_t events = counters->otherEvents;
+    for (unsigned type = 0; type < kWJHMetricsTypeLimit; ++type) {
+        events += counters->eventsByType[type];
+    }
+    return events;
+}
+
+void WJHMetricsCountersDifference(WJHMetricsCounters *result, WJHMetricsCounters const *later, WJHMetricsCounters const *earlier) {
+    uint64_t laterWords[kCounterCount], earlierWords[kCounterCount];
+    memcpy(laterWords, later, sizeof(laterWords));
+    memcpy(earlierWords, earlier, sizeof(earlierWords));
+    for (size_t i = 0; i < kCounterCount; ++i) {
+        laterWords[i] -= earlierWords[i];
+    }
+    memcpy(result, laterWords, sizeof(*result));
+}
+
+uint64_t WJHMetricsCountersTimePercentile(WJHMetricsCounters const *counters, double percentile) {
+    uint64_t count = 0;
+    for (unsigned bucket = 0; bucket < kWJHMetricsTimeBucketCount; ++bucket) {
+        count += counters->callbackTimes[bucket];
+    }
+    if (count == 0) {
+        return 0;
+    }
+    if (percentile < 0) {
+        percentile = 0;
+    } else if (percentile > 100) {
+        percentile = 100;
+    }
+
+    // The rank of the percentile, counting from one, so the 0th percentile is the smallest time.
+    uint64_t rank = (uint64_t)(percentile / 100 * (double)count + 0.5);
+    rank = rank ? rank : 1;
+    uint64_t seen = 0;
+    for (unsigned bucket = 0; bucket < kWJHMetricsTimeBucketCount - 1; ++bucket) {
+        seen += counters->callbackTimes[bucket];
+        if (seen >= rank) {
+            return UINT64_C(1) << (bucket + 1);
+        }
+    }
+    return UINT64_MAX;
+}
@@ -0,0 +1,193 @@
+//
+//  WJHMetricsSegment.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHMetricsSegment_h
+#define WJHEventTap_WJHMetricsSegment_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    /// Events are counted by type below this.  Larger types are counted together, in otherEvents.
+    kWJHMetricsTypeLimit = 32,
+
+    /// Callback times are counted in power of two buckets of nanoseconds.  Bucket i counts times of 2^i up to 2^(i+1) nanoseconds, except that the first bucket also counts zero, and the last everything longer.
+    kWJHMetricsTimeBucketCount = 32,
+
+    /// The version of the segment layout.  It changes whenever the layout changes incompatibly; counters are only ever added at the end, which does not change it.
+    kWJHMetricsVersion = 1,
+};
+
+/**
+ What the callback did with an event.
+ */
+typedef enum WJHMetricsOutcome {
+    /// The event was returned to the system.  An event changed in place, as by a remap, counts as passed.
+    WJHMetricsPassed,
+
+    /// Another event was returned in its place.
+    WJHMetricsModified,
+
+    /// The event was removed from the event stream.
+    WJHMetricsDropped,
+} WJHMetricsOutcome;
+
+/**
+ The counters of one tap, since its metrics were enabled.
+ */
+typedef struct WJHMetricsCounters {
+    /// Events by CGEventType.  Tap notifications are not events; they are counted as disables.
+    uint64_t eventsByType[kWJHMetricsTypeLimit];
+    uint64_t otherEvents;
+
+    uint64_t passed;
+    uint64_t modified;
+    uint64_t dropped;
+
+    /// The number of times the queue to an asynchronous delegate was full.
+    uint64_t ringBufferOverflows;
+
+    /// The number of times the system disabled the tap, because it was too slow, or because of user input.
+    uint64_t timeoutDisables;
+    uint64_t userInputDisables;
+
+    /// The total time spent in the callback, and the number of callbacks by how long they took.
+    uint64_t callbackNanoseconds;
+    uint64_t callbackTimes[kWJHMetricsTimeBucketCount];
+} WJHMetricsCounters;
+
+/**
+ A consistent copy of a segment.
+ */
+typedef struct WJHMetricsSnapshot {
+    /// The process that publishes the segment, and the tap's current eventTapID.
+    int32_t pid;
+    uint32_t eventTapID;
+
+    WJHMetricsCounters counters;
+} WJHMetricsSnapshot;
+
+/**
+ Publishes the counters of one tap in a named POSIX shared memory segment, where another process can read them without any round trip into the tapped process.
+
+ The segment starts with a small header (a magic number, kWJHMetricsVersion, the offset and size of the counters, the publisher's pid and eventTapID), followed by a sequence number and a WJHMetricsCounters, every member of which is a 64 bit counter.  The sequence number is a seqlock: the writer makes it odd, updates the counters, and makes it even again, and a reader retries any copy during which it was odd, or changed.  The ordering is carried by release stores and acquire loads of the sequence number and the counters themselves, with no fences, so ThreadSanitizer can check it.
+
+ The writer never waits for anything: each update is a pair of stores to the sequence number, and a load and a release store of each counter it touches, with no locks and no read-modify-write instructions.  The price is that only one thread may write at any given time, which the tap callback satisfies.  Readers may be in any number of processes.
+
+ It only depends on POSIX, so it can be built and tested anywhere.
+ */
+typedef struct WJHMetricsWriter WJHMetricsWriter;
+
+/**
+ Create a segment, replacing any stale segment with the same name.
+
+ @param name the name of the segment, which is prefixed with '/' if it does not start with one.  Some systems limit names to 31 characters, including the '/'.
+ @param eventTapID the tap the counters belong to, for readers to report
+
+ @return a new writer, which must be released with WJHMetricsWriterDestroy, or NULL, with errno set, if the segment could not be created.
+ */
+WJHMetricsWriter * WJHMetricsWriterCreate(char const *name, uint32_t eventTapID);
+
+/**
+ Remove the segment's name, and unmap it.  Readers that have it open can go on reading the final counters.
+ */
+void WJHMetricsWriterDestroy(WJHMetricsWriter *writer);
+
+/**
+ Count one event.
+
+ @param type the type of the event
+ @param outcome what the callback did with it
+ @param nanoseconds how long the callback took
+ */
+void WJHMetricsWriterRecordEvent(WJHMetricsWriter *writer, uint32_t type, WJHMetricsOutcome outcome, uint64_t nanoseconds);
+
+/**
+ Count a tap being disabled by the system.
+
+ @param timeout true if it was disabled because it was too slow, false if it was disabled by user input
+ */
+void WJHMetricsWriterRecordDisable(WJHMetricsWriter *writer, bool timeout);
+
+/**
+ Set the number of ring buffer overflows, which the ring buffer counts itself.  Nothing is written if the number has not changed.
+ */
+void WJHMetricsWriterSetRingBufferOverflows(WJHMetricsWriter *writer, uint64_t overflows);
+
+/**
+ Publish a new eventTapID, after the tap has replaced its system tap.  The counters carry on.  Unlike the other writer functions, this may be called from any thread, while another thread counts events.
+ */
+void WJHMetricsWriterSetEventTapID(WJHMetricsWriter *writer, uint32_t eventTapID);
+
+/**
+ The result of opening a segment.
+ */
+typedef enum WJHMetricsOpenResult {
+    WJHMetricsOpened,
+
+    /// There is no segment with that name, or it has not been initialized yet.
+    WJHMetricsNotFound,
+
+    /// The segment has another version, or a layout this reader does not understand.  A segment with more counters than this reader knows about, or fewer, is compatible.
+    WJHMetricsIncompatible,
+
+    /// The segment could not be opened, or mapped; errno says why.
+    WJHMetricsOpenFailed,
+} WJHMetricsOpenResult;
+
+/**
+ Reads a segment published by a WJHMetricsWriter, possibly in another process.  A reader is only used by one thread at a time.
+ */
+typedef struct WJHMetricsReader WJHMetricsReader;
+
+/**
+ Open a segment for reading.
+
+ @param name the name given to WJHMetricsWriterCreate
+ @param reader receives the reader if the segment was opened, which must be released with WJHMetricsReaderClose
+ */
+WJHMetricsOpenResult WJHMetricsReaderOpen(char const *name, WJHMetricsReader **reader);
+
+/**
+ Close a reader.
+ */
+void WJHMetricsReaderClose(WJHMetricsReader *reader);
+
+/**
+ Copy the segment.  Never blocks the writer.
+
+ @return true if @a snapshot holds a consistent copy, or false if the writer kept changing the counters for the whole of a bounded number of attempts.
+ */
+bool WJHMetricsReaderRead(WJHMetricsReader *reader, WJHMetricsSnapshot *snapshot);
+
+/**
+ The total number of events counted.
+ */
+uint64_t WJHMetricsCountersEvents(WJHMetricsCounters const *counters);
+
+/**
+ Subtract each counter of @a earlier from the same counter of @a later, which gives the counts for the time between the two copies.
+ */
+void WJHMetricsCountersDifference(WJHMetricsCounters *result, WJHMetricsCounters const *later, WJHMetricsCounters const *earlier);
+
+/**
+ An upper bound on the callback time at a percentile, from the callback time buckets.
+
+ @param percentile the percentile, from 0 to 100
+ @return the end of the bucket that holds the percentile, in nanoseconds; UINT64_MAX if that is the last bucket, which has no end; or zero if there were no callbacks.
+ */
+uint64_t WJHMetricsCountersTimePercentile(WJHMetricsCounters const *counters, double percentile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
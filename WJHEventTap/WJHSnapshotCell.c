@@ -0,0 +1,175 @@
+//
+//  WJHSnapshotCell.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHSnapshotCell.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+enum { kCacheLineSize = 64 };
+
+/*
+ Readers announce themselves in the count for the epoch they saw, then load the snapshot.  All of the atomics are sequentially consistent, which the argument below relies on.
+
+ A snapshot retired at time t is held by a reader only if that reader loaded it before t, so its count was raised before t, and stays raised until it leaves.  The epoch only flips after the count that is not current is seen to be zero, and the next flip looks at the other count.  So once a retired snapshot has seen two flips, both counts have been seen to be zero after it was retired, and none of its readers can remain.
+ */
+struct WJHSnapshotCell {
+    _Atomic(WJHSnapshot *) current;
+    atomic_uint epoch;
+
+    // Readers write their counts on every event; keep them off the line that holds what they read.
+    char padding[kCacheLineSize];
+    atomic_uint_fast64_t readers[2];
+    char morePadding[kCacheLineSize];
+
+    pthread_mutex_t mutex;
+
+    /// retired[0] were retired since the last flip; retired[1] have seen one flip since they were retired.
+    WJHSnapshot *retired[2];
+    size_t retiredCount[2];
+
+    WJHSnapshotDestroy destroy;
+    void *context;
+};
+
+static void destroyList(WJHSnapshotCell *cell, WJHSnapshot *snapshot) {
+    while (snapshot) {
+        WJHSnapshot *next = snapshot->next;
+        cell->destroy(snapshot, cell->context);
+        snapshot = next;
+    }
+}
+
+WJHSnapshotCell * WJHSnapshotCellCreate(WJHSnapshot *initial, WJHSnapshotDestroy destroy, void *context) {
+    WJHSnapshotCell *cell = malloc(sizeof(*cell));
+    if (cell == NULL) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&cell->mutex, NULL) != 0) {
+        free(cell);
+        return NULL;
+    }
+    atomic_init(&cell->current, initial);
+    atomic_init(&cell->epoch, 0);
+    atomic_init(&cell->readers[0], 0);
+    atomic_init(&cell->readers[1], 0);
+    cell->retired[0] = cell->retired[1] = NULL;
+    cell->retiredCount[0] = cell->retiredCount[1] = 0;
+    cell->destroy = destroy;
+    cell->context = context;
+    return cell;
+}
+
+void WJHSnapshotCellDestroy(WJHSnapshotCell *cell) {
+    if (cell == NULL) {
+        return;
+    }
+    destroyList(cell, cell->retired[1]);
+    destroyList(cell, cell->retired[0]);
+    WJHSnapshot *current = atomic_load(&cell->current);
+    if (current) {
+        cell->destroy(current, cell->context);
+    }
+    pthread_mutex_destroy(&cell->mutex);
+    free(cell);
+}
+
+WJHSnapshot const * WJHSnapshotCellReadBegin(WJHSnapshotCell *cell, unsigned *token) {
+    unsigned epoch = atomic_load(&cell->epoch) & 1;
+    atomic_fetch_add(&cell->readers[epoch], 1);
+    *token = epoch;
+    return atomic_load(&cell->current);
+}
+
+void WJHSnapshotCellReadEnd(WJHSnapshotCell *cell, unsigned token) {
+    atomic_fetch_sub(&cell->readers[token & 1], 1);
+}
+
+/**
+ Flip the epoch if the readers of the previous one have all left.  Called with the mutex held.
+
+ @param expired receives the snapshots that have now seen two flips, prepended to whatever it already holds, for the caller to destroy once the mutex is released
+ @return true if the epoch flipped.
+ */
+static bool advance(WJHSnapshotCell *cell, WJHSnapshot **expired) {
+    unsigned epoch = atomic_load(&cell->epoch) & 1;
+    if (atomic_load(&cell->readers[epoch ^ 1]) != 0) {
+        return false;
+    }
+    WJHSnapshot *last = cell->retired[1];
+    if (last) {
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = *expired;
+        *expired = cell->retired[1];
+    }
+    cell->retired[1] = cell->retired[0];
+    cell->retiredCount[1] = cell->retiredCount[0];
+    cell->retired[0] = NULL;
+    cell->retiredCount[0] = 0;
+    atomic_store(&cell->epoch, epoch ^ 1);
+    return true;
+}
+
+/**
+ Advance as far as the readers allow.  Called with the mutex held.
+ */
+static size_t reclaim(WJHSnapshotCell *cell, WJHSnapshot **expired) {
+    for (int i = 0; i < 2 && cell->retiredCount[0] + cell->retiredCount[1] > 0 && advance(cell, expired); ++i) {
+    }
+    return cell->retiredCount[0] + cell->retiredCount[1];
+}
+
+static void publishLocked(WJHSnapshotCell *cell, WJHSnapshot *snapshot, WJHSnapshot **expired) {
+    WJHSnapshot *old = atomic_exchange(&cell->current, snapshot);
+    if (old) {
+        old->next = cell->retired[0];
+        cell->retired[0] = old;
+        ++cell->retiredCount[0];
+    }
+    reclaim(cell, expired);
+}
+
+// Snapshots are destroyed after the mutex is released, so destroying one may publish another.
+
+void WJHSnapshotCellPublish(WJHSnapshotCell *cell, WJHSnapshot *snapshot) {
+    WJHSnapshot *expired = NULL;
+    pthread_mutex_lock(&cell->mutex);
+    publishLocked(cell, snapshot, &expired);
+    pthread_mutex_unlock(&cell->mutex);
+    destroyList(cell, expired);
+}
+
+bool WJHSnapshotCellUpdate(WJHSnapshotCell *cell, WJHSnapshot * (*update)(WJHSnapshot const *current, void *context), void *context) {
+    WJHSnapshot *expired = NULL;
+    pthread_mutex_lock(&cell->mutex);
+    WJHSnapshot *snapshot = update(atomic_load(&cell->current), context);
+    if (snapshot) {
+        publishLocked(cell, snapshot, &expired);
+    }
+    pthread_mutex_unlock(&cell->mutex);
+    destroyList(cell, expired);
+    return snapshot != NULL;
+}
+
+size_t WJHSnapshotCellReclaim(WJHSnapshotCell *cell) {
+    WJHSnapshot *expired = NULL;
+    pthread_mutex_lock(&cell->mutex);
+    size_t pending = reclaim(cell, &expired);
+    pthread_mutex_unlock(&cell->mutex);
+    destroyList(cell, expired);
+    return pending;
+}
+
+void WJHSnapshotCellSynchronize(WJHSnapshotCell *cell) {
+    while (WJHSnapshotCellReclaim(cell) > 0) {
+        sched_yield();
+    }
+}
@@ -0,0 +1,100 @@
+//
+//  WJHSnapshotCell.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHSnapshotCell_h
+#define WJHEventTap_WJHSnapshotCell_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ The header of every snapshot kept in a cell, which must be its first member.  The cell uses it to link snapshots that are waiting to be reclaimed.
+ */
+typedef struct WJHSnapshot {
+    struct WJHSnapshot *next;
+} WJHSnapshot;
+
+/**
+ Called to destroy a snapshot that no reader can see any longer.
+ */
+typedef void (*WJHSnapshotDestroy)(WJHSnapshot *snapshot, void *context);
+
+/**
+ Holds the current version of an immutable snapshot, which readers use without locks, and writers replace, read-copy-update style, without waiting for readers.
+
+ A reader brackets its use of the snapshot with WJHSnapshotCellReadBegin and WJHSnapshotCellReadEnd.  That costs one load of the epoch, an increment and decrement of a reader count, and one load of the snapshot, with no locks, and no reference counting of the snapshot itself.  Read sections may nest, and a reader may publish a new snapshot from inside one.
+
+ A writer publishes a new snapshot, and retires the old one.  Retired snapshots are reclaimed once two grace periods have passed: each grace period ends when the readers counted under the previous epoch have all left, at which point the epoch flips.  No reader that could have seen a retired snapshot survives both, so its destruction is safe.  Writers never wait for readers; reclamation is attempted on every publish, and by WJHSnapshotCellReclaim.
+
+ Writers are serialized by a mutex.  The destroy callback is called without it, so destroying a snapshot may publish another.
+ */
+typedef struct WJHSnapshotCell WJHSnapshotCell;
+
+/**
+ Create a cell.
+
+ @param initial the first snapshot, which the cell takes ownership of
+ @param destroy called to destroy each snapshot once no reader can see it, including the current one when the cell is destroyed
+ @param context passed to @a destroy
+
+ @return a new cell, which must be released with WJHSnapshotCellDestroy, or NULL if memory could not be allocated.
+ */
+WJHSnapshotCell * WJHSnapshotCellCreate(WJHSnapshot *initial, WJHSnapshotDestroy destroy, void *context);
+
+/**
+ Destroy a cell, and every snapshot it still holds.  There must be no readers.
+ */
+void WJHSnapshotCellDestroy(WJHSnapshotCell *cell);
+
+/**
+ Begin a read section.
+
+ @param token receives the value to pass to WJHSnapshotCellReadEnd
+
+ @return the current snapshot, which stays valid until the matching WJHSnapshotCellReadEnd, even if it is replaced in the meantime.
+ */
+WJHSnapshot const * WJHSnapshotCellReadBegin(WJHSnapshotCell *cell, unsigned *token);
+
+/**
+ End a read section.
+ */
+void WJHSnapshotCellReadEnd(WJHSnapshotCell *cell, unsigned token);
+
+/**
+ Make @a snapshot the current one, and retire the snapshot it replaces.  Never blocks on readers.
+ */
+void WJHSnapshotCellPublish(WJHSnapshotCell *cell, WJHSnapshot *snapshot);
+
+/**
+ Call @a update with the current snapshot, under the writer mutex, and publish what it returns, unless it returns NULL.  This is how a writer changes one part of a snapshot without losing a concurrent change to another part.
+
+ @return true if a new snapshot was published.
+ */
+bool WJHSnapshotCellUpdate(WJHSnapshotCell *cell, WJHSnapshot * (*update)(WJHSnapshot const *current, void *context), void *context);
+
+/**
+ Destroy whatever retired snapshots can be destroyed now, without waiting.
+
+ @return the number of retired snapshots still waiting for readers to leave.
+ */
+size_t WJHSnapshotCellReclaim(WJHSnapshotCell *cell);
+
+/**
+ Wait until every retired snapshot has been destroyed.  Must not be called from inside a read section, which would wait for itself.
+ */
+void WJHSnapshotCellSynchronize(WJHSnapshotCell *cell);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,186 @@
+//
+//  WJHWatchdog.c
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHWatchdog.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+enum {
+    // The number of calls averaged over, as a power of two.
+    kAverageShift = 3,
+
+    // The calls measured at a level before their average is trusted to shed another.
+    kMinimumAverageSamples = 1 << kAverageShift,
+
+    kMaximumHoldMultiplier = 32,
+};
+
+struct WJHWatchdog {
+    WJHWatchdogPolicy policy;
+    uint64_t shedThreshold;
+    uint64_t recoverThreshold;
+    WJHWatchdogCallback callback;
+    void *context;
+
+    // Only used by the thread using the watchdog.
+    uint64_t lastChange;
+    uint64_t hold;
+    bool recovered;
+    uint32_t samples;
+    uint64_t average;
+
+    // Only written by the thread using the watchdog, but read from any thread.
+    _Atomic uint32_t level;
+    _Atomic uint64_t publishedAverage;
+    _Atomic uint64_t calls;
+    _Atomic uint64_t timeouts;
+    _Atomic uint64_t levelsShed;
+    _Atomic uint64_t levelsRecovered;
+};
+
+static inline void increment(_Atomic uint64_t *counter) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+WJHWatchdogPolicy WJHWatchdogDefaultPolicy(void) {
+    return (WJHWatchdogPolicy){
+        .budget = 100000000,
+        .shedPercent = 50,
+        .recoverPercent = 10,
+        .holdTime = 1000000000,
+    };
+}
+
+WJHWatchdog * WJHWatchdogCreate(WJHWatchdogPolicy const *policy, WJHWatchdogCallback callback, void *context) {
+    if (policy == NULL || policy->budget == 0 || policy->recoverPercent > policy->shedPercent) {
+        errno = EINVAL;
+        return NULL;
+    }
+    WJHWatchdog *watchdog = calloc(1, sizeof(*watchdog));
+    if (watchdog == NULL) {
+        return NULL;
+    }
+    watchdog->policy = *policy;
+    watchdog->shedThreshold = policy->budget / 100 * policy->shedPercent + policy->budget % 100 * policy->shedPercent / 100;
+    watchdog->recoverThreshold = policy->budget / 100 * policy->recoverPercent + policy->budget % 100 * policy->recoverPercent / 100;
+    watchdog->callback = callback;
+    watchdog->context = context;
+    watchdog->hold = policy->holdTime;
+    atomic_init(&watchdog->level, WJHWatchdogLevelNormal);
+    atomic_init(&watchdog->publishedAverage, 0);
+    atomic_init(&watchdog->calls, 0);
+    atomic_init(&watchdog->timeouts, 0);
+    atomic_init(&watchdog->levelsShed, 0);
+    atomic_init(&watchdog->levelsRecovered, 0);
+    return watchdog;
+}
+
+void WJHWatchdogDestroy(WJHWatchdog *watchdog) {
+    free(watchdog);
+}
+
+#pragma mark - Levels
+
+static void changeLevel(WJHWatchdog *watchdog, WJHWatchdogLevel to, WJHWatchdogReason reason, uint64_t now) {
+    WJHWatchdogLevel const from = (WJHWatchdogLevel)atomic_load_explicit(&watchdog->level, memory_order_relaxed);
+    if (to > from) {
+        // Shedding again so soon after recovering means the handlers are still slow, so wait longer before the next try.
+        if (watchdog->recovered && now - watchdog->lastChange < watchdog->hold) {
+            uint64_t const longest = watchdog->policy.holdTime * kMaximumHoldMultiplier;
+            watchdog->hold = watchdog->hold > longest / 2 ? longest : watchdog->hold * 2;
+        } else {
+            watchdog->hold = watchdog->policy.holdTime;
+        }
+        increment(&watchdog->levelsShed);
+    } else {
+        increment(&watchdog->levelsRecovered);
+    }
+
+    // Calls made at the old level say little about the new one.
+    watchdog->recovered = to < from;
+    watchdog->lastChange = now;
+    watchdog->samples = 0;
+    watchdog->average = 0;
+    atomic_store_explicit(&watchdog->publishedAverage, 0, memory_order_relaxed);
+    atomic_store_explicit(&watchdog->level, to, memory_order_relaxed);
+    if (watchdog->callback) {
+        watchdog->callback(watchdog->context, from, to, reason, now);
+    }
+}
+
+static void shed(WJHWatchdog *watchdog, WJHWatchdogReason reason, uint64_t now) {
+    WJHWatchdogLevel const level = (WJHWatchdogLevel)atomic_load_explicit(&watchdog->level, memory_order_relaxed);
+    if (level + 1 < WJHWatchdogLevelCount) {
+        changeLevel(watchdog, level + 1, reason, now);
+    }
+}
+
+WJHWatchdogLevel WJHWatchdogBeginEvent(WJHWatchdog *watchdog, uint64_t now) {
+    WJHWatchdogLevel level = (WJHWatchdogLevel)atomic_load_explicit(&watchdog->level, memory_order_relaxed);
+    if (level != WJHWatchdogLevelNormal && now - watchdog->lastChange >= watchdog->hold) {
+        // Levels that stop calls can not be measured, so a hold time without calls counts as recovering.
+        if (watchdog->samples == 0 || watchdog->average <= watchdog->recoverThreshold) {
+            changeLevel(watchdog, --level, WJHWatchdogReasonRecovered, now);
+        }
+    }
+    return level;
+}
+
+void WJHWatchdogRecordCall(WJHWatchdog *watchdog, uint64_t now, uint64_t nanoseconds) {
+    increment(&watchdog->calls);
+    if (watchdog->samples == 0) {
+        watchdog->average = nanoseconds;
+    } else if (nanoseconds >= watchdog->average) {
+        watchdog->average += (nanoseconds - watchdog->average) >> kAverageShift;
+    } else {
+        watchdog->average -= (watchdog->average - nanoseconds) >> kAverageShift;
+    }
+    ++watchdog->samples;
+    atomic_store_explicit(&watchdog->publishedAverage, watchdog->average, memory_order_relaxed);
+
+    if (nanoseconds >= watchdog->policy.budget) {
+        shed(watchdog, WJHWatchdogReasonOverBudget, now);
+    } else if (watchdog->samples >= kMinimumAverageSamples && watchdog->average > watchdog->shedThreshold) {
+        shed(watchdog, WJHWatchdogReasonSlow, now);
+    }
+}
+
+void WJHWatchdogRecordTimeout(WJHWatchdog *watchdog, uint64_t now) {
+    increment(&watchdog->timeouts);
+    shed(watchdog, WJHWatchdogReasonTimeout, now);
+}
+
+#pragma mark - Observing
+
+WJHWatchdogLevel WJHWatchdogGetLevel(WJHWatchdog const *watchdog) {
+    return (WJHWatchdogLevel)atomic_load_explicit(&((WJHWatchdog *)watchdog)->level, memory_order_relaxed);
+}
+
+WJHWatchdogStatistics WJHWatchdogGetStatistics(WJHWatchdog const *watchdog) {
+    WJHWatchdog *mutableWatchdog = (WJHWatchdog *)watchdog;
+    return (WJHWatchdogStatistics){
+        .level = WJHWatchdogGetLevel(watchdog),
+        .averageNanoseconds = atomic_load_explicit(&mutableWatchdog->publishedAverage, memory_order_relaxed),
+        .calls = atomic_load_explicit(&mutableWatchdog->calls, memory_order_relaxed),
+        .timeouts = atomic_load_explicit(&mutableWatchdog->timeouts, memory_order_relaxed),
+        .levelsShed = atomic_load_explicit(&mutableWatchdog->levelsShed, memory_order_relaxed),
+        .levelsRecovered = atomic_load_explicit(&mutableWatchdog->levelsRecovered, memory_order_relaxed),
+    };
+}
+
+char const * WJHWatchdogLevelName(WJHWatchdogLevel level) {
+    switch (level) {
+        case WJHWatchdogLevelNormal: return "normal";
+        case WJHWatchdogLevelSkipOptional: return "skip_optional";
+        case WJHWatchdogLevelShedMotion: return "shed_motion";
+        case WJHWatchdogLevelPassThrough: return "pass_through";
+        case WJHWatchdogLevelCount: break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,156 @@
+//
+//  WJHWatchdog.h
+//  WJHEventTap
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTap_WJHWatchdog_h
+#define WJHEventTap_WJHWatchdog_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ How much work a tap sheds to keep its callback within budget.  Each level sheds everything the ones before it do.
+ */
+typedef enum WJHWatchdogLevel {
+    /// Every event is handled as usual.
+    WJHWatchdogLevelNormal = 0,
+
+    /// Work that is not needed to handle events, such as recording them, is skipped.
+    WJHWatchdogLevelSkipOptional,
+
+    /// Motion events (mouse moves and drags, and scrolling) are passed on without being handled.
+    WJHWatchdogLevelShedMotion,
+
+    /// Every event is passed on untouched.
+    WJHWatchdogLevelPassThrough,
+
+    WJHWatchdogLevelCount
+} WJHWatchdogLevel;
+
+/**
+ Why the level changed.
+ */
+typedef enum WJHWatchdogReason {
+    /// A single call took the whole budget.
+    WJHWatchdogReasonOverBudget,
+
+    /// Calls have been taking most of the budget, on average.
+    WJHWatchdogReasonSlow,
+
+    /// The system disabled the tap because its callback took too long.
+    WJHWatchdogReasonTimeout,
+
+    /// Calls have been fast for the hold time, or none have been made.
+    WJHWatchdogReasonRecovered,
+} WJHWatchdogReason;
+
+/**
+ When to shed, and when to recover.  All times are in nanoseconds.
+ */
+typedef struct WJHWatchdogPolicy {
+    /// The longest a call should take.  A call that takes this long sheds another level at once.
+    uint64_t budget;
+
+    /// Shed another level when the average call takes more than this percentage of the budget.
+    uint32_t shedPercent;
+
+    /// Recover a level when the average call takes no more than this percentage of the budget.
+    uint32_t recoverPercent;
+
+    /// The least time spent at a level before recovering from it.  It doubles, up to 32 times, each time a level is shed again within the hold time of recovering to it, so a handler that stays slow is not retried on every hold.
+    uint64_t holdTime;
+} WJHWatchdogPolicy;
+
+/**
+ A 100 millisecond budget, shedding above 50% of it, and recovering below 10%, with a one second hold time.
+ */
+WJHWatchdogPolicy WJHWatchdogDefaultPolicy(void);
+
+/**
+ Called with every level change, on the thread that caused it.
+
+ @param now the time of the change, on the clock the watchdog is given
+ */
+typedef void (*WJHWatchdogCallback)(void *context, WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason, uint64_t now);
+
+/**
+ Counters describing a watchdog.
+ */
+typedef struct WJHWatchdogStatistics {
+    WJHWatchdogLevel level;
+
+    /// The moving average of recent calls, in nanoseconds.
+    uint64_t averageNanoseconds;
+
+    uint64_t calls;
+    uint64_t timeouts;
+    uint64_t levelsShed;
+    uint64_t levelsRecovered;
+} WJHWatchdogStatistics;
+
+/**
+ Tracks how long a tap's handlers take against a budget, and decides how much work the tap sheds.
+
+ The watchdog steps down a level whenever a call takes the whole budget, the system times the tap out, or the moving average of recent calls passes the shed threshold, and steps back up a level at a time, once the average falls below the recover threshold and the hold time has passed.  Levels that stop the calls being made can not be measured, so they are recovered from when the hold time passes without a call.
+
+ It never reads a clock.  Every function that depends on time is given the time, so the state machine can be driven by a fake clock, and tested anywhere.  Only one thread may use a watchdog at any given time, except for WJHWatchdogGetLevel and WJHWatchdogGetStatistics, which may be called from any thread.
+ */
+typedef struct WJHWatchdog WJHWatchdog;
+
+/**
+ Create a watchdog, at WJHWatchdogLevelNormal.
+
+ @param policy the policy, which is copied
+ @param callback called with each level change, or NULL
+ @param context passed to each call of @a callback
+
+ @return a new watchdog, which must be released with WJHWatchdogDestroy, or NULL, with errno set, if the policy has no budget, recovers above the percentage it sheds at, or memory could not be allocated.
+ */
+WJHWatchdog * WJHWatchdogCreate(WJHWatchdogPolicy const *policy, WJHWatchdogCallback callback, void *context);
+
+void WJHWatchdogDestroy(WJHWatchdog *watchdog);
+
+/**
+ Get the level to handle an event at, recovering a level first if it is time to.
+
+ @param now the current time
+ */
+WJHWatchdogLevel WJHWatchdogBeginEvent(WJHWatchdog *watchdog, uint64_t now);
+
+/**
+ Record how long a call took.
+
+ @param now the time the call finished
+ @param nanoseconds how long it took
+ */
+void WJHWatchdogRecordCall(WJHWatchdog *watchdog, uint64_t now, uint64_t nanoseconds);
+
+/**
+ Record that the system disabled the tap because its callback took too long.
+ */
+void WJHWatchdogRecordTimeout(WJHWatchdog *watchdog, uint64_t now);
+
+/**
+ The current level.
+ */
+WJHWatchdogLevel WJHWatchdogGetLevel(WJHWatchdog const *watchdog);
+
+WJHWatchdogStatistics WJHWatchdogGetStatistics(WJHWatchdog const *watchdog);
+
+/**
+ A short name for a level (e.g., "shed_motion"), for logs.
+ */
+char const * WJHWatchdogLevelName(WJHWatchdogLevel level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
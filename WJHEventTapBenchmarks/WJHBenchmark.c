@@ -0,0 +1,482 @@
+//
+//  WJHBenchmark.c
+//  WJHEventTapBenchmarks
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHBenchmark.h"
+#include "WJHEventBackend.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+enum {
+    kScreenWidth = 2560,
+    kScreenHeight = 1440,
+
+    // Virtual keycodes.
+    kKeycodeSpace = 0x31,
+    kKeycodeCommand = 0x37,
+    kKeycodeShift = 0x38,
+
+    kNanosecondsPerMillisecond = 1000000,
+};
+
+// Letters, in rough order of frequency in English text.
+static uint16_t const kLetterKeycodes[] = {
+    0x0E, 0x11, 0x00, 0x1F, 0x22, 0x2D, 0x01, 0x04, 0x0F, 0x02, 0x25, 0x08, 0x20,
+    0x2E, 0x0D, 0x03, 0x05, 0x10, 0x23, 0x0B, 0x09, 0x28, 0x26, 0x07, 0x0C, 0x06,
+};
+
+#pragma mark - Workloads
+
+typedef struct Generator {
+    uint64_t random;
+    uint64_t timestamp;
+    double x;
+    double y;
+    double velocityX;
+    double velocityY;
+
+    // Mouse storm.
+    uint32_t dragRemaining;
+    bool pendingMouseUp;
+
+    // Typing burst: the rest of the current keystroke, in reverse order.
+    WJHEventRecord keystroke[4];
+    uint32_t keystrokeRemaining;
+
+    // Scroll fling.
+    uint32_t flingRemaining;
+    double flingDelta;
+} Generator;
+
+// xorshift64*, which is plenty random for shaping input, and the same everywhere.
+static uint64_t nextRandom(Generator *generator) {
+    uint64_t x = generator->random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    generator->random = x;
+    return x * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+static uint32_t randomBelow(Generator *generator, uint32_t limit) {
+    return (uint32_t)(nextRandom(generator) >> 32) % limit;
+}
+
+static WJHEventRecord makeRecord(Generator const *generator, uint32_t type) {
+    WJHEventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = generator->timestamp;
+    record.x = generator->x;
+    record.y = generator->y;
+    record.type = type;
+    return record;
+}
+
+static double clamp(double value, double limit) {
+    return value < 0 ? 0 : (value >= limit ? limit - 1 : value);
+}
+
+static WJHEventRecord nextMouseStorm(Generator *generator) {
+    generator->timestamp += kNanosecondsPerMillisecond;
+    if (generator->pendingMouseUp) {
+        generator->pendingMouseUp = false;
+        return makeRecord(generator, kWJHEventTypeLeftMouseUp);
+    }
+    if (generator->dragRemaining == 0 && randomBelow(generator, 200) == 0) {
+        generator->dragRemaining = randomBelow(generator, 40);
+        generator->pendingMouseUp = generator->dragRemaining == 0;
+        return makeRecord(generator, kWJHEventTypeLeftMouseDown);
+    }
+
+    // Wander, with a little inertia, bouncing off the edges of the screen.
+    generator->velocityX = 0.9 * generator->velocityX + (double)randomBelow(generator, 9) - 4;
+    generator->velocityY = 0.9 * generator->velocityY + (double)randomBelow(generator, 9) - 4;
+    double const oldX = generator->x, oldY = generator->y;
+    generator->x = clamp(generator->x + generator->velocityX, kScreenWidth);
+    generator->y = clamp(generator->y + generator->velocityY, kScreenHeight);
+    if (generator->x == 0 || generator->x == kScreenWidth - 1) {
+        generator->velocityX = -generator->velocityX;
+    }
+    if (generator->y == 0 || generator->y == kScreenHeight - 1) {
+        generator->velocityY = -generator->velocityY;
+    }
+
+    uint32_t type = kWJHEventTypeMouseMoved;
+    if (generator->dragRemaining > 0) {
+        type = kWJHEventTypeLeftMouseDragged;
+        generator->pendingMouseUp = --generator->dragRemaining == 0;
+    }
+    WJHEventRecord record = makeRecord(generator, type);
+    record.deltaX = (int32_t)(generator->x - oldX);
+    record.deltaY = (int32_t)(generator->y - oldY);
+    return record;
+}
+
+static WJHEventRecord nextTypingBurst(Generator *generator) {
+    if (generator->keystrokeRemaining == 0) {
+        uint16_t keycode = kLetterKeycodes[randomBelow(generator, sizeof(kLetterKeycodes) / sizeof(*kLetterKeycodes))];
+        if (randomBelow(generator, 6) == 0) {
+            keycode = kKeycodeSpace;
+        }
+        uint16_t modifier = 0;
+        uint64_t flags = 0;
+        uint32_t const roll = randomBelow(generator, 50);
+        if (roll == 0) {
+            modifier = kKeycodeCommand;
+            flags = kWJHEventFlagCommand;
+        } else if (roll < 6) {
+            modifier = kKeycodeShift;
+            flags = kWJHEventFlagShift;
+        }
+
+        // Built in reverse, so the next event is always the last one.
+        uint32_t count = 0;
+        WJHEventRecord *keystroke = generator->keystroke;
+        if (modifier) {
+            keystroke[count] = makeRecord(generator, kWJHEventTypeFlagsChanged);
+            keystroke[count++].keycode = modifier;
+        }
+        keystroke[count] = makeRecord(generator, kWJHEventTypeKeyUp);
+        keystroke[count].flags = flags;
+        keystroke[count++].keycode = keycode;
+        keystroke[count] = makeRecord(generator, kWJHEventTypeKeyDown);
+        keystroke[count].flags = flags;
+        keystroke[count++].keycode = keycode;
+        if (modifier) {
+            keystroke[count] = makeRecord(generator, kWJHEventTypeFlagsChanged);
+            keystroke[count].flags = flags;
+            keystroke[count++].keycode = modifier;
+        }
+        generator->keystrokeRemaining = count;
+    }
+
+    // Keys are held for 40 to 90ms, and the gaps between them are 20 to 120ms.
+    WJHEventRecord record = generator->keystroke[--generator->keystrokeRemaining];
+    generator->timestamp += (record.type == kWJHEventTypeKeyUp ? 40 + randomBelow(generator, 50) : 20 + randomBelow(generator, 100)) * (uint64_t)kNanosecondsPerMillisecond;
+    record.timestamp = generator->timestamp;
+    return record;
+}
+
+static WJHEventRecord nextScrollFling(Generator *generator) {
+    if (generator->flingRemaining == 0) {
+        generator->flingRemaining = 20 + randomBelow(generator, 40);
+        generator->flingDelta = (double)(20 + randomBelow(generator, 60)) * (randomBelow(generator, 4) == 0 ? 1 : -1);
+        generator->timestamp += (300 + randomBelow(generator, 700)) * (uint64_t)kNanosecondsPerMillisecond;
+    }
+    --generator->flingRemaining;
+
+    // Trackpads report at about 120 Hz, and momentum decays geometrically.
+    generator->timestamp += 8 * kNanosecondsPerMillisecond;
+    WJHEventRecord record = makeRecord(generator, kWJHEventTypeScrollWheel);
+    record.deltaY = (int32_t)generator->flingDelta;
+    generator->flingDelta *= 0.9;
+    return record;
+}
+
+static WJHEventRecord nextEvent(Generator *generator, WJHBenchmarkWorkload workload) {
+    switch (workload) {
+        case WJHBenchmarkWorkloadMouseStorm:
+            return nextMouseStorm(generator);
+        case WJHBenchmarkWorkloadTypingBurst:
+            return nextTypingBurst(generator);
+        case WJHBenchmarkWorkloadScrollFling:
+        default:
+            return nextScrollFling(generator);
+    }
+}
+
+char const * WJHBenchmarkWorkloadName(WJHBenchmarkWorkload workload) {
+    switch (workload) {
+        case WJHBenchmarkWorkloadMouseStorm:
+            return "mouse_storm";
+        case WJHBenchmarkWorkloadTypingBurst:
+            return "typing_burst";
+        case WJHBenchmarkWorkloadScrollFling:
+            return "scroll_fling";
+        case WJHBenchmarkWorkloadMixed:
+            return "mixed";
+        default:
+            return "unknown";
+    }
+}
+
+void WJHBenchmarkGenerate(WJHBenchmarkWorkload workload, uint64_t seed, WJHEventRecord *records, size_t count) {
+    Generator generator;
+    memset(&generator, 0, sizeof(generator));
+    generator.random = seed * UINT64_C(0x9E3779B97F4A7C15) + 1;
+    generator.x = kScreenWidth / 2;
+    generator.y = kScreenHeight / 2;
+
+    WJHBenchmarkWorkload current = workload;
+    size_t runRemaining = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (workload == WJHBenchmarkWorkloadMixed && runRemaining == 0 && generator.keystrokeRemaining == 0 && generator.dragRemaining == 0 && !generator.pendingMouseUp) {
+            current = (WJHBenchmarkWorkload)randomBelow(&generator, WJHBenchmarkWorkloadMixed);
+            runRemaining = 64 + randomBelow(&generator, 192);
+        }
+        records[i] = nextEvent(&generator, current);
+        if (runRemaining > 0) {
+            --runRemaining;
+        }
+    }
+}
+
+#pragma mark - Measurement
+
+static WJHBenchmarkAllocationCounter allocationCounter;
+
+uint64_t WJHBenchmarkNow(void) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+void WJHBenchmarkSetAllocationCounter(WJHBenchmarkAllocationCounter counter) {
+    allocationCounter = counter;
+}
+
+void WJHBenchmarkReportInit(WJHBenchmarkReport *report) {
+    memset(report, 0, sizeof(*report));
+}
+
+void WJHBenchmarkReportDestroy(WJHBenchmarkReport *report) {
+    free(report->results);
+    memset(report, 0, sizeof(*report));
+}
+
+bool WJHBenchmarkReportAdd(WJHBenchmarkReport *report, WJHBenchmarkResult const *result) {
+    if (report->count == report->capacity) {
+        size_t const capacity = report->capacity ? 2 * report->capacity : 32;
+        WJHBenchmarkResult *results = realloc(report->results, capacity * sizeof(*results));
+        if (results == NULL) {
+            return false;
+        }
+        report->results = results;
+        report->capacity = capacity;
+    }
+    report->results[report->count++] = *result;
+    return true;
+}
+
+static void copyString(char *destination, size_t size, char const *source) {
+    size_t const length = strlen(source);
+    size_t const copied = length < size ? length : size - 1;
+    memcpy(destination, source, copied);
+    destination[copied] = '\0';
+}
+
+bool WJHBenchmarkRun(WJHBenchmarkReport *report, char const *name, char const *workload, WJHEventRecord const *records, size_t count, unsigned repetitions, WJHBenchmarkBody body, void *context) {
+    if (repetitions == 0) {
+        repetitions = 1;
+    }
+    body(context, records, count);
+
+    WJHBenchmarkAllocationCounter const counter = allocationCounter;
+    uint64_t const allocations = counter ? counter() : 0;
+    uint64_t best = UINT64_MAX;
+    for (unsigned i = 0; i < repetitions; ++i) {
+        uint64_t const start = WJHBenchmarkNow();
+        body(context, records, count);
+        uint64_t const elapsed = WJHBenchmarkNow() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    WJHBenchmarkResult result;
+    memset(&result, 0, sizeof(result));
+    copyString(result.name, sizeof(result.name), name);
+    copyString(result.workload, sizeof(result.workload), workload);
+    result.operations = count;
+    result.nsPerOperation = count ? (double)best / count : 0;
+    result.allocationsPerOperation = counter && count ? (double)(counter() - allocations) / ((double)count * repetitions) : -1;
+    return WJHBenchmarkReportAdd(report, &result);
+}
+
+#pragma mark - Reports
+
+// Names come from code, not users, but quote anything JSON would choke on anyway.
+static void writeJSONString(FILE *file, char const *string) {
+    fputc('"', file);
+    for (; *string; ++string) {
+        if (*string == '"' || *string == '\\') {
+            fputc('\\', file);
+        }
+        fputc((unsigned char)*string < 0x20 ? ' ' : *string, file);
+    }
+    fputc('"', file);
+}
+
+bool WJHBenchmarkReportWriteJSON(WJHBenchmarkReport const *report, FILE *file) {
+    fputs("[", file);
+    for (size_t i = 0; i < report->count; ++i) {
+        WJHBenchmarkResult const *result = report->results + i;
+        fputs(i ? ",\n  {\"name\": " : "\n  {\"name\": ", file);
+        writeJSONString(file, result->name);
+        fputs(", \"workload\": ", file);
+        writeJSONString(file, result->workload);
+        fprintf(file, ", \"operations\": %llu, \"ns_per_op\": %.3f, \"allocs_per_op\": ", (unsigned long long)result->operations, result->nsPerOperation);
+        if (result->allocationsPerOperation < 0) {
+            fputs("null}", file);
+        } else {
+            fprintf(file, "%.4f}", result->allocationsPerOperation);
+        }
+    }
+    fputs("\n]\n", file);
+    return fflush(file) == 0 && !ferror(file);
+}
+
+bool WJHBenchmarkReportWriteCSV(WJHBenchmarkReport const *report, FILE *file) {
+    fputs("name,workload,operations,ns_per_op,allocs_per_op\n", file);
+    for (size_t i = 0; i < report->count; ++i) {
+        WJHBenchmarkResult const *result = report->results + i;
+        fprintf(file, "%s,%s,%llu,%.3f,", result->name, result->workload, (unsigned long long)result->operations, result->nsPerOperation);
+        if (result->allocationsPerOperation >= 0) {
+            fprintf(file, "%.4f", result->allocationsPerOperation);
+        }
+        fputc('\n', file);
+    }
+    return fflush(file) == 0 && !ferror(file);
+}
+
+#pragma mark - Thresholds
+
+static char const * trim(char const *begin, char const **end) {
+    while (begin < *end && isspace((unsigned char)*begin)) {
+        ++begin;
+    }
+    while (*end > begin && isspace((unsigned char)(*end)[-1])) {
+        --*end;
+    }
+    return begin;
+}
+
+static bool parseText(char const *begin, char const *end, char *destination, size_t size) {
+    begin = trim(begin, &end);
+    size_t const length = (size_t)(end - begin);
+    if (length == 0 || length >= size) {
+        return false;
+    }
+    memcpy(destination, begin, length);
+    destination[length] = '\0';
+    return true;
+}
+
+static bool parseLimit(char const *begin, char const *end, double *limit) {
+    begin = trim(begin, &end);
+    if (begin == end) {
+        *limit = -1;
+        return true;
+    }
+    char buffer[64];
+    size_t const length = (size_t)(end - begin);
+    if (length >= sizeof(buffer)) {
+        return false;
+    }
+    memcpy(buffer, begin, length);
+    buffer[length] = '\0';
+    char *parsed;
+    *limit = strtod(buffer, &parsed);
+    return *parsed == '\0' && *limit >= 0;
+}
+
+static bool parseThreshold(char const *line, char const *end, WJHBenchmarkThreshold *threshold) {
+    char const *fields[5];
+    size_t count = 0;
+    fields[count++] = line;
+    for (char const *p = line; p < end; ++p) {
+        if (*p == ',') {
+            if (count == 4) {
+                return false;
+            }
+            fields[count++] = p + 1;
+        }
+    }
+    if (count != 4) {
+        return false;
+    }
+    fields[4] = end + 1;
+    return parseText(fields[0], fields[1] - 1, threshold->name, sizeof(threshold->name))
+        && parseText(fields[1], fields[2] - 1, threshold->workload, sizeof(threshold->workload))
+        && parseLimit(fields[2], fields[3] - 1, &threshold->maxNsPerOperation)
+        && parseLimit(fields[3], fields[4] - 1, &threshold->maxAllocationsPerOperation);
+}
+
+bool WJHBenchmarkParseThresholds(char const *text, WJHBenchmarkThreshold *thresholds, size_t capacity, size_t *count, size_t *errorLine) {
+    *count = 0;
+    if (errorLine) {
+        *errorLine = 0;
+    }
+    size_t lineNumber = 0;
+    while (*text) {
+        char const *end = strchr(text, '\n');
+        if (end == NULL) {
+            end = text + strlen(text);
+        }
+        ++lineNumber;
+
+        char const *trimmedEnd = end;
+        char const *line = trim(text, &trimmedEnd);
+        bool const ignored = line == trimmedEnd || *line == '#' || strncmp(line, "name,", 5) == 0;
+        if (!ignored) {
+            WJHBenchmarkThreshold threshold;
+            if (!parseThreshold(line, trimmedEnd, &threshold)) {
+                if (errorLine) {
+                    *errorLine = lineNumber;
+                }
+                return false;
+            }
+            if (*count < capacity) {
+                thresholds[*count] = threshold;
+            }
+            ++*count;
+        }
+        text = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+size_t WJHBenchmarkReportCheck(WJHBenchmarkReport const *report, WJHBenchmarkThreshold const *thresholds, size_t count, FILE *log) {
+    size_t failures = 0;
+    for (size_t i = 0; i < report->count; ++i) {
+        WJHBenchmarkResult const *result = report->results + i;
+        for (size_t j = 0; j < count; ++j) {
+            WJHBenchmarkThreshold const *threshold = thresholds + j;
+            if (strcmp(threshold->name, result->name) != 0 || (strcmp(threshold->workload, "*") != 0 && strcmp(threshold->workload, result->workload) != 0)) {
+                continue;
+            }
+            if (threshold->maxNsPerOperation >= 0 && result->nsPerOperation > threshold->maxNsPerOperation) {
+                ++failures;
+                if (log) {
+                    fprintf(log, "%s (%s): %.1f ns/op exceeds %.1f\n", result->name, result->workload, result->nsPerOperation, threshold->maxNsPerOperation);
+                }
+            }
+            if (threshold->maxAllocationsPerOperation >= 0 && result->allocationsPerOperation > threshold->maxAllocationsPerOperation) {
+                ++failures;
+                if (log) {
+                    fprintf(log, "%s (%s): %.4f allocations/op exceeds %.4f\n", result->name, result->workload, result->allocationsPerOperation, threshold->maxAllocationsPerOperation);
+                }
+            }
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,163 @@
+//
+//  WJHBenchmark.h
+//  WJHEventTapBenchmarks
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTapBenchmarks_WJHBenchmark_h
+#define WJHEventTapBenchmarks_WJHBenchmark_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "WJHEventRecord.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ A synthetic stream of input, shaped like something a user actually does.
+ */
+typedef enum WJHBenchmarkWorkload {
+    /// A 1000 Hz mouse swept around the screen, mostly moves, with the odd click and drag.
+    WJHBenchmarkWorkloadMouseStorm = 0,
+
+    /// Fast typing: key downs and ups, a few milliseconds apart, with shifted letters and the odd command key shortcut.
+    WJHBenchmarkWorkloadTypingBurst,
+
+    /// Trackpad flings: bursts of scroll wheel events with decaying deltas, separated by pauses.
+    WJHBenchmarkWorkloadScrollFling,
+
+    /// The other workloads interleaved, a run of each at a time.
+    WJHBenchmarkWorkloadMixed,
+
+    WJHBenchmarkWorkloadCount
+} WJHBenchmarkWorkload;
+
+/**
+ The name used for a workload in reports and thresholds (e.g., "mouse_storm").
+ */
+char const * WJHBenchmarkWorkloadName(WJHBenchmarkWorkload workload);
+
+/**
+ Fill @a records with a workload.  The same workload and seed always produce the same records, so runs on different machines, or platforms, see the same input.  Timestamps are in nanoseconds, starting at zero.
+ */
+void WJHBenchmarkGenerate(WJHBenchmarkWorkload workload, uint64_t seed, WJHEventRecord *records, size_t count);
+
+/**
+ A monotonic clock, in nanoseconds.
+ */
+uint64_t WJHBenchmarkNow(void);
+
+/**
+ Returns the number of heap allocations made so far by the process.
+ */
+typedef uint64_t (*WJHBenchmarkAllocationCounter)(void);
+
+/**
+ Set the function used to count allocations, or NULL if allocations can not be counted.  Counting allocations is platform specific, so it is up to the program running the benchmarks.
+ */
+void WJHBenchmarkSetAllocationCounter(WJHBenchmarkAllocationCounter counter);
+
+/**
+ The outcome of one benchmark.
+ */
+typedef struct WJHBenchmarkResult {
+    /// The thing measured (e.g., "filter", or "dispatch.per_type").
+    char name[64];
+
+    /// The workload it was fed, or a description of the setup for benchmarks that do not consume events (e.g., "taps=256").
+    char workload[32];
+
+    /// The number of operations timed, in one repetition.  For benchmarks that consume events, an operation is one event.
+    uint64_t operations;
+
+    /// The time per operation, from the fastest repetition.
+    double nsPerOperation;
+
+    /// The heap allocations per operation, over every repetition, or a negative value if allocations were not counted.
+    double allocationsPerOperation;
+} WJHBenchmarkResult;
+
+/**
+ A growable list of results.
+ */
+typedef struct WJHBenchmarkReport {
+    WJHBenchmarkResult *results;
+    size_t count;
+    size_t capacity;
+} WJHBenchmarkReport;
+
+void WJHBenchmarkReportInit(WJHBenchmarkReport *report);
+void WJHBenchmarkReportDestroy(WJHBenchmarkReport *report);
+
+/**
+ Append a copy of @a result.  Returns false if memory could not be allocated.
+ */
+bool WJHBenchmarkReportAdd(WJHBenchmarkReport *report, WJHBenchmarkResult const *result);
+
+/**
+ Called once per repetition, with the whole input.
+ */
+typedef void (*WJHBenchmarkBody)(void *context, WJHEventRecord const *records, size_t count);
+
+/**
+ Time @a body over @a records, and add the result to @a report.
+
+ The body is run once to warm up, then @a repetitions times; the fastest repetition is reported.  Allocations are counted over all of the timed repetitions.
+
+ @param name the name of the benchmark
+ @param workload the name of the workload the records came from
+ */
+bool WJHBenchmarkRun(WJHBenchmarkReport *report, char const *name, char const *workload, WJHEventRecord const *records, size_t count, unsigned repetitions, WJHBenchmarkBody body, void *context);
+
+/**
+ Write a report as a JSON array of objects, with keys name, workload, operations, ns_per_op, and allocs_per_op.  Uncounted allocations are written as null.
+ */
+bool WJHBenchmarkReportWriteJSON(WJHBenchmarkReport const *report, FILE *file);
+
+/**
+ Write a report as CSV, with a header row and the same columns as the JSON.  Uncounted allocations are left empty.
+ */
+bool WJHBenchmarkReportWriteCSV(WJHBenchmarkReport const *report, FILE *file);
+
+/**
+ An upper bound on the cost of a benchmark.
+ */
+typedef struct WJHBenchmarkThreshold {
+    char name[64];
+
+    /// The workload the bound applies to, or "*" for every workload.
+    char workload[32];
+
+    /// The limits, or a negative value for no limit.
+    double maxNsPerOperation;
+    double maxAllocationsPerOperation;
+} WJHBenchmarkThreshold;
+
+/**
+ Parse thresholds from CSV text, one per line: name,workload,max_ns_per_op,max_allocs_per_op.  A limit may be left empty.  Blank lines, and lines starting with '#', are ignored, as is a header line starting with "name,".
+
+ @param thresholds receives up to @a capacity thresholds
+ @param count receives the number of thresholds in the text, which may be more than @a capacity
+ @param errorLine if not NULL, receives the line number (from 1) of the first malformed line, or 0
+ @return false if a line is malformed
+ */
+bool WJHBenchmarkParseThresholds(char const *text, WJHBenchmarkThreshold *thresholds, size_t capacity, size_t *count, size_t *errorLine);
+
+/**
+ Compare the results of a report against thresholds.  A result is checked against every threshold with the same name and a matching workload; results without a threshold, and thresholds without a result, pass.  A result whose allocations were not counted passes any allocation limit.
+
+ @param log if not NULL, receives a line describing each failure
+ @return the number of failures
+ */
+size_t WJHBenchmarkReportCheck(WJHBenchmarkReport const *report, WJHBenchmarkThreshold const *thresholds, size_t count, FILE *log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,212 @@
+//
+//  WJHBenchmarkMain.c
+//  WJHEventTapBenchmarks
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+/*
+ A command line driver for the portable benchmarks, for running them where there is no XCTest, such as on Linux.  It is not part of the Xcode targets, which run the same benchmarks from WJHEventTapBenchmarks.m.  Build it from the root of the repository with:
+
+     cc -O2 -std=c11 -D_GNU_SOURCE -IWJHEventTap -c \
+         WJHEventTapBenchmarks/WJHBenchmark.c WJHEventTapBenchmarks/WJHCoreBenchmarks.c WJHEventTapBenchmarks/WJHBenchmarkMain.c \
+         WJHEventTap/WJHEventFilterProgram.c WJHEventTap/WJHHotkeyMatcher.c WJHEventTap/WJHEventRemapTable.c WJHEventTap/WJHEventHub.c \
+         WJHEventTap/WJHEventCoalescer.c WJHEventTap/WJHEventRingBuffer.c WJHEventTap/WJHLatencyHistogram.c WJHEventTap/WJHEvdevBackend.c
+     c++ -O2 -std=c++17 -IWJHEventTap -c WJHEventTapBenchmarks/WJHTemplateBenchmarks.cpp
+     c++ -o wjh-benchmarks *.o -lm
+
+ Usage: wjh-benchmarks [--events N] [--repetitions N] [--json PATH] [--csv PATH] [--thresholds PATH]
+
+ Results are written as CSV to standard output, unless --json or --csv is given.  With --thresholds, each failure is reported on standard error, and the exit status is 1 if any threshold was exceeded.
+ */
+
+#include "WJHBenchmark.h"
+#include "WJHCoreBenchmarks.h"
+#include "WJHTemplateBenchmarks.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+
+#include <errno.h>
+#include <stdatomic.h>
+
+// glibc lets a program replace the allocator, as long as it replaces all of it, aligned allocation included.  Forward to the real one, counting as we go.
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void *pointer, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void * __libc_valloc(size_t size);
+extern void __libc_free(void *pointer);
+
+static atomic_uint_fast64_t allocations;
+
+void * malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void * realloc(void *pointer, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+
+void * memalign(size_t alignment, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void * aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *allocated = memalign(alignment, size);
+    if (allocated == NULL) {
+        return ENOMEM;
+    }
+    *pointer = allocated;
+    return 0;
+}
+
+void * valloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_valloc(size);
+}
+
+void free(void *pointer) {
+    __libc_free(pointer);
+}
+
+static uint64_t countAllocations(void) {
+    return atomic_load_explicit(&allocations, memory_order_relaxed);
+}
+
+#else
+
+#define countAllocations NULL
+
+#endif
+
+static char * readFile(char const *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    char *text = NULL;
+    size_t length = 0, capacity = 0, bytes;
+    do {
+        if (length + 4096 + 1 > capacity) {
+            capacity = 2 * capacity + 4096 + 1;
+            char *grown = realloc(text, capacity);
+            if (grown == NULL) {
+                break;
+            }
+            text = grown;
+        }
+        bytes = fread(text + length, 1, capacity - length - 1, file);
+        length += bytes;
+    } while (bytes > 0);
+    bool const failed = ferror(file) || text == NULL;
+    fclose(file);
+    if (failed) {
+        free(text);
+        return NULL;
+    }
+    text[length] = '\0';
+    return text;
+}
+
+static bool writeReport(WJHBenchmarkReport const *report, char const *path, bool (*write)(WJHBenchmarkReport const *, FILE *)) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    bool const written = write(report, file);
+    return fclose(file) == 0 && written;
+}
+
+static int usage(char const *program) {
+    fprintf(stderr, "usage: %s [--events N] [--repetitions N] [--json PATH] [--csv PATH] [--thresholds PATH]\n", program);
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    size_t eventCount = 100000;
+    unsigned repetitions = 5;
+    char const *jsonPath = NULL;
+    char const *csvPath = NULL;
+    char const *thresholdsPath = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 == argc) {
+            return usage(argv[0]);
+        }
+        char const *option = argv[i], *value = argv[++i];
+        if (strcmp(option, "--events") == 0) {
+            eventCount = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--repetitions") == 0) {
+            repetitions = (unsigned)strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--json") == 0) {
+            jsonPath = value;
+        } else if (strcmp(option, "--csv") == 0) {
+            csvPath = value;
+        } else if (strcmp(option, "--thresholds") == 0) {
+            thresholdsPath = value;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (eventCount == 0 || repetitions == 0) {
+        return usage(argv[0]);
+    }
+
+    WJHBenchmarkThreshold *thresholds = NULL;
+    size_t thresholdCount = 0;
+    if (thresholdsPath) {
+        char *text = readFile(thresholdsPath);
+        size_t errorLine;
+        if (text == NULL) {
+            perror(thresholdsPath);
+            return 2;
+        }
+        if (!WJHBenchmarkParseThresholds(text, NULL, 0, &thresholdCount, &errorLine)) {
+            fprintf(stderr, "%s:%zu: malformed threshold\n", thresholdsPath, errorLine);
+            free(text);
+            return 2;
+        }
+        thresholds = calloc(thresholdCount + 1, sizeof(*thresholds));
+        WJHBenchmarkParseThresholds(text, thresholds, thresholdCount, &thresholdCount, NULL);
+        free(text);
+    }
+
+    WJHBenchmarkSetAllocationCounter(countAllocations);
+    WJHBenchmarkReport report;
+    WJHBenchmarkReportInit(&report);
+    int status = 0;
+    if (!WJHCoreBenchmarksRun(&report, eventCount, repetitions) || !WJHTemplateBenchmarksRun(&report, eventCount, repetitions)) {
+        fprintf(stderr, "out of memory\n");
+        status = 2;
+    } else if ((jsonPath && !writeReport(&report, jsonPath, WJHBenchmarkReportWriteJSON)) || (csvPath && !writeReport(&report, csvPath, WJHBenchmarkReportWriteCSV))) {
+        perror(jsonPath && csvPath ? "writing results" : (jsonPath ? jsonPath : csvPath));
+        status = 2;
+    } else {
+        if (jsonPath == NULL && csvPath == NULL) {
+            WJHBenchmarkReportWriteCSV(&report, stdout);
+        }
+        if (thresholds && WJHBenchmarkReportCheck(&report, thresholds, thresholdCount, stderr) > 0) {
+            status = 1;
+        }
+    }
+    WJHBenchmarkReportDestroy(&report);
+    free(thresholds);
+    return status;
+}
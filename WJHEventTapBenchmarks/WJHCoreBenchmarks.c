@@ -0,0 +1,453 @@
+//
+//  WJHCoreBenchmarks.c
+//  WJHEventTapBenchmarks
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreBenchmarks.h"
+#include "WJHEvdevBackend.h"
+#include "WJHEventBackend.h"
+#include "WJHEventCoalescer.h"
+#include "WJHEventFilterProgram.h"
+#include "WJHEventHub.h"
+#include "WJHEventRemapTable.h"
+#include "WJHEventRingBuffer.h"
+#include "WJHHotkeyMatcher.h"
+#include "WJHLatencyHistogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum {
+    kHotkeyCount = 100,
+    kHotkeySweepStart = 10,
+    kHotkeySweepEnd = 10000,
+    kHubSubscriberCount = 8,
+    kRingBufferCapacity = 1024,
+    kRingBufferBatch = 64,
+
+    /// The most input events a record is written as: a report of two motions, or two wheels.
+    kEvdevEventsPerRecord = 3,
+};
+
+// Keeps the compiler from optimizing away work whose result is otherwise unused.
+static volatile uint64_t sink;
+
+#pragma mark - Filter
+
+static void runFilter(void *context, WJHEventRecord const *records, size_t count) {
+    WJHEventFilterProgram const *program = context;
+    uint64_t matched = 0;
+    for (size_t i = 0; i < count; ++i) {
+        matched += WJHEventFilterProgramMatches(program, records + i);
+    }
+    sink = matched;
+}
+
+static WJHEventFilterProgram * createFilter(void) {
+    // Command shortcuts on a few keys, clicks in a corner of the screen, and horizontal-ish scrolling with no modifiers.
+    static uint16_t const keycodes[] = { 0x00, 0x01, 0x08, 0x09, 0x0C, 0x0D, 0x11, 0x2D };
+    static WJHEventFilterRect const corner = { 0, 0, 400, 300 };
+    WJHEventFilterRule const rules[] = {
+        {
+            .typeMask = (1u << kWJHEventTypeKeyDown) | (1u << kWJHEventTypeKeyUp),
+            .flagsMask = kWJHEventFlagCommand,
+            .flagsValue = kWJHEventFlagCommand,
+            .keycodes = keycodes,
+            .keycodeCount = sizeof(keycodes) / sizeof(*keycodes),
+        },
+        {
+            .typeMask = (1u << kWJHEventTypeLeftMouseDown) | (1u << kWJHEventTypeLeftMouseUp) | (1u << kWJHEventTypeLeftMouseDragged),
+            .rects = &corner,
+            .rectCount = 1,
+        },
+        {
+            .typeMask = 1u << kWJHEventTypeScrollWheel,
+            .flagsMask = kWJHEventFlagShift | kWJHEventFlagControl | kWJHEventFlagAlternate | kWJHEventFlagCommand,
+        },
+    };
+    return WJHEventFilterProgramCreate(rules, sizeof(rules) / sizeof(*rules));
+}
+
+#pragma mark - Hotkeys
+
+static void runHotkeys(void *context, WJHEventRecord const *records, size_t count) {
+    WJHHotkeyMatcher *matcher = context;
+    uint64_t consumed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventRecord const *record = records + i;
+        if (record->type == kWJHEventTypeKeyDown) {
+            size_t binding;
+            consumed += WJHHotkeyMatcherKeyDown(matcher, record->keycode, record->flags, record->timestamp, &binding) == WJHHotkeyMatched;
+        } else if (record->type == kWJHEventTypeKeyUp) {
+            consumed += WJHHotkeyMatcherKeyUp(matcher, record->keycode);
+        }
+    }
+    WJHHotkeyMatcherReset(matcher);
+    sink = consumed;
+}
+
+static WJHHotkeyMatcher * createHotkeys(void) {
+    // Single chords on every modifier combination of the letters, and a handful of Ctrl-K sequences.
+    static uint64_t const modifiers[] = {
+        kWJHEventFlagCommand,
+        kWJHEventFlagCommand | kWJHEventFlagShift,
+        kWJHEventFlagControl,
+        kWJHEventFlagControl | kWJHEventFlagAlternate,
+    };
+    uint64_t const modifierMask = kWJHEventFlagShift | kWJHEventFlagControl | kWJHEventFlagAlternate | kWJHEventFlagCommand;
+    WJHHotkeyChord chords[2 * kHotkeyCount];
+    WJHHotkeyBinding bindings[kHotkeyCount];
+    for (size_t i = 0; i < kHotkeyCount; ++i) {
+        WJHHotkeyChord *chord = chords + 2 * i;
+        if (i < 4 * 24) {
+            chord[0] = (WJHHotkeyChord){ (uint16_t)(i % 24), modifiers[i / 24] };
+            bindings[i] = (WJHHotkeyBinding){ chord, 1, 0 };
+        } else {
+            chord[0] = (WJHHotkeyChord){ 0x28, kWJHEventFlagCommand | kWJHEventFlagAlternate };
+            chord[1] = (WJHHotkeyChord){ (uint16_t)(i % 24), kWJHEventFlagCommand | kWJHEventFlagAlternate };
+            bindings[i] = (WJHHotkeyBinding){ chord, 2, 1000000000 };
+        }
+    }
+    return WJHHotkeyMatcherCreate(bindings, kHotkeyCount, modifierMask, NULL);
+}
+
+/**
+ Two-chord bindings for every key of the first 100 and 8 modifier combinations, each followed by one of 13 keys, to show that the cost of a key press does not depend on how many bindings there are.
+ */
+static WJHHotkeyMatcher * createSweepHotkeys(size_t count) {
+    static uint64_t const modifiers[] = {
+        0,
+        kWJHEventFlagShift,
+        kWJHEventFlagControl,
+        kWJHEventFlagAlternate,
+        kWJHEventFlagCommand,
+        kWJHEventFlagControl | kWJHEventFlagShift,
+        kWJHEventFlagCommand | kWJHEventFlagShift,
+        kWJHEventFlagCommand | kWJHEventFlagAlternate,
+    };
+    uint64_t const modifierMask = kWJHEventFlagShift | kWJHEventFlagControl | kWJHEventFlagAlternate | kWJHEventFlagCommand;
+    WJHHotkeyChord *chords = malloc(2 * count * sizeof(*chords));
+    WJHHotkeyBinding *bindings = malloc(count * sizeof(*bindings));
+    WJHHotkeyMatcher *matcher = NULL;
+    if (chords && bindings) {
+        for (size_t i = 0; i < count; ++i) {
+            chords[2 * i] = (WJHHotkeyChord){ (uint16_t)(i % 100), modifiers[(i / 100) % 8] };
+            chords[2 * i + 1] = (WJHHotkeyChord){ (uint16_t)(100 + i / 800), kWJHEventFlagControl };
+            bindings[i] = (WJHHotkeyBinding){ chords + 2 * i, 2, 1000000000 };
+        }
+        matcher = WJHHotkeyMatcherCreate(bindings, count, modifierMask, NULL);
+    }
+    free(bindings);
+    free(chords);
+    return matcher;
+}
+
+static bool runHotkeySweep(WJHBenchmarkReport *report, char const *workload, WJHEventRecord const *records, size_t eventCount, unsigned repetitions) {
+    bool ok = true;
+    for (size_t count = kHotkeySweepStart; ok && count <= kHotkeySweepEnd; count *= 10) {
+        char name[32];
+        snprintf(name, sizeof(name), "hotkeys.%zu", count);
+        WJHHotkeyMatcher *matcher = createSweepHotkeys(count);
+        ok = matcher && WJHBenchmarkRun(report, name, workload, records, eventCount, repetitions, runHotkeys, matcher);
+        WJHHotkeyMatcherDestroy(matcher);
+    }
+    return ok;
+}
+
+#pragma mark - Remap
+
+typedef struct RemapContext {
+    WJHEventRemapTable *table;
+    WJHEventRemapState state;
+} RemapContext;
+
+static void runRemap(void *context, WJHEventRecord const *records, size_t count) {
+    RemapContext *remap = context;
+    uint64_t changed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventRecord record = records[i];
+        changed += WJHEventRemapTableApply(remap->table, &remap->state, &record) != 0;
+    }
+    sink = changed;
+}
+
+static WJHEventRemapTable * createRemap(void) {
+    // A Command-key layout swap on the letters, Caps Lock to Escape, swapped mouse buttons, and natural scrolling.
+    WJHEventRemapKeyRule keys[25];
+    for (uint16_t i = 0; i < 24; ++i) {
+        keys[i] = (WJHEventRemapKeyRule){ .keycode = i, .flagsMask = kWJHEventFlagCommand, .flagsValue = kWJHEventFlagCommand, .toKeycode = (uint16_t)(23 - i), .setFlags = kWJHEventFlagControl, .clearFlags = kWJHEventFlagCommand };
+    }
+    keys[24] = (WJHEventRemapKeyRule){ .keycode = 0x39, .toKeycode = 0x35 };
+    WJHEventRemapButtonRule const buttons[] = { { 0, 1 }, { 1, 0 } };
+    WJHEventRemapScroll const scroll = { false, 1, -1 };
+    WJHEventRemapSpec const spec = { keys, 25, buttons, 2, &scroll };
+    return WJHEventRemapTableCreate(&spec, NULL);
+}
+
+#pragma mark - Hub
+
+static void * passEvent(void *context, uint32_t type, void *event, void *info) {
+    (void)type;
+    (void)info;
+    ++*(uint64_t *)context;
+    return event;
+}
+
+static void runHub(void *context, WJHEventRecord const *records, size_t count) {
+    WJHEventHub *hub = context;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventHubDispatch(hub, records[i].type, (void *)(records + i), NULL);
+    }
+}
+
+static WJHEventHub * createHub(uint64_t *deliveries) {
+    // Subscribers with the kinds of masks taps ask for: everything, the mouse, the keyboard, and scrolling.
+    uint64_t const mouse = (1u << kWJHEventTypeMouseMoved) | (1u << kWJHEventTypeLeftMouseDown) | (1u << kWJHEventTypeLeftMouseUp) | (1u << kWJHEventTypeLeftMouseDragged);
+    uint64_t const keyboard = (1u << kWJHEventTypeKeyDown) | (1u << kWJHEventTypeKeyUp) | (1u << kWJHEventTypeFlagsChanged);
+    uint64_t const masks[kHubSubscriberCount] = { ~UINT64_C(0), mouse, keyboard, 1u << kWJHEventTypeScrollWheel, mouse | keyboard, keyboard, mouse, ~UINT64_C(0) };
+    WJHEventHub *hub = WJHEventHubCreate(false);
+    for (size_t i = 0; hub && i < kHubSubscriberCount; ++i) {
+        WJHEventHubSubscriber const subscriber = { masks[i], i % 2 == 0, passEvent, deliveries };
+        if (WJHEventHubAdd(hub, &subscriber) == 0) {
+            WJHEventHubDestroy(hub);
+            hub = NULL;
+        }
+    }
+    return hub;
+}
+
+#pragma mark - Coalescer
+
+static void countRun(void *context, WJHCoalescedEvent const *event) {
+    *(uint64_t *)context += event->count;
+}
+
+typedef struct CoalescerContext {
+    WJHEventCoalescer coalescer;
+    uint64_t merged;
+} CoalescerContext;
+
+static void runCoalescer(void *context, WJHEventRecord const *records, size_t count) {
+    CoalescerContext *coalescer = context;
+    WJHEventCoalescerInit(&coalescer->coalescer, 16000000, countRun, &coalescer->merged);
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventCoalescerAdd(&coalescer->coalescer, records + i);
+    }
+    WJHEventCoalescerFlush(&coalescer->coalescer);
+    sink = coalescer->merged;
+}
+
+#pragma mark - Ring buffer
+
+static void runRingBuffer(void *context, WJHEventRecord const *records, size_t count) {
+    WJHEventRingBuffer *buffer = context;
+    WJHEventRecord batch[kRingBufferBatch];
+    uint64_t popped = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventRingBufferPush(buffer, records + i);
+        if (i % kRingBufferBatch == kRingBufferBatch - 1) {
+            popped += WJHEventRingBufferPop(buffer, batch, kRingBufferBatch);
+        }
+    }
+    while (WJHEventRingBufferCount(buffer) > 0) {
+        popped += WJHEventRingBufferPop(buffer, batch, kRingBufferBatch);
+    }
+    sink = popped;
+}
+
+#pragma mark - Latency histogram
+
+static void runHistogram(void *context, WJHEventRecord const *records, size_t count) {
+    WJHLatencyHistogram *histogram = context;
+
+    // Stand-in latencies, spread over a few orders of magnitude.
+    for (size_t i = 0; i < count; ++i) {
+        WJHLatencyHistogramRecord(histogram, 500 + (records[i].timestamp % 100000));
+    }
+}
+
+#pragma mark - Evdev replay
+
+// From <linux/input-event-codes.h>.
+enum {
+    kEvSyn = 0x00,
+    kEvKey = 0x01,
+    kEvRel = 0x02,
+    kRelX = 0x00,
+    kRelY = 0x01,
+    kRelHWheel = 0x06,
+    kRelWheel = 0x08,
+    kBtnLeft = 0x110,
+    kKeyA = 30,
+};
+
+typedef struct EvdevContext {
+    /// A temporary file holding the workload, as a capture of Linux input events.
+    int fd;
+    WJHEventBackendTap *tap;
+    uint64_t keyDowns;
+} EvdevContext;
+
+static bool countKeyDowns(void *context, WJHEventRecord *record) {
+    *(uint64_t *)context += record->type == kWJHEventTypeKeyDown;
+    return true;
+}
+
+static size_t appendInputEvent(WJHEvdevInputEvent *events, size_t count, WJHEventRecord const *record, uint16_t type, uint16_t code, int32_t value) {
+    events[count] = (WJHEvdevInputEvent){ (int64_t)(record->timestamp / 1000000000), (int64_t)(record->timestamp % 1000000000 / 1000), type, code, value };
+    return count + 1;
+}
+
+/**
+ Write @a records as the input events a Linux device would have reported for them, each in a report of its own.
+
+ @return the number of input events written to @a events, which must have room for kEvdevEventsPerRecord per record.
+ */
+static size_t encodeEvdev(WJHEvdevInputEvent *events, WJHEventRecord const *records, size_t recordCount) {
+    size_t count = 0;
+    for (size_t i = 0; i < recordCount; ++i) {
+        WJHEventRecord const *record = records + i;
+        uint16_t code = WJHEvdevKeycodeToLinux(record->keycode);
+        code = code == UINT16_MAX ? kKeyA : code;
+        switch (record->type) {
+            case kWJHEventTypeKeyDown:
+            case kWJHEventTypeKeyUp:
+                count = appendInputEvent(events, count, record, kEvKey, code, record->type == kWJHEventTypeKeyDown);
+                break;
+            case kWJHEventTypeFlagsChanged:
+                count = appendInputEvent(events, count, record, kEvKey, code, record->flags != 0);
+                break;
+            case kWJHEventTypeLeftMouseDown:
+            case kWJHEventTypeLeftMouseUp:
+                count = appendInputEvent(events, count, record, kEvKey, (uint16_t)(kBtnLeft + record->button), record->type == kWJHEventTypeLeftMouseDown);
+                break;
+            case kWJHEventTypeScrollWheel:
+                count = appendInputEvent(events, count, record, kEvRel, kRelWheel, record->deltaY);
+                count = appendInputEvent(events, count, record, kEvRel, kRelHWheel, record->deltaX);
+                break;
+            default:
+                count = appendInputEvent(events, count, record, kEvRel, kRelX, record->deltaX);
+                count = appendInputEvent(events, count, record, kEvRel, kRelY, record->deltaY);
+                break;
+        }
+        count = appendInputEvent(events, count, record, kEvSyn, 0, 0);
+    }
+    return count;
+}
+
+/**
+ Replace the capture with one of @a records.
+ */
+static bool writeEvdev(EvdevContext *evdev, WJHEvdevInputEvent *events, WJHEventRecord const *records, size_t recordCount) {
+    size_t remaining = encodeEvdev(events, records, recordCount) * sizeof(*events);
+    char const *bytes = (char const *)events;
+    if (ftruncate(evdev->fd, 0) != 0 || lseek(evdev->fd, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    while (remaining > 0) {
+        ssize_t written = write(evdev->fd, bytes, remaining);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        remaining -= (size_t)written;
+    }
+    return true;
+}
+
+/**
+ Create a passive evdev tap for every event type, reading an anonymous temporary file.
+ */
+static bool createEvdev(EvdevContext *evdev) {
+    char const *directory = getenv("TMPDIR");
+    if (directory == NULL || *directory == '\0') {
+        directory = "/tmp";
+    }
+    char path[1024];
+    if ((size_t)snprintf(path, sizeof(path), "%s/wjh-evdev-XXXXXX", directory) >= sizeof(path)) {
+        return false;
+    }
+    evdev->fd = mkstemp(path);
+    if (evdev->fd < 0) {
+        return false;
+    }
+    unlink(path);
+    WJHEvdevOptions const options = { .inputFD = evdev->fd, .outputFD = -1 };
+    evdev->tap = kWJHEvdevBackend.create(&options, ~UINT64_C(0), true, countKeyDowns, &evdev->keyDowns);
+    if (evdev->tap == NULL) {
+        return false;
+    }
+    kWJHEvdevBackend.setEnabled(evdev->tap, true);
+    return true;
+}
+
+static void destroyEvdev(EvdevContext *evdev) {
+    kWJHEvdevBackend.destroy(evdev->tap);
+    if (evdev->fd >= 0) {
+        close(evdev->fd);
+    }
+}
+
+/// Replays the capture written for the workload, rather than the records themselves, through the backend to its callback.
+static void runEvdev(void *context, WJHEventRecord const *records, size_t count) {
+    EvdevContext *evdev = context;
+    (void)records;
+    (void)count;
+    lseek(evdev->fd, 0, SEEK_SET);
+    while (kWJHEvdevBackend.deliver(evdev->tap) > 0) {
+    }
+    sink = evdev->keyDowns;
+}
+
+#pragma mark - Running
+
+bool WJHCoreBenchmarksRun(WJHBenchmarkReport *report, size_t eventCount, unsigned repetitions) {
+    WJHEventRecord *records = malloc(eventCount * sizeof(*records));
+    uint64_t deliveries = 0;
+    CoalescerContext coalescer = { .merged = 0 };
+    RemapContext *remap = calloc(1, sizeof(*remap));
+    WJHEventFilterProgram *filter = createFilter();
+    WJHHotkeyMatcher *hotkeys = createHotkeys();
+    if (remap) {
+        remap->table = createRemap();
+    }
+    WJHEventHub *hub = createHub(&deliveries);
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(kRingBufferCapacity, WJHEventRingBufferDropOldest);
+    WJHLatencyHistogram *histogram = WJHLatencyHistogramCreate();
+    WJHEvdevInputEvent *evdevEvents = malloc(kEvdevEventsPerRecord * eventCount * sizeof(*evdevEvents));
+    EvdevContext evdev = { .fd = -1 };
+
+    bool ok = records && filter && hotkeys && remap && remap->table && hub && buffer && histogram && evdevEvents && createEvdev(&evdev);
+    for (WJHBenchmarkWorkload workload = 0; ok && workload < WJHBenchmarkWorkloadCount; ++workload) {
+        char const *name = WJHBenchmarkWorkloadName(workload);
+        WJHBenchmarkGenerate(workload, 1, records, eventCount);
+        ok = WJHBenchmarkRun(report, "filter", name, records, eventCount, repetitions, runFilter, filter)
+            && WJHBenchmarkRun(report, "hotkeys", name, records, eventCount, repetitions, runHotkeys, hotkeys)
+            && runHotkeySweep(report, name, records, eventCount, repetitions)
+            && WJHBenchmarkRun(report, "remap", name, records, eventCount, repetitions, runRemap, remap)
+            && WJHBenchmarkRun(report, "hub", name, records, eventCount, repetitions, runHub, hub)
+            && WJHBenchmarkRun(report, "coalescer", name, records, eventCount, repetitions, runCoalescer, &coalescer)
+            && WJHBenchmarkRun(report, "ring_buffer", name, records, eventCount, repetitions, runRingBuffer, buffer)
+            && WJHBenchmarkRun(report, "latency_histogram", name, records, eventCount, repetitions, runHistogram, histogram)
+            && writeEvdev(&evdev, evdevEvents, records, eventCount)
+            && WJHBenchmarkRun(report, "evdev", name, records, eventCount, repetitions, runEvdev, &evdev);
+    }
+
+    destroyEvdev(&evdev);
+    free(evdevEvents);
+    WJHLatencyHistogramDestroy(histogram);
+    WJHEventRingBufferDestroy(buffer);
+    WJHEventHubDestroy(hub);
+    if (remap) {
+        WJHEventRemapTableDestroy(remap->table);
+        free(remap);
+    }
+    WJHHotkeyMatcherDestroy(hotkeys);
+    WJHEventFilterProgramDestroy(filter);
+    free(records);
+    return ok;
+}
@@ -0,0 +1,32 @@
+//
+//  WJHCoreBenchmarks.h
+//  WJHEventTapBenchmarks
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTapBenchmarks_WJHCoreBenchmarks_h
+#define WJHEventTapBenchmarks_WJHCoreBenchmarks_h
+
+#include "WJHBenchmark.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Benchmark the parts of the tap callback that do not depend on CoreGraphics: the event filter, hotkey matcher, hub dispatch, coalescer, ring buffer, and latency histogram; and the evdev backend, replaying each workload as a capture of Linux input events, through the backend to a tap callback.
+
+ Each is fed every workload, and gets one result per workload, named after the component (e.g., "filter").  These run anywhere the framework's C sources build, including Linux.
+
+ @param eventCount the number of events generated for each workload
+ @param repetitions the number of timed runs of each benchmark
+ @return false if memory could not be allocated
+ */
+bool WJHCoreBenchmarksRun(WJHBenchmarkReport *report, size_t eventCount, unsigned repetitions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,308 @@
+//
+//  WJHEventTapBenchmarks.m
+//  WJHEventTapBenchmarks
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHBenchmark.h"
+#import "WJHCoreBenchmarks.h"
+#import "WJHTemplateBenchmarks.h"
+
+/**
+ Measures the cost of the tap hot paths, and fails if any of them exceeds its threshold.
+
+ Every result is also written, as JSON and CSV, to the directory named by the WJH_BENCHMARK_OUTPUT environment variable, or the temporary directory if it is not set.  Thresholds are read from the file named by WJH_BENCHMARK_THRESHOLDS, or from the Thresholds.csv in this bundle.
+
+ The benchmarks of the portable components are shared with the command line driver in WJHBenchmarkMain.c, which runs them on Linux.  Only the cases that need CoreGraphics, or Objective-C, are here.
+ */
+@interface WJHEventTapBenchmarks : XCTestCase
+@end
+
+static size_t const kEventCount = 100000;
+static size_t const kDispatchEventCount = 20000;
+static unsigned const kRepetitions = 5;
+static NSUInteger const kConstructionTapCount = 8;
+
+static WJHBenchmarkReport report;
+static WJHBenchmarkThreshold *thresholds;
+static size_t thresholdCount;
+
+
+#pragma mark - Allocation counting
+
+// libmalloc calls this, when it is set, for every allocation and free.  It is how malloc stack logging is implemented.
+typedef void (malloc_logger_t)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfHotFramesToSkip);
+extern malloc_logger_t *malloc_logger;
+
+enum { kMallocLogTypeAllocate = 2 };
+
+static malloc_logger_t *previousLogger;
+static atomic_uint_fast64_t allocations;
+
+static void countAllocation(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfHotFramesToSkip) {
+    if (type & kMallocLogTypeAllocate) {
+        atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    }
+    if (previousLogger) {
+        previousLogger(type, arg1, arg2, arg3, result, numberOfHotFramesToSkip + 1);
+    }
+}
+
+static uint64_t allocationCount(void) {
+    return atomic_load_explicit(&allocations, memory_order_relaxed);
+}
+
+
+#pragma mark - Delegates
+
+/// Implements the per-type methods for every event the workloads generate.
+@interface WJHPerTypeDelegate : NSObject<WJHEventTapDelegate>
+@end
+
+@implementation WJHPerTypeDelegate
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap leftMouseDownEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap leftMouseUpEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap leftMouseDraggedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap keyDownEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap keyUpEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap modifierFlagsChangedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap scrollWheelEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+@end
+
+/// Only implements the catch-all for unknown events, which every event falls through to.
+@interface WJHUnknownEventDelegate : NSObject<WJHEventTapDelegate>
+@end
+
+@implementation WJHUnknownEventDelegate
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap unknownEvent:(CGEventRef)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+@end
+
+
+#pragma mark - Dispatch
+
+typedef struct DispatchContext {
+    __unsafe_unretained WJHEventTap *tap;
+    CGEventRef const *events;
+} DispatchContext;
+
+static void runDispatch(void *context, WJHEventRecord const *records, size_t count) {
+    DispatchContext const *dispatch = context;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventTapDispatchEvent(dispatch->tap, NULL, (CGEventType)records[i].type, dispatch->events[i]);
+    }
+}
+
+
+@implementation WJHEventTapBenchmarks
+
++ (void)setUp {
+    [super setUp];
+    WJHBenchmarkReportInit(&report);
+    previousLogger = malloc_logger;
+    malloc_logger = countAllocation;
+    WJHBenchmarkSetAllocationCounter(allocationCount);
+
+    NSString *path = [[NSProcessInfo processInfo] environment][@"WJH_BENCHMARK_THRESHOLDS"];
+    if (path == nil) {
+        path = [[NSBundle bundleForClass:self] pathForResource:@"Thresholds" ofType:@"csv"];
+    }
+    NSString *text = path ? [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL] : nil;
+    size_t errorLine = 0;
+    if (text && WJHBenchmarkParseThresholds(text.UTF8String, NULL, 0, &thresholdCount, &errorLine)) {
+        thresholds = calloc(thresholdCount + 1, sizeof(*thresholds));
+        WJHBenchmarkParseThresholds(text.UTF8String, thresholds, thresholdCount, &thresholdCount, NULL);
+    } else {
+        NSLog(@"benchmarks: no thresholds from %@ (line %zu), so nothing can fail", path, errorLine);
+    }
+}
+
++ (void)tearDown {
+    NSString *directory = [[NSProcessInfo processInfo] environment][@"WJH_BENCHMARK_OUTPUT"] ?: NSTemporaryDirectory();
+    for (NSString *name in @[@"WJHEventTapBenchmarks.json", @"WJHEventTapBenchmarks.csv"]) {
+        NSString *path = [directory stringByAppendingPathComponent:name];
+        FILE *file = fopen(path.fileSystemRepresentation, "w");
+        if (file) {
+            if ([name.pathExtension isEqualToString:@"json"]) {
+                WJHBenchmarkReportWriteJSON(&report, file);
+            } else {
+                WJHBenchmarkReportWriteCSV(&report, file);
+            }
+            fclose(file);
+            NSLog(@"benchmarks: wrote %@", path);
+        }
+    }
+
+    WJHBenchmarkSetAllocationCounter(NULL);
+    malloc_logger = previousLogger;
+    free(thresholds);
+    thresholds = NULL;
+    thresholdCount = 0;
+    WJHBenchmarkReportDestroy(&report);
+    [super tearDown];
+}
+
+/**
+ Check new results against the thresholds, and add them to the report that is written out at the end.
+ */
+- (void)finishResults:(WJHBenchmarkReport *)results {
+    for (size_t i = 0; i < results->count; ++i) {
+        WJHBenchmarkResult *result = results->results + i;
+        NSLog(@"benchmarks: %s (%s): %.1f ns/op, %.3f allocations/op", result->name, result->workload, result->nsPerOperation, result->allocationsPerOperation);
+        WJHBenchmarkReport const single = { result, 1, 1 };
+        if (WJHBenchmarkReportCheck(&single, thresholds, thresholdCount, NULL) > 0) {
+            XCTFail(@"%s (%s) exceeds its threshold: %.1f ns/op, %.3f allocations/op", result->name, result->workload, result->nsPerOperation, result->allocationsPerOperation);
+        }
+        WJHBenchmarkReportAdd(&report, result);
+    }
+    WJHBenchmarkReportDestroy(results);
+}
+
+/**
+ Time @a block, which performs @a operations operations, and add a result for it.  Whatever the block returns is released after the timing stops.
+ */
+- (void)addResultNamed:(char const *)name workload:(NSString *)workload operations:(NSUInteger)operations to:(WJHBenchmarkReport *)results block:(id(^)(void))block {
+    uint64_t best = UINT64_MAX;
+    uint64_t const firstAllocation = allocationCount();
+    for (unsigned i = 0; i < kRepetitions; ++i) {
+        @autoreleasepool {
+            uint64_t const start = WJHBenchmarkNow();
+            id keep = block();
+            uint64_t const elapsed = WJHBenchmarkNow() - start;
+            best = MIN(best, elapsed);
+            keep = nil;
+        }
+    }
+
+    WJHBenchmarkResult result = {
+        .operations = operations,
+        .nsPerOperation = (double)best / operations,
+        .allocationsPerOperation = (double)(allocationCount() - firstAllocation) / ((double)operations * kRepetitions),
+    };
+    strlcpy(result.name, name, sizeof(result.name));
+    strlcpy(result.workload, workload.UTF8String, sizeof(result.workload));
+    WJHBenchmarkReportAdd(results, &result);
+}
+
+
+#pragma mark - Benchmarks
+
+- (void)testCoreComponents {
+    WJHBenchmarkReport results;
+    WJHBenchmarkReportInit(&results);
+    XCTAssertTrue(WJHCoreBenchmarksRun(&results, kEventCount, kRepetitions));
+    [self finishResults:&results];
+}
+
+- (void)testTemplateDispatch {
+    WJHBenchmarkReport results;
+    WJHBenchmarkReportInit(&results);
+    XCTAssertTrue(WJHTemplateBenchmarksRun(&results, kEventCount, kRepetitions));
+    [self finishResults:&results];
+}
+
+- (void)testDelegateStyles {
+    WJHEventTapDelegate *receivedEvent = [WJHEventTapDelegate new];
+    receivedEvent.receivedEvent = ^BOOL(WJHEventTap *eventTap, CGEventRef *event, CGEventType type, CGEventTapProxy proxy) {
+        return YES;
+    };
+    WJHEventTapDelegate *blocks = [WJHEventTapDelegate new];
+    WJHEventTapEventBlock const pass = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        return event;
+    };
+    blocks.leftMouseDownEvent = blocks.leftMouseUpEvent = blocks.leftMouseDraggedEvent = blocks.mouseMovedEvent = pass;
+    blocks.keyDownEvent = blocks.keyUpEvent = blocks.modifierFlagsChangedEvent = blocks.scrollWheelEvent = pass;
+
+    char const *names[] = { "dispatch.per_type", "dispatch.per_type_blocks", "dispatch.received_event", "dispatch.unknown_event" };
+    NSArray *delegates = @[[WJHPerTypeDelegate new], blocks, receivedEvent, [WJHUnknownEventDelegate new]];
+
+    WJHBenchmarkReport results;
+    WJHBenchmarkReportInit(&results);
+    WJHEventRecord *records = malloc(kDispatchEventCount * sizeof(*records));
+    CGEventRef *events = malloc(kDispatchEventCount * sizeof(*events));
+    for (WJHBenchmarkWorkload workload = 0; workload < WJHBenchmarkWorkloadCount; ++workload) {
+        WJHBenchmarkGenerate(workload, 1, records, kDispatchEventCount);
+        for (size_t i = 0; i < kDispatchEventCount; ++i) {
+            events[i] = WJHEventCreateWithRecord(records + i);
+        }
+        for (NSUInteger i = 0; i < delegates.count; ++i) {
+            WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegates[i]];
+            DispatchContext context = { tap, events };
+            XCTAssertTrue(WJHBenchmarkRun(&results, names[i], WJHBenchmarkWorkloadName(workload), records, kDispatchEventCount, kRepetitions, runDispatch, &context));
+        }
+        for (size_t i = 0; i < kDispatchEventCount; ++i) {
+            CFRelease(events[i]);
+        }
+    }
+    free(events);
+    free(records);
+    [self finishResults:&results];
+}
+
+- (void)testConstructionWithExistingTaps {
+    WJHBenchmarkReport results;
+    WJHBenchmarkReportInit(&results);
+    NSMutableArray *existing = [NSMutableArray array];
+    for (NSNumber *count in @[@0, @16, @64, @256]) {
+        while (existing.count < count.unsignedIntegerValue) {
+            WJHEventTap *tap = [[WJHEventTap alloc] initWithProcess:NULL eventMask:CGEventMaskBit(kCGEventOtherMouseUp) beforeOthers:NO passive:YES runLoop:nil delegate:nil];
+            XCTAssertNotNil(tap);
+            if (tap == nil) {
+                break;
+            }
+            [existing addObject:tap];
+        }
+        NSString *workload = [NSString stringWithFormat:@"taps=%@", count];
+
+        [self addResultNamed:"construction" workload:workload operations:kConstructionTapCount to:&results block:^id{
+            NSMutableArray *taps = [NSMutableArray arrayWithCapacity:kConstructionTapCount];
+            for (NSUInteger i = 0; i < kConstructionTapCount; ++i) {
+                WJHEventTap *tap = [[WJHEventTap alloc] initWithProcess:NULL eventMask:kCGEventMaskForAllEvents beforeOthers:(i % 2) passive:NO runLoop:nil delegate:nil];
+                if (tap) {
+                    [taps addObject:tap];
+                }
+            }
+            return taps;
+        }];
+
+        NSMutableArray *specifications = [NSMutableArray arrayWithCapacity:kConstructionTapCount];
+        for (NSUInteger i = 0; i < kConstructionTapCount; ++i) {
+            [specifications addObject:[WJHEventTapSpecification specificationWithProcess:NULL eventMask:kCGEventMaskForAllEvents beforeOthers:(i % 2) passive:NO delegate:nil]];
+        }
+        [self addResultNamed:"construction.bulk" workload:workload operations:kConstructionTapCount to:&results block:^id{
+            return [WJHEventTap tapsWithSpecifications:specifications runLoop:nil];
+        }];
+
+        [self addResultNamed:"system_taps" workload:workload operations:1 to:&results block:^id{
+            return [WJHEventTap systemTapsWithTransform:^id(CGEventTapInformation const *tapInfo) {
+                return @(tapInfo->eventTapID);
+            }];
+        }];
+    }
+    [self finishResults:&results];
+}
+
+@end
@@ -0,0 +1,141 @@
+//
+//  WJHTemplateBenchmarks.cpp
+//  WJHEventTapBenchmarks
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHTemplateBenchmarks.h"
+#include "WJHEventTap.hpp"
+
+#include <cstdlib>
+
+namespace {
+
+// Keeps the compiler from optimizing away work whose result is otherwise unused.
+volatile uint64_t sink;
+
+/// Handles every event type the workloads generate, doing a token amount of work with each.
+struct PerTypeHandler {
+    uint64_t total = 0;
+
+    bool leftMouseDown(WJHEventRecord &record) {
+        total += record.button;
+        return true;
+    }
+    bool leftMouseUp(WJHEventRecord &record) {
+        total += record.button;
+        return true;
+    }
+    bool leftMouseDragged(WJHEventRecord &record) {
+        total += static_cast<uint64_t>(record.x);
+        return true;
+    }
+    bool mouseMoved(WJHEventRecord &record) {
+        total += static_cast<uint64_t>(record.x);
+        return true;
+    }
+    bool keyDown(WJHEventRecord &record) {
+        total += record.keycode;
+        return true;
+    }
+    bool keyUp(WJHEventRecord &record) {
+        total += record.keycode;
+        return true;
+    }
+    bool modifierFlagsChanged(WJHEventRecord &record) {
+        total += record.flags;
+        return true;
+    }
+    bool scrollWheel(WJHEventRecord &record) {
+        total += static_cast<uint64_t>(record.deltaY);
+        return true;
+    }
+};
+
+struct UnknownEventHandler {
+    uint64_t total = 0;
+
+    bool unknownEvent(WJHEventRecord &record) {
+        total += record.type;
+        return true;
+    }
+};
+
+template <class Handler>
+void runTemplate(void *context, WJHEventRecord const *records, size_t count) {
+    Handler &handler = *static_cast<Handler *>(context);
+    uint64_t passed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventRecord record = records[i];
+        passed += wjh::dispatch(handler, record);
+    }
+    sink = passed + handler.total;
+}
+
+#pragma mark - Indirect
+
+typedef bool (*HandlerFunction)(PerTypeHandler *handler, WJHEventRecord *record);
+
+template <bool (PerTypeHandler::*function)(WJHEventRecord &)>
+bool callHandler(PerTypeHandler *handler, WJHEventRecord *record) {
+    return (handler->*function)(*record);
+}
+
+bool ignoreEvent(PerTypeHandler *, WJHEventRecord *) {
+    return true;
+}
+
+/// The same handler, behind a table filled in at run time, so the compiler can not see through it.
+struct IndirectContext {
+    PerTypeHandler handler;
+    HandlerFunction functions[32];
+};
+
+void runIndirect(void *context, WJHEventRecord const *records, size_t count) {
+    IndirectContext &indirect = *static_cast<IndirectContext *>(context);
+    uint64_t passed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventRecord record = records[i];
+        HandlerFunction const function = record.type < 32 ? indirect.functions[record.type] : ignoreEvent;
+        passed += function(&indirect.handler, &record);
+    }
+    sink = passed + indirect.handler.total;
+}
+
+void fillIndirect(IndirectContext &indirect) {
+    for (HandlerFunction &function : indirect.functions) {
+        function = ignoreEvent;
+    }
+    indirect.functions[kWJHEventTypeLeftMouseDown] = callHandler<&PerTypeHandler::leftMouseDown>;
+    indirect.functions[kWJHEventTypeLeftMouseUp] = callHandler<&PerTypeHandler::leftMouseUp>;
+    indirect.functions[kWJHEventTypeLeftMouseDragged] = callHandler<&PerTypeHandler::leftMouseDragged>;
+    indirect.functions[kWJHEventTypeMouseMoved] = callHandler<&PerTypeHandler::mouseMoved>;
+    indirect.functions[kWJHEventTypeKeyDown] = callHandler<&PerTypeHandler::keyDown>;
+    indirect.functions[kWJHEventTypeKeyUp] = callHandler<&PerTypeHandler::keyUp>;
+    indirect.functions[kWJHEventTypeFlagsChanged] = callHandler<&PerTypeHandler::modifierFlagsChanged>;
+    indirect.functions[kWJHEventTypeScrollWheel] = callHandler<&PerTypeHandler::scrollWheel>;
+}
+
+} // namespace
+
+#pragma mark - Running
+
+bool WJHTemplateBenchmarksRun(WJHBenchmarkReport *report, size_t eventCount, unsigned repetitions) {
+    WJHEventRecord *records = static_cast<WJHEventRecord *>(malloc(eventCount * sizeof(*records)));
+    PerTypeHandler perType;
+    UnknownEventHandler unknown;
+    IndirectContext indirect;
+    fillIndirect(indirect);
+
+    bool ok = records != nullptr;
+    for (int workload = 0; ok && workload < WJHBenchmarkWorkloadCount; ++workload) {
+        char const *name = WJHBenchmarkWorkloadName(static_cast<WJHBenchmarkWorkload>(workload));
+        WJHBenchmarkGenerate(static_cast<WJHBenchmarkWorkload>(workload), 1, records, eventCount);
+        ok = WJHBenchmarkRun(report, "dispatch.template", name, records, eventCount, repetitions, runTemplate<PerTypeHandler>, &perType)
+            && WJHBenchmarkRun(report, "dispatch.template_unknown", name, records, eventCount, repetitions, runTemplate<UnknownEventHandler>, &unknown)
+            && WJHBenchmarkRun(report, "dispatch.indirect", name, records, eventCount, repetitions, runIndirect, &indirect);
+    }
+    free(records);
+    return ok;
+}
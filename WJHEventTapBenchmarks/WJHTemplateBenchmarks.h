@@ -0,0 +1,35 @@
+//
+//  WJHTemplateBenchmarks.h
+//  WJHEventTapBenchmarks
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTapBenchmarks_WJHTemplateBenchmarks_h
+#define WJHEventTapBenchmarks_WJHTemplateBenchmarks_h
+
+#include "WJHBenchmark.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Benchmark the compile-time dispatch of WJHEventTap.hpp, against the same handlers called through a per-type table of function pointers, which is the least an Objective-C delegate costs.
+
+ Each is fed every workload, and gets one result per workload:
+ - "dispatch.template": a handler of the types the workloads generate.
+ - "dispatch.template_unknown": a handler with only an unknownEvent function.
+ - "dispatch.indirect": the first handler's functions, called through a table indexed by type.
+
+ @param eventCount the number of events generated for each workload
+ @param repetitions the number of timed runs of each benchmark
+ @return false if memory could not be allocated
+ */
+bool WJHTemplateBenchmarksRun(WJHBenchmarkReport *report, size_t eventCount, unsigned repetitions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,162 @@
+//
+//  WJHEventTapMonitorMain.c
+//  WJHEventTapMonitor
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+/*
+ Prints the rates of a tap that publishes its metrics, as enabled by -[WJHEventTap enableMetricsWithName:].  The counters are read straight out of the shared memory segment, so the tapped process is never asked for anything, and never waits for the monitor.  It is not part of the Xcode targets.  Build it from the root of the repository with:
+
+     cc -O2 -std=c11 -D_GNU_SOURCE -I. -o wjh-monitor \
+         WJHEventTapMonitor/WJHEventTapMonitorMain.c WJHEventTap/WJHMetricsSegment.c -lrt
+
+ (leave out -lrt on the Mac).
+
+ Usage: wjh-monitor NAME [--interval SECONDS] [--count N] [--types]
+
+ Every interval, it prints the events per second, and how many of them were passed, modified, and dropped; the ring buffer overflows and the times the system disabled the tap, during the interval; and upper bounds on the median, 99th percentile, and longest callback times, in microseconds.  With --types, it also prints the events per second of each type that had any.  It waits for the segment to appear, and starts over when a new tap publishes under the same name.  When a tap replaces its system tap, it prints the new eventTapID, and goes on.
+ */
+
+#include <WJHEventTap/WJHMetricsSegment.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int usage(char const *program) {
+    fprintf(stderr, "usage: %s NAME [--interval SECONDS] [--count N] [--types]\n", program);
+    return 2;
+}
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static void sleepFor(double seconds) {
+    struct timespec time = { (time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9) };
+    while (nanosleep(&time, &time) != 0 && errno == EINTR) {
+    }
+}
+
+/// Read the segment, through a mapping of its own, so a segment that has been replaced since the last read is noticed.
+static WJHMetricsOpenResult readSegment(char const *name, WJHMetricsSnapshot *snapshot) {
+    WJHMetricsReader *reader;
+    WJHMetricsOpenResult result = WJHMetricsReaderOpen(name, &reader);
+    if (result != WJHMetricsOpened) {
+        return result;
+    }
+    bool read = WJHMetricsReaderRead(reader, snapshot);
+    WJHMetricsReaderClose(reader);
+    return read ? WJHMetricsOpened : WJHMetricsNotFound;
+}
+
+static double microseconds(uint64_t nanoseconds) {
+    return nanoseconds == UINT64_MAX ? INFINITY : (double)nanoseconds / 1000;
+}
+
+static uint64_t longestTime(WJHMetricsCounters const *counters) {
+    for (unsigned bucket = kWJHMetricsTimeBucketCount; bucket-- > 0;) {
+        if (counters->callbackTimes[bucket]) {
+            return bucket == kWJHMetricsTimeBucketCount - 1 ? UINT64_MAX : UINT64_C(1) << (bucket + 1);
+        }
+    }
+    return 0;
+}
+
+static void printHeader(WJHMetricsSnapshot const *snapshot) {
+    printf("pid %" PRId32 ", tap %" PRIu32 "\n", snapshot->pid, snapshot->eventTapID);
+    printf("%12s %12s %12s %12s %10s %9s %9s %9s %9s %9s\n", "events/s", "passed/s", "modified/s", "dropped/s", "overflows", "timeouts", "disables", "p50 us", "p99 us", "max us");
+}
+
+static void printInterval(WJHMetricsCounters const *delta, double seconds, bool types) {
+    printf("%12.0f %12.0f %12.0f %12.0f %10" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9.1f %9.1f %9.1f\n",
+           (double)WJHMetricsCountersEvents(delta) / seconds, (double)delta->passed / seconds, (double)delta->modified / seconds, (double)delta->dropped / seconds,
+           delta->ringBufferOverflows, delta->timeoutDisables, delta->userInputDisables,
+           microseconds(WJHMetricsCountersTimePercentile(delta, 50)), microseconds(WJHMetricsCountersTimePercentile(delta, 99)), microseconds(longestTime(delta)));
+    if (types) {
+        for (unsigned type = 0; type < kWJHMetricsTypeLimit; ++type) {
+            if (delta->eventsByType[type]) {
+                printf("    type %2u %12.0f/s\n", type, (double)delta->eventsByType[type] / seconds);
+            }
+        }
+        if (delta->otherEvents) {
+            printf("    other   %12.0f/s\n", (double)delta->otherEvents / seconds);
+        }
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        return usage(argv[0]);
+    }
+    char const *name = argv[1];
+    double interval = 1;
+    unsigned long count = 0;
+    bool types = false;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--types") == 0) {
+            types = true;
+        } else if (i + 1 == argc) {
+            return usage(argv[0]);
+        } else if (strcmp(argv[i], "--interval") == 0) {
+            interval = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--count") == 0) {
+            count = strtoul(argv[++i], NULL, 10);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (!(interval > 0)) {
+        return usage(argv[0]);
+    }
+
+    WJHMetricsSnapshot previous, snapshot;
+    bool attached = false, waiting = false;
+    double previousTime = 0;
+    for (unsigned long printed = 0; count == 0 || printed < count;) {
+        WJHMetricsOpenResult result = readSegment(name, &snapshot);
+        double const time = now();
+        if (result == WJHMetricsIncompatible) {
+            fprintf(stderr, "%s: the segment has a layout this monitor does not understand\n", name);
+            return 1;
+        }
+        if (result == WJHMetricsOpenFailed) {
+            fprintf(stderr, "%s: %s\n", name, strerror(errno));
+            return 1;
+        }
+        if (result == WJHMetricsNotFound) {
+            if (!waiting) {
+                fprintf(stderr, "waiting for %s\n", name);
+                waiting = true;
+            }
+            attached = false;
+        } else if (!attached || snapshot.pid != previous.pid || WJHMetricsCountersEvents(&snapshot.counters) < WJHMetricsCountersEvents(&previous.counters)) {
+            // A new tap, or a new process: its counters start from zero, so there is nothing to take a rate against yet.
+            printHeader(&snapshot);
+            attached = true;
+            waiting = false;
+        } else {
+            if (snapshot.eventTapID != previous.eventTapID) {
+                // The tap replaced its system tap, and kept counting.
+                printHeader(&snapshot);
+            }
+            WJHMetricsCounters delta;
+            WJHMetricsCountersDifference(&delta, &snapshot.counters, &previous.counters);
+            printInterval(&delta, time - previousTime, types);
+            ++printed;
+        }
+        previous = snapshot;
+        previousTime = time;
+        sleepFor(interval);
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+//
+//  WJHCoreChecks.h
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTapTests_WJHCoreChecks_h
+#define WJHEventTapTests_WJHCoreChecks_h
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ The tally of a run of checks on the C core of the framework.  The checks use only C11 and POSIX threads, so they run on Linux, from WJHCoreChecksMain.c, as well as the Mac, from the XCTest case of each component.
+ */
+typedef struct WJHChecks {
+    /// Where to write each failed check, or NULL.
+    FILE *log;
+
+    unsigned passed;
+    unsigned failed;
+} WJHChecks;
+
+/**
+ Record whether @a condition holds, writing it to the log if it does not.
+
+ @return @a condition, so a check can guard the checks that depend on it.
+ */
+#define WJHCheck(checks, condition) WJHChecksRecord((checks), (condition), #condition, __FILE__, __LINE__)
+
+static inline bool WJHChecksRecord(WJHChecks *checks, bool passed, char const *condition, char const *file, int line) {
+    if (passed) {
+        ++checks->passed;
+    } else {
+        ++checks->failed;
+        if (checks->log) {
+            fprintf(checks->log, "%s:%d: check failed: %s\n", file, line, condition);
+        }
+    }
+    return passed;
+}
+
+/**
+ Push and pop records between a synthetic producer thread and a consumer, with both overflow policies.  A blocking buffer loses nothing and reorders nothing; a drop-oldest buffer stays in order, keeps the newest records, and counts every record it drops.
+ */
+void WJHEventRingBufferChecks(WJHChecks *checks);
+
+/**
+ Check that the buckets of a latency histogram are contiguous, and precise to 1/16, across the edge of every power of two; that percentiles come from the right buckets; and that snapshots taken while another thread records stay in order.
+ */
+void WJHLatencyHistogramChecks(WJHChecks *checks);
+
+/**
+ Feed recorded sequences of moves, drags, clicks and scrolls to a coalescer, checking which records merge, that a change of type, flags, or button, or a pause longer than the window, starts a new run, and that the runs sum their deltas and paths and come out in order.
+ */
+void WJHEventCoalescerChecks(WJHChecks *checks);
+
+/**
+ Write recordings to a temporary file and replay them, checking that every field of every record survives the round trip, that a full file drops and counts the records that do not fit, that other files are rejected, and that a recording opened while another thread writes it holds a complete prefix of its records.
+ */
+void WJHEventRecordingChecks(WJHChecks *checks);
+
+/**
+ Compile fixed and seeded random sets of filter rules, checking that each program agrees with a plain interpretation of its rules on random events, reads only the fields it reports, reports the right type mask, and rejects invalid rules.
+ */
+void WJHEventFilterProgramChecks(WJHChecks *checks);
+
+/**
+ Drive a hub from a synthetic event source, which like the system tap only delivers the types in its mask.  Check the chain order, that each subscriber is handed what the one before returned, that the source's mask widens and narrows with the subscribers, and that random subscribing and unsubscribing agrees with a plain model of the chain.
+ */
+void WJHEventHubChecks(WJHChecks *checks);
+
+/**
+ Compile fixed and seeded random remapping specifications, checking that each table agrees with a plain model of its rules on random streams of key and button events, sends each release where its press went, transforms and saturates scroll deltas, reports the right type mask, and rejects invalid rules.
+ */
+void WJHEventRemapTableChecks(WJHChecks *checks);
+
+/**
+ Replay a canned capture of Linux input events through the evdev backend, written at once and in pieces that split events across reads, checking the type, keycode, modifier flags, position, deltas, and button of every record, that each report's motion becomes one event, that an active tap writes what passes with its changes, and that a disabled one passes everything.
+ */
+void WJHEvdevBackendChecks(WJHChecks *checks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
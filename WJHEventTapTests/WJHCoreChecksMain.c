@@ -0,0 +1,94 @@
+//
+//  WJHCoreChecksMain.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+/*
+ A command line driver for the checks of the C core, for running them where there is no XCTest, such as on Linux.  It is not part of the Xcode targets, whose test cases run the same checks.  Build it, preferably with a sanitizer, from the root of the repository with:
+
+     cc -O2 -std=c11 -D_GNU_SOURCE -pthread -fsanitize=address,undefined -I. -o wjh-core-checks \
+         WJHEventTapTests/WJHCoreChecksMain.c \
+         WJHEventTapTests/WJHEventRingBufferChecks.c WJHEventTap/WJHEventRingBuffer.c \
+         WJHEventTapTests/WJHLatencyHistogramChecks.c WJHEventTap/WJHLatencyHistogram.c \
+         WJHEventTapTests/WJHEventCoalescerChecks.c WJHEventTap/WJHEventCoalescer.c \
+         WJHEventTapTests/WJHEventRecordingChecks.c WJHEventTap/WJHEventRecording.c \
+         WJHEventTapTests/WJHEventFilterProgramChecks.c WJHEventTap/WJHEventFilterProgram.c \
+         WJHEventTapTests/WJHEventHubChecks.c WJHEventTap/WJHEventHub.c \
+         WJHEventTapTests/WJHEventRemapTableChecks.c WJHEventTap/WJHEventRemapTable.c \
+         WJHEventTapTests/WJHEvdevBackendChecks.c WJHEventTap/WJHEvdevBackend.c -lm
+
+ Usage: wjh-core-checks [suite ...]
+
+ With no arguments, every suite runs.  The exit status is 0 if every check passed.
+ */
+
+#include "WJHCoreChecks.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct Suite {
+    char const *name;
+    void (*run)(WJHChecks *checks);
+} Suite;
+
+static Suite const kSuites[] = {
+    { "ring-buffer", WJHEventRingBufferChecks },
+    { "histogram", WJHLatencyHistogramChecks },
+    { "coalescer", WJHEventCoalescerChecks },
+    { "recording", WJHEventRecordingChecks },
+    { "filter", WJHEventFilterProgramChecks },
+    { "hub", WJHEventHubChecks },
+    { "remap", WJHEventRemapTableChecks },
+    { "evdev", WJHEvdevBackendChecks },
+};
+static size_t const kSuiteCount = sizeof(kSuites) / sizeof(*kSuites);
+
+static int usage(char const *program) {
+    fprintf(stderr, "usage: %s [suite ...]\nsuites:", program);
+    for (size_t i = 0; i < kSuiteCount; ++i) {
+        fprintf(stderr, " %s", kSuites[i].name);
+    }
+    fprintf(stderr, "\n");
+    return 2;
+}
+
+static Suite const * findSuite(char const *name) {
+    for (size_t i = 0; i < kSuiteCount; ++i) {
+        if (strcmp(kSuites[i].name, name) == 0) {
+            return kSuites + i;
+        }
+    }
+    return NULL;
+}
+
+static unsigned runSuite(Suite const *suite) {
+    WJHChecks checks = { .log = stderr };
+    suite->run(&checks);
+    printf("%s: %u passed, %u failed\n", suite->name, checks.passed, checks.failed);
+    return checks.failed;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned failed = 0;
+    if (argc == 1) {
+        for (size_t i = 0; i < kSuiteCount; ++i) {
+            failed += runSuite(kSuites + i);
+        }
+    }
+    for (int i = 1; i < argc; ++i) {
+        Suite const *suite = findSuite(argv[i]);
+        if (suite == NULL) {
+            return usage(argv[0]);
+        }
+        failed += runSuite(suite);
+    }
+
+    if (failed != 0) {
+        fprintf(stderr, "FAILED\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,374 @@
+//
+//  WJHEvdevBackendChecks.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreChecks.h"
+#include <WJHEventTap/WJHEvdevBackend.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+// From <linux/input-event-codes.h>.
+enum {
+    kEvSyn = 0x00,
+    kEvKey = 0x01,
+    kEvRel = 0x02,
+    kRelX = 0x00,
+    kRelY = 0x01,
+    kRelHWheel = 0x06,
+    kRelWheel = 0x08,
+    kBtnLeft = 0x110,
+    kBtnRight = 0x111,
+    kBtnMiddle = 0x112,
+    kKeyA = 30,
+    kKeyS = 31,
+    kKeyLeftCtrl = 29,
+    kKeyLeftShift = 42,
+    kKeyRightShift = 54,
+    kKeyLeftAlt = 56,
+    kKeyCapsLock = 58,
+    kKeyLeftMeta = 125,
+    kKeyF13 = 183,
+};
+
+enum {
+    kMaxRecords = 64,
+    kSplitWriteCount = 50,
+};
+
+static uint64_t const kModifiers = kWJHEventFlagControl | kWJHEventFlagAlternate | kWJHEventFlagCommand | kWJHEventFlagAlphaShift;
+
+#define EVENT(_type_, _code_, _value_) { 0, 0, _type_, _code_, _value_ }
+#define REPORT EVENT(kEvSyn, 0, 0)
+
+/**
+ A canned capture: modifiers, with both shift keys and a caps lock toggle; a key pressed, repeated, and released; a key with no macOS equivalent; reports of several motions, of wheels, and of both; and a drag with each kind of button.  The pointer starts at (100, 100).
+ */
+static WJHEvdevInputEvent const kStream[] = {
+    /* 0 */ EVENT(kEvKey, kKeyLeftShift, 1), REPORT,
+    /* 2 */ EVENT(kEvKey, kKeyA, 1), REPORT,
+    /* 4 */ EVENT(kEvKey, kKeyA, 2), REPORT,
+    /* 6 */ EVENT(kEvKey, kKeyA, 0), REPORT,
+    /* 8 */ EVENT(kEvKey, kKeyRightShift, 1), EVENT(kEvKey, kKeyLeftShift, 0), EVENT(kEvKey, kKeyRightShift, 0), REPORT,
+    /* 12 */ EVENT(kEvKey, kKeyLeftCtrl, 1), EVENT(kEvKey, kKeyLeftAlt, 1), EVENT(kEvKey, kKeyLeftMeta, 1), REPORT,
+    /* 16 */ EVENT(kEvKey, kKeyCapsLock, 1), EVENT(kEvKey, kKeyCapsLock, 0), REPORT,
+    /* 19 */ EVENT(kEvKey, kKeyF13, 1), REPORT,
+    /* 21 */ EVENT(kEvRel, kRelX, 3), EVENT(kEvRel, kRelY, 4), EVENT(kEvRel, kRelX, 2), EVENT(kEvRel, kRelY, -1), REPORT,
+    /* 26 */ EVENT(kEvRel, kRelWheel, -2), EVENT(kEvRel, kRelHWheel, 1), REPORT,
+    /* 29 */ EVENT(kEvRel, kRelX, 1), EVENT(kEvRel, kRelWheel, 1), REPORT,
+    /* 32 */ EVENT(kEvKey, kBtnLeft, 1), REPORT,
+    /* 34 */ EVENT(kEvRel, kRelX, 1), REPORT,
+    /* 36 */ EVENT(kEvKey, kBtnLeft, 0), REPORT,
+    /* 38 */ EVENT(kEvKey, kBtnRight, 1), REPORT,
+    /* 40 */ EVENT(kEvRel, kRelY, 1), REPORT,
+    /* 42 */ EVENT(kEvKey, kBtnRight, 0), REPORT,
+    /* 44 */ EVENT(kEvKey, kBtnMiddle, 1), REPORT,
+    /* 46 */ EVENT(kEvRel, kRelX, -1), REPORT,
+    /* 48 */ EVENT(kEvKey, kBtnMiddle, 0), REPORT,
+    /* 50 */ EVENT(kEvKey, kKeyLeftCtrl, 0), EVENT(kEvKey, kKeyLeftAlt, 0), EVENT(kEvKey, kKeyLeftMeta, 0), EVENT(kEvKey, kKeyCapsLock, 1), EVENT(kEvKey, kKeyCapsLock, 0), REPORT,
+};
+static size_t const kStreamCount = sizeof(kStream) / sizeof(*kStream);
+
+/**
+ A record the capture should be mapped to.
+ */
+typedef struct Expected {
+    /// The input event the record was made from, or for motion, the report that ended it.
+    size_t source;
+    uint32_t type;
+    uint16_t keycode;
+    uint64_t flags;
+    double x;
+    double y;
+    int32_t deltaX;
+    int32_t deltaY;
+    uint16_t button;
+} Expected;
+
+static Expected const kExpected[] = {
+    { 0, kWJHEventTypeFlagsChanged, 0x38, kWJHEventFlagShift, 100, 100, 0, 0, 0 },
+    { 2, kWJHEventTypeKeyDown, 0x00, kWJHEventFlagShift, 100, 100, 0, 0, 0 },
+    // An autorepeat is another key down.
+    { 4, kWJHEventTypeKeyDown, 0x00, kWJHEventFlagShift, 100, 100, 0, 0, 0 },
+    { 6, kWJHEventTypeKeyUp, 0x00, kWJHEventFlagShift, 100, 100, 0, 0, 0 },
+    // Shift stays down until both shift keys are up.
+    { 8, kWJHEventTypeFlagsChanged, 0x3C, kWJHEventFlagShift, 100, 100, 0, 0, 0 },
+    { 9, kWJHEventTypeFlagsChanged, 0x38, kWJHEventFlagShift, 100, 100, 0, 0, 0 },
+    { 10, kWJHEventTypeFlagsChanged, 0x3C, 0, 100, 100, 0, 0, 0 },
+    { 12, kWJHEventTypeFlagsChanged, 0x3B, kWJHEventFlagControl, 100, 100, 0, 0, 0 },
+    { 13, kWJHEventTypeFlagsChanged, 0x3A, kWJHEventFlagControl | kWJHEventFlagAlternate, 100, 100, 0, 0, 0 },
+    { 14, kWJHEventTypeFlagsChanged, 0x37, kWJHEventFlagControl | kWJHEventFlagAlternate | kWJHEventFlagCommand, 100, 100, 0, 0, 0 },
+    // Caps lock toggles on its press, not its release.
+    { 16, kWJHEventTypeFlagsChanged, 0x39, kModifiers, 100, 100, 0, 0, 0 },
+    { 17, kWJHEventTypeFlagsChanged, 0x39, kModifiers, 100, 100, 0, 0, 0 },
+    // F13 has no macOS keycode, so nothing is delivered for it.  The motion of a report is summed into one event.
+    { 25, kWJHEventTypeMouseMoved, 0, kModifiers, 105, 103, 5, 3, 0 },
+    { 28, kWJHEventTypeScrollWheel, 0, kModifiers, 105, 103, 1, -2, 0 },
+    { 31, kWJHEventTypeMouseMoved, 0, kModifiers, 106, 103, 1, 0, 0 },
+    { 31, kWJHEventTypeScrollWheel, 0, kModifiers, 106, 103, 0, 1, 0 },
+    { 32, kWJHEventTypeLeftMouseDown, 0, kModifiers, 106, 103, 0, 0, 0 },
+    { 35, kWJHEventTypeLeftMouseDragged, 0, kModifiers, 107, 103, 1, 0, 0 },
+    { 36, kWJHEventTypeLeftMouseUp, 0, kModifiers, 107, 103, 0, 0, 0 },
+    { 38, kWJHEventTypeRightMouseDown, 0, kModifiers, 107, 103, 0, 0, 1 },
+    { 41, kWJHEventTypeRightMouseDragged, 0, kModifiers, 107, 104, 0, 1, 0 },
+    { 42, kWJHEventTypeRightMouseUp, 0, kModifiers, 107, 104, 0, 0, 1 },
+    { 44, kWJHEventTypeOtherMouseDown, 0, kModifiers, 107, 104, 0, 0, 2 },
+    { 47, kWJHEventTypeOtherMouseDragged, 0, kModifiers, 106, 104, -1, 0, 0 },
+    { 48, kWJHEventTypeOtherMouseUp, 0, kModifiers, 106, 104, 0, 0, 2 },
+    { 50, kWJHEventTypeFlagsChanged, 0x3B, kWJHEventFlagAlternate | kWJHEventFlagCommand | kWJHEventFlagAlphaShift, 106, 104, 0, 0, 0 },
+    { 51, kWJHEventTypeFlagsChanged, 0x3A, kWJHEventFlagCommand | kWJHEventFlagAlphaShift, 106, 104, 0, 0, 0 },
+    { 52, kWJHEventTypeFlagsChanged, 0x37, kWJHEventFlagAlphaShift, 106, 104, 0, 0, 0 },
+    { 53, kWJHEventTypeFlagsChanged, 0x39, 0, 106, 104, 0, 0, 0 },
+    { 54, kWJHEventTypeFlagsChanged, 0x39, 0, 106, 104, 0, 0, 0 },
+};
+static size_t const kExpectedCount = sizeof(kExpected) / sizeof(*kExpected);
+
+/// Each input event of the capture is a microsecond after the one before.
+static uint64_t timestampOf(size_t index) {
+    return 1000000000 + index * 1000;
+}
+
+static void makeStream(WJHEvdevInputEvent *events) {
+    memcpy(events, kStream, sizeof(kStream));
+    for (size_t i = 0; i < kStreamCount; ++i) {
+        events[i].seconds = 1;
+        events[i].microseconds = (int64_t)i;
+    }
+}
+
+/// Collects records, and drops or rewrites some of them.
+typedef struct Collector {
+    WJHEventRecord records[kMaxRecords];
+    size_t count;
+    uint32_t dropType;
+    uint16_t remapFrom;
+    uint16_t remapTo;
+} Collector;
+
+static bool collect(void *context, WJHEventRecord *record) {
+    Collector *collector = context;
+    if (collector->count < kMaxRecords) {
+        collector->records[collector->count] = *record;
+    }
+    ++collector->count;
+    if (record->keycode == collector->remapFrom) {
+        record->keycode = collector->remapTo;
+    }
+    return record->type != collector->dropType;
+}
+
+static bool matches(WJHEventRecord const *record, Expected const *expected) {
+    return record->timestamp == timestampOf(expected->source)
+        && record->type == expected->type
+        && record->keycode == expected->keycode
+        && record->flags == expected->flags
+        && record->x == expected->x
+        && record->y == expected->y
+        && record->deltaX == expected->deltaX
+        && record->deltaY == expected->deltaY
+        && record->button == expected->button;
+}
+
+static void checkCollected(WJHChecks *checks, Collector const *collector, uint32_t tapID) {
+    if (!WJHCheck(checks, collector->count == kExpectedCount)) {
+        return;
+    }
+    size_t mismatched = 0, wrongTap = 0;
+    for (size_t i = 0; i < kExpectedCount; ++i) {
+        mismatched += !matches(collector->records + i, kExpected + i);
+        wrongTap += collector->records[i].tapID != tapID;
+    }
+    WJHCheck(checks, mismatched == 0);
+    WJHCheck(checks, wrongTap == 0);
+}
+
+/**
+ Create a passive tap for every event type, reading the capture from the read end of a pipe.
+ */
+static WJHEventBackendTap * createTap(int const *input, Collector *collector, uint32_t *tapID) {
+    WJHEvdevOptions const options = { .inputFD = input[0], .outputFD = -1, .x = 100, .y = 100 };
+    WJHEventBackendTap *tap = kWJHEvdevBackend.create(&options, ~UINT64_C(0), true, collect, collector);
+    if (tap == NULL) {
+        return NULL;
+    }
+    kWJHEvdevBackend.setEnabled(tap, true);
+    // The newest tap is listed first.
+    WJHEventBackendTapInfo info;
+    *tapID = kWJHEvdevBackend.listTaps(&info, 1) > 0 ? info.tapID : 0;
+    return tap;
+}
+
+/**
+ Replay the whole capture, written to the pipe at once, and compare every record with the one expected.
+ */
+static void checkMapping(WJHChecks *checks) {
+    int input[2];
+    if (!WJHCheck(checks, pipe(input) == 0)) {
+        return;
+    }
+    WJHEvdevInputEvent events[kStreamCount];
+    makeStream(events);
+    WJHCheck(checks, write(input[1], events, sizeof(events)) == (ssize_t)sizeof(events));
+    close(input[1]);
+
+    Collector collector = { .dropType = UINT32_MAX, .remapFrom = UINT16_MAX };
+    uint32_t tapID;
+    WJHEventBackendTap *tap = createTap(input, &collector, &tapID);
+    if (WJHCheck(checks, tap != NULL)) {
+        long total = 0, delivered;
+        while ((delivered = kWJHEvdevBackend.deliver(tap)) > 0) {
+            total += delivered;
+        }
+        WJHCheck(checks, delivered == 0);
+        WJHCheck(checks, total == (long)kStreamCount);
+        checkCollected(checks, &collector, tapID);
+        kWJHEvdevBackend.destroy(tap);
+    }
+    close(input[0]);
+}
+
+/// A small, seeded generator, so a failure can be reproduced.
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/**
+ Replay the capture written in pieces of random sizes, most of which split an input event, delivering whenever a whole event has been written, so each read ends where a write did.  The records must be the same as from a single write, and bytes of an event cut short at the end must be ignored.
+ */
+static void checkSplitReads(WJHChecks *checks) {
+    int input[2];
+    if (!WJHCheck(checks, pipe(input) == 0)) {
+        return;
+    }
+    Collector collector = { .dropType = UINT32_MAX, .remapFrom = UINT16_MAX };
+    uint32_t tapID;
+    WJHEventBackendTap *tap = createTap(input, &collector, &tapID);
+    if (!WJHCheck(checks, tap != NULL)) {
+        close(input[0]);
+        close(input[1]);
+        return;
+    }
+
+    WJHEvdevInputEvent events[kStreamCount];
+    makeStream(events);
+    unsigned char const *bytes = (unsigned char const *)events;
+    size_t const size = sizeof(events);
+    uint64_t state = 0x9E3779B97F4A7C15;
+    size_t written = 0;
+    long total = 0;
+    unsigned writes = 0, failedWrites = 0, failedDelivers = 0;
+    while (written < size) {
+        size_t piece = 1 + nextRandom(&state) % (2 * size / kSplitWriteCount);
+        piece = piece < size - written ? piece : size - written;
+        failedWrites += write(input[1], bytes + written, piece) != (ssize_t)piece;
+        written += piece;
+        ++writes;
+        // Only deliver when there is a whole event to read, or it would wait for more.
+        if ((long)(written / sizeof(*events)) > total) {
+            long delivered = kWJHEvdevBackend.deliver(tap);
+            failedDelivers += delivered <= 0;
+            total += delivered > 0 ? delivered : 0;
+        }
+    }
+    WJHCheck(checks, failedWrites == 0);
+    WJHCheck(checks, failedDelivers == 0);
+    WJHCheck(checks, writes > kSplitWriteCount / 2);
+    WJHCheck(checks, total == (long)kStreamCount);
+
+    // Half an event, and then the end of the stream.
+    WJHCheck(checks, write(input[1], bytes, sizeof(*events) / 2) == (ssize_t)(sizeof(*events) / 2));
+    close(input[1]);
+    WJHCheck(checks, kWJHEvdevBackend.deliver(tap) == 0);
+    checkCollected(checks, &collector, tapID);
+    kWJHEvdevBackend.destroy(tap);
+    close(input[0]);
+}
+
+/**
+ Pass a short capture through an active tap that drops motion and remaps one key, and through a disabled one, and read back what each wrote.
+ */
+static void checkOutput(WJHChecks *checks, bool enabled) {
+    WJHEvdevInputEvent const events[] = {
+        EVENT(kEvKey, kKeyA, 1), REPORT,
+        EVENT(kEvRel, kRelX, 5), EVENT(kEvRel, kRelWheel, 1), REPORT,
+        EVENT(kEvKey, kKeyF13, 1), REPORT,
+    };
+    int input[2], output[2];
+    if (!WJHCheck(checks, pipe(input) == 0)) {
+        return;
+    }
+    if (!WJHCheck(checks, pipe(output) == 0)) {
+        close(input[0]);
+        close(input[1]);
+        return;
+    }
+    WJHCheck(checks, write(input[1], events, sizeof(events)) == (ssize_t)sizeof(events));
+    close(input[1]);
+
+    Collector collector = { .dropType = kWJHEventTypeMouseMoved, .remapFrom = WJHEvdevKeycodeFromLinux(kKeyA), .remapTo = WJHEvdevKeycodeFromLinux(kKeyS) };
+    WJHEvdevOptions const options = { .inputFD = input[0], .outputFD = output[1] };
+    WJHEventBackendTap *tap = kWJHEvdevBackend.create(&options, ~UINT64_C(0), false, collect, &collector);
+    if (WJHCheck(checks, tap != NULL)) {
+        kWJHEvdevBackend.setEnabled(tap, enabled);
+        while (kWJHEvdevBackend.deliver(tap) > 0) {
+        }
+        kWJHEvdevBackend.destroy(tap);
+    }
+    close(output[1]);
+
+    WJHEvdevInputEvent written[16];
+    ssize_t bytes = read(output[0], written, sizeof(written));
+    if (enabled) {
+        // The key, the wheel without the motion, and the key with no macOS equivalent, untouched.
+        WJHCheck(checks, collector.count == 3);
+        if (WJHCheck(checks, bytes == (ssize_t)(6 * sizeof(*written)))) {
+            WJHCheck(checks, written[0].type == kEvKey && written[0].code == kKeyS && written[0].value == 1);
+            WJHCheck(checks, written[1].type == kEvSyn);
+            WJHCheck(checks, written[2].type == kEvRel && written[2].code == kRelWheel);
+            WJHCheck(checks, written[3].type == kEvSyn);
+            WJHCheck(checks, written[4].type == kEvKey && written[4].code == kKeyF13);
+            WJHCheck(checks, written[5].type == kEvSyn);
+        }
+    } else {
+        // A disabled tap calls nothing, and passes everything.
+        WJHCheck(checks, collector.count == 0);
+        WJHCheck(checks, bytes == (ssize_t)sizeof(events) && memcmp(written, events, sizeof(events)) == 0);
+    }
+    close(input[0]);
+    close(output[0]);
+}
+
+/**
+ Every Linux key with a macOS keycode maps back to itself.
+ */
+static void checkKeycodesRoundTrip(WJHChecks *checks) {
+    unsigned mapped = 0, wrong = 0;
+    for (uint16_t code = 0; code < 256; ++code) {
+        uint16_t keycode = WJHEvdevKeycodeFromLinux(code);
+        if (keycode != UINT16_MAX) {
+            ++mapped;
+            wrong += WJHEvdevKeycodeToLinux(keycode) != code;
+        }
+    }
+    WJHCheck(checks, wrong == 0);
+    // The letters, digits, punctuation, modifiers, function keys, and navigation keys.
+    WJHCheck(checks, mapped > 80);
+    WJHCheck(checks, WJHEvdevKeycodeFromLinux(kKeyF13) == UINT16_MAX);
+    WJHCheck(checks, WJHEvdevKeycodeToLinux(0x7F) == UINT16_MAX);
+}
+
+void WJHEvdevBackendChecks(WJHChecks *checks) {
+    checkMapping(checks);
+    checkSplitReads(checks);
+    checkOutput(checks, true);
+    checkOutput(checks, false);
+    checkKeycodesRoundTrip(checks);
+}
@@ -0,0 +1,231 @@
+//
+//  WJHEventBackendTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <fcntl.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHCoreChecks.h"
+
+@interface WJHEventBackendTests : XCTestCase
+@end
+
+static uint32_t const kBenchmarkReportCount = 1000000;
+
+// From <linux/input-event-codes.h>.
+enum {
+    kEvSyn = 0x00,
+    kEvKey = 0x01,
+    kEvRel = 0x02,
+    kRelX = 0x00,
+    kRelY = 0x01,
+    kRelWheel = 0x08,
+    kBtnLeft = 0x110,
+    kKeyA = 30,
+    kKeyS = 31,
+    kKeyLeftShift = 42,
+    kKeyF13 = 183,
+};
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+static WJHEvdevInputEvent inputEvent(uint16_t type, uint16_t code, int32_t value) {
+    static int64_t microseconds;
+    ++microseconds;
+    return (WJHEvdevInputEvent){ microseconds / 1000000, microseconds % 1000000, type, code, value };
+}
+
+/// Collects records, and drops or rewrites some of them.
+typedef struct Collector {
+    WJHEventRecord records[64];
+    size_t count;
+    uint32_t dropType;
+    uint16_t remapFrom;
+    uint16_t remapTo;
+} Collector;
+
+static bool collect(void *context, WJHEventRecord *record) {
+    Collector *collector = context;
+    if (collector->count < 64) {
+        collector->records[collector->count++] = *record;
+    }
+    if (record->keycode == collector->remapFrom) {
+        record->keycode = collector->remapTo;
+    }
+    return record->type != collector->dropType;
+}
+
+static bool countKeyDowns(void *context, WJHEventRecord *record) {
+    *(uint64_t *)context += record->type == kWJHEventTypeKeyDown;
+    return true;
+}
+
+@implementation WJHEventBackendTests
+
+- (void)writeEvents:(WJHEvdevInputEvent const *)events count:(size_t)count to:(int)fd {
+    // Split the first event across writes, as a pipe may.
+    XCTAssertEqual(10, write(fd, events, 10));
+    XCTAssertEqual((ssize_t)(count * sizeof(*events) - 10), write(fd, (char const *)events + 10, count * sizeof(*events) - 10));
+}
+
+- (void)testEvdevMapping {
+    WJHEvdevInputEvent const events[] = {
+        inputEvent(kEvKey, kKeyLeftShift, 1), inputEvent(kEvSyn, 0, 0),
+        inputEvent(kEvKey, kKeyA, 1), inputEvent(kEvSyn, 0, 0),
+        inputEvent(kEvKey, kKeyA, 0), inputEvent(kEvSyn, 0, 0),
+        inputEvent(kEvRel, kRelX, 5), inputEvent(kEvRel, kRelY, -3), inputEvent(kEvRel, kRelWheel, 1), inputEvent(kEvSyn, 0, 0),
+        inputEvent(kEvKey, kBtnLeft, 1), inputEvent(kEvSyn, 0, 0),
+        inputEvent(kEvRel, kRelX, 1), inputEvent(kEvSyn, 0, 0),
+    };
+    int input[2];
+    XCTAssertEqual(0, pipe(input));
+    [self writeEvents:events count:sizeof(events) / sizeof(*events) to:input[1]];
+    close(input[1]);
+
+    Collector collector = { .dropType = UINT32_MAX, .remapFrom = UINT16_MAX };
+    WJHEvdevOptions options = { .inputFD = input[0], .outputFD = -1, .x = 100, .y = 100 };
+    WJHEventBackendTap *tap = kWJHEvdevBackend.create(&options, ~UINT64_C(0), true, collect, &collector);
+    kWJHEvdevBackend.setEnabled(tap, true);
+    long total = 0, delivered;
+    while ((delivered = kWJHEvdevBackend.deliver(tap)) > 0) {
+        total += delivered;
+    }
+    XCTAssertEqual(0, delivered);
+    XCTAssertEqual((long)(sizeof(events) / sizeof(*events)), total);
+
+    uint32_t const types[] = { kWJHEventTypeFlagsChanged, kWJHEventTypeKeyDown, kWJHEventTypeKeyUp, kWJHEventTypeMouseMoved, kWJHEventTypeScrollWheel, kWJHEventTypeLeftMouseDown, kWJHEventTypeLeftMouseDragged };
+    XCTAssertEqual(sizeof(types) / sizeof(*types), collector.count);
+    for (size_t i = 0; i < collector.count; ++i) {
+        XCTAssertEqual(types[i], collector.records[i].type);
+        XCTAssertEqual((uint64_t)kWJHEventFlagShift, collector.records[i].flags);
+    }
+    XCTAssertEqual(0x38, collector.records[0].keycode);
+    XCTAssertEqual(WJHEvdevKeycodeFromLinux(kKeyA), collector.records[1].keycode);
+    XCTAssertEqual(105.0, collector.records[3].x);
+    XCTAssertEqual(97.0, collector.records[3].y);
+    XCTAssertEqual(1, collector.records[4].deltaY);
+    XCTAssertEqual(106.0, collector.records[6].x);
+
+    kWJHEvdevBackend.destroy(tap);
+    close(input[0]);
+}
+
+- (void)testEvdevActiveTapRewritesOutput {
+    WJHEvdevInputEvent const events[] = {
+        inputEvent(kEvKey, kKeyA, 1), inputEvent(kEvSyn, 0, 0),
+        inputEvent(kEvRel, kRelX, 5), inputEvent(kEvRel, kRelWheel, 1), inputEvent(kEvSyn, 0, 0),
+        inputEvent(kEvKey, kKeyF13, 1),
+    };
+    int input[2], output[2];
+    XCTAssertEqual(0, pipe(input));
+    XCTAssertEqual(0, pipe(output));
+    [self writeEvents:events count:sizeof(events) / sizeof(*events) to:input[1]];
+    close(input[1]);
+
+    Collector collector = { .dropType = kWJHEventTypeMouseMoved, .remapFrom = WJHEvdevKeycodeFromLinux(kKeyA), .remapTo = WJHEvdevKeycodeFromLinux(kKeyS) };
+    WJHEvdevOptions options = { .inputFD = input[0], .outputFD = output[1] };
+    WJHEventBackendTap *tap = kWJHEvdevBackend.create(&options, ~UINT64_C(0), false, collect, &collector);
+    kWJHEvdevBackend.setEnabled(tap, true);
+    while (kWJHEvdevBackend.deliver(tap) > 0) {
+    }
+    kWJHEvdevBackend.destroy(tap);
+    close(output[1]);
+
+    WJHEvdevInputEvent written[16];
+    ssize_t bytes = read(output[0], written, sizeof(written));
+    XCTAssertEqual((ssize_t)(5 * sizeof(*written)), bytes);
+    XCTAssertEqual(kKeyS, written[0].code);
+    XCTAssertEqual(kEvSyn, written[1].type);
+    XCTAssertEqual(kRelWheel, written[2].code);
+    XCTAssertEqual(kEvSyn, written[3].type);
+    XCTAssertEqual(kKeyF13, written[4].code);
+    close(input[0]);
+    close(output[0]);
+}
+
+- (void)testEvdevListTaps {
+    int input[2];
+    XCTAssertEqual(0, pipe(input));
+    WJHEvdevOptions options = { .inputFD = input[0], .outputFD = -1 };
+    Collector collector;
+    WJHEventBackendTap *tap = kWJHEvdevBackend.create(&options, CGEventMaskBit(kCGEventKeyDown), true, collect, &collector);
+    XCTAssertFalse(kWJHEvdevBackend.isEnabled(tap));
+
+    WJHEventBackendTapInfo infos[8];
+    size_t count = kWJHEvdevBackend.listTaps(infos, 8);
+    XCTAssertGreaterThanOrEqual(count, 1);
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyDown), infos[0].eventMask);
+    XCTAssertTrue(infos[0].passive);
+
+    kWJHEvdevBackend.destroy(tap);
+    XCTAssertEqual(count - 1, kWJHEvdevBackend.listTaps(NULL, 0));
+    close(input[0]);
+    close(input[1]);
+}
+
+- (void)testKeycodeMapping {
+    XCTAssertEqual(0x00, WJHEvdevKeycodeFromLinux(kKeyA));
+    XCTAssertEqual(kKeyA, WJHEvdevKeycodeToLinux(0x00));
+    XCTAssertEqual(UINT16_MAX, WJHEvdevKeycodeFromLinux(kKeyF13));
+    XCTAssertEqual(UINT16_MAX, WJHEvdevKeycodeToLinux(0x7F));
+}
+
+- (void)testCoreChecks {
+    WJHChecks checks = { .log = stderr };
+    WJHEvdevBackendChecks(&checks);
+    XCTAssertEqual(0, checks.failed);
+}
+
+
+#pragma mark - Benchmarks
+
+- (void)testEvdevReplayBenchmark {
+    // A capture of typing (Q through P), with a mouse report after each key event.
+    size_t const count = 6 * (size_t)kBenchmarkReportCount;
+    WJHEvdevInputEvent *events = calloc(count, sizeof(*events));
+    for (uint32_t i = 0; i < kBenchmarkReportCount; ++i) {
+        WJHEvdevInputEvent *report = events + 6 * (size_t)i;
+        report[0] = inputEvent(kEvKey, (uint16_t)(16 + i % 10), i & 1);
+        report[1] = inputEvent(kEvSyn, 0, 0);
+        report[2] = inputEvent(kEvRel, kRelX, 1);
+        report[3] = inputEvent(kEvRel, kRelY, -1);
+        report[4] = inputEvent(kEvRel, kRelWheel, 0);
+        report[5] = inputEvent(kEvSyn, 0, 0);
+    }
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    FILE *file = fopen(path.fileSystemRepresentation, "wb");
+    fwrite(events, sizeof(*events), count, file);
+    fclose(file);
+    free(events);
+
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    uint64_t keyDowns = 0;
+    WJHEvdevOptions options = { .inputFD = fd, .outputFD = -1 };
+    WJHEventBackendTap *tap = kWJHEvdevBackend.create(&options, ~UINT64_C(0), true, countKeyDowns, &keyDowns);
+    kWJHEvdevBackend.setEnabled(tap, true);
+
+    long total = 0, delivered;
+    uint64_t start = mach_absolute_time();
+    while ((delivered = kWJHEvdevBackend.deliver(tap)) > 0) {
+        total += delivered;
+    }
+    double time = nanosecondsSince(start);
+    kWJHEvdevBackend.destroy(tap);
+    close(fd);
+    unlink(path.fileSystemRepresentation);
+
+    XCTAssertEqual((long)count, total);
+    XCTAssertEqual((uint64_t)kBenchmarkReportCount / 2, keyDowns);
+    NSLog(@"evdev replay: %.1f ns/input event, %.1f ns/record", time / count, time / (2 * kBenchmarkReportCount));
+}
+
+@end
@@ -0,0 +1,169 @@
+//
+//  WJHEventCoalescerChecks.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreChecks.h"
+#include <WJHEventTap/WJHEventBackend.h>
+#include <WJHEventTap/WJHEventCoalescer.h>
+
+#include <math.h>
+#include <string.h>
+
+static uint64_t const kMillisecond = 1000000;
+
+enum { kMaxRuns = 16 };
+
+typedef struct RunLog {
+    WJHCoalescedEvent runs[kMaxRuns];
+    size_t count;
+} RunLog;
+
+static void logRun(void *context, WJHCoalescedEvent const *event) {
+    RunLog *log = context;
+    if (log->count < kMaxRuns) {
+        log->runs[log->count++] = *event;
+    }
+}
+
+static WJHEventRecord makeRecord(uint64_t milliseconds, uint32_t type, double x, double y, int32_t deltaX, int32_t deltaY) {
+    WJHEventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = milliseconds * kMillisecond;
+    record.type = type;
+    record.x = x;
+    record.y = y;
+    record.deltaX = deltaX;
+    record.deltaY = deltaY;
+    return record;
+}
+
+/**
+ Feed @a count records to a fresh coalescer with a 16ms window, then flush it, checking each result against @a expected.
+ */
+static void feed(WJHChecks *checks, RunLog *log, WJHEventRecord const *records, size_t count, WJHEventCoalescerResult const *expected) {
+    WJHEventCoalescer coalescer;
+    memset(log, 0, sizeof(*log));
+    WJHEventCoalescerInit(&coalescer, 16 * kMillisecond, logRun, log);
+    size_t unexpected = 0;
+    for (size_t i = 0; i < count; ++i) {
+        unexpected += WJHEventCoalescerAdd(&coalescer, records + i) != expected[i];
+    }
+    WJHCheck(checks, unexpected == 0);
+    WJHEventCoalescerFlush(&coalescer);
+    WJHCheck(checks, !WJHEventCoalescerFlush(&coalescer));
+}
+
+static void checkMergesMovesAndSumsPath(WJHChecks *checks) {
+    WJHEventRecord const records[] = {
+        makeRecord(0, kWJHEventTypeMouseMoved, 0, 0, 0, 0),
+        makeRecord(1, kWJHEventTypeMouseMoved, 3, 4, 3, 4),
+        makeRecord(2, kWJHEventTypeMouseMoved, 6, 8, 3, 4),
+    };
+    WJHEventCoalescerResult const expected[] = {
+        WJHEventCoalescerStarted, WJHEventCoalescerMerged, WJHEventCoalescerMerged,
+    };
+    RunLog log;
+    feed(checks, &log, records, 3, expected);
+    if (!WJHCheck(checks, log.count == 1)) {
+        return;
+    }
+    WJHCoalescedEvent const *run = log.runs;
+    WJHCheck(checks, run->count == 3);
+    WJHCheck(checks, run->record.x == 6 && run->record.y == 8);
+    WJHCheck(checks, run->record.deltaX == 6 && run->record.deltaY == 8);
+    WJHCheck(checks, fabs(run->pathLength - 10) < 1e-9);
+    WJHCheck(checks, run->firstTimestamp == 0);
+    WJHCheck(checks, run->record.timestamp == 2 * kMillisecond);
+}
+
+static void checkSumsScrollDeltas(WJHChecks *checks) {
+    WJHEventRecord const records[] = {
+        makeRecord(0, kWJHEventTypeScrollWheel, 10, 10, 1, -3),
+        makeRecord(1, kWJHEventTypeScrollWheel, 10, 10, 2, -4),
+        makeRecord(2, kWJHEventTypeScrollWheel, 10, 10, 0, -5),
+    };
+    WJHEventCoalescerResult const expected[] = {
+        WJHEventCoalescerStarted, WJHEventCoalescerMerged, WJHEventCoalescerMerged,
+    };
+    RunLog log;
+    feed(checks, &log, records, 3, expected);
+    if (!WJHCheck(checks, log.count == 1)) {
+        return;
+    }
+    WJHCheck(checks, log.runs[0].count == 3);
+    WJHCheck(checks, log.runs[0].record.deltaX == 3);
+    WJHCheck(checks, log.runs[0].record.deltaY == -12);
+    WJHCheck(checks, log.runs[0].pathLength == 0);
+}
+
+/**
+ A move, a click, a drag with a long pause, a drag with another button, then a scroll with a modifier change in the middle.  Every change of type, flags, or button, and every pause longer than the window, starts a new run, and nothing is reordered.
+ */
+static void checkRunsBreakInOrder(WJHChecks *checks) {
+    WJHEventRecord records[] = {
+        makeRecord(0, kWJHEventTypeMouseMoved, 0, 0, 0, 0),
+        makeRecord(1, kWJHEventTypeMouseMoved, 3, 4, 3, 4),
+        makeRecord(2, kWJHEventTypeLeftMouseDown, 3, 4, 0, 0),
+        makeRecord(3, kWJHEventTypeLeftMouseDragged, 3, 14, 0, 10),
+        makeRecord(4, kWJHEventTypeLeftMouseDragged, 3, 24, 0, 10),
+        makeRecord(30, kWJHEventTypeLeftMouseDragged, 3, 34, 0, 10),
+        makeRecord(31, kWJHEventTypeLeftMouseUp, 3, 34, 0, 0),
+        makeRecord(32, kWJHEventTypeOtherMouseDragged, 3, 44, 0, 10),
+        makeRecord(33, kWJHEventTypeOtherMouseDragged, 3, 54, 0, 10),
+        makeRecord(40, kWJHEventTypeScrollWheel, 3, 54, 0, 1),
+        makeRecord(41, kWJHEventTypeScrollWheel, 3, 54, 0, 1),
+        makeRecord(42, kWJHEventTypeScrollWheel, 3, 54, 0, 1),
+    };
+    records[7].button = 2;
+    records[8].button = 3;
+    records[11].flags = kWJHEventFlagShift;
+    WJHEventCoalescerResult const expected[] = {
+        WJHEventCoalescerStarted, WJHEventCoalescerMerged,
+        WJHEventCoalescerPassed,
+        WJHEventCoalescerStarted, WJHEventCoalescerMerged, WJHEventCoalescerStarted,
+        WJHEventCoalescerPassed,
+        WJHEventCoalescerStarted, WJHEventCoalescerStarted,
+        WJHEventCoalescerStarted, WJHEventCoalescerMerged, WJHEventCoalescerStarted,
+    };
+    RunLog log;
+    feed(checks, &log, records, sizeof(records) / sizeof(*records), expected);
+    if (!WJHCheck(checks, log.count == 7)) {
+        return;
+    }
+    WJHCheck(checks, log.runs[0].record.type == kWJHEventTypeMouseMoved && log.runs[0].count == 2);
+    WJHCheck(checks, log.runs[1].record.type == kWJHEventTypeLeftMouseDragged && log.runs[1].count == 2);
+    WJHCheck(checks, fabs(log.runs[1].pathLength - 20) < 1e-9);
+    WJHCheck(checks, log.runs[2].count == 1 && log.runs[2].firstTimestamp == 30 * kMillisecond);
+    WJHCheck(checks, log.runs[3].record.button == 2 && log.runs[4].record.button == 3);
+    WJHCheck(checks, log.runs[5].record.type == kWJHEventTypeScrollWheel && log.runs[5].count == 2);
+    WJHCheck(checks, log.runs[6].count == 1 && log.runs[6].record.flags == kWJHEventFlagShift);
+
+    uint64_t previous = 0, outOfOrder = 0;
+    for (size_t i = 0; i < log.count; ++i) {
+        outOfOrder += log.runs[i].firstTimestamp < previous;
+        previous = log.runs[i].record.timestamp;
+    }
+    WJHCheck(checks, outOfOrder == 0);
+}
+
+static void checkCanMerge(WJHChecks *checks) {
+    WJHCheck(checks, WJHEventCoalescerCanMerge(kWJHEventTypeMouseMoved));
+    WJHCheck(checks, WJHEventCoalescerCanMerge(kWJHEventTypeLeftMouseDragged));
+    WJHCheck(checks, WJHEventCoalescerCanMerge(kWJHEventTypeRightMouseDragged));
+    WJHCheck(checks, WJHEventCoalescerCanMerge(kWJHEventTypeOtherMouseDragged));
+    WJHCheck(checks, WJHEventCoalescerCanMerge(kWJHEventTypeScrollWheel));
+    WJHCheck(checks, !WJHEventCoalescerCanMerge(kWJHEventTypeKeyDown));
+    WJHCheck(checks, !WJHEventCoalescerCanMerge(kWJHEventTypeLeftMouseDown));
+    WJHCheck(checks, !WJHEventCoalescerCanMerge(kWJHEventTypeFlagsChanged));
+    WJHCheck(checks, !WJHEventCoalescerCanMerge(kWJHEventTypeTapDisabledByTimeout));
+}
+
+void WJHEventCoalescerChecks(WJHChecks *checks) {
+    checkMergesMovesAndSumsPath(checks);
+    checkSumsScrollDeltas(checks);
+    checkRunsBreakInOrder(checks);
+    checkCanMerge(checks);
+}
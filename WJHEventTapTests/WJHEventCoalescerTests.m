@@ -0,0 +1,294 @@
+//
+//  WJHEventCoalescerTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHCoreChecks.h"
+
+@interface WJHEventCoalescerTests : XCTestCase
+@end
+
+static uint64_t const kMillisecond = 1000000;
+
+enum { kMaxRuns = 64 };
+
+typedef struct {
+    WJHCoalescedEvent runs[kMaxRuns];
+    size_t count;
+} RunLog;
+
+static void logRun(void *context, WJHCoalescedEvent const *event) {
+    RunLog *log = context;
+    if (log->count < kMaxRuns) {
+        log->runs[log->count++] = *event;
+    }
+}
+
+static WJHEventRecord makeRecord(uint64_t milliseconds, CGEventType type, double x, double y, int32_t deltaX, int32_t deltaY) {
+    WJHEventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = milliseconds * kMillisecond;
+    record.type = type;
+    record.x = x;
+    record.y = y;
+    record.deltaX = deltaX;
+    record.deltaY = deltaY;
+    return record;
+}
+
+/// Records every callback, in order, as a string.
+@interface WJHCoalescingDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, strong) NSMutableArray *log;
+@end
+
+@implementation WJHCoalescingDelegate
+- (instancetype)init {
+    if (self = [super init]) {
+        _log = [NSMutableArray array];
+    }
+    return self;
+}
+- (void)eventTap:(WJHEventTap*)eventTap coalescedEvent:(WJHCoalescedEvent const *)event {
+    [_log addObject:[NSString stringWithFormat:@"coalesced %u x%u", event->record.type, event->count]];
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    [_log addObject:@"mouseMoved"];
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap leftMouseDownEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    [_log addObject:@"leftMouseDown"];
+    return event;
+}
+@end
+
+/// Knows nothing about coalescing.
+@interface WJHPlainMoveDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, assign) NSUInteger count;
+@property (nonatomic, assign) int64_t deltaX;
+@end
+
+@implementation WJHPlainMoveDelegate
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    ++_count;
+    _deltaX += CGEventGetIntegerValueField(event, kCGMouseEventDeltaX);
+    return event;
+}
+@end
+
+@implementation WJHEventCoalescerTests {
+    WJHEventCoalescer coalescer;
+    RunLog log;
+}
+
+- (void)setUp {
+    [super setUp];
+    memset(&log, 0, sizeof(log));
+    WJHEventCoalescerInit(&coalescer, 16 * kMillisecond, logRun, &log);
+}
+
+- (void)feed:(WJHEventRecord const *)records count:(size_t)count results:(WJHEventCoalescerResult *)results {
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventCoalescerResult result = WJHEventCoalescerAdd(&coalescer, records + i);
+        if (results) {
+            results[i] = result;
+        }
+    }
+}
+
+- (void)dispatch:(CGEventType)type deltaX:(int64_t)deltaX to:(WJHEventTap *)tap {
+    CGEventRef event = CGEventCreate(NULL);
+    CGEventSetType(event, type);
+    CGEventSetIntegerValueField(event, kCGMouseEventDeltaX, deltaX);
+    WJHEventTapDispatchEvent(tap, NULL, type, event);
+    CFRelease(event);
+}
+
+
+#pragma mark - Coalescer
+
+- (void)testMergesMovesAndSumsPath {
+    WJHEventRecord records[] = {
+        makeRecord(0, kCGEventMouseMoved, 0, 0, 0, 0),
+        makeRecord(1, kCGEventMouseMoved, 3, 4, 3, 4),
+        makeRecord(2, kCGEventMouseMoved, 6, 8, 3, 4),
+    };
+    WJHEventCoalescerResult results[3];
+    [self feed:records count:3 results:results];
+    XCTAssertEqual(WJHEventCoalescerStarted, results[0]);
+    XCTAssertEqual(WJHEventCoalescerMerged, results[1]);
+    XCTAssertEqual(WJHEventCoalescerMerged, results[2]);
+    XCTAssertEqual(0, log.count);
+
+    XCTAssertTrue(WJHEventCoalescerFlush(&coalescer));
+    XCTAssertFalse(WJHEventCoalescerFlush(&coalescer));
+    XCTAssertEqual(1, log.count);
+    WJHCoalescedEvent const *run = log.runs;
+    XCTAssertEqual(3, run->count);
+    XCTAssertEqual(6, run->record.x);
+    XCTAssertEqual(8, run->record.y);
+    XCTAssertEqual(6, run->record.deltaX);
+    XCTAssertEqual(8, run->record.deltaY);
+    XCTAssertEqualWithAccuracy(10, run->pathLength, 1e-9);
+    XCTAssertEqual(0, run->firstTimestamp);
+    XCTAssertEqual(2 * kMillisecond, run->record.timestamp);
+}
+
+- (void)testSumsScrollDeltas {
+    WJHEventRecord records[] = {
+        makeRecord(0, kCGEventScrollWheel, 10, 10, 1, -3),
+        makeRecord(1, kCGEventScrollWheel, 10, 10, 2, -4),
+        makeRecord(2, kCGEventScrollWheel, 10, 10, 0, -5),
+    };
+    [self feed:records count:3 results:NULL];
+    WJHEventCoalescerFlush(&coalescer);
+    XCTAssertEqual(1, log.count);
+    XCTAssertEqual(3, log.runs[0].count);
+    XCTAssertEqual(3, log.runs[0].record.deltaX);
+    XCTAssertEqual(-12, log.runs[0].record.deltaY);
+    XCTAssertEqual(0, log.runs[0].pathLength);
+}
+
+- (void)testRecordedSequenceKeepsOrder {
+    // Move, click, drag, a long pause in the drag, then scroll with a modifier change in the middle.
+    WJHEventRecord records[] = {
+        makeRecord(0, kCGEventMouseMoved, 0, 0, 0, 0),
+        makeRecord(1, kCGEventMouseMoved, 3, 4, 3, 4),
+        makeRecord(2, kCGEventLeftMouseDown, 3, 4, 0, 0),
+        makeRecord(3, kCGEventLeftMouseDragged, 3, 14, 0, 10),
+        makeRecord(4, kCGEventLeftMouseDragged, 3, 24, 0, 10),
+        makeRecord(30, kCGEventLeftMouseDragged, 3, 34, 0, 10),
+        makeRecord(31, kCGEventLeftMouseUp, 3, 34, 0, 0),
+        makeRecord(40, kCGEventScrollWheel, 3, 34, 0, 1),
+        makeRecord(41, kCGEventScrollWheel, 3, 34, 0, 1),
+        makeRecord(42, kCGEventScrollWheel, 3, 34, 0, 1),
+    };
+    records[9].flags = kCGEventFlagMaskShift;
+    WJHEventCoalescerResult results[10];
+    [self feed:records count:10 results:results];
+    WJHEventCoalescerFlush(&coalescer);
+
+    WJHEventCoalescerResult const expected[] = {
+        WJHEventCoalescerStarted, WJHEventCoalescerMerged,
+        WJHEventCoalescerPassed,
+        WJHEventCoalescerStarted, WJHEventCoalescerMerged, WJHEventCoalescerStarted,
+        WJHEventCoalescerPassed,
+        WJHEventCoalescerStarted, WJHEventCoalescerMerged, WJHEventCoalescerStarted,
+    };
+    for (int i = 0; i < 10; ++i) {
+        XCTAssertEqual(expected[i], results[i], @"record %d", i);
+    }
+
+    XCTAssertEqual(5, log.count);
+    XCTAssertEqual(kCGEventMouseMoved, log.runs[0].record.type);
+    XCTAssertEqual(2, log.runs[0].count);
+    XCTAssertEqual(kCGEventLeftMouseDragged, log.runs[1].record.type);
+    XCTAssertEqual(2, log.runs[1].count);
+    XCTAssertEqualWithAccuracy(20, log.runs[1].pathLength, 1e-9);
+    XCTAssertEqual(1, log.runs[2].count);
+    XCTAssertEqual(30 * kMillisecond, log.runs[2].firstTimestamp);
+    XCTAssertEqual(kCGEventScrollWheel, log.runs[3].record.type);
+    XCTAssertEqual(2, log.runs[3].count);
+    XCTAssertEqual(1, log.runs[4].count);
+    XCTAssertEqual(kCGEventFlagMaskShift, log.runs[4].record.flags);
+}
+
+- (void)testCanMerge {
+    XCTAssertTrue(WJHEventCoalescerCanMerge(kCGEventMouseMoved));
+    XCTAssertTrue(WJHEventCoalescerCanMerge(kCGEventLeftMouseDragged));
+    XCTAssertTrue(WJHEventCoalescerCanMerge(kCGEventRightMouseDragged));
+    XCTAssertTrue(WJHEventCoalescerCanMerge(kCGEventOtherMouseDragged));
+    XCTAssertTrue(WJHEventCoalescerCanMerge(kCGEventScrollWheel));
+    XCTAssertTrue(WJHEventCoalescerCanMerge(kCGEventTabletPointer));
+    XCTAssertFalse(WJHEventCoalescerCanMerge(kCGEventKeyDown));
+    XCTAssertFalse(WJHEventCoalescerCanMerge(kCGEventLeftMouseDown));
+    XCTAssertFalse(WJHEventCoalescerCanMerge(kCGEventTabletProximity));
+    XCTAssertFalse(WJHEventCoalescerCanMerge(kCGEventTapDisabledByTimeout));
+}
+
+- (void)testCoreChecks {
+    WJHChecks checks = { .log = stderr };
+    WJHEventCoalescerChecks(&checks);
+    XCTAssertEqual(0, checks.failed);
+}
+
+
+#pragma mark - Tap
+
+- (void)testOnlyPassiveTapsCoalesce {
+    WJHEventTap *active = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:nil];
+    XCTAssertFalse([active enableCoalescingWithWindow:0.016]);
+
+    WJHEventTap *passive = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:nil];
+    XCTAssertFalse([passive enableCoalescingWithWindow:0]);
+    XCTAssertTrue([passive enableCoalescingWithWindow:0.016]);
+    XCTAssertTrue(passive.coalescesEvents);
+    XCTAssertFalse([passive enableCoalescingWithWindow:0.016]);
+    XCTAssertFalse([passive enableAsynchronousDeliveryWithCapacity:64 overflowPolicy:WJHEventRingBufferDropOldest queue:nil]);
+}
+
+- (void)testTapDeliversRunsInOrder {
+    WJHCoalescingDelegate *delegate = [WJHCoalescingDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    // A window long enough that the test can not outlast it.
+    XCTAssertTrue([tap enableCoalescingWithWindow:3600]);
+
+    for (int i = 0; i < 5; ++i) {
+        [self dispatch:kCGEventMouseMoved deltaX:1 to:tap];
+    }
+    XCTAssertEqual(0, delegate.log.count);
+    [self dispatch:kCGEventLeftMouseDown deltaX:0 to:tap];
+    [self dispatch:kCGEventMouseMoved deltaX:1 to:tap];
+    WJHEventTapFlushCoalescedEvents(tap);
+
+    NSArray *expected = @[
+        [NSString stringWithFormat:@"coalesced %u x5", kCGEventMouseMoved],
+        @"leftMouseDown",
+        [NSString stringWithFormat:@"coalesced %u x1", kCGEventMouseMoved],
+    ];
+    XCTAssertEqualObjects(expected, delegate.log);
+}
+
+- (void)testTapFallsBackToTypeSpecificMethod {
+    WJHPlainMoveDelegate *delegate = [WJHPlainMoveDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    XCTAssertTrue([tap enableCoalescingWithWindow:3600]);
+
+    for (int i = 0; i < 100; ++i) {
+        [self dispatch:kCGEventMouseMoved deltaX:2 to:tap];
+    }
+    WJHEventTapFlushCoalescedEvents(tap);
+    XCTAssertEqual(1, delegate.count);
+    XCTAssertEqual(200, delegate.deltaX);
+}
+
+- (void)testTimerFlushesOnRunLoop {
+    WJHCoalescingDelegate *delegate = [WJHCoalescingDelegate new];
+    WJHEventTapThread *thread = [[WJHEventTapThread alloc] initWithName:@"coalescing"];
+    WJHEventTap *tap = [[WJHEventTap alloc] initWithProcess:NULL eventMask:kCGEventMaskForAllEvents beforeOthers:NO passive:YES thread:thread delegate:delegate];
+    XCTAssertTrue([tap enableCoalescingWithWindow:0.01]);
+
+    [thread performBlockAndWait:^{
+        // Make sure the tap is past the start-up phase, where it ignores events until the system reports that it was disabled.
+        [self dispatch:kCGEventTapDisabledByUserInput deltaX:0 to:tap];
+        for (int i = 0; i < 3; ++i) {
+            [self dispatch:kCGEventMouseMoved deltaX:1 to:tap];
+        }
+    }];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Run delivered"];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.2 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [thread performBlockAndWait:^{
+            if (delegate.log.count == 1) {
+                [expectation fulfill];
+            }
+        }];
+    });
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+@end
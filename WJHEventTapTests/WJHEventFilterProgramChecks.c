@@ -0,0 +1,273 @@
+//
+//  WJHEventFilterProgramChecks.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreChecks.h"
+#include <WJHEventTap/WJHEventBackend.h>
+#include <WJHEventTap/WJHEventFilterProgram.h>
+
+#include <string.h>
+
+enum {
+    kRandomProgramCount = 200,
+    kRandomRecordCount = 2000,
+    kMaxRules = 6,
+    kMaxKeycodes = 8,
+    kMaxRects = 3,
+};
+
+static uint64_t const kCommandOption = kWJHEventFlagCommand | kWJHEventFlagAlternate;
+
+/// A small, seeded generator, so a failure can be reproduced.
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static uint32_t randomBelow(uint64_t *state, uint32_t limit) {
+    return (uint32_t)(nextRandom(state) % limit);
+}
+
+static WJHEventRecord makeRecord(uint32_t type, uint64_t flags, uint16_t keycode, uint16_t button, double x, double y) {
+    WJHEventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.flags = flags;
+    record.keycode = keycode;
+    record.button = button;
+    record.x = x;
+    record.y = y;
+    return record;
+}
+
+/**
+ The rules interpreted as documented, one at a time, with none of the compiler's tables.
+ */
+static bool referenceMatches(WJHEventFilterRule const *rules, size_t count, WJHEventRecord const *record) {
+    if (record->type >= kWJHEventFilterTypeLimit) {
+        return true;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        WJHEventFilterRule const *rule = rules + i;
+        bool matches = rule->typeMask == 0 || (rule->typeMask & (UINT32_C(1) << record->type));
+        matches = matches && (record->flags & rule->flagsMask) == rule->flagsValue;
+        if (matches && rule->keycodeCount) {
+            bool found = false;
+            for (size_t k = 0; k < rule->keycodeCount; ++k) {
+                found = found || rule->keycodes[k] == record->keycode;
+            }
+            matches = found;
+        }
+        if (matches && rule->buttonMask) {
+            matches = record->button < 32 && (rule->buttonMask & (UINT32_C(1) << record->button));
+        }
+        if (matches && rule->rectCount) {
+            bool inside = false;
+            for (size_t r = 0; r < rule->rectCount; ++r) {
+                WJHEventFilterRect const *rect = rule->rects + r;
+                inside = inside || (record->x >= rect->x && record->x < rect->x + rect->width && record->y >= rect->y && record->y < rect->y + rect->height);
+            }
+            matches = inside;
+        }
+        if (matches) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// "Only keyDown of Q, W, or E with Cmd+Opt" or "only left clicks in the hot corner".
+static void checkShortcutProgram(WJHChecks *checks) {
+    static uint16_t const keycodes[] = { 12, 13, 14 };
+    static WJHEventFilterRect const hotCorner = { 0, 0, 100, 100 };
+    WJHEventFilterRule const rules[] = {
+        {
+            .typeMask = 1 << kWJHEventTypeKeyDown,
+            .flagsMask = kCommandOption,
+            .flagsValue = kCommandOption,
+            .keycodes = keycodes,
+            .keycodeCount = 3,
+        },
+        {
+            .typeMask = (1 << kWJHEventTypeLeftMouseDown) | (1 << kWJHEventTypeOtherMouseDown),
+            .buttonMask = 1 << 0,
+            .rects = &hotCorner,
+            .rectCount = 1,
+        },
+    };
+    WJHEventFilterProgram *program = WJHEventFilterProgramCreate(rules, 2);
+    if (!WJHCheck(checks, program != NULL)) {
+        return;
+    }
+    WJHEventRecord record = makeRecord(kWJHEventTypeKeyDown, kCommandOption, 12, 0, 0, 0);
+    WJHCheck(checks, WJHEventFilterProgramMatches(program, &record));
+    record = makeRecord(kWJHEventTypeKeyDown, kWJHEventFlagCommand, 12, 0, 0, 0);
+    WJHCheck(checks, !WJHEventFilterProgramMatches(program, &record));
+    record = makeRecord(kWJHEventTypeKeyDown, kCommandOption, 15, 0, 0, 0);
+    WJHCheck(checks, !WJHEventFilterProgramMatches(program, &record));
+    record = makeRecord(kWJHEventTypeKeyUp, kCommandOption, 12, 0, 0, 0);
+    WJHCheck(checks, !WJHEventFilterProgramMatches(program, &record));
+    record = makeRecord(kWJHEventTypeLeftMouseDown, 0, 0, 0, 0, 99.5);
+    WJHCheck(checks, WJHEventFilterProgramMatches(program, &record));
+    record = makeRecord(kWJHEventTypeLeftMouseDown, 0, 0, 0, 100, 50);
+    WJHCheck(checks, !WJHEventFilterProgramMatches(program, &record));
+    record = makeRecord(kWJHEventTypeTapDisabledByTimeout, 0, 0, 0, 0, 0);
+    WJHCheck(checks, WJHEventFilterProgramMatches(program, &record));
+
+    WJHCheck(checks, WJHEventFilterProgramFields(program, kWJHEventTypeKeyDown) == (WJHEventFilterFieldFlags | WJHEventFilterFieldKeycode));
+    WJHCheck(checks, WJHEventFilterProgramFields(program, kWJHEventTypeLeftMouseDown) == (WJHEventFilterFieldButton | WJHEventFilterFieldLocation));
+    WJHCheck(checks, WJHEventFilterProgramFields(program, kWJHEventTypeMouseMoved) == 0);
+    uint64_t typeMask = WJHEventFilterProgramTypeMask(program);
+    WJHCheck(checks, (typeMask & ((UINT64_C(1) << kWJHEventFilterTypeLimit) - 1)) == ((1 << kWJHEventTypeKeyDown) | (1 << kWJHEventTypeLeftMouseDown) | (1 << kWJHEventTypeOtherMouseDown)));
+    WJHCheck(checks, (typeMask >> kWJHEventFilterTypeLimit) == ~UINT64_C(0) >> kWJHEventFilterTypeLimit);
+    WJHEventFilterProgramDestroy(program);
+}
+
+static void checkInvalidRules(WJHChecks *checks) {
+    uint16_t keycode = kWJHEventFilterKeycodeLimit;
+    WJHEventFilterRule rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.keycodes = &keycode;
+    rule.keycodeCount = 1;
+    WJHCheck(checks, WJHEventFilterProgramCreate(&rule, 1) == NULL);
+
+    memset(&rule, 0, sizeof(rule));
+    rule.flagsMask = kWJHEventFlagCommand;
+    rule.flagsValue = kWJHEventFlagShift;
+    WJHCheck(checks, WJHEventFilterProgramCreate(&rule, 1) == NULL);
+
+    WJHEventFilterProgram *none = WJHEventFilterProgramCreate(NULL, 0);
+    if (WJHCheck(checks, none != NULL)) {
+        WJHEventRecord record = makeRecord(kWJHEventTypeKeyDown, 0, 0, 0, 0, 0);
+        WJHCheck(checks, !WJHEventFilterProgramMatches(none, &record));
+        WJHEventFilterProgramDestroy(none);
+    }
+}
+
+/**
+ Random storage for the rules of one random program.
+ */
+typedef struct RandomRules {
+    WJHEventFilterRule rules[kMaxRules];
+    uint16_t keycodes[kMaxRules][kMaxKeycodes];
+    WJHEventFilterRect rects[kMaxRules][kMaxRects];
+    size_t count;
+} RandomRules;
+
+static uint32_t const kTypes[] = {
+    kWJHEventTypeLeftMouseDown, kWJHEventTypeLeftMouseUp, kWJHEventTypeMouseMoved, kWJHEventTypeKeyDown, kWJHEventTypeKeyUp, kWJHEventTypeFlagsChanged, kWJHEventTypeScrollWheel, kWJHEventTypeOtherMouseDown,
+};
+static size_t const kTypeCount = sizeof(kTypes) / sizeof(*kTypes);
+static uint64_t const kFlags[] = { kWJHEventFlagShift, kWJHEventFlagControl, kWJHEventFlagAlternate, kWJHEventFlagCommand };
+
+static uint64_t randomFlags(uint64_t *state) {
+    uint64_t flags = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        flags |= randomBelow(state, 2) ? kFlags[i] : 0;
+    }
+    return flags;
+}
+
+/// Rules over a few types, flags, keycodes and buttons, and a small area, so that random events match some of the time.
+static void makeRandomRules(RandomRules *random, uint64_t *state) {
+    memset(random, 0, sizeof(*random));
+    random->count = randomBelow(state, kMaxRules + 1);
+    for (size_t i = 0; i < random->count; ++i) {
+        WJHEventFilterRule *rule = random->rules + i;
+        for (uint32_t n = randomBelow(state, 3); n > 0; --n) {
+            rule->typeMask |= UINT32_C(1) << kTypes[randomBelow(state, (uint32_t)kTypeCount)];
+        }
+        if (randomBelow(state, 2)) {
+            rule->flagsMask = randomFlags(state);
+            rule->flagsValue = randomFlags(state) & rule->flagsMask;
+        }
+        rule->keycodeCount = randomBelow(state, 3) ? 0 : 1 + randomBelow(state, kMaxKeycodes);
+        for (size_t k = 0; k < rule->keycodeCount; ++k) {
+            // Both ends of the keycode range, and the edges of bitmap words.
+            random->keycodes[i][k] = (uint16_t)(randomBelow(state, 2) ? randomBelow(state, 16) : randomBelow(state, kWJHEventFilterKeycodeLimit));
+        }
+        rule->keycodes = random->keycodes[i];
+        rule->buttonMask = randomBelow(state, 3) ? 0 : randomBelow(state, 16);
+        rule->rectCount = randomBelow(state, 3) ? 0 : 1 + randomBelow(state, kMaxRects);
+        for (size_t r = 0; r < rule->rectCount; ++r) {
+            random->rects[i][r] = (WJHEventFilterRect){ randomBelow(state, 50), randomBelow(state, 50), randomBelow(state, 60), randomBelow(state, 60) };
+        }
+        rule->rects = random->rects[i];
+    }
+}
+
+static WJHEventRecord makeRandomRecord(uint64_t *state) {
+    uint32_t type = randomBelow(state, 10) ? kTypes[randomBelow(state, (uint32_t)kTypeCount)] : randomBelow(state, 40);
+    uint16_t keycode = (uint16_t)(randomBelow(state, 2) ? randomBelow(state, 16) : randomBelow(state, 2 * kWJHEventFilterKeycodeLimit));
+    uint16_t button = (uint16_t)(randomBelow(state, 8) ? randomBelow(state, 4) : randomBelow(state, 64));
+    return makeRecord(type, randomFlags(state), keycode, button, randomBelow(state, 120), randomBelow(state, 120));
+}
+
+/**
+ Compile random programs, and evaluate random events against each, comparing every result with the reference.  The fields a program does not read for a type are zeroed first, so each program must also report every field it reads.
+ */
+static void checkMatchesReference(WJHChecks *checks) {
+    uint64_t state = 0x9e3779b97f4a7c15;
+    uint64_t failedToCompile = 0, mismatched = 0, underreported = 0, wrongTypeMask = 0, matched = 0;
+    for (int p = 0; p < kRandomProgramCount; ++p) {
+        RandomRules random;
+        makeRandomRules(&random, &state);
+        WJHEventFilterProgram *program = WJHEventFilterProgramCreate(random.rules, random.count);
+        if (program == NULL) {
+            ++failedToCompile;
+            continue;
+        }
+        // The program has its own copy of the rules.
+        RandomRules original = random;
+        for (size_t i = 0; i < original.count; ++i) {
+            original.rules[i].keycodes = original.keycodes[i];
+            original.rules[i].rects = original.rects[i];
+        }
+        memset(random.keycodes, 0xff, sizeof(random.keycodes));
+        memset(random.rects, 0, sizeof(random.rects));
+
+        uint64_t typeMask = WJHEventFilterProgramTypeMask(program);
+        for (uint32_t type = 0; type < kWJHEventFilterTypeLimit; ++type) {
+            bool possible = false;
+            for (size_t i = 0; i < original.count; ++i) {
+                possible = possible || original.rules[i].typeMask == 0 || (original.rules[i].typeMask & (UINT32_C(1) << type));
+            }
+            wrongTypeMask += possible != !!(typeMask & (UINT64_C(1) << type));
+        }
+
+        for (int e = 0; e < kRandomRecordCount; ++e) {
+            WJHEventRecord record = makeRandomRecord(&state);
+            bool expected = referenceMatches(original.rules, original.count, &record);
+            matched += expected;
+            mismatched += WJHEventFilterProgramMatches(program, &record) != expected;
+
+            uint32_t fields = WJHEventFilterProgramFields(program, record.type);
+            WJHEventRecord partial = makeRecord(record.type,
+                                                fields & WJHEventFilterFieldFlags ? record.flags : 0,
+                                                fields & WJHEventFilterFieldKeycode ? record.keycode : 0,
+                                                fields & WJHEventFilterFieldButton ? record.button : 0,
+                                                fields & WJHEventFilterFieldLocation ? record.x : 0,
+                                                fields & WJHEventFilterFieldLocation ? record.y : 0);
+            underreported += WJHEventFilterProgramMatches(program, &partial) != expected;
+        }
+        WJHEventFilterProgramDestroy(program);
+    }
+    WJHCheck(checks, failedToCompile == 0);
+    WJHCheck(checks, wrongTypeMask == 0);
+    WJHCheck(checks, mismatched == 0);
+    WJHCheck(checks, underreported == 0);
+    // Otherwise, the comparison shows little.
+    WJHCheck(checks, matched > (uint64_t)kRandomProgramCount * kRandomRecordCount / 20);
+}
+
+void WJHEventFilterProgramChecks(WJHChecks *checks) {
+    checkShortcutProgram(checks);
+    checkInvalidRules(checks);
+    checkMatchesReference(checks);
+}
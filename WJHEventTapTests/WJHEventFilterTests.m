@@ -0,0 +1,280 @@
+//
+//  WJHEventFilterTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHCoreChecks.h"
+
+@interface WJHEventFilterTests : XCTestCase
+@end
+
+static uint32_t const kSyntheticEventCount = 4096;
+static uint32_t const kBenchmarkEventCount = 10000000;
+static uint64_t const kCommandOption = kCGEventFlagMaskCommand | kCGEventFlagMaskAlternate;
+static uint16_t const kKeycodes[] = { 12, 13, 14 };
+static WJHEventFilterRect const kHotCorner = { 0, 0, 100, 100 };
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+static WJHEventRecord makeRecord(CGEventType type, uint64_t flags, uint16_t keycode, uint16_t button, double x, double y) {
+    WJHEventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.flags = flags;
+    record.keycode = keycode;
+    record.button = button;
+    record.x = x;
+    record.y = y;
+    return record;
+}
+
+/// "Only keyDown of Q, W, or E with Cmd+Opt" or "only left clicks in the hot corner".
+static WJHEventFilterProgram * createShortcutProgram(void) {
+    WJHEventFilterRule rules[] = {
+        {
+            .typeMask = CGEventMaskBit(kCGEventKeyDown),
+            .flagsMask = kCommandOption,
+            .flagsValue = kCommandOption,
+            .keycodes = kKeycodes,
+            .keycodeCount = sizeof(kKeycodes) / sizeof(*kKeycodes),
+        },
+        {
+            .typeMask = CGEventMaskBit(kCGEventLeftMouseDown) | CGEventMaskBit(kCGEventOtherMouseDown),
+            .buttonMask = 1 << kCGMouseButtonLeft,
+            .rects = &kHotCorner,
+            .rectCount = 1,
+        },
+    };
+    return WJHEventFilterProgramCreate(rules, sizeof(rules) / sizeof(*rules));
+}
+
+/// Counts every event it is given.
+@interface WJHFilteredDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, assign) NSUInteger count;
+@end
+
+@implementation WJHFilteredDelegate
+- (BOOL)eventTap:(WJHEventTap*)eventTap receivedEvent:(CGEventRef*)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    ++_count;
+    return YES;
+}
+@end
+
+@implementation WJHEventFilterTests {
+    WJHEventFilterProgram *program;
+}
+
+- (void)setUp {
+    [super setUp];
+    program = createShortcutProgram();
+}
+
+- (void)tearDown {
+    WJHEventFilterProgramDestroy(program);
+    [super tearDown];
+}
+
+- (BOOL)matches:(WJHEventRecord)record {
+    return WJHEventFilterProgramMatches(program, &record);
+}
+
+
+#pragma mark - Program
+
+- (void)testKeyRule {
+    XCTAssertTrue([self matches:makeRecord(kCGEventKeyDown, kCommandOption, 12, 0, 0, 0)]);
+    XCTAssertTrue([self matches:makeRecord(kCGEventKeyDown, kCommandOption | kCGEventFlagMaskNonCoalesced, 14, 0, 0, 0)]);
+    XCTAssertFalse([self matches:makeRecord(kCGEventKeyDown, kCGEventFlagMaskCommand, 12, 0, 0, 0)]);
+    XCTAssertFalse([self matches:makeRecord(kCGEventKeyDown, kCommandOption, 15, 0, 0, 0)]);
+    XCTAssertFalse([self matches:makeRecord(kCGEventKeyUp, kCommandOption, 12, 0, 0, 0)]);
+}
+
+- (void)testMouseRule {
+    XCTAssertTrue([self matches:makeRecord(kCGEventLeftMouseDown, 0, 0, kCGMouseButtonLeft, 0, 99.5)]);
+    XCTAssertFalse([self matches:makeRecord(kCGEventLeftMouseDown, 0, 0, kCGMouseButtonLeft, 100, 50)]);
+    XCTAssertFalse([self matches:makeRecord(kCGEventOtherMouseDown, 0, 0, kCGMouseButtonCenter, 50, 50)]);
+    XCTAssertFalse([self matches:makeRecord(kCGEventMouseMoved, 0, 0, kCGMouseButtonLeft, 50, 50)]);
+}
+
+- (void)testFields {
+    XCTAssertEqual(WJHEventFilterFieldFlags | WJHEventFilterFieldKeycode, WJHEventFilterProgramFields(program, kCGEventKeyDown));
+    XCTAssertEqual(WJHEventFilterFieldButton | WJHEventFilterFieldLocation, WJHEventFilterProgramFields(program, kCGEventLeftMouseDown));
+    XCTAssertEqual(0, WJHEventFilterProgramFields(program, kCGEventMouseMoved));
+}
+
+- (void)testTapNotificationsAlwaysPass {
+    XCTAssertTrue([self matches:makeRecord(kCGEventTapDisabledByTimeout, 0, 0, 0, 0, 0)]);
+    XCTAssertTrue([self matches:makeRecord(kCGEventTapDisabledByUserInput, 0, 0, 0, 0, 0)]);
+}
+
+- (void)testEmptyAndUnconstrainedRules {
+    WJHEventFilterProgram *none = WJHEventFilterProgramCreate(NULL, 0);
+    WJHEventRecord record = makeRecord(kCGEventKeyDown, 0, 0, 0, 0, 0);
+    XCTAssertFalse(WJHEventFilterProgramMatches(none, &record));
+    WJHEventFilterProgramDestroy(none);
+
+    WJHEventFilterRule any;
+    memset(&any, 0, sizeof(any));
+    WJHEventFilterProgram *all = WJHEventFilterProgramCreate(&any, 1);
+    XCTAssertTrue(WJHEventFilterProgramMatches(all, &record));
+    WJHEventFilterProgramDestroy(all);
+}
+
+- (void)testInvalidRules {
+    uint16_t keycode = kWJHEventFilterKeycodeLimit;
+    WJHEventFilterRule rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.keycodes = &keycode;
+    rule.keycodeCount = 1;
+    XCTAssertTrue(WJHEventFilterProgramCreate(&rule, 1) == NULL);
+
+    memset(&rule, 0, sizeof(rule));
+    rule.flagsMask = kCGEventFlagMaskCommand;
+    rule.flagsValue = kCGEventFlagMaskShift;
+    XCTAssertTrue(WJHEventFilterProgramCreate(&rule, 1) == NULL);
+    XCTAssertNil([WJHEventFilter filterWithRules:&rule count:1]);
+}
+
+- (void)testCoreChecks {
+    WJHChecks checks = { .log = stderr };
+    WJHEventFilterProgramChecks(&checks);
+    XCTAssertEqual(0, checks.failed);
+}
+
+
+#pragma mark - Tap
+
+- (void)testTapShortCircuitsFilteredEvents {
+    WJHEventFilterRule rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.typeMask = CGEventMaskBit(kCGEventKeyDown);
+    rule.keycodes = kKeycodes;
+    rule.keycodeCount = 1;
+    WJHEventFilter *filter = [WJHEventFilter filterWithRules:&rule count:1];
+
+    WJHFilteredDelegate *delegate = [WJHFilteredDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    tap.filter = filter;
+
+    CGEventRef match = CGEventCreateKeyboardEvent(NULL, 12, true);
+    CGEventRef other = CGEventCreateKeyboardEvent(NULL, 13, true);
+    XCTAssertTrue([filter matchesEvent:match type:kCGEventKeyDown]);
+    XCTAssertFalse([filter matchesEvent:other type:kCGEventKeyDown]);
+
+    XCTAssertEqual(other, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, other));
+    XCTAssertEqual(0, delegate.count);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, match);
+    XCTAssertEqual(1, delegate.count);
+
+    tap.filter = nil;
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, other);
+    XCTAssertEqual(2, delegate.count);
+    CFRelease(match);
+    CFRelease(other);
+}
+
+- (void)testFilterDoesNotBypassRemapOrHotkeys {
+    WJHEventFilterRule rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.typeMask = CGEventMaskBit(kCGEventKeyDown);
+    rule.keycodes = kKeycodes;
+    rule.keycodeCount = 1;
+
+    WJHFilteredDelegate *delegate = [WJHFilteredDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    tap.filter = [WJHEventFilter filterWithRules:&rule count:1];
+    WJHEventRemapKeyRule keyRule = { .keycode = 13, .toKeycode = 14 };
+    WJHEventRemapSpec spec = { &keyRule, 1, NULL, 0, NULL };
+    tap.remap = [WJHEventRemap remapWithSpec:&spec];
+    __block int fired = 0;
+    WJHHotkeyChord chord = { .keycode = 15 };
+    WJHHotkeyBinding binding = { &chord, 1, 0 };
+    tap.hotkeys = [WJHHotkeys hotkeysWithBindings:&binding count:1 handler:^(NSUInteger index) {
+        ++fired;
+    }];
+
+    // Neither passes the filter, so the delegate sees neither, but the first is still remapped, and the second still fires its hotkey.
+    CGEventRef remapped = CGEventCreateKeyboardEvent(NULL, 13, true);
+    XCTAssertEqual(remapped, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, remapped));
+    XCTAssertEqual(14, CGEventGetIntegerValueField(remapped, kCGKeyboardEventKeycode));
+    CGEventRef hotkey = CGEventCreateKeyboardEvent(NULL, 15, true);
+    XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, hotkey) == NULL);
+    XCTAssertEqual(1, fired);
+    XCTAssertEqual(0, delegate.count);
+
+    CFRelease(remapped);
+    CFRelease(hotkey);
+}
+
+
+#pragma mark - Benchmarks
+
+- (void)fillSyntheticRecords:(WJHEventRecord *)records {
+    CGEventType const types[] = { kCGEventKeyDown, kCGEventKeyUp, kCGEventMouseMoved, kCGEventLeftMouseDown, kCGEventScrollWheel, kCGEventFlagsChanged };
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < kSyntheticEventCount; ++i) {
+        seed = seed * 1103515245 + 12345;
+        records[i] = makeRecord(types[(seed >> 8) % 6], (seed & 1) ? kCommandOption : 0, (seed >> 4) % 128, (seed >> 12) % 3, (seed >> 16) % 400, (seed >> 20) % 400);
+    }
+}
+
+- (void)testFilterBenchmark {
+    WJHEventRecord *records = calloc(kSyntheticEventCount, sizeof(*records));
+    [self fillSyntheticRecords:records];
+
+    uint64_t matched = 0;
+    uint64_t start = mach_absolute_time();
+    for (uint32_t i = 0; i < kBenchmarkEventCount; ++i) {
+        matched += WJHEventFilterProgramMatches(program, records + i % kSyntheticEventCount);
+    }
+    double filterTime = nanosecondsSince(start) / kBenchmarkEventCount;
+    free(records);
+
+    WJHFilteredDelegate *delegate = [WJHFilteredDelegate new];
+    WJHEventTap *plainTap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    WJHEventTap *filteredTap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    filteredTap.filter = [WJHEventFilter filterWithRules:(WJHEventFilterRule[]){ { .typeMask = CGEventMaskBit(kCGEventKeyDown), .keycodes = kKeycodes, .keycodeCount = 3 } } count:1];
+    CGEventRef event = CGEventCreateKeyboardEvent(NULL, 40, true);
+    uint32_t const eventCount = kBenchmarkEventCount / 10;
+
+    start = mach_absolute_time();
+    for (uint32_t i = 0; i < eventCount; ++i) {
+        WJHEventTapDispatchEvent(plainTap, NULL, kCGEventKeyDown, event);
+    }
+    double plainTime = nanosecondsSince(start) / eventCount;
+
+    start = mach_absolute_time();
+    for (uint32_t i = 0; i < eventCount; ++i) {
+        WJHEventTapDispatchEvent(filteredTap, NULL, kCGEventKeyDown, event);
+    }
+    double filteredTime = nanosecondsSince(start) / eventCount;
+    CFRelease(event);
+
+    XCTAssertEqual(eventCount, delegate.count);
+    NSLog(@"Filter program %.2f ns/event (%llu of %u matched); rejected key down through tap %.1f ns/event, versus %.1f ns/event to the delegate without a filter", filterTime, matched, kBenchmarkEventCount, filteredTime, plainTime);
+}
+
+- (void)testPerformanceFilterProgram {
+    WJHEventRecord *records = calloc(kSyntheticEventCount, sizeof(*records));
+    [self fillSyntheticRecords:records];
+    [self measureBlock:^{
+        uint64_t matched = 0;
+        for (uint32_t i = 0; i < kBenchmarkEventCount; ++i) {
+            matched += WJHEventFilterProgramMatches(program, records + i % kSyntheticEventCount);
+        }
+        XCTAssertGreaterThan(matched, 0);
+    }];
+    free(records);
+}
+
+@end
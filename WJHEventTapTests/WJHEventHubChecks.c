@@ -0,0 +1,279 @@
+//
+//  WJHEventHubChecks.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreChecks.h"
+#include <WJHEventTap/WJHEventBackend.h>
+#include <WJHEventTap/WJHEventHub.h>
+
+#include <stdint.h>
+#include <string.h>
+
+enum {
+    kMaxSubscribers = 12,
+    kMaxTrace = 64,
+    kRandomStepCount = 5000,
+};
+
+static uint32_t const kTypes[] = {
+    kWJHEventTypeLeftMouseDown, kWJHEventTypeMouseMoved, kWJHEventTypeKeyDown, kWJHEventTypeKeyUp, kWJHEventTypeFlagsChanged, kWJHEventTypeScrollWheel,
+};
+static size_t const kTypeCount = sizeof(kTypes) / sizeof(*kTypes);
+
+static uint64_t maskBit(uint32_t type) {
+    return UINT64_C(1) << type;
+}
+
+/**
+ A synthetic event source, standing in for the one system tap a hub shares.  Like the tap, it only delivers the types in its own mask, which is brought up to date with the hub's after each change to the subscribers.
+ */
+typedef struct Source {
+    WJHEventHub *hub;
+    uint64_t eventMask;
+
+    /// Events the source did not deliver, as the hub had no use for them.
+    uint64_t skipped;
+} Source;
+
+static void syncSource(Source *source) {
+    source->eventMask = WJHEventHubEventMask(source->hub);
+}
+
+static uintptr_t deliver(Source *source, uint32_t type, uintptr_t event) {
+    if (type < 64 && !(source->eventMask & maskBit(type))) {
+        ++source->skipped;
+        return event;
+    }
+    return (uintptr_t)WJHEventHubDispatch(source->hub, type, (void *)event, source);
+}
+
+/// The order the subscribers were called in, for one event.
+typedef struct Trace {
+    int names[kMaxTrace];
+    size_t count;
+
+    /// Subscribers that were given an event outside their mask, not the event the one before them returned, or not the info the source dispatched with.
+    uint64_t wrongEvent;
+} Trace;
+
+/**
+ A subscriber that adds one to the event it is given, so that each one can check it was handed what the one before returned.
+ */
+typedef struct Subscriber {
+    Source *source;
+    int name;
+    uint64_t eventMask;
+    uint64_t id;
+    Trace *trace;
+    bool drop;
+} Subscriber;
+
+static void * traceCallback(void *context, uint32_t type, void *event, void *info) {
+    Subscriber *subscriber = context;
+    Trace *trace = subscriber->trace;
+    trace->wrongEvent += type < 64 && !(subscriber->eventMask & maskBit(type));
+    trace->wrongEvent += (uintptr_t)event != 1000 + trace->count;
+    trace->wrongEvent += info != subscriber->source;
+    if (trace->count < kMaxTrace) {
+        trace->names[trace->count] = subscriber->name;
+    }
+    ++trace->count;
+    return subscriber->drop ? NULL : (void *)((uintptr_t)event + 1);
+}
+
+static uint64_t subscribe(Source *source, Subscriber *subscriber, bool beforeOthers) {
+    WJHEventHubSubscriber description = { subscriber->eventMask, beforeOthers, traceCallback, subscriber };
+    subscriber->source = source;
+    subscriber->id = WJHEventHubAdd(source->hub, &description);
+    syncSource(source);
+    return subscriber->id;
+}
+
+static bool traceIs(Trace const *trace, int const *names, size_t count) {
+    return trace->count == count && memcmp(trace->names, names, count * sizeof(*names)) == 0;
+}
+
+/**
+ The chain order of the system: before others, the most recent first, then after others, the oldest first.
+ */
+static void checkChainOrder(WJHChecks *checks) {
+    Source source = { .hub = WJHEventHubCreate(false) };
+    if (!WJHCheck(checks, source.hub != NULL)) {
+        return;
+    }
+    Trace trace = { .count = 0 };
+    Subscriber subscribers[4];
+    bool const beforeOthers[4] = { false, true, false, true };
+    for (int i = 0; i < 4; ++i) {
+        subscribers[i] = (Subscriber){ .name = i, .eventMask = ~UINT64_C(0), .trace = &trace };
+        WJHCheck(checks, subscribe(&source, subscribers + i, beforeOthers[i]) != 0);
+    }
+    WJHCheck(checks, WJHEventHubCount(source.hub) == 4);
+
+    WJHCheck(checks, deliver(&source, kWJHEventTypeKeyDown, 1000) == 1004);
+    int const expected[] = { 3, 1, 0, 2 };
+    WJHCheck(checks, traceIs(&trace, expected, 4));
+    WJHCheck(checks, trace.wrongEvent == 0);
+
+    // A dropped event goes no further.
+    trace.count = 0;
+    subscribers[0].drop = true;
+    WJHCheck(checks, deliver(&source, kWJHEventTypeKeyDown, 1000) == 0);
+    WJHCheck(checks, traceIs(&trace, expected, 3));
+    WJHEventHubDestroy(source.hub);
+}
+
+static void checkPassiveSeesOriginal(WJHChecks *checks) {
+    Source source = { .hub = WJHEventHubCreate(true) };
+    if (!WJHCheck(checks, source.hub != NULL)) {
+        return;
+    }
+    Trace trace = { .count = 0 };
+    Subscriber first = { .name = 0, .eventMask = ~UINT64_C(0), .trace = &trace, .drop = true };
+    Subscriber second = { .name = 1, .eventMask = ~UINT64_C(0), .trace = &trace };
+    subscribe(&source, &first, false);
+    subscribe(&source, &second, false);
+    WJHCheck(checks, deliver(&source, kWJHEventTypeKeyDown, 1000) == 1000);
+    int const expected[] = { 0, 1 };
+    WJHCheck(checks, traceIs(&trace, expected, 2));
+    // Each saw the original, so the second was not given what the first returned.
+    WJHCheck(checks, trace.wrongEvent == 1);
+    WJHEventHubDestroy(source.hub);
+}
+
+/**
+ The source widens its mask as subscribers come, and narrows it as they go, without ever missing an event a subscriber wants.  Tap notifications go to everyone, whatever the masks.
+ */
+static void checkMaskWidening(WJHChecks *checks) {
+    Source source = { .hub = WJHEventHubCreate(false) };
+    if (!WJHCheck(checks, source.hub != NULL)) {
+        return;
+    }
+    Trace trace = { .count = 0 };
+    Subscriber keys = { .name = 0, .eventMask = maskBit(kWJHEventTypeKeyDown), .trace = &trace };
+    Subscriber mouse = { .name = 1, .eventMask = maskBit(kWJHEventTypeMouseMoved) | maskBit(kWJHEventTypeKeyDown), .trace = &trace };
+    WJHCheck(checks, source.eventMask == 0);
+
+    subscribe(&source, &keys, false);
+    WJHCheck(checks, source.eventMask == maskBit(kWJHEventTypeKeyDown));
+    deliver(&source, kWJHEventTypeMouseMoved, 1000);
+    WJHCheck(checks, trace.count == 0 && source.skipped == 1);
+
+    subscribe(&source, &mouse, true);
+    WJHCheck(checks, source.eventMask == (maskBit(kWJHEventTypeKeyDown) | maskBit(kWJHEventTypeMouseMoved)));
+    deliver(&source, kWJHEventTypeMouseMoved, 1000);
+    int const moved[] = { 1 };
+    WJHCheck(checks, traceIs(&trace, moved, 1));
+
+    trace.count = 0;
+    deliver(&source, kWJHEventTypeKeyDown, 1000);
+    int const keyed[] = { 1, 0 };
+    WJHCheck(checks, traceIs(&trace, keyed, 2));
+
+    WJHCheck(checks, WJHEventHubRemove(source.hub, mouse.id));
+    WJHCheck(checks, !WJHEventHubRemove(source.hub, mouse.id));
+    syncSource(&source);
+    WJHCheck(checks, source.eventMask == maskBit(kWJHEventTypeKeyDown));
+
+    trace.count = 0;
+    deliver(&source, kWJHEventTypeTapDisabledByTimeout, 1000);
+    WJHCheck(checks, trace.count == 1);
+    WJHCheck(checks, trace.wrongEvent == 0);
+    WJHEventHubDestroy(source.hub);
+}
+
+/// A small, seeded generator, so a failure can be reproduced.
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static uint32_t randomBelow(uint64_t *state, uint32_t limit) {
+    return (uint32_t)(nextRandom(state) % limit);
+}
+
+/**
+ Subscribe and unsubscribe at random, delivering an event of a random type after each change, and compare the subscribers called with a plain model of the chain.
+ */
+static void checkMatchesModel(WJHChecks *checks) {
+    Source source = { .hub = WJHEventHubCreate(false) };
+    if (!WJHCheck(checks, source.hub != NULL)) {
+        return;
+    }
+    Trace trace = { .count = 0 };
+    Subscriber subscribers[kMaxSubscribers];
+    bool subscribed[kMaxSubscribers] = { false };
+    // The model: the subscribers, by name, in chain order.  A subscriber's name is its slot in subscribers.
+    int chain[kMaxSubscribers];
+    size_t chainCount = 0;
+
+    uint64_t state = 0x2545f4914f6cdd1d;
+    uint64_t wrongOrder = 0, wrongMask = 0, wrongCount = 0, delivered = 0;
+    for (int step = 0; step < kRandomStepCount; ++step) {
+        if (chainCount < kMaxSubscribers && (chainCount == 0 || randomBelow(&state, 2))) {
+            int name = 0;
+            while (subscribed[name]) {
+                ++name;
+            }
+            Subscriber *subscriber = subscribers + name;
+            *subscriber = (Subscriber){ .name = name, .trace = &trace };
+            for (uint32_t n = 1 + randomBelow(&state, 2); n > 0; --n) {
+                subscriber->eventMask |= maskBit(kTypes[randomBelow(&state, (uint32_t)kTypeCount)]);
+            }
+            bool beforeOthers = randomBelow(&state, 2);
+            subscribe(&source, subscriber, beforeOthers);
+            subscribed[name] = true;
+            size_t at = beforeOthers ? 0 : chainCount;
+            memmove(chain + at + 1, chain + at, (chainCount - at) * sizeof(*chain));
+            chain[at] = name;
+            ++chainCount;
+        } else {
+            size_t at = randomBelow(&state, (uint32_t)chainCount);
+            WJHEventHubRemove(source.hub, subscribers[chain[at]].id);
+            syncSource(&source);
+            subscribed[chain[at]] = false;
+            memmove(chain + at, chain + at + 1, (chainCount - at - 1) * sizeof(*chain));
+            --chainCount;
+        }
+
+        uint64_t eventMask = 0;
+        for (size_t i = 0; i < chainCount; ++i) {
+            eventMask |= subscribers[chain[i]].eventMask;
+        }
+        wrongMask += source.eventMask != eventMask;
+        wrongCount += WJHEventHubCount(source.hub) != chainCount;
+
+        uint32_t type = kTypes[randomBelow(&state, (uint32_t)kTypeCount)];
+        int expected[kMaxSubscribers];
+        size_t expectedCount = 0;
+        for (size_t i = 0; i < chainCount; ++i) {
+            if (subscribers[chain[i]].eventMask & maskBit(type)) {
+                expected[expectedCount++] = chain[i];
+            }
+        }
+        trace.count = 0;
+        uintptr_t result = deliver(&source, type, 1000);
+        delivered += expectedCount > 0;
+        wrongOrder += !traceIs(&trace, expected, expectedCount) || result != 1000 + expectedCount;
+    }
+    WJHCheck(checks, wrongOrder == 0);
+    WJHCheck(checks, wrongMask == 0);
+    WJHCheck(checks, wrongCount == 0);
+    WJHCheck(checks, trace.wrongEvent == 0);
+    // Otherwise, the comparison shows little.
+    WJHCheck(checks, delivered > kRandomStepCount / 2);
+    WJHEventHubDestroy(source.hub);
+}
+
+void WJHEventHubChecks(WJHChecks *checks) {
+    checkChainOrder(checks);
+    checkPassiveSeesOriginal(checks);
+    checkMaskWidening(checks);
+    checkMatchesModel(checks);
+}
@@ -0,0 +1,244 @@
+//
+//  WJHEventMaskTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+
+@interface WJHEventMaskTests : XCTestCase
+@end
+
+static CGEventMask const kKeyMask = CGEventMaskBit(kCGEventKeyDown) | CGEventMaskBit(kCGEventKeyUp);
+static CGEventMask const kMouseMask = CGEventMaskBit(kCGEventLeftMouseDown) | CGEventMaskBit(kCGEventLeftMouseUp) | CGEventMaskBit(kCGEventMouseMoved);
+
+/// Only handles key down events.
+@interface WJHKeyDownDelegate : NSObject<WJHEventTapDelegate>
+@end
+
+@implementation WJHKeyDownDelegate
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap keyDownEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+@end
+
+/// Handles scrolling, and whatever has no method of its own.
+@interface WJHUnknownEventDelegate : NSObject<WJHEventTapDelegate>
+@end
+
+@implementation WJHUnknownEventDelegate
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap scrollWheelEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap unknownEvent:(CGEventRef)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+@end
+
+/// Sees every event first.
+@interface WJHAllEventsDelegate : NSObject<WJHEventTapDelegate>
+@end
+
+@implementation WJHAllEventsDelegate
+- (BOOL)eventTap:(WJHEventTap*)eventTap receivedEvent:(CGEventRef*)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    return YES;
+}
+@end
+
+/// Says which events it wants, whatever it responds to.
+@interface WJHExplicitMaskDelegate : WJHAllEventsDelegate
+@end
+
+@implementation WJHExplicitMaskDelegate
+- (CGEventMask)eventMaskForEventTap:(WJHEventTap*)eventTap {
+    return CGEventMaskBit(kCGEventFlagsChanged);
+}
+@end
+
+/// Only wants coalesced runs.
+@interface WJHCoalescedEventDelegate : NSObject<WJHEventTapDelegate>
+@end
+
+@implementation WJHCoalescedEventDelegate
+- (void)eventTap:(WJHEventTap*)eventTap coalescedEvent:(WJHCoalescedEvent const *)event {
+}
+@end
+
+@implementation WJHEventMaskTests
+
+#pragma mark - Filter and Remap
+
+- (void)testFilterTypeMask {
+    WJHEventFilterRule rules[] = {
+        { .typeMask = CGEventMaskBit(kCGEventKeyDown) | CGEventMaskBit(kCGEventKeyUp), .flagsMask = kCGEventFlagMaskCommand, .flagsValue = kCGEventFlagMaskCommand },
+        { .typeMask = CGEventMaskBit(kCGEventScrollWheel) },
+    };
+    WJHEventFilterProgram *program = WJHEventFilterProgramCreate(rules, 2);
+    XCTAssertEqual(kKeyMask | CGEventMaskBit(kCGEventScrollWheel), WJHEventFilterProgramTypeMask(program) & UINT32_MAX);
+    // Types the filter can not name always pass.
+    XCTAssertEqual(~UINT64_C(0) << kWJHEventFilterTypeLimit, WJHEventFilterProgramTypeMask(program) & ~(uint64_t)UINT32_MAX);
+    WJHEventFilterProgramDestroy(program);
+
+    WJHEventFilterRule everything = { .typeMask = 0 };
+    program = WJHEventFilterProgramCreate(&everything, 1);
+    XCTAssertEqual(~UINT64_C(0), WJHEventFilterProgramTypeMask(program));
+    WJHEventFilterProgramDestroy(program);
+}
+
+- (void)testRemapTypeMask {
+    WJHEventRemapKeyRule keyRule = { .keycode = 57, .toKeycode = 53 };
+    WJHEventRemapButtonRule buttonRules[] = { { 1, 1 }, { 3, 2 } };
+    WJHEventRemapSpec spec = { &keyRule, 1, buttonRules, 2, NULL };
+    WJHEventRemapTable *table = WJHEventRemapTableCreate(&spec, NULL);
+    // Sending the right button to itself changes nothing, so only the other buttons are remapped.
+    CGEventMask otherMouseMask = CGEventMaskBit(kCGEventOtherMouseDown) | CGEventMaskBit(kCGEventOtherMouseUp) | CGEventMaskBit(kCGEventOtherMouseDragged);
+    XCTAssertEqual(kKeyMask | otherMouseMask, WJHEventRemapTableTypeMask(table));
+    WJHEventRemapTableDestroy(table);
+
+    WJHEventRemapScroll scroll = { false, 1, -1 };
+    spec = (WJHEventRemapSpec){ NULL, 0, NULL, 0, &scroll };
+    table = WJHEventRemapTableCreate(&spec, NULL);
+    XCTAssertEqual(CGEventMaskBit(kCGEventScrollWheel), WJHEventRemapTableTypeMask(table));
+    WJHEventRemapTableDestroy(table);
+}
+
+
+#pragma mark - Delegate
+
+- (void)testDelegateMaskFollowsImplementedMethods {
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:nil];
+    XCTAssertEqual(0, [tap eventMaskForDelegate:nil]);
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyDown), [tap eventMaskForDelegate:[WJHKeyDownDelegate new]]);
+    XCTAssertEqual(kCGEventMaskForAllEvents, [tap eventMaskForDelegate:[WJHAllEventsDelegate new]]);
+    XCTAssertEqual(CGEventMaskBit(kCGEventFlagsChanged), [tap eventMaskForDelegate:[WJHExplicitMaskDelegate new]]);
+
+    CGEventMask unknownMask = [tap eventMaskForDelegate:[WJHUnknownEventDelegate new]];
+    XCTAssertTrue(unknownMask & CGEventMaskBit(kCGEventScrollWheel));
+    XCTAssertTrue(unknownMask & CGEventMaskBit(29));
+    XCTAssertFalse(unknownMask & kKeyMask);
+    XCTAssertFalse(unknownMask & kMouseMask);
+}
+
+- (void)testCoalescedEventsOnlyCountWhenCoalescing {
+    WJHCoalescedEventDelegate *delegate = [WJHCoalescedEventDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    XCTAssertEqual(0, [tap eventMaskForDelegate:delegate]);
+    XCTAssertTrue([tap enableCoalescingWithWindow:0.016]);
+    CGEventMask mask = [tap eventMaskForDelegate:delegate];
+    XCTAssertTrue(mask & CGEventMaskBit(kCGEventMouseMoved));
+    XCTAssertTrue(mask & CGEventMaskBit(kCGEventScrollWheel));
+    XCTAssertFalse(mask & kKeyMask);
+}
+
+- (void)testBlockDelegateMaskFollowsBlocks {
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:nil];
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    XCTAssertEqual(0, [tap eventMaskForDelegate:delegate]);
+
+    WJHEventTapEventBlock block = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        return event;
+    };
+    delegate.keyUpEvent = block;
+    delegate.mouseMovedEvent = block;
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyUp) | CGEventMaskBit(kCGEventMouseMoved), [tap eventMaskForDelegate:delegate]);
+
+    // Batches only go to receivedRecords when the tap delivers batches.
+    delegate.receivedRecords = ^(WJHEventTap *eventTap, WJHEventRecord const *records, NSUInteger count) {
+    };
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyUp) | CGEventMaskBit(kCGEventMouseMoved), [tap eventMaskForDelegate:delegate]);
+    XCTAssertTrue([tap enableBatchedDeliveryWithBatchSize:16 interval:0.1]);
+    XCTAssertEqual(kCGEventMaskForAllEvents, [tap eventMaskForDelegate:delegate]);
+    delegate.receivedRecords = nil;
+
+    delegate.unknownEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventType type, CGEventTapProxy proxy) {
+        return event;
+    };
+    XCTAssertEqual(kCGEventMaskForAllEvents, [tap eventMaskForDelegate:delegate]);
+}
+
+
+#pragma mark - Tap
+
+- (void)testMinimalEventMaskCombinesConfiguration {
+    CGEventMask const initialMask = kKeyMask | kMouseMask | CGEventMaskBit(kCGEventFlagsChanged);
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:initialMask passive:NO delegate:[WJHKeyDownDelegate new]];
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyDown), tap.minimalEventMask);
+
+    WJHHotkeyChord chord = { .keycode = 12, .modifiers = kCGEventFlagMaskCommand };
+    WJHHotkeyBinding binding = { &chord, 1, 0 };
+    tap.hotkeys = [WJHHotkeys hotkeysWithBindings:&binding count:1 handler:^(NSUInteger index) {}];
+    XCTAssertEqual(kKeyMask, tap.minimalEventMask);
+
+    // The remap asks for scrolling, which the initializer did not, so it is left out.
+    WJHEventRemapButtonRule buttonRule = { 0, 1 };
+    WJHEventRemapScroll scroll = { true, 1, 1 };
+    WJHEventRemapSpec spec = { NULL, 0, &buttonRule, 1, &scroll };
+    tap.remap = [WJHEventRemap remapWithSpec:&spec];
+    XCTAssertEqual(kKeyMask | CGEventMaskBit(kCGEventLeftMouseDown) | CGEventMaskBit(kCGEventLeftMouseUp), tap.minimalEventMask);
+
+    // The filter only narrows what the delegate is given, not what the hotkeys and remap need.
+    WJHEventFilterRule rule = { .typeMask = CGEventMaskBit(kCGEventKeyUp) | CGEventMaskBit(kCGEventLeftMouseDown) };
+    tap.filter = [WJHEventFilter filterWithRules:&rule count:1];
+    XCTAssertEqual(kKeyMask | CGEventMaskBit(kCGEventLeftMouseDown) | CGEventMaskBit(kCGEventLeftMouseUp), tap.minimalEventMask);
+    tap.hotkeys = nil;
+    tap.remap = nil;
+    XCTAssertEqual(0, tap.minimalEventMask);
+}
+
+- (void)testPassiveTapIgnoresRemapInMask {
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:nil];
+    WJHEventRemapScroll scroll = { true, 1, 1 };
+    WJHEventRemapSpec spec = { NULL, 0, NULL, 0, &scroll };
+    tap.remap = [WJHEventRemap remapWithSpec:&spec];
+    XCTAssertEqual(0, tap.minimalEventMask);
+}
+
+- (void)testAutomaticEventMaskFollowsConfiguration {
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:[WJHKeyDownDelegate new]];
+    XCTAssertFalse(tap.automaticEventMask);
+    XCTAssertEqual(kCGEventMaskForAllEvents, tap.requestedEventMask);
+
+    tap.automaticEventMask = YES;
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyDown), tap.requestedEventMask);
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyDown), tap.eventMask);
+
+    tap.delegate = [WJHUnknownEventDelegate new];
+    XCTAssertEqual(tap.minimalEventMask, tap.requestedEventMask);
+    XCTAssertTrue(tap.eventMask & CGEventMaskBit(kCGEventScrollWheel));
+
+    // A tap that wants nothing still has to ask for something.
+    tap.delegate = nil;
+    XCTAssertEqual(CGEventMaskBit(kCGEventNull), tap.eventMask);
+
+    // Changing a block is invisible to the tap, until it is told.
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    tap.delegate = delegate;
+    delegate.scrollWheelEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        return event;
+    };
+    XCTAssertEqual(CGEventMaskBit(kCGEventNull), tap.eventMask);
+    XCTAssertTrue([tap updateEventMask]);
+    XCTAssertEqual(CGEventMaskBit(kCGEventScrollWheel), tap.eventMask);
+
+    tap.automaticEventMask = NO;
+    XCTAssertEqual(kCGEventMaskForAllEvents, tap.requestedEventMask);
+    XCTAssertEqual(kCGEventMaskForAllEvents, tap.eventMask);
+}
+
+- (void)testRecordingWantsEverything {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kKeyMask | kMouseMask passive:YES delegate:nil];
+    XCTAssertTrue([tap enableRecordingToPath:path capacity:64]);
+    XCTAssertEqual(kKeyMask | kMouseMask, tap.minimalEventMask);
+
+    WJHEventFilterRule rule = { .typeMask = CGEventMaskBit(kCGEventMouseMoved) };
+    tap.filter = [WJHEventFilter filterWithRules:&rule count:1];
+    XCTAssertEqual(kKeyMask | kMouseMask, tap.minimalEventMask);
+    tap = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+@end
@@ -0,0 +1,254 @@
+//
+//  WJHEventRecordingChecks.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreChecks.h"
+#include <WJHEventTap/WJHEventBackend.h>
+#include <WJHEventTap/WJHEventRecording.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint32_t const kRecordedWhileReadingCount = 20000;
+
+static WJHEventRecord makeRecord(uint64_t timestamp, uint32_t type, uint16_t keycode) {
+    WJHEventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = timestamp;
+    record.type = type;
+    record.keycode = keycode;
+    record.x = keycode * 2;
+    record.y = keycode * 3;
+    record.flags = kWJHEventFlagShift;
+    record.deltaX = -keycode;
+    record.button = keycode & 3;
+    return record;
+}
+
+/**
+ Make a fresh, empty file for a recording, in the temporary directory.
+
+ @return true if @a path, of @a size bytes, now names the file.
+ */
+static bool makeTemporaryPath(char *path, size_t size) {
+    char const *directory = getenv("TMPDIR");
+    if (directory == NULL || *directory == '\0') {
+        directory = "/tmp";
+    }
+    size_t length = strlen(directory);
+    char const *separator = directory[length - 1] == '/' ? "" : "/";
+    if ((size_t)snprintf(path, size, "%s%swjh-recording-XXXXXX", directory, separator) >= size) {
+        return false;
+    }
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+static void writeRecords(char const *path, uint32_t count, uint32_t capacity) {
+    WJHEventRecorder *recorder = WJHEventRecorderCreate(path, capacity);
+    if (recorder == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        WJHEventRecord record = makeRecord(i, kWJHEventTypeKeyDown, (uint16_t)i);
+        WJHEventRecorderAppend(recorder, &record);
+    }
+    WJHEventRecorderDestroy(recorder);
+}
+
+static off_t fileSize(char const *path) {
+    struct stat info;
+    return stat(path, &info) == 0 ? info.st_size : -1;
+}
+
+typedef struct Collected {
+    uint16_t keycodes[8];
+    int count;
+    int limit;
+} Collected;
+
+static bool collectKeycodes(void *context, WJHEventRecord const *record) {
+    Collected *collected = context;
+    if (collected->count < 8) {
+        collected->keycodes[collected->count] = record->keycode;
+    }
+    return ++collected->count != collected->limit;
+}
+
+static void checkRoundTrip(WJHChecks *checks, char const *path) {
+    writeRecords(path, 5, 100);
+    WJHCheck(checks, fileSize(path) == kWJHEventRecordingHeaderSize + 5 * kWJHEventRecordingRecordSize);
+
+    WJHEventReplay *replay = WJHEventReplayOpen(path);
+    if (!WJHCheck(checks, replay != NULL)) {
+        return;
+    }
+    WJHCheck(checks, WJHEventReplayCount(replay) == 5);
+    WJHEventRecord const *records = WJHEventReplayRecords(replay);
+    for (uint16_t i = 0; i < 5; ++i) {
+        WJHEventRecord expected = makeRecord(i, kWJHEventTypeKeyDown, i);
+        WJHCheck(checks, memcmp(&expected, records + i, sizeof(expected)) == 0);
+    }
+
+    Collected collected = { .limit = -1 };
+    WJHCheck(checks, WJHEventReplayRun(replay, WJHEventReplayAsFastAsPossible, collectKeycodes, &collected) == 5);
+    uint16_t const expected[] = { 0, 1, 2, 3, 4 };
+    WJHCheck(checks, collected.count == 5 && memcmp(collected.keycodes, expected, sizeof(expected)) == 0);
+
+    Collected stopped = { .limit = 2 };
+    WJHCheck(checks, WJHEventReplayRun(replay, WJHEventReplayAsFastAsPossible, collectKeycodes, &stopped) == 2);
+    WJHEventReplayClose(replay);
+}
+
+static void checkFullFileDropsRecords(WJHChecks *checks, char const *path) {
+    WJHEventRecorder *recorder = WJHEventRecorderCreate(path, 2);
+    if (!WJHCheck(checks, recorder != NULL)) {
+        return;
+    }
+    WJHEventRecord record = makeRecord(0, kWJHEventTypeKeyDown, 0);
+    WJHCheck(checks, WJHEventRecorderAppend(recorder, &record));
+    WJHCheck(checks, WJHEventRecorderAppend(recorder, &record));
+    WJHCheck(checks, !WJHEventRecorderAppend(recorder, &record));
+    WJHCheck(checks, WJHEventRecorderCount(recorder) == 2);
+    WJHCheck(checks, WJHEventRecorderDropped(recorder) == 1);
+    WJHEventRecorderDestroy(recorder);
+    WJHCheck(checks, fileSize(path) == kWJHEventRecordingHeaderSize + 2 * kWJHEventRecordingRecordSize);
+}
+
+static void checkRejectsOtherFiles(WJHChecks *checks, char const *path) {
+    unlink(path);
+    WJHCheck(checks, WJHEventReplayOpen(path) == NULL && errno == ENOENT);
+
+    FILE *file = fopen(path, "w");
+    if (!WJHCheck(checks, file != NULL)) {
+        return;
+    }
+    fputs("not a recording, but long enough to hold a header, if it were one", file);
+    fclose(file);
+    WJHCheck(checks, WJHEventReplayOpen(path) == NULL && errno == EINVAL);
+
+    // A record cut short.
+    writeRecords(path, 3, 3);
+    WJHCheck(checks, truncate(path, fileSize(path) - 1) == 0);
+    WJHCheck(checks, WJHEventReplayOpen(path) == NULL && errno == EINVAL);
+}
+
+static uint64_t monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void checkOriginalTiming(WJHChecks *checks, char const *path) {
+    uint64_t const interval = 5000000;
+    WJHEventRecorder *recorder = WJHEventRecorderCreate(path, 3);
+    if (!WJHCheck(checks, recorder != NULL)) {
+        return;
+    }
+    for (uint64_t i = 0; i < 3; ++i) {
+        WJHEventRecord record = makeRecord(1000 + i * interval, kWJHEventTypeKeyDown, 0);
+        WJHEventRecorderAppend(recorder, &record);
+    }
+    WJHEventRecorderDestroy(recorder);
+
+    WJHEventReplay *replay = WJHEventReplayOpen(path);
+    if (!WJHCheck(checks, replay != NULL)) {
+        return;
+    }
+    Collected collected = { .limit = -1 };
+    uint64_t start = monotonicNanoseconds();
+    WJHCheck(checks, WJHEventReplayRun(replay, WJHEventReplayOriginalTiming, collectKeycodes, &collected) == 3);
+    WJHCheck(checks, monotonicNanoseconds() - start >= 2 * interval);
+    WJHEventReplayClose(replay);
+}
+
+typedef struct Writer {
+    WJHEventRecorder *recorder;
+    atomic_bool done;
+} Writer;
+
+/// A synthetic tap, recording keys as fast as it can.
+static void * writeRecordsWhileReading(void *context) {
+    Writer *writer = context;
+    for (uint32_t i = 0; i < kRecordedWhileReadingCount; ++i) {
+        WJHEventRecord record = makeRecord(i, kWJHEventTypeKeyDown, (uint16_t)i);
+        WJHEventRecorderAppend(writer->recorder, &record);
+        if ((i & 255) == 0) {
+            sched_yield();
+        }
+    }
+    atomic_store(&writer->done, true);
+    return NULL;
+}
+
+/**
+ Open the recording again and again while another thread writes it.  Each replay must hold a complete prefix of what was written.
+ */
+static void checkReadableWhileRecording(WJHChecks *checks, char const *path) {
+    Writer writer = { .recorder = WJHEventRecorderCreate(path, kRecordedWhileReadingCount) };
+    if (!WJHCheck(checks, writer.recorder != NULL)) {
+        return;
+    }
+    atomic_init(&writer.done, false);
+    pthread_t thread;
+    if (!WJHCheck(checks, pthread_create(&thread, NULL, writeRecordsWhileReading, &writer) == 0)) {
+        WJHEventRecorderDestroy(writer.recorder);
+        return;
+    }
+
+    uint64_t opened = 0, failed = 0, shrank = 0, mismatched = 0, previous = 0;
+    bool done;
+    do {
+        done = atomic_load(&writer.done);
+        WJHEventReplay *replay = WJHEventReplayOpen(path);
+        if (replay == NULL) {
+            ++failed;
+            continue;
+        }
+        ++opened;
+        uint64_t count = WJHEventReplayCount(replay);
+        shrank += count < previous;
+        previous = count;
+        WJHEventRecord const *records = WJHEventReplayRecords(replay);
+        for (uint64_t i = 0; i < count; ++i) {
+            WJHEventRecord expected = makeRecord(i, kWJHEventTypeKeyDown, (uint16_t)i);
+            mismatched += memcmp(&expected, records + i, sizeof(expected)) != 0;
+        }
+        WJHEventReplayClose(replay);
+    } while (!done);
+    pthread_join(thread, NULL);
+
+    WJHCheck(checks, failed == 0);
+    WJHCheck(checks, shrank == 0);
+    WJHCheck(checks, mismatched == 0);
+    // The last replay was opened after the writer had finished.
+    WJHCheck(checks, opened > 0 && previous == kRecordedWhileReadingCount);
+    WJHEventRecorderDestroy(writer.recorder);
+}
+
+void WJHEventRecordingChecks(WJHChecks *checks) {
+    char path[1024];
+    if (!WJHCheck(checks, makeTemporaryPath(path, sizeof(path)))) {
+        return;
+    }
+    checkRoundTrip(checks, path);
+    checkFullFileDropsRecords(checks, path);
+    checkRejectsOtherFiles(checks, path);
+    checkOriginalTiming(checks, path);
+    checkReadableWhileRecording(checks, path);
+    unlink(path);
+}
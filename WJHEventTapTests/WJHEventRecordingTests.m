@@ -0,0 +1,261 @@
+//
+//  WJHEventRecordingTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHCoreChecks.h"
+
+@interface WJHEventRecordingTests : XCTestCase
+@end
+
+static uint32_t const kBenchmarkRecordCount = 1000000;
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+static WJHEventRecord makeRecord(uint64_t timestamp, CGEventType type, uint16_t keycode) {
+    WJHEventRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = timestamp;
+    record.type = type;
+    record.keycode = keycode;
+    record.x = keycode * 2;
+    record.y = keycode * 3;
+    return record;
+}
+
+static bool collectKeycodes(void *context, WJHEventRecord const *record) {
+    [(__bridge NSMutableArray *)context addObject:@(record->keycode)];
+    return true;
+}
+
+static bool stopAfterTwo(void *context, WJHEventRecord const *record) {
+    return ++*(int *)context < 2;
+}
+
+static bool countRecord(void *context, WJHEventRecord const *record) {
+    ++*(uint64_t *)context;
+    return true;
+}
+
+/// Logs the keyboard events it is given, in order.
+@interface WJHKeyLogDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, strong) NSMutableArray *log;
+@property (nonatomic, assign) uint64_t count;
+@end
+
+@implementation WJHKeyLogDelegate
+- (instancetype)init {
+    if (self = [super init]) {
+        _log = [NSMutableArray array];
+    }
+    return self;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap keyDownEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    [_log addObject:[NSString stringWithFormat:@"down %lld", CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode)]];
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap keyUpEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    [_log addObject:[NSString stringWithFormat:@"up %lld", CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode)]];
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    ++_count;
+    return event;
+}
+@end
+
+@implementation WJHEventRecordingTests {
+    NSString *path;
+}
+
+- (void)setUp {
+    [super setUp];
+    path = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID].UUIDString stringByAppendingPathExtension:@"wjhrec"]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+    [super tearDown];
+}
+
+- (void)writeRecords:(uint32_t)count capacity:(uint32_t)capacity {
+    WJHEventRecorder *recorder = WJHEventRecorderCreate(path.fileSystemRepresentation, capacity);
+    XCTAssertTrue(recorder != NULL);
+    for (uint32_t i = 0; i < count; ++i) {
+        WJHEventRecord record = makeRecord(i, kCGEventKeyDown, (uint16_t)i);
+        WJHEventRecorderAppend(recorder, &record);
+    }
+    WJHEventRecorderDestroy(recorder);
+}
+
+- (unsigned long long)fileSize {
+    return [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL].fileSize;
+}
+
+
+#pragma mark - Format
+
+- (void)testRoundTrip {
+    [self writeRecords:5 capacity:100];
+    XCTAssertEqual(kWJHEventRecordingHeaderSize + 5 * kWJHEventRecordingRecordSize, [self fileSize]);
+
+    WJHEventReplay *replay = WJHEventReplayOpen(path.fileSystemRepresentation);
+    XCTAssertTrue(replay != NULL);
+    XCTAssertEqual(5, WJHEventReplayCount(replay));
+    WJHEventRecord const *records = WJHEventReplayRecords(replay);
+    for (uint16_t i = 0; i < 5; ++i) {
+        WJHEventRecord expected = makeRecord(i, kCGEventKeyDown, i);
+        XCTAssertEqual(0, memcmp(&expected, records + i, sizeof(expected)));
+    }
+
+    NSMutableArray *keycodes = [NSMutableArray array];
+    XCTAssertEqual(5, WJHEventReplayRun(replay, WJHEventReplayAsFastAsPossible, collectKeycodes, (__bridge void *)keycodes));
+    XCTAssertEqualObjects((@[@0, @1, @2, @3, @4]), keycodes);
+
+    int calls = 0;
+    XCTAssertEqual(2, WJHEventReplayRun(replay, WJHEventReplayAsFastAsPossible, stopAfterTwo, &calls));
+    WJHEventReplayClose(replay);
+}
+
+- (void)testFullFileDropsRecords {
+    WJHEventRecorder *recorder = WJHEventRecorderCreate(path.fileSystemRepresentation, 2);
+    WJHEventRecord record = makeRecord(0, kCGEventKeyDown, 0);
+    XCTAssertTrue(WJHEventRecorderAppend(recorder, &record));
+    XCTAssertTrue(WJHEventRecorderAppend(recorder, &record));
+    XCTAssertFalse(WJHEventRecorderAppend(recorder, &record));
+    XCTAssertEqual(2, WJHEventRecorderCount(recorder));
+    XCTAssertEqual(1, WJHEventRecorderDropped(recorder));
+    WJHEventRecorderDestroy(recorder);
+}
+
+- (void)testReadableWhileRecording {
+    WJHEventRecorder *recorder = WJHEventRecorderCreate(path.fileSystemRepresentation, 100);
+    WJHEventRecord record = makeRecord(0, kCGEventKeyDown, 7);
+    WJHEventRecorderAppend(recorder, &record);
+
+    WJHEventReplay *replay = WJHEventReplayOpen(path.fileSystemRepresentation);
+    XCTAssertTrue(replay != NULL);
+    XCTAssertEqual(1, WJHEventReplayCount(replay));
+    XCTAssertEqual(7, WJHEventReplayRecords(replay)->keycode);
+    WJHEventReplayClose(replay);
+    WJHEventRecorderDestroy(recorder);
+}
+
+- (void)testRejectsOtherFiles {
+    XCTAssertTrue(WJHEventReplayOpen(path.fileSystemRepresentation) == NULL);
+    XCTAssertEqual(ENOENT, errno);
+
+    [[@"not a recording, but long enough to hold a header, if it were one" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:path atomically:YES];
+    XCTAssertTrue(WJHEventReplayOpen(path.fileSystemRepresentation) == NULL);
+    XCTAssertEqual(EINVAL, errno);
+
+    [self writeRecords:3 capacity:3];
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    [[data subdataWithRange:NSMakeRange(0, data.length - 1)] writeToFile:path atomically:YES];
+    XCTAssertTrue(WJHEventReplayOpen(path.fileSystemRepresentation) == NULL);
+    XCTAssertEqual(EINVAL, errno);
+}
+
+- (void)testOriginalTiming {
+    WJHEventRecorder *recorder = WJHEventRecorderCreate(path.fileSystemRepresentation, 3);
+    for (uint64_t i = 0; i < 3; ++i) {
+        WJHEventRecord record = makeRecord(1000 + i * 20 * NSEC_PER_MSEC, kCGEventKeyDown, 0);
+        WJHEventRecorderAppend(recorder, &record);
+    }
+    WJHEventRecorderDestroy(recorder);
+
+    WJHEventReplay *replay = WJHEventReplayOpen(path.fileSystemRepresentation);
+    uint64_t count = 0;
+    uint64_t start = mach_absolute_time();
+    WJHEventReplayRun(replay, WJHEventReplayOriginalTiming, countRecord, &count);
+    XCTAssertGreaterThanOrEqual(nanosecondsSince(start), 40 * NSEC_PER_MSEC);
+    XCTAssertEqual(3, count);
+    WJHEventReplayClose(replay);
+}
+
+- (void)testCoreChecks {
+    WJHChecks checks = { .log = stderr };
+    WJHEventRecordingChecks(&checks);
+    XCTAssertEqual(0, checks.failed);
+}
+
+
+#pragma mark - Tap
+
+- (void)testTapRecordingReplaysToDelegate {
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:nil];
+    XCTAssertFalse(tap.recordsEvents);
+    XCTAssertTrue([tap enableRecordingToPath:path capacity:16]);
+    XCTAssertTrue(tap.recordsEvents);
+    XCTAssertFalse([tap enableRecordingToPath:path capacity:16]);
+
+    CGEventRef down = CGEventCreateKeyboardEvent(NULL, 12, true);
+    CGEventRef up = CGEventCreateKeyboardEvent(NULL, 12, false);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, down);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyUp, up);
+    CFRelease(down);
+    CFRelease(up);
+    XCTAssertEqual(2, tap.recordedEventCount);
+    XCTAssertEqual(0, tap.droppedRecordingEventCount);
+    tap = nil;
+
+    WJHKeyLogDelegate *delegate = [WJHKeyLogDelegate new];
+    XCTAssertTrue([WJHEventTap replayRecordingAtPath:path delegate:delegate timing:WJHEventReplayAsFastAsPossible]);
+    XCTAssertEqualObjects((@[@"down 12", @"up 12"]), delegate.log);
+
+    XCTAssertFalse([WJHEventTap replayRecordingAtPath:[path stringByAppendingString:@"-missing"] delegate:delegate timing:WJHEventReplayAsFastAsPossible]);
+}
+
+
+#pragma mark - Benchmarks
+
+- (void)testRecordingAndReplayBenchmark {
+    WJHEventRecorder *recorder = WJHEventRecorderCreate(path.fileSystemRepresentation, kBenchmarkRecordCount);
+    WJHEventRecord record = makeRecord(0, kCGEventMouseMoved, 0);
+    uint64_t start = mach_absolute_time();
+    for (uint32_t i = 0; i < kBenchmarkRecordCount; ++i) {
+        record.timestamp = i;
+        WJHEventRecorderAppend(recorder, &record);
+    }
+    double appendTime = nanosecondsSince(start) / kBenchmarkRecordCount;
+    WJHEventRecorderDestroy(recorder);
+
+    WJHEventReplay *replay = WJHEventReplayOpen(path.fileSystemRepresentation);
+    uint64_t count = 0;
+    start = mach_absolute_time();
+    WJHEventReplayRun(replay, WJHEventReplayAsFastAsPossible, countRecord, &count);
+    double replayTime = nanosecondsSince(start) / kBenchmarkRecordCount;
+    WJHEventReplayClose(replay);
+    XCTAssertEqual(kBenchmarkRecordCount, count);
+
+    WJHKeyLogDelegate *delegate = [WJHKeyLogDelegate new];
+    start = mach_absolute_time();
+    XCTAssertTrue([WJHEventTap replayRecordingAtPath:path delegate:delegate timing:WJHEventReplayAsFastAsPossible]);
+    double delegateTime = nanosecondsSince(start) / kBenchmarkRecordCount;
+    XCTAssertEqual(kBenchmarkRecordCount, delegate.count);
+
+    NSLog(@"%u records: append %.1f ns/record, replay %.1f ns/record, replay to delegate %.1f ns/event", kBenchmarkRecordCount, appendTime, replayTime, delegateTime);
+}
+
+- (void)testPerformanceAppend {
+    WJHEventRecord record = makeRecord(0, kCGEventMouseMoved, 0);
+    [self measureBlock:^{
+        WJHEventRecorder *recorder = WJHEventRecorderCreate(path.fileSystemRepresentation, kBenchmarkRecordCount);
+        for (uint32_t i = 0; i < kBenchmarkRecordCount; ++i) {
+            WJHEventRecorderAppend(recorder, &record);
+        }
+        WJHEventRecorderDestroy(recorder);
+    }];
+}
+
+@end
@@ -0,0 +1,351 @@
+//
+//  WJHEventRemapTableChecks.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreChecks.h"
+#include <WJHEventTap/WJHEventBackend.h>
+#include <WJHEventTap/WJHEventRemapTable.h>
+
+#include <math.h>
+#include <string.h>
+
+enum {
+    kRandomTableCount = 200,
+    kRandomEventCount = 2000,
+    kMaxKeyRules = 12,
+    kMaxButtonRules = 6,
+};
+
+// Virtual keycodes, from the ANSI layout.
+static uint16_t const kKeyA = 0;
+static uint16_t const kKeyS = 1;
+static uint16_t const kKeyD = 2;
+static uint16_t const kKeyEscape = 53;
+static uint16_t const kKeyCapsLock = 57;
+
+/// A few keys, including both ends of the keycode range, so random rules often share a key.
+static uint16_t const kKeycodes[] = { 0, 1, 2, 53, 57, kWJHEventRemapKeycodeLimit - 1 };
+static size_t const kKeycodeCount = sizeof(kKeycodes) / sizeof(*kKeycodes);
+static uint64_t const kFlags[] = { kWJHEventFlagShift, kWJHEventFlagControl, kWJHEventFlagAlternate, kWJHEventFlagCommand };
+
+static WJHEventRecord keyRecord(uint32_t type, uint16_t keycode, uint64_t flags) {
+    return (WJHEventRecord){ .type = type, .keycode = keycode, .flags = flags };
+}
+
+static WJHEventRecord buttonRecord(uint32_t type, uint16_t button) {
+    return (WJHEventRecord){ .type = type, .button = button };
+}
+
+static void checkKeyRules(WJHChecks *checks) {
+    WJHEventRemapKeyRule const keyRules[] = {
+        // Command-A becomes Control-S, and A on its own becomes D.
+        { .keycode = kKeyA, .flagsMask = kWJHEventFlagCommand, .flagsValue = kWJHEventFlagCommand, .toKeycode = kKeyS, .setFlags = kWJHEventFlagControl, .clearFlags = kWJHEventFlagCommand },
+        { .keycode = kKeyCapsLock, .toKeycode = kKeyEscape },
+        { .keycode = kKeyA, .toKeycode = kKeyD },
+    };
+    WJHEventRemapSpec spec = { keyRules, 3, NULL, 0, NULL };
+    WJHEventRemapTable *table = WJHEventRemapTableCreate(&spec, NULL);
+    if (!WJHCheck(checks, table != NULL)) {
+        return;
+    }
+    WJHEventRemapState state;
+    memset(&state, 0, sizeof(state));
+
+    WJHEventRecord record = keyRecord(kWJHEventTypeKeyDown, kKeyA, kWJHEventFlagCommand | kWJHEventFlagShift);
+    WJHCheck(checks, WJHEventRemapTableApply(table, &state, &record) == (WJHEventRemapChangedKeycode | WJHEventRemapChangedFlags));
+    WJHCheck(checks, record.keycode == kKeyS && record.flags == (kWJHEventFlagControl | kWJHEventFlagShift));
+
+    // Command is released before A, but the release still goes to S.
+    record = keyRecord(kWJHEventTypeKeyUp, kKeyA, kWJHEventFlagShift);
+    WJHCheck(checks, WJHEventRemapTableApply(table, &state, &record) == WJHEventRemapChangedKeycode);
+    WJHCheck(checks, record.keycode == kKeyS);
+
+    record = keyRecord(kWJHEventTypeKeyDown, kKeyCapsLock, kWJHEventFlagShift);
+    WJHCheck(checks, WJHEventRemapTableApply(table, NULL, &record) == WJHEventRemapChangedKeycode);
+    WJHCheck(checks, record.keycode == kKeyEscape && record.flags == kWJHEventFlagShift);
+
+    record = keyRecord(kWJHEventTypeKeyDown, kKeyEscape, 0);
+    WJHCheck(checks, WJHEventRemapTableApply(table, &state, &record) == 0);
+    record = keyRecord(kWJHEventTypeKeyDown, kWJHEventRemapKeycodeLimit, 0);
+    WJHCheck(checks, WJHEventRemapTableApply(table, &state, &record) == 0);
+    WJHCheck(checks, WJHEventRemapTableTypeMask(table) == (UINT64_C(1) << kWJHEventTypeKeyDown | UINT64_C(1) << kWJHEventTypeKeyUp));
+    WJHEventRemapTableDestroy(table);
+}
+
+static void checkButtonsAndScroll(WJHChecks *checks) {
+    // Swap the left and right buttons, and send button 3 to the middle button.
+    WJHEventRemapButtonRule const buttonRules[] = { { 0, 1 }, { 1, 0 }, { 3, 2 } };
+    // Natural scrolling, vertically, at two and a half times the speed, with the axes swapped.
+    WJHEventRemapScroll const scroll = { true, 1, -2.5 };
+    WJHEventRemapSpec spec = { NULL, 0, buttonRules, 3, &scroll };
+    WJHEventRemapTable *table = WJHEventRemapTableCreate(&spec, NULL);
+    if (!WJHCheck(checks, table != NULL)) {
+        return;
+    }
+
+    WJHEventRecord record = buttonRecord(kWJHEventTypeLeftMouseDown, 0);
+    WJHCheck(checks, WJHEventRemapTableApply(table, NULL, &record) == (WJHEventRemapChangedButton | WJHEventRemapChangedType));
+    WJHCheck(checks, record.type == kWJHEventTypeRightMouseDown && record.button == 1);
+    record = buttonRecord(kWJHEventTypeRightMouseDragged, 1);
+    WJHEventRemapTableApply(table, NULL, &record);
+    WJHCheck(checks, record.type == kWJHEventTypeLeftMouseDragged && record.button == 0);
+    record = buttonRecord(kWJHEventTypeOtherMouseUp, 3);
+    WJHCheck(checks, WJHEventRemapTableApply(table, NULL, &record) == WJHEventRemapChangedButton);
+    WJHCheck(checks, record.type == kWJHEventTypeOtherMouseUp && record.button == 2);
+    record = buttonRecord(kWJHEventTypeOtherMouseDown, 4);
+    WJHCheck(checks, WJHEventRemapTableApply(table, NULL, &record) == 0);
+
+    record = (WJHEventRecord){ .type = kWJHEventTypeScrollWheel, .deltaX = 3, .deltaY = 4 };
+    WJHCheck(checks, WJHEventRemapTableApply(table, NULL, &record) == WJHEventRemapChangedScroll);
+    WJHCheck(checks, record.deltaX == 4 && record.deltaY == -8);
+    // Scaled deltas that do not fit saturate.
+    record = (WJHEventRecord){ .type = kWJHEventTypeScrollWheel, .deltaX = INT32_MAX, .deltaY = 0 };
+    WJHEventRemapTableApply(table, NULL, &record);
+    WJHCheck(checks, record.deltaX == 0 && record.deltaY == INT32_MIN);
+    double x = 1, y = 0.5;
+    WJHCheck(checks, WJHEventRemapTableTransformScroll(table, &x, &y));
+    WJHCheck(checks, fabs(x - 0.5) < 1e-9 && fabs(y + 2.5) < 1e-9);
+
+    uint64_t const expected = UINT64_C(1) << kWJHEventTypeLeftMouseDown | UINT64_C(1) << kWJHEventTypeLeftMouseUp | UINT64_C(1) << kWJHEventTypeLeftMouseDragged
+        | UINT64_C(1) << kWJHEventTypeRightMouseDown | UINT64_C(1) << kWJHEventTypeRightMouseUp | UINT64_C(1) << kWJHEventTypeRightMouseDragged
+        | UINT64_C(1) << kWJHEventTypeOtherMouseDown | UINT64_C(1) << kWJHEventTypeOtherMouseUp | UINT64_C(1) << kWJHEventTypeOtherMouseDragged
+        | UINT64_C(1) << kWJHEventTypeScrollWheel;
+    WJHCheck(checks, WJHEventRemapTableTypeMask(table) == expected);
+    WJHEventRemapTableDestroy(table);
+}
+
+static void checkInvalidRules(WJHChecks *checks) {
+    WJHEventRemapError error;
+    WJHEventRemapButtonRule const duplicate[] = { { 1, 2 }, { 1, 3 } };
+    WJHEventRemapSpec spec = { NULL, 0, duplicate, 2, NULL };
+    WJHCheck(checks, WJHEventRemapTableCreate(&spec, &error) == NULL);
+    WJHCheck(checks, error.invalid == WJHEventRemapInvalidButtonRule && error.index == 1);
+
+    WJHEventRemapButtonRule const tooBigButton = { 0, kWJHEventRemapButtonLimit };
+    spec = (WJHEventRemapSpec){ NULL, 0, &tooBigButton, 1, NULL };
+    WJHCheck(checks, WJHEventRemapTableCreate(&spec, &error) == NULL);
+    WJHCheck(checks, error.invalid == WJHEventRemapInvalidButtonRule && error.index == 0);
+
+    // A bad key rule is told apart from a bad button rule at the same index.
+    WJHEventRemapKeyRule const keyRules[] = {
+        { .keycode = kKeyA, .toKeycode = kKeyS },
+        { .keycode = kWJHEventRemapKeycodeLimit, .toKeycode = kKeyA },
+    };
+    WJHEventRemapButtonRule const buttonRules[] = { { 0, 1 }, { 1, kWJHEventRemapButtonLimit } };
+    spec = (WJHEventRemapSpec){ keyRules, 2, buttonRules, 2, NULL };
+    WJHCheck(checks, WJHEventRemapTableCreate(&spec, &error) == NULL);
+    WJHCheck(checks, error.invalid == WJHEventRemapInvalidKeyRule && error.index == 1);
+    spec.keyRuleCount = 1;
+    WJHCheck(checks, WJHEventRemapTableCreate(&spec, &error) == NULL);
+    WJHCheck(checks, error.invalid == WJHEventRemapInvalidButtonRule && error.index == 1);
+
+    WJHEventRemapScroll const infinite = { false, INFINITY, 1 };
+    spec = (WJHEventRemapSpec){ NULL, 0, NULL, 0, &infinite };
+    WJHCheck(checks, WJHEventRemapTableCreate(&spec, &error) == NULL);
+    WJHCheck(checks, error.invalid == WJHEventRemapInvalidScroll);
+    WJHEventRemapScroll const notANumber = { false, 1, NAN };
+    spec = (WJHEventRemapSpec){ NULL, 0, NULL, 0, &notANumber };
+    WJHCheck(checks, WJHEventRemapTableCreate(&spec, NULL) == NULL);
+
+    spec = (WJHEventRemapSpec){ keyRules, 1, buttonRules, 1, NULL };
+    WJHEventRemapTable *table = WJHEventRemapTableCreate(&spec, &error);
+    if (WJHCheck(checks, table != NULL)) {
+        WJHCheck(checks, error.invalid == WJHEventRemapInvalidNone);
+        WJHEventRemapTableDestroy(table);
+    }
+}
+
+/// A small, seeded generator, so a failure can be reproduced.
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static uint32_t randomBelow(uint64_t *state, uint32_t limit) {
+    return (uint32_t)(nextRandom(state) % limit);
+}
+
+static uint64_t randomFlags(uint64_t *state) {
+    uint64_t flags = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        flags |= randomBelow(state, 2) ? kFlags[i] : 0;
+    }
+    return flags;
+}
+
+/**
+ A specification, and the state of a plain model of it: the rules searched in the order they were written, and the keys and buttons that are down, by where they were sent.
+ */
+typedef struct Model {
+    WJHEventRemapKeyRule keyRules[kMaxKeyRules];
+    WJHEventRemapButtonRule buttonRules[kMaxButtonRules];
+    WJHEventRemapSpec spec;
+    int keysDown[kWJHEventRemapKeycodeLimit];
+    int buttonsDown[kWJHEventRemapButtonLimit];
+} Model;
+
+static void makeRandomModel(Model *model, uint64_t *state) {
+    memset(model, 0, sizeof(*model));
+    size_t keyRuleCount = randomBelow(state, kMaxKeyRules + 1);
+    for (size_t i = 0; i < keyRuleCount; ++i) {
+        WJHEventRemapKeyRule *rule = model->keyRules + i;
+        rule->keycode = kKeycodes[randomBelow(state, (uint32_t)kKeycodeCount)];
+        rule->toKeycode = kKeycodes[randomBelow(state, (uint32_t)kKeycodeCount)];
+        if (randomBelow(state, 2)) {
+            rule->flagsMask = randomFlags(state);
+            rule->flagsValue = randomFlags(state) & rule->flagsMask;
+        }
+        rule->setFlags = randomBelow(state, 2) ? randomFlags(state) : 0;
+        rule->clearFlags = randomBelow(state, 2) ? randomFlags(state) : 0;
+    }
+    // Each button at most once, as the compiler requires.
+    size_t buttonRuleCount = 0;
+    for (uint16_t button = 0; button < kMaxButtonRules; ++button) {
+        if (randomBelow(state, 2)) {
+            model->buttonRules[buttonRuleCount++] = (WJHEventRemapButtonRule){ button, (uint16_t)randomBelow(state, kMaxButtonRules) };
+        }
+    }
+    model->spec = (WJHEventRemapSpec){ model->keyRules, keyRuleCount, model->buttonRules, buttonRuleCount, NULL };
+    for (size_t i = 0; i < kWJHEventRemapKeycodeLimit; ++i) {
+        model->keysDown[i] = -1;
+    }
+    for (size_t i = 0; i < kWJHEventRemapButtonLimit; ++i) {
+        model->buttonsDown[i] = -1;
+    }
+}
+
+static void modelApplyKey(Model *model, WJHEventRecord *record) {
+    uint16_t keycode = record->keycode;
+    for (size_t i = 0; i < model->spec.keyRuleCount; ++i) {
+        WJHEventRemapKeyRule const *rule = model->keyRules + i;
+        if (rule->keycode == keycode && (record->flags & rule->flagsMask) == rule->flagsValue) {
+            record->keycode = rule->toKeycode;
+            record->flags = (record->flags & ~rule->clearFlags) | rule->setFlags;
+            break;
+        }
+    }
+    if (record->type == kWJHEventTypeKeyDown) {
+        model->keysDown[keycode] = record->keycode;
+    } else if (model->keysDown[keycode] >= 0) {
+        record->keycode = (uint16_t)model->keysDown[keycode];
+        model->keysDown[keycode] = -1;
+    }
+}
+
+/// The down, up, and dragged types of the left, right, and other buttons.
+static uint32_t const kButtonTypes[3][3] = {
+    { kWJHEventTypeLeftMouseDown, kWJHEventTypeLeftMouseUp, kWJHEventTypeLeftMouseDragged },
+    { kWJHEventTypeRightMouseDown, kWJHEventTypeRightMouseUp, kWJHEventTypeRightMouseDragged },
+    { kWJHEventTypeOtherMouseDown, kWJHEventTypeOtherMouseUp, kWJHEventTypeOtherMouseDragged },
+};
+
+static void modelApplyButton(Model *model, WJHEventRecord *record, int action) {
+    uint16_t button = record->button, toButton = button;
+    for (size_t i = 0; i < model->spec.buttonRuleCount; ++i) {
+        if (model->buttonRules[i].button == button) {
+            toButton = model->buttonRules[i].toButton;
+        }
+    }
+    if (action == 0) {
+        model->buttonsDown[button] = toButton;
+    } else if (model->buttonsDown[button] >= 0) {
+        toButton = (uint16_t)model->buttonsDown[button];
+        if (action == 1) {
+            model->buttonsDown[button] = -1;
+        }
+    }
+    if (toButton != button) {
+        record->button = toButton;
+        record->type = kButtonTypes[toButton < 2 ? toButton : 2][action];
+    }
+}
+
+static uint64_t modelTypeMask(Model const *model) {
+    uint64_t mask = 0;
+    if (model->spec.keyRuleCount) {
+        mask |= UINT64_C(1) << kWJHEventTypeKeyDown | UINT64_C(1) << kWJHEventTypeKeyUp;
+    }
+    for (size_t i = 0; i < model->spec.buttonRuleCount; ++i) {
+        WJHEventRemapButtonRule const *rule = model->buttonRules + i;
+        if (rule->toButton != rule->button) {
+            for (int action = 0; action < 3; ++action) {
+                mask |= UINT64_C(1) << kButtonTypes[rule->button < 2 ? rule->button : 2][action];
+            }
+        }
+    }
+    return mask;
+}
+
+/**
+ Compile random specifications, and run random streams of presses, drags and releases through each, with state, comparing every record with the model's.  Modifiers change freely between a press and its release, and each release must still go where its press went.
+ */
+static void checkMatchesModel(WJHChecks *checks) {
+    uint64_t random = 0xd1b54a32d192ed03;
+    uint64_t failedToCompile = 0, wrongTypeMask = 0, mismatched = 0, changed = 0;
+    for (int t = 0; t < kRandomTableCount; ++t) {
+        Model model;
+        makeRandomModel(&model, &random);
+        WJHEventRemapTable *table = WJHEventRemapTableCreate(&model.spec, NULL);
+        if (table == NULL) {
+            ++failedToCompile;
+            continue;
+        }
+        // The table has its own copy of the rules.
+        Model original = model;
+        original.spec.keyRules = original.keyRules;
+        original.spec.buttonRules = original.buttonRules;
+        memset(model.keyRules, 0, sizeof(model.keyRules));
+        memset(model.buttonRules, 0, sizeof(model.buttonRules));
+        wrongTypeMask += WJHEventRemapTableTypeMask(table) != modelTypeMask(&original);
+
+        WJHEventRemapState state;
+        memset(&state, 0, sizeof(state));
+        for (int e = 0; e < kRandomEventCount; ++e) {
+            WJHEventRecord record;
+            if (randomBelow(&random, 2)) {
+                uint32_t type = randomBelow(&random, 2) ? kWJHEventTypeKeyDown : kWJHEventTypeKeyUp;
+                record = keyRecord(type, kKeycodes[randomBelow(&random, (uint32_t)kKeycodeCount)], randomFlags(&random));
+            } else {
+                uint16_t button = (uint16_t)randomBelow(&random, kMaxButtonRules);
+                record = buttonRecord(kButtonTypes[button < 2 ? button : 2][randomBelow(&random, 3)], button);
+            }
+            WJHEventRecord expected = record;
+            if (record.type == kWJHEventTypeKeyDown || record.type == kWJHEventTypeKeyUp) {
+                modelApplyKey(&original, &expected);
+            } else {
+                int action = record.type == kButtonTypes[0][0] || record.type == kButtonTypes[1][0] || record.type == kButtonTypes[2][0] ? 0
+                    : record.type == kButtonTypes[0][1] || record.type == kButtonTypes[1][1] || record.type == kButtonTypes[2][1] ? 1 : 2;
+                modelApplyButton(&original, &expected, action);
+            }
+            WJHEventRecord before = record;
+            uint32_t changes = WJHEventRemapTableApply(table, &state, &record);
+            changed += changes != 0;
+            mismatched += memcmp(&record, &expected, sizeof(record)) != 0;
+            // The changes reported are the fields that changed.
+            uint32_t actual = (before.type != record.type ? WJHEventRemapChangedType : 0)
+                | (before.flags != record.flags ? WJHEventRemapChangedFlags : 0)
+                | (before.keycode != record.keycode ? WJHEventRemapChangedKeycode : 0)
+                | (before.button != record.button ? WJHEventRemapChangedButton : 0);
+            mismatched += changes != actual;
+        }
+        WJHEventRemapTableDestroy(table);
+    }
+    WJHCheck(checks, failedToCompile == 0);
+    WJHCheck(checks, wrongTypeMask == 0);
+    WJHCheck(checks, mismatched == 0);
+    // Otherwise, the comparison shows little.
+    WJHCheck(checks, changed > (uint64_t)kRandomTableCount * kRandomEventCount / 10);
+}
+
+void WJHEventRemapTableChecks(WJHChecks *checks) {
+    checkKeyRules(checks);
+    checkButtonsAndScroll(checks);
+    checkInvalidRules(checks);
+    checkMatchesModel(checks);
+}
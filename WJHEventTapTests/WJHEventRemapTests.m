@@ -0,0 +1,268 @@
+//
+//  WJHEventRemapTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHCoreChecks.h"
+
+@interface WJHEventRemapTests : XCTestCase
+@end
+
+static uint32_t const kBenchmarkEventCount = 10000000;
+
+// Virtual keycodes, from the ANSI layout.
+static uint16_t const kKeyA = 0;
+static uint16_t const kKeyS = 1;
+static uint16_t const kKeyD = 2;
+static uint16_t const kKeyEscape = 53;
+static uint16_t const kKeyCapsLock = 57;
+
+static WJHEventRemapKeyRule const kKeyRules[] = {
+    // Command-A becomes Control-S, and A on its own becomes D.
+    { .keycode = kKeyA, .flagsMask = kCGEventFlagMaskCommand, .flagsValue = kCGEventFlagMaskCommand, .toKeycode = kKeyS, .setFlags = kCGEventFlagMaskControl, .clearFlags = kCGEventFlagMaskCommand },
+    { .keycode = kKeyA, .toKeycode = kKeyD },
+    { .keycode = kKeyCapsLock, .toKeycode = kKeyEscape },
+};
+
+// Swap the left and right buttons, and send button 3 to the middle button.
+static WJHEventRemapButtonRule const kButtonRules[] = { { 0, 1 }, { 1, 0 }, { 3, 2 } };
+
+// Natural scrolling, vertically, at two and a half times the speed, with the axes swapped.
+static WJHEventRemapScroll const kScroll = { true, 1, -2.5 };
+
+static WJHEventRecord keyRecord(CGEventType type, uint16_t keycode, uint64_t flags) {
+    return (WJHEventRecord){ .type = type, .keycode = keycode, .flags = flags };
+}
+
+static WJHEventRecord buttonRecord(CGEventType type, uint16_t button) {
+    return (WJHEventRecord){ .type = type, .button = button };
+}
+
+static CGEventRef createKeyEvent(uint16_t keycode, bool down, CGEventFlags flags) {
+    CGEventRef event = CGEventCreateKeyboardEvent(NULL, keycode, down);
+    CGEventSetFlags(event, flags);
+    return event;
+}
+
+/// Remembers the keycode and type of the last event it was given.
+@interface WJHRemapDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, assign) CGEventType lastType;
+@property (nonatomic, assign) int64_t lastKeycode;
+@property (nonatomic, assign) NSUInteger count;
+@end
+
+@implementation WJHRemapDelegate
+- (BOOL)eventTap:(WJHEventTap*)eventTap receivedEvent:(CGEventRef*)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    _lastType = type;
+    _lastKeycode = CGEventGetIntegerValueField(*event, kCGKeyboardEventKeycode);
+    ++_count;
+    return YES;
+}
+@end
+
+@implementation WJHEventRemapTests {
+    WJHEventRemapTable *table;
+    WJHEventRemapState state;
+}
+
+- (void)setUp {
+    [super setUp];
+    WJHEventRemapSpec spec = { kKeyRules, 3, kButtonRules, 3, &kScroll };
+    table = WJHEventRemapTableCreate(&spec, NULL);
+    memset(&state, 0, sizeof(state));
+}
+
+- (void)tearDown {
+    WJHEventRemapTableDestroy(table);
+    [super tearDown];
+}
+
+
+#pragma mark - Table
+
+- (void)testKeyRules {
+    XCTAssertTrue(table != NULL);
+    WJHEventRecord record = keyRecord(kCGEventKeyDown, kKeyA, kCGEventFlagMaskCommand | kCGEventFlagMaskShift);
+    XCTAssertEqual(WJHEventRemapChangedKeycode | WJHEventRemapChangedFlags, WJHEventRemapTableApply(table, &state, &record));
+    XCTAssertEqual(kKeyS, record.keycode);
+    XCTAssertEqual(kCGEventFlagMaskControl | kCGEventFlagMaskShift, record.flags);
+
+    // Command is released before A, but the release still goes to S.
+    record = keyRecord(kCGEventKeyUp, kKeyA, kCGEventFlagMaskShift);
+    XCTAssertEqual(WJHEventRemapChangedKeycode, WJHEventRemapTableApply(table, &state, &record));
+    XCTAssertEqual(kKeyS, record.keycode);
+
+    record = keyRecord(kCGEventKeyDown, kKeyA, 0);
+    WJHEventRemapTableApply(table, &state, &record);
+    XCTAssertEqual(kKeyD, record.keycode);
+
+    record = keyRecord(kCGEventKeyDown, kKeyCapsLock, kCGEventFlagMaskShift);
+    XCTAssertEqual(WJHEventRemapChangedKeycode, WJHEventRemapTableApply(table, NULL, &record));
+    XCTAssertEqual(kKeyEscape, record.keycode);
+    XCTAssertEqual(kCGEventFlagMaskShift, record.flags);
+
+    record = keyRecord(kCGEventKeyDown, kKeyEscape, 0);
+    XCTAssertEqual(0, WJHEventRemapTableApply(table, &state, &record));
+    record = keyRecord(kCGEventKeyDown, kWJHEventRemapKeycodeLimit, 0);
+    XCTAssertEqual(0, WJHEventRemapTableApply(table, &state, &record));
+}
+
+- (void)testButtonRulesChangeTheType {
+    WJHEventRecord record = buttonRecord(kCGEventLeftMouseDown, 0);
+    XCTAssertEqual(WJHEventRemapChangedButton | WJHEventRemapChangedType, WJHEventRemapTableApply(table, NULL, &record));
+    XCTAssertEqual(kCGEventRightMouseDown, record.type);
+    XCTAssertEqual(1, record.button);
+
+    record = buttonRecord(kCGEventRightMouseDragged, 1);
+    WJHEventRemapTableApply(table, NULL, &record);
+    XCTAssertEqual(kCGEventLeftMouseDragged, record.type);
+    XCTAssertEqual(0, record.button);
+
+    record = buttonRecord(kCGEventOtherMouseUp, 3);
+    XCTAssertEqual(WJHEventRemapChangedButton, WJHEventRemapTableApply(table, NULL, &record));
+    XCTAssertEqual(kCGEventOtherMouseUp, record.type);
+    XCTAssertEqual(2, record.button);
+
+    record = buttonRecord(kCGEventOtherMouseDown, 4);
+    XCTAssertEqual(0, WJHEventRemapTableApply(table, NULL, &record));
+}
+
+- (void)testReleaseFollowsPressAcrossTables {
+    WJHEventRemapSpec spec = { NULL, 0, NULL, 0, NULL };
+    WJHEventRemapTable *empty = WJHEventRemapTableCreate(&spec, NULL);
+    XCTAssertTrue(empty != NULL);
+
+    WJHEventRecord record = buttonRecord(kCGEventLeftMouseDown, 0);
+    WJHEventRemapTableApply(table, &state, &record);
+    XCTAssertEqual(kCGEventRightMouseDown, record.type);
+
+    // The table is swapped while the button is down.
+    record = buttonRecord(kCGEventLeftMouseDragged, 0);
+    WJHEventRemapTableApply(empty, &state, &record);
+    XCTAssertEqual(kCGEventRightMouseDragged, record.type);
+    record = buttonRecord(kCGEventLeftMouseUp, 0);
+    WJHEventRemapTableApply(empty, &state, &record);
+    XCTAssertEqual(kCGEventRightMouseUp, record.type);
+
+    record = buttonRecord(kCGEventLeftMouseDown, 0);
+    XCTAssertEqual(0, WJHEventRemapTableApply(empty, &state, &record));
+    WJHEventRemapTableDestroy(empty);
+}
+
+- (void)testScroll {
+    WJHEventRecord record = { .type = kCGEventScrollWheel, .deltaX = 3, .deltaY = 4 };
+    XCTAssertEqual(WJHEventRemapChangedScroll, WJHEventRemapTableApply(table, NULL, &record));
+    XCTAssertEqual(4, record.deltaX);
+    XCTAssertEqual(-8, record.deltaY);
+
+    double x = 1, y = 0.5;
+    XCTAssertTrue(WJHEventRemapTableTransformScroll(table, &x, &y));
+    XCTAssertEqualWithAccuracy(0.5, x, 1e-9);
+    XCTAssertEqualWithAccuracy(-2.5, y, 1e-9);
+}
+
+- (void)testInvalidRules {
+    WJHEventRemapError error;
+    WJHEventRemapButtonRule const duplicate[] = { { 1, 2 }, { 1, 3 } };
+    WJHEventRemapSpec spec = { NULL, 0, duplicate, 2, NULL };
+    XCTAssertTrue(WJHEventRemapTableCreate(&spec, &error) == NULL);
+    XCTAssertEqual(WJHEventRemapInvalidButtonRule, error.invalid);
+    XCTAssertEqual(1, error.index);
+
+    WJHEventRemapKeyRule const tooBig = { .keycode = kKeyA, .toKeycode = kWJHEventRemapKeycodeLimit };
+    spec = (WJHEventRemapSpec){ &tooBig, 1, NULL, 0, NULL };
+    XCTAssertTrue(WJHEventRemapTableCreate(&spec, &error) == NULL);
+    XCTAssertEqual(WJHEventRemapInvalidKeyRule, error.invalid);
+    XCTAssertEqual(0, error.index);
+    XCTAssertNil([WJHEventRemap remapWithSpec:&spec]);
+
+    WJHEventRemapScroll const infinite = { false, INFINITY, 1 };
+    spec = (WJHEventRemapSpec){ NULL, 0, NULL, 0, &infinite };
+    XCTAssertTrue(WJHEventRemapTableCreate(&spec, &error) == NULL);
+    XCTAssertEqual(WJHEventRemapInvalidScroll, error.invalid);
+
+    spec = (WJHEventRemapSpec){ &kKeyRules[0], 1, NULL, 0, NULL };
+    WJHEventRemapTable *valid = WJHEventRemapTableCreate(&spec, &error);
+    XCTAssertTrue(valid != NULL);
+    XCTAssertEqual(WJHEventRemapInvalidNone, error.invalid);
+    WJHEventRemapTableDestroy(valid);
+}
+
+- (void)testCoreChecks {
+    WJHChecks checks = { .log = stderr };
+    WJHEventRemapTableChecks(&checks);
+    XCTAssertEqual(0, checks.failed);
+}
+
+
+#pragma mark - Tap
+
+- (void)testActiveTapRemapsInPlace {
+    WJHEventRemapSpec spec = { kKeyRules, 3, kButtonRules, 3, &kScroll };
+    WJHRemapDelegate *delegate = [WJHRemapDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    tap.remap = [WJHEventRemap remapWithSpec:&spec];
+
+    CGEventRef down = createKeyEvent(kKeyA, true, kCGEventFlagMaskCommand);
+    XCTAssertEqual(down, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, down));
+    XCTAssertEqual(kKeyS, CGEventGetIntegerValueField(down, kCGKeyboardEventKeycode));
+    XCTAssertEqual(kCGEventFlagMaskControl, CGEventGetFlags(down) & (kCGEventFlagMaskControl | kCGEventFlagMaskCommand));
+    XCTAssertEqual(kKeyS, delegate.lastKeycode);
+
+    // Removing the remap does not strand the key that is down.
+    tap.remap = nil;
+    CGEventRef up = createKeyEvent(kKeyA, false, 0);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyUp, up);
+    XCTAssertEqual(kKeyS, CGEventGetIntegerValueField(up, kCGKeyboardEventKeycode));
+
+    tap.remap = [WJHEventRemap remapWithSpec:&spec];
+    CGEventRef click = CGEventCreateMouseEvent(NULL, kCGEventLeftMouseDown, CGPointZero, kCGMouseButtonLeft);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventLeftMouseDown, click);
+    XCTAssertEqual(kCGEventRightMouseDown, CGEventGetType(click));
+    XCTAssertEqual(kCGMouseButtonRight, CGEventGetIntegerValueField(click, kCGMouseEventButtonNumber));
+    XCTAssertEqual(kCGEventRightMouseDown, delegate.lastType);
+
+    CGEventRef scroll = CGEventCreateScrollWheelEvent(NULL, kCGScrollEventUnitLine, 2, 4, 3);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventScrollWheel, scroll);
+    XCTAssertEqual(-8, CGEventGetIntegerValueField(scroll, kCGScrollWheelEventDeltaAxis1));
+    XCTAssertEqual(4, CGEventGetIntegerValueField(scroll, kCGScrollWheelEventDeltaAxis2));
+
+    CFRelease(down);
+    CFRelease(up);
+    CFRelease(click);
+    CFRelease(scroll);
+}
+
+- (void)testPassiveTapDoesNotRemap {
+    WJHEventRemapSpec spec = { kKeyRules, 3, NULL, 0, NULL };
+    WJHRemapDelegate *delegate = [WJHRemapDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    tap.remap = [WJHEventRemap remapWithSpec:&spec];
+
+    CGEventRef event = createKeyEvent(kKeyCapsLock, true, 0);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, event);
+    XCTAssertEqual(kKeyCapsLock, CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode));
+    XCTAssertEqual(1, delegate.count);
+    CFRelease(event);
+}
+
+
+#pragma mark - Benchmarks
+
+- (void)testPerformanceApply {
+    [self measureBlock:^{
+        uint64_t changed = 0;
+        for (uint32_t i = 0; i < kBenchmarkEventCount; ++i) {
+            WJHEventRecord record = keyRecord((i & 1) ? kCGEventKeyUp : kCGEventKeyDown, (uint16_t)((i >> 1) % 64), (i & 4) ? kCGEventFlagMaskCommand : 0);
+            changed += WJHEventRemapTableApply(table, &state, &record) != 0;
+        }
+        XCTAssertGreaterThan(changed, 0);
+    }];
+}
+
+@end
@@ -0,0 +1,126 @@
+//
+//  WJHEventRingBufferChecks.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreChecks.h"
+#include <WJHEventTap/WJHEventBackend.h>
+#include <WJHEventTap/WJHEventRingBuffer.h>
+
+#include <pthread.h>
+
+static uint64_t const kThreadedRecordCount = 100000;
+
+typedef struct Producer {
+    WJHEventRingBuffer *buffer;
+    uint64_t count;
+} Producer;
+
+/// A synthetic producer, standing in for the tap callback.  Each record carries its sequence number as its timestamp.
+static void * produce(void *context) {
+    Producer *producer = context;
+    for (uint64_t i = 0; i < producer->count; ++i) {
+        WJHEventRecord record = { .timestamp = i, .type = kWJHEventTypeMouseMoved };
+        WJHEventRingBufferPush(producer->buffer, &record);
+    }
+    return NULL;
+}
+
+static void checkCapacity(WJHChecks *checks) {
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(100, WJHEventRingBufferDropOldest);
+    if (!WJHCheck(checks, buffer != NULL)) {
+        return;
+    }
+    WJHCheck(checks, WJHEventRingBufferCapacity(buffer) == 128);
+    WJHEventRingBufferDestroy(buffer);
+}
+
+static void checkDropOldestKeepsNewest(WJHChecks *checks) {
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(4, WJHEventRingBufferDropOldest);
+    if (!WJHCheck(checks, buffer != NULL)) {
+        return;
+    }
+    for (uint64_t i = 0; i < 10; ++i) {
+        WJHEventRecord record = { .timestamp = i };
+        WJHCheck(checks, WJHEventRingBufferPush(buffer, &record));
+    }
+
+    WJHEventRecord records[10];
+    if (WJHCheck(checks, WJHEventRingBufferPop(buffer, records, 10) == 4)) {
+        for (uint64_t i = 0; i < 4; ++i) {
+            WJHCheck(checks, records[i].timestamp == 6 + i);
+        }
+    }
+
+    WJHEventRingBufferStatistics statistics = WJHEventRingBufferGetStatistics(buffer);
+    WJHCheck(checks, statistics.pushed == 10);
+    WJHCheck(checks, statistics.popped == 4);
+    WJHCheck(checks, statistics.dropped == 6);
+    WJHCheck(checks, statistics.overflows == 6);
+    WJHEventRingBufferDestroy(buffer);
+}
+
+static void checkCloseKeepsRecords(WJHChecks *checks) {
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(4, WJHEventRingBufferBlock);
+    if (!WJHCheck(checks, buffer != NULL)) {
+        return;
+    }
+    WJHEventRecord record = { .timestamp = 42 };
+    WJHCheck(checks, WJHEventRingBufferPush(buffer, &record));
+    WJHEventRingBufferClose(buffer);
+    WJHCheck(checks, !WJHEventRingBufferPush(buffer, &record));
+    WJHCheck(checks, WJHEventRingBufferCount(buffer) == 1);
+    record.timestamp = 0;
+    WJHCheck(checks, WJHEventRingBufferPop(buffer, &record, 1) == 1);
+    WJHCheck(checks, record.timestamp == 42);
+    WJHEventRingBufferDestroy(buffer);
+}
+
+/**
+ Consume everything a producer thread pushes, checking that the records arrive in order, and, from a blocking buffer, that none are missing.
+ */
+static void checkThreaded(WJHChecks *checks, WJHEventRingBufferPolicy policy) {
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(64, policy);
+    if (!WJHCheck(checks, buffer != NULL)) {
+        return;
+    }
+    Producer producer = { buffer, kThreadedRecordCount };
+    pthread_t thread;
+    if (!WJHCheck(checks, pthread_create(&thread, NULL, produce, &producer) == 0)) {
+        WJHEventRingBufferDestroy(buffer);
+        return;
+    }
+
+    bool const exact = policy == WJHEventRingBufferBlock;
+    uint64_t next = 0, outOfOrder = 0;
+    WJHEventRecord records[16];
+    // The producer's last record is never dropped, as nothing comes after it.
+    while (next < kThreadedRecordCount) {
+        size_t count = WJHEventRingBufferPop(buffer, records, 16);
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t timestamp = records[i].timestamp;
+            if (exact ? timestamp != next : timestamp < next) {
+                ++outOfOrder;
+            }
+            next = timestamp + 1;
+        }
+    }
+    pthread_join(thread, NULL);
+    WJHCheck(checks, outOfOrder == 0);
+
+    WJHEventRingBufferStatistics statistics = WJHEventRingBufferGetStatistics(buffer);
+    WJHCheck(checks, statistics.pushed == kThreadedRecordCount);
+    WJHCheck(checks, statistics.popped + statistics.dropped == kThreadedRecordCount);
+    WJHCheck(checks, !exact || statistics.dropped == 0);
+    WJHEventRingBufferDestroy(buffer);
+}
+
+void WJHEventRingBufferChecks(WJHChecks *checks) {
+    checkCapacity(checks);
+    checkDropOldestKeepsNewest(checks);
+    checkCloseKeepsRecords(checks);
+    checkThreaded(checks, WJHEventRingBufferBlock);
+    checkThreaded(checks, WJHEventRingBufferDropOldest);
+}
@@ -0,0 +1,165 @@
+//
+//  WJHEventRingBufferTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <pthread.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHCoreChecks.h"
+
+@interface WJHEventRingBufferTests : XCTestCase
+@end
+
+typedef struct {
+    WJHEventRingBuffer *buffer;
+    uint64_t count;
+} ProducerArgs;
+
+/// A synthetic producer, standing in for the tap callback.  Each record carries its sequence number as its timestamp.
+static void * producer(void *context) {
+    ProducerArgs *args = context;
+    for (uint64_t i = 0; i < args->count; ++i) {
+        WJHEventRecord record = { .timestamp = i, .type = kCGEventMouseMoved };
+        WJHEventRingBufferPush(args->buffer, &record);
+    }
+    return NULL;
+}
+
+@implementation WJHEventRingBufferTests
+
+- (void)testCapacityIsRoundedUpToPowerOfTwo {
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(100, WJHEventRingBufferDropOldest);
+    XCTAssertEqual(128, WJHEventRingBufferCapacity(buffer));
+    WJHEventRingBufferDestroy(buffer);
+}
+
+- (void)testDropOldestKeepsNewest {
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(4, WJHEventRingBufferDropOldest);
+    for (uint64_t i = 0; i < 10; ++i) {
+        WJHEventRecord record = { .timestamp = i };
+        XCTAssertTrue(WJHEventRingBufferPush(buffer, &record));
+    }
+
+    WJHEventRecord records[10];
+    XCTAssertEqual(4, WJHEventRingBufferPop(buffer, records, 10));
+    for (uint64_t i = 0; i < 4; ++i) {
+        XCTAssertEqual(6 + i, records[i].timestamp);
+    }
+
+    WJHEventRingBufferStatistics stats = WJHEventRingBufferGetStatistics(buffer);
+    XCTAssertEqual(10, stats.pushed);
+    XCTAssertEqual(4, stats.popped);
+    XCTAssertEqual(6, stats.dropped);
+    XCTAssertEqual(6, stats.overflows);
+    WJHEventRingBufferDestroy(buffer);
+}
+
+- (void)testCloseFailsPushesButKeepsRecords {
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(4, WJHEventRingBufferBlock);
+    WJHEventRecord record = { .timestamp = 42 };
+    XCTAssertTrue(WJHEventRingBufferPush(buffer, &record));
+    WJHEventRingBufferClose(buffer);
+    XCTAssertFalse(WJHEventRingBufferPush(buffer, &record));
+    XCTAssertEqual(1, WJHEventRingBufferCount(buffer));
+    XCTAssertEqual(1, WJHEventRingBufferPop(buffer, &record, 1));
+    XCTAssertEqual(42, record.timestamp);
+    WJHEventRingBufferDestroy(buffer);
+}
+
+- (void)testBlockingProducerLosesNothing {
+    uint64_t const count = 1000000;
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(64, WJHEventRingBufferBlock);
+    ProducerArgs args = { buffer, count };
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, &args);
+
+    WJHEventRecord records[16];
+    uint64_t expected = 0;
+    while (expected < count) {
+        size_t n = WJHEventRingBufferPop(buffer, records, 16);
+        for (size_t i = 0; i < n; ++i, ++expected) {
+            if (records[i].timestamp != expected) {
+                XCTFail(@"Expected %llu, got %llu", expected, records[i].timestamp);
+                expected = count;
+                break;
+            }
+        }
+    }
+    pthread_join(thread, NULL);
+
+    WJHEventRingBufferStatistics stats = WJHEventRingBufferGetStatistics(buffer);
+    XCTAssertEqual(count, stats.pushed);
+    XCTAssertEqual(count, stats.popped);
+    XCTAssertEqual(0, stats.dropped);
+    WJHEventRingBufferDestroy(buffer);
+}
+
+- (void)testDropOldestProducerStaysOrdered {
+    uint64_t const count = 1000000;
+    WJHEventRingBuffer *buffer = WJHEventRingBufferCreate(64, WJHEventRingBufferDropOldest);
+    ProducerArgs args = { buffer, count };
+    pthread_t thread;
+    pthread_create(&thread, NULL, producer, &args);
+
+    WJHEventRecord records[16];
+    uint64_t last = 0;
+    BOOL first = YES;
+    while (last != count - 1) {
+        size_t n = WJHEventRingBufferPop(buffer, records, 16);
+        for (size_t i = 0; i < n; ++i) {
+            XCTAssertTrue(first || records[i].timestamp > last);
+            last = records[i].timestamp;
+            first = NO;
+        }
+    }
+    pthread_join(thread, NULL);
+
+    WJHEventRingBufferStatistics stats = WJHEventRingBufferGetStatistics(buffer);
+    XCTAssertEqual(count, stats.pushed);
+    XCTAssertEqual(count, stats.popped + stats.dropped);
+    WJHEventRingBufferDestroy(buffer);
+}
+
+- (void)testCoreChecks {
+    WJHChecks checks = { .log = stderr };
+    WJHEventRingBufferChecks(&checks);
+    XCTAssertEqual(0, checks.failed);
+}
+
+- (void)testTapDeliversAsynchronously {
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    dispatch_queue_t queue = dispatch_queue_create("WJHEventRingBufferTests", DISPATCH_QUEUE_SERIAL);
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Delivered"];
+    __block NSUInteger delivered = 0;
+    delegate.keyDownEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        XCTAssertEqual(7, CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode));
+        if (++delivered == 100) {
+            [expectation fulfill];
+        }
+        return event;
+    };
+
+    WJHEventTap *activeTap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    XCTAssertFalse([activeTap enableAsynchronousDeliveryWithCapacity:128 overflowPolicy:WJHEventRingBufferBlock queue:queue]);
+
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    XCTAssertTrue([tap enableAsynchronousDeliveryWithCapacity:128 overflowPolicy:WJHEventRingBufferBlock queue:queue]);
+    XCTAssertTrue(tap.deliversAsynchronously);
+
+    CGEventRef event = CGEventCreate(NULL);
+    CGEventSetType(event, kCGEventKeyDown);
+    CGEventSetIntegerValueField(event, kCGKeyboardEventKeycode, 7);
+    for (int i = 0; i < 100; ++i) {
+        XCTAssertEqual(event, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, event));
+    }
+    CFRelease(event);
+
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+    XCTAssertEqual(100, tap.asynchronousDeliveryStatistics.pushed);
+}
+
+@end
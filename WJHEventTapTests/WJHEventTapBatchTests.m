@@ -0,0 +1,263 @@
+//
+//  WJHEventTapBatchTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+
+@interface WJHEventTapBatchTests : XCTestCase
+@end
+
+static uint64_t const kThroughputEventCount = 1000000;
+static uint32_t const kThroughputBatchSize = 256;
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+/// Records every batch, and every per-event callback, in order.
+@interface WJHBatchDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, strong) NSMutableArray *batchSizes;
+@property (nonatomic, strong) NSMutableArray *types;
+@property (nonatomic, assign) NSUInteger mouseMoves;
+@end
+
+@implementation WJHBatchDelegate
+- (instancetype)init {
+    if (self = [super init]) {
+        _batchSizes = [NSMutableArray array];
+        _types = [NSMutableArray array];
+    }
+    return self;
+}
+- (void)eventTap:(WJHEventTap*)eventTap receivedRecords:(WJHEventRecord const *)records count:(NSUInteger)count {
+    [_batchSizes addObject:@(count)];
+    for (NSUInteger i = 0; i < count; ++i) {
+        [_types addObject:@(records[i].type)];
+    }
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    ++_mouseMoves;
+    return event;
+}
+@end
+
+/// Knows nothing about batches.
+@interface WJHPerEventDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, strong) NSMutableArray *types;
+@end
+
+@implementation WJHPerEventDelegate
+- (instancetype)init {
+    if (self = [super init]) {
+        _types = [NSMutableArray array];
+    }
+    return self;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap keyDownEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    [_types addObject:@(kCGEventKeyDown)];
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    [_types addObject:@(kCGEventMouseMoved)];
+    return event;
+}
+@end
+
+/// Does the least possible work per event, so the benchmark measures the delivery machinery.
+@interface WJHCountingDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, assign) uint64_t count;
+@end
+
+@implementation WJHCountingDelegate
+- (void)eventTap:(WJHEventTap*)eventTap receivedRecords:(WJHEventRecord const *)records count:(NSUInteger)count {
+    _count += count;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    ++_count;
+    return event;
+}
+@end
+
+@implementation WJHEventTapBatchTests
+
+- (void)dispatch:(CGEventType)type to:(WJHEventTap *)tap {
+    CGEventRef event = CGEventCreate(NULL);
+    CGEventSetType(event, type);
+    XCTAssertEqual(event, WJHEventTapDispatchEvent(tap, NULL, type, event));
+    CFRelease(event);
+}
+
+- (WJHEventTap *)detachedTapWithDelegate:(id<WJHEventTapDelegate>)delegate batchSize:(uint32_t)batchSize {
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    XCTAssertTrue([tap enableBatchedDeliveryWithBatchSize:batchSize interval:1]);
+    return tap;
+}
+
+
+#pragma mark - Configuration
+
+- (void)testEnableRules {
+    WJHEventTap *active = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:nil];
+    XCTAssertFalse([active enableBatchedDeliveryWithBatchSize:16 interval:1]);
+    XCTAssertFalse(active.deliversBatches);
+
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:nil];
+    XCTAssertFalse([tap enableBatchedDeliveryWithBatchSize:0 interval:1]);
+    XCTAssertFalse([tap enableBatchedDeliveryWithBatchSize:16 interval:0]);
+    XCTAssertTrue([tap enableBatchedDeliveryWithBatchSize:16 interval:1]);
+    XCTAssertTrue(tap.deliversBatches);
+    XCTAssertFalse([tap enableBatchedDeliveryWithBatchSize:16 interval:1]);
+    XCTAssertFalse([tap enableCoalescingWithWindow:1]);
+    XCTAssertFalse([tap enableAsynchronousDeliveryWithCapacity:16 overflowPolicy:WJHEventRingBufferDropOldest queue:nil]);
+
+    WJHEventTap *coalescing = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:nil];
+    XCTAssertTrue([coalescing enableCoalescingWithWindow:1]);
+    XCTAssertFalse([coalescing enableBatchedDeliveryWithBatchSize:16 interval:1]);
+}
+
+
+#pragma mark - Delivery
+
+- (void)testBatchesAreDeliveredInOrderWhenFull {
+    WJHBatchDelegate *delegate = [WJHBatchDelegate new];
+    WJHEventTap *tap = [self detachedTapWithDelegate:delegate batchSize:4];
+
+    CGEventType types[] = { kCGEventMouseMoved, kCGEventKeyDown, kCGEventKeyUp, kCGEventMouseMoved, kCGEventScrollWheel, kCGEventFlagsChanged };
+    for (size_t i = 0; i < sizeof(types) / sizeof(*types); ++i) {
+        [self dispatch:types[i] to:tap];
+    }
+    XCTAssertEqualObjects(@[@4], delegate.batchSizes);
+
+    WJHEventTapFlushBatchedEvents(tap);
+    XCTAssertEqualObjects((@[@4, @2]), delegate.batchSizes);
+    XCTAssertEqualObjects((@[@(kCGEventMouseMoved), @(kCGEventKeyDown), @(kCGEventKeyUp), @(kCGEventMouseMoved), @(kCGEventScrollWheel), @(kCGEventFlagsChanged)]), delegate.types);
+    XCTAssertEqual(0, delegate.mouseMoves);
+
+    WJHEventTapFlushBatchedEvents(tap);
+    XCTAssertEqual(2, delegate.batchSizes.count);
+}
+
+- (void)testPerEventMethodsWithoutBatchMethod {
+    WJHPerEventDelegate *delegate = [WJHPerEventDelegate new];
+    WJHEventTap *tap = [self detachedTapWithDelegate:delegate batchSize:3];
+
+    [self dispatch:kCGEventKeyDown to:tap];
+    [self dispatch:kCGEventMouseMoved to:tap];
+    XCTAssertEqual(0, delegate.types.count);
+    [self dispatch:kCGEventKeyDown to:tap];
+    XCTAssertEqualObjects((@[@(kCGEventKeyDown), @(kCGEventMouseMoved), @(kCGEventKeyDown)]), delegate.types);
+}
+
+- (void)testBlockDelegate {
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    __block NSUInteger moves = 0;
+    delegate.mouseMovedEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        ++moves;
+        return event;
+    };
+    WJHEventTap *tap = [self detachedTapWithDelegate:delegate batchSize:2];
+
+    // Without a batch block, the records are handed to the per-event blocks.
+    [self dispatch:kCGEventMouseMoved to:tap];
+    [self dispatch:kCGEventMouseMoved to:tap];
+    XCTAssertEqual(2, moves);
+
+    __block NSUInteger batched = 0;
+    delegate.receivedRecords = ^(WJHEventTap *eventTap, WJHEventRecord const *records, NSUInteger count) {
+        batched += count;
+    };
+    [self dispatch:kCGEventMouseMoved to:tap];
+    [self dispatch:kCGEventMouseMoved to:tap];
+    XCTAssertEqual(2, moves);
+    XCTAssertEqual(2, batched);
+}
+
+- (void)testTapWithoutBatchingIsUnchanged {
+    WJHBatchDelegate *delegate = [WJHBatchDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    XCTAssertFalse(tap.deliversBatches);
+    [self dispatch:kCGEventMouseMoved to:tap];
+    XCTAssertEqual(1, delegate.mouseMoves);
+    XCTAssertEqual(0, delegate.batchSizes.count);
+}
+
+- (void)testTimerFlushesOnRunLoop {
+    WJHBatchDelegate *delegate = [WJHBatchDelegate new];
+    WJHEventTapThread *thread = [[WJHEventTapThread alloc] initWithName:@"batching"];
+    WJHEventTap *tap = [[WJHEventTap alloc] initWithProcess:NULL eventMask:kCGEventMaskForAllEvents beforeOthers:NO passive:YES thread:thread delegate:delegate];
+    XCTAssertTrue([tap enableBatchedDeliveryWithBatchSize:100 interval:0.01]);
+
+    [thread performBlockAndWait:^{
+        // Make sure the tap is past the start-up phase, where it ignores events until the system reports that it was disabled.
+        [self dispatch:kCGEventTapDisabledByUserInput to:tap];
+        for (int i = 0; i < 3; ++i) {
+            [self dispatch:kCGEventMouseMoved to:tap];
+        }
+    }];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Batch delivered"];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.2 * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [thread performBlockAndWait:^{
+            if ([delegate.batchSizes isEqualToArray:@[@3]]) {
+                [expectation fulfill];
+            }
+        }];
+    });
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+
+#pragma mark - Throughput
+
+- (double)eventsPerSecondThrough:(WJHEventTap *)tap {
+    CGEventRef event = CGEventCreate(NULL);
+    CGEventSetType(event, kCGEventMouseMoved);
+    uint64_t start = mach_absolute_time();
+    for (uint64_t i = 0; i < kThroughputEventCount; ++i) {
+        WJHEventTapDispatchEvent(tap, NULL, kCGEventMouseMoved, event);
+    }
+    WJHEventTapFlushBatchedEvents(tap);
+    double elapsed = nanosecondsSince(start);
+    CFRelease(event);
+    return kThroughputEventCount / (elapsed / NSEC_PER_SEC);
+}
+
+- (void)testThroughputBenchmark {
+    WJHCountingDelegate *single = [WJHCountingDelegate new];
+    WJHEventTap *singleTap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:single];
+    double singleRate = [self eventsPerSecondThrough:singleTap];
+
+    WJHCountingDelegate *batched = [WJHCountingDelegate new];
+    WJHEventTap *batchedTap = [self detachedTapWithDelegate:batched batchSize:kThroughputBatchSize];
+    double batchedRate = [self eventsPerSecondThrough:batchedTap];
+
+    XCTAssertEqual(kThroughputEventCount, single.count);
+    XCTAssertEqual(kThroughputEventCount, batched.count);
+    NSLog(@"Delivering %llu events: one at a time %.2f M events/sec, in batches of %u %.2f M events/sec", kThroughputEventCount, singleRate / 1e6, kThroughputBatchSize, batchedRate / 1e6);
+}
+
+- (void)testPerformanceOneAtATime {
+    WJHCountingDelegate *delegate = [WJHCountingDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    [self measureBlock:^{
+        [self eventsPerSecondThrough:tap];
+    }];
+}
+
+- (void)testPerformanceBatched {
+    WJHCountingDelegate *delegate = [WJHCountingDelegate new];
+    WJHEventTap *tap = [self detachedTapWithDelegate:delegate batchSize:kThroughputBatchSize];
+    [self measureBlock:^{
+        [self eventsPerSecondThrough:tap];
+    }];
+}
+
+@end
@@ -0,0 +1,196 @@
+//
+//  WJHEventTapBulkCreationTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+
+@interface WJHEventTapBulkCreationTests : XCTestCase
+@end
+
+static NSUInteger const kStartupTapCount = 12;
+static uint32_t const kBackgroundTapCount = 500;
+
+/**
+ Makes the machine look busy, by reporting a pile of taps owned by some other process along with the real ones.
+ */
+typedef struct {
+    uint32_t backgroundTaps;
+    uint32_t calls;
+    BOOL failing;
+} BusySystem;
+
+static CGError busyProvider(void *context, uint32_t maxNumberOfTaps, CGEventTapInformation *tapList, uint32_t *eventTapCount) {
+    BusySystem *system = context;
+    ++system->calls;
+    if (system->failing) {
+        return kCGErrorFailure;
+    }
+
+    uint32_t count = 0;
+    CGError error = CGGetEventTapList(tapList ? maxNumberOfTaps : 0, tapList, &count);
+    if (error != kCGErrorSuccess) {
+        return error;
+    }
+    if (tapList == NULL) {
+        *eventTapCount = count + system->backgroundTaps;
+        return kCGErrorSuccess;
+    }
+    for (uint32_t i = 0; i < system->backgroundTaps && count < maxNumberOfTaps; ++i) {
+        CGEventTapInformation info = {
+            .eventTapID = 0x40000000 + i,
+            .tapPoint = kCGSessionEventTap,
+            .options = kCGEventTapOptionListenOnly,
+            .eventsOfInterest = kCGEventMaskForAllEvents,
+            .tappingProcess = 1,
+            .enabled = true,
+        };
+        tapList[count++] = info;
+    }
+    *eventTapCount = count;
+    return kCGErrorSuccess;
+}
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+@implementation WJHEventTapBulkCreationTests {
+    BusySystem system;
+}
+
+- (void)setUp {
+    [super setUp];
+    memset(&system, 0, sizeof(system));
+    system.backgroundTaps = kBackgroundTapCount;
+    WJHEventTapSetTapListProvider(busyProvider, &system);
+}
+
+- (void)tearDown {
+    WJHEventTapSetTapListProvider(NULL, NULL);
+    [super tearDown];
+}
+
+- (NSArray*)specificationsWithCount:(NSUInteger)count {
+    NSMutableArray *specifications = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; ++i) {
+        CGEventMask eventMask = (i % 2) ? kCGEventMaskForAllEvents : CGEventMaskBit(kCGEventOtherMouseUp);
+        [specifications addObject:[WJHEventTapSpecification specificationWithProcess:NULL eventMask:eventMask beforeOthers:(i % 3 == 0) passive:(i % 4 == 0) delegate:nil]];
+    }
+    return [specifications copy];
+}
+
+- (NSDictionary*)systemTapsByID {
+    NSMutableDictionary *result = [NSMutableDictionary dictionary];
+    [WJHEventTap enumerateSystemTapsUsingBlock:^(const CGEventTapInformation *tapInfo, BOOL *stop) {
+        result[@(tapInfo->eventTapID)] = [NSValue wjh_valueWithCGEventTapInformation:*tapInfo];
+    }];
+    return result;
+}
+
+
+#pragma mark - Tests
+
+- (void)testTapsMatchSystemTaps {
+    NSArray *specifications = [self specificationsWithCount:kStartupTapCount];
+    NSArray *taps = [WJHEventTap tapsWithSpecifications:specifications runLoop:nil];
+    XCTAssertEqual(specifications.count, taps.count);
+
+    NSDictionary *systemTaps = [self systemTapsByID];
+    NSMutableSet *ids = [NSMutableSet set];
+    for (NSUInteger i = 0; i < taps.count; ++i) {
+        WJHEventTap *tap = taps[i];
+        WJHEventTapSpecification *specification = specifications[i];
+        XCTAssertEqual(specification.eventMask, tap.requestedEventMask);
+        XCTAssertEqual(specification.beforeOthers, tap.beforeOthers);
+        XCTAssertEqual(specification.passive, tap.passive);
+        XCTAssertEqual(kWJHProcessEventTap, tap.location);
+        XCTAssertFalse(tap.isEnabled);
+        [ids addObject:@(tap.eventTapID)];
+
+        CGEventTapInformation info = [systemTaps[@(tap.eventTapID)] wjh_CGEventTapInformationValue];
+        XCTAssertEqual(tap.eventTapID, info.eventTapID);
+        XCTAssertEqual(getpid(), info.tappingProcess);
+        XCTAssertEqual(tap.eventMask, info.eventsOfInterest);
+        XCTAssertEqual(tap.passive ? kCGEventTapOptionListenOnly : kCGEventTapOptionDefault, info.options);
+    }
+    XCTAssertEqual(taps.count, ids.count);
+}
+
+- (void)testTapsShareThread {
+    NSArray *taps = [WJHEventTap tapsWithSpecifications:[self specificationsWithCount:3] thread:nil];
+    XCTAssertEqual(3, taps.count);
+    WJHEventTapThread *thread = [taps.firstObject thread];
+    XCTAssertNotNil(thread);
+    for (WJHEventTap *tap in taps) {
+        XCTAssertEqual(thread, tap.thread);
+        XCTAssertEqual(thread.runLoop, tap.runLoop);
+    }
+}
+
+- (void)testNoSpecifications {
+    XCTAssertEqualObjects(@[], [WJHEventTap tapsWithSpecifications:@[] runLoop:nil]);
+}
+
+- (void)testFailureLeavesNoTaps {
+    uint32_t count = [WJHEventTap systemTapCount];
+    system.failing = YES;
+    XCTAssertNil([WJHEventTap tapsWithSpecifications:[self specificationsWithCount:3] runLoop:nil]);
+    XCTAssertEqual(count, [WJHEventTap systemTapCount]);
+}
+
+- (void)testStartupBenchmark {
+    NSArray *specifications = [self specificationsWithCount:kStartupTapCount];
+
+    system.calls = 0;
+    uint64_t start = mach_absolute_time();
+    @autoreleasepool {
+        NSMutableArray *taps = [NSMutableArray array];
+        for (WJHEventTapSpecification *specification in specifications) {
+            [taps addObject:[[WJHEventTap alloc] initWithProcess:NULL eventMask:specification.eventMask beforeOthers:specification.beforeOthers passive:specification.passive runLoop:nil delegate:nil]];
+        }
+    }
+    double individualTime = nanosecondsSince(start);
+    uint32_t individualCalls = system.calls;
+
+    system.calls = 0;
+    start = mach_absolute_time();
+    @autoreleasepool {
+        XCTAssertNotNil([WJHEventTap tapsWithSpecifications:specifications runLoop:nil]);
+    }
+    double bulkTime = nanosecondsSince(start);
+    uint32_t bulkCalls = system.calls;
+
+    XCTAssertLessThan(bulkCalls, individualCalls);
+    NSLog(@"Creating %lu taps among %u others: one at a time %.2f ms, %u tap list calls; in bulk %.2f ms, %u tap list calls", (unsigned long)kStartupTapCount, kBackgroundTapCount, individualTime / 1e6, individualCalls, bulkTime / 1e6, bulkCalls);
+}
+
+- (void)testPerformanceBulkStartup {
+    NSArray *specifications = [self specificationsWithCount:kStartupTapCount];
+    [self measureBlock:^{
+        @autoreleasepool {
+            [WJHEventTap tapsWithSpecifications:specifications runLoop:nil];
+        }
+    }];
+}
+
+- (void)testPerformanceIndividualStartup {
+    NSArray *specifications = [self specificationsWithCount:kStartupTapCount];
+    [self measureBlock:^{
+        @autoreleasepool {
+            NSMutableArray *taps = [NSMutableArray array];
+            for (WJHEventTapSpecification *specification in specifications) {
+                [taps addObject:[[WJHEventTap alloc] initWithProcess:NULL eventMask:specification.eventMask beforeOthers:specification.beforeOthers passive:specification.passive runLoop:nil delegate:nil]];
+            }
+        }
+    }];
+}
+
+@end
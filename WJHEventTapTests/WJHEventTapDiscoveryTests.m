@@ -0,0 +1,329 @@
+//
+//  WJHEventTapDiscoveryTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+
+/**
+ These tests run discovery against a simulated tap list, so contention can be staged without a window server.
+ */
+@interface WJHEventTapDiscoveryTests : XCTestCase
+@end
+
+enum { kMaxFakeTaps = 64 };
+static pid_t const kMyPid = 100;
+static pid_t const kOtherPid = 200;
+
+typedef struct {
+    CGEventTapInformation taps[kMaxFakeTaps];
+    uint32_t count;
+    uint32_t nextID;
+
+    /// For this many creates, another tap from this process shows up along with ours.
+    uint32_t contendedCreates;
+    uint32_t creates;
+    uint32_t destroys;
+    uint32_t sleeps;
+    uint32_t lastSleep;
+    BOOL failList;
+
+    /// For bulk discovery: the tap created for each request, the location that sees contention, events the system adds to each new tap, and the request whose tap can not be created.
+    WJHEventTapDiscoveryRequest const *requests;
+    uint32_t ownIDs[kMaxFakeTaps];
+    uint32_t contendedTapPoint;
+    CGEventMask extraEvents;
+    size_t failCreateAt;
+} FakeSystem;
+
+static CGError fakeProvider(void *context, uint32_t maxNumberOfTaps, CGEventTapInformation *tapList, uint32_t *eventTapCount) {
+    FakeSystem *system = context;
+    if (system->failList) {
+        return kCGErrorFailure;
+    }
+    if (tapList == NULL) {
+        *eventTapCount = system->count;
+        return kCGErrorSuccess;
+    }
+    uint32_t count = MIN(system->count, maxNumberOfTaps);
+    memcpy(tapList, system->taps, count * sizeof(*tapList));
+    *eventTapCount = count;
+    return kCGErrorSuccess;
+}
+
+static uint32_t addTapAt(FakeSystem *system, pid_t pid, uint32_t tapPoint, CGEventMask eventsOfInterest) {
+    CGEventTapInformation tap = {
+        .eventTapID = system->nextID++,
+        .tapPoint = tapPoint,
+        .eventsOfInterest = eventsOfInterest,
+        .tappingProcess = pid,
+        .processBeingTapped = tapPoint == kWJHProcessEventTap ? pid : 0,
+    };
+    system->taps[system->count++] = tap;
+    return tap.eventTapID;
+}
+
+static void addTap(FakeSystem *system, pid_t pid) {
+    addTapAt(system, pid, kWJHProcessEventTap, 0);
+}
+
+static bool fakeCreate(void *context) {
+    FakeSystem *system = context;
+    ++system->creates;
+    // Other processes creating taps at the same time never confuse discovery.
+    addTap(system, kOtherPid);
+    if (system->contendedCreates) {
+        --system->contendedCreates;
+        addTap(system, kMyPid);
+    }
+    addTap(system, kMyPid);
+    return true;
+}
+
+static void fakeDestroy(void *context) {
+    FakeSystem *system = context;
+    ++system->destroys;
+    --system->count;
+}
+
+static void fakeSleep(void *context, uint32_t microseconds) {
+    FakeSystem *system = context;
+    ++system->sleeps;
+    system->lastSleep = microseconds;
+}
+
+static NSMutableSet *fakeSystemSleeps;
+
+static void recordingSleep(void *context, uint32_t microseconds) {
+    fakeSleep(context, microseconds);
+    [fakeSystemSleeps addObject:@(microseconds)];
+}
+
+static bool fakeBulkCreate(void *context, size_t index) {
+    FakeSystem *system = context;
+    if (index == system->failCreateAt) {
+        return false;
+    }
+    ++system->creates;
+    WJHEventTapDiscoveryRequest const *request = system->requests + index;
+    addTapAt(system, kOtherPid, request->match.tapPoint, request->eventMask);
+    if (system->contendedCreates && request->match.tapPoint == system->contendedTapPoint) {
+        --system->contendedCreates;
+        addTapAt(system, kMyPid, request->match.tapPoint, request->eventMask);
+    }
+    system->ownIDs[index] = addTapAt(system, kMyPid, request->match.tapPoint, request->eventMask | system->extraEvents);
+    return true;
+}
+
+static void fakeBulkDestroy(void *context, size_t index) {
+    FakeSystem *system = context;
+    ++system->destroys;
+    for (uint32_t i = 0; i < system->count; ++i) {
+        if (system->taps[i].eventTapID == system->ownIDs[index]) {
+            memmove(system->taps + i, system->taps + i + 1, (system->count - i - 1) * sizeof(*system->taps));
+            --system->count;
+            break;
+        }
+    }
+    system->ownIDs[index] = 0;
+}
+
+@implementation WJHEventTapDiscoveryTests {
+    FakeSystem system;
+    WJHEventTapList list;
+    WJHEventTapMatch match;
+    WJHEventTapDiscoveryCallbacks callbacks;
+}
+
+- (void)setUp {
+    [super setUp];
+    memset(&system, 0, sizeof(system));
+    system.nextID = 10;
+    addTap(&system, kMyPid);
+    addTap(&system, kOtherPid);
+
+    WJHEventTapListInit(&list, NULL, 0);
+    WJHEventTapListSetProvider(&list, fakeProvider, &system);
+    system.failCreateAt = SIZE_MAX;
+    match = (WJHEventTapMatch){ .tappingProcess = kMyPid, .processBeingTapped = kMyPid, .tapPoint = kWJHProcessEventTap };
+    callbacks = (WJHEventTapDiscoveryCallbacks){ fakeCreate, fakeDestroy, fakeSleep, &system };
+}
+
+- (void)tearDown {
+    WJHEventTapListDestroy(&list);
+    [super tearDown];
+}
+
+- (WJHEventTapDiscoveryRequest)requestAtTapPoint:(uint32_t)tapPoint eventMask:(CGEventMask)eventMask {
+    WJHEventTapDiscoveryRequest request = {
+        .match = { .tappingProcess = kMyPid, .processBeingTapped = tapPoint == kWJHProcessEventTap ? kMyPid : -1, .tapPoint = tapPoint },
+        .eventMask = eventMask,
+    };
+    return request;
+}
+
+- (void)assertResolved:(CGEventTapInformation const *)infos count:(size_t)count {
+    for (size_t i = 0; i < count; ++i) {
+        XCTAssertNotEqual(0, system.ownIDs[i]);
+        XCTAssertEqual(system.ownIDs[i], infos[i].eventTapID, @"request %zu", i);
+    }
+}
+
+#pragma mark - Tests
+
+- (void)testDiffIDs {
+    uint32_t before[] = { 1, 3, 5, 9 };
+    uint32_t after[] = { 1, 2, 3, 4, 5, 6 };
+    uint32_t added[6];
+    XCTAssertEqual(3, WJHEventTapDiffIDs(before, 4, after, 6, added));
+    XCTAssertEqual(2, added[0]);
+    XCTAssertEqual(4, added[1]);
+    XCTAssertEqual(6, added[2]);
+}
+
+- (void)testFindsTapDespiteOtherProcesses {
+    CGEventTapInformation info;
+    uint32_t attempts;
+    XCTAssertEqual(WJHEventTapDiscoveryFound, WJHEventTapDiscover(&list, &match, NULL, &callbacks, &info, &attempts));
+    XCTAssertEqual(1, attempts);
+    XCTAssertEqual(kMyPid, info.tappingProcess);
+    XCTAssertEqual(system.taps[system.count - 1].eventTapID, info.eventTapID);
+    XCTAssertEqual(0, system.destroys);
+}
+
+- (void)testRetriesWithBackoffUnderContention {
+    system.contendedCreates = 3;
+    WJHEventTapDiscoveryPolicy policy = { .maxAttempts = 8, .initialBackoffMicroseconds = 10, .maxBackoffMicroseconds = 50 };
+    CGEventTapInformation info;
+    uint32_t attempts;
+    XCTAssertEqual(WJHEventTapDiscoveryFound, WJHEventTapDiscover(&list, &match, &policy, &callbacks, &info, &attempts));
+    XCTAssertEqual(4, attempts);
+    XCTAssertEqual(3, system.destroys);
+    XCTAssertEqual(3, system.sleeps);
+    XCTAssertEqual(40, system.lastSleep);
+}
+
+- (void)testBackoffIsJittered {
+    system.contendedCreates = UINT32_MAX;
+    WJHEventTapDiscoveryPolicy policy = { .maxAttempts = 24, .initialBackoffMicroseconds = 1000, .maxBackoffMicroseconds = 1000, .jitterPercent = 50 };
+    CGEventTapInformation info;
+    fakeSystemSleeps = [NSMutableSet set];
+    callbacks.sleep = recordingSleep;
+    XCTAssertEqual(WJHEventTapDiscoveryExhausted, WJHEventTapDiscover(&list, &match, &policy, &callbacks, &info, NULL));
+    XCTAssertEqual(23, system.sleeps);
+    for (NSNumber *pause in fakeSystemSleeps) {
+        XCTAssertGreaterThanOrEqual(pause.unsignedIntValue, 500);
+        XCTAssertLessThanOrEqual(pause.unsignedIntValue, 1000);
+    }
+    // Twenty-three pauses spread over 501 values are all but certain to differ.
+    XCTAssertGreaterThan(fakeSystemSleeps.count, 1);
+    fakeSystemSleeps = nil;
+}
+
+- (void)testGivesUpAfterMaxAttempts {
+    system.contendedCreates = UINT32_MAX;
+    WJHEventTapDiscoveryPolicy policy = { .maxAttempts = 5, .initialBackoffMicroseconds = 10, .maxBackoffMicroseconds = 50 };
+    CGEventTapInformation info;
+    uint32_t attempts;
+    XCTAssertEqual(WJHEventTapDiscoveryExhausted, WJHEventTapDiscover(&list, &match, &policy, &callbacks, &info, &attempts));
+    XCTAssertEqual(5, attempts);
+    XCTAssertEqual(5, system.creates);
+    XCTAssertEqual(5, system.destroys);
+    XCTAssertEqual(50, system.lastSleep);
+}
+
+- (void)testListFailure {
+    system.failList = YES;
+    CGEventTapInformation info;
+    XCTAssertEqual(WJHEventTapDiscoveryListFailed, WJHEventTapDiscover(&list, &match, NULL, &callbacks, &info, NULL));
+    XCTAssertEqual(0, system.creates);
+}
+
+- (void)testDiscoverManyResolvesIdenticalTapsInOneRound {
+    enum { kCount = 5 };
+    WJHEventTapDiscoveryRequest requests[kCount];
+    for (int i = 0; i < kCount; ++i) {
+        requests[i] = [self requestAtTapPoint:kWJHProcessEventTap eventMask:kCGEventMaskForAllEvents];
+    }
+    system.requests = requests;
+    WJHEventTapBulkDiscoveryCallbacks bulkCallbacks = { fakeBulkCreate, fakeBulkDestroy, fakeSleep, &system };
+
+    CGEventTapInformation infos[kCount];
+    uint32_t rounds;
+    XCTAssertEqual(WJHEventTapDiscoveryFound, WJHEventTapDiscoverMany(&list, requests, kCount, NULL, &bulkCallbacks, infos, &rounds));
+    XCTAssertEqual(1, rounds);
+    XCTAssertEqual(kCount, system.creates);
+    XCTAssertEqual(0, system.destroys);
+    [self assertResolved:infos count:kCount];
+}
+
+- (void)testDiscoverManyRetriesOnlyAmbiguousTaps {
+    enum { kCount = 5 };
+    WJHEventTapDiscoveryRequest requests[kCount] = {
+        [self requestAtTapPoint:kWJHProcessEventTap eventMask:CGEventMaskBit(kCGEventKeyDown)],
+        [self requestAtTapPoint:kCGSessionEventTap eventMask:CGEventMaskBit(kCGEventKeyDown)],
+        [self requestAtTapPoint:kWJHProcessEventTap eventMask:CGEventMaskBit(kCGEventKeyUp)],
+        [self requestAtTapPoint:kCGSessionEventTap eventMask:CGEventMaskBit(kCGEventKeyUp)],
+        [self requestAtTapPoint:kWJHProcessEventTap eventMask:CGEventMaskBit(kCGEventMouseMoved)],
+    };
+    system.requests = requests;
+    system.contendedTapPoint = kCGSessionEventTap;
+    system.contendedCreates = 1;
+    WJHEventTapBulkDiscoveryCallbacks bulkCallbacks = { fakeBulkCreate, fakeBulkDestroy, fakeSleep, &system };
+
+    CGEventTapInformation infos[kCount];
+    uint32_t rounds;
+    XCTAssertEqual(WJHEventTapDiscoveryFound, WJHEventTapDiscoverMany(&list, requests, kCount, NULL, &bulkCallbacks, infos, &rounds));
+    XCTAssertEqual(2, rounds);
+    XCTAssertEqual(kCount + 2, system.creates);
+    XCTAssertEqual(2, system.destroys);
+    XCTAssertEqual(1, system.sleeps);
+    [self assertResolved:infos count:kCount];
+    for (size_t i = 0; i < kCount; ++i) {
+        XCTAssertEqual(requests[i].eventMask, infos[i].eventsOfInterest);
+    }
+}
+
+- (void)testDiscoverManyRejectsUnrequestedEvents {
+    enum { kCount = 3 };
+    WJHEventTapDiscoveryRequest requests[kCount];
+    for (int i = 0; i < kCount; ++i) {
+        requests[i] = [self requestAtTapPoint:kWJHProcessEventTap eventMask:CGEventMaskBit(kCGEventKeyDown)];
+    }
+    system.requests = requests;
+    system.extraEvents = CGEventMaskBit(kCGEventKeyUp);
+    uint32_t const originalCount = system.count;
+    WJHEventTapBulkDiscoveryCallbacks bulkCallbacks = { fakeBulkCreate, fakeBulkDestroy, fakeSleep, &system };
+    WJHEventTapDiscoveryPolicy policy = { .maxAttempts = 3, .initialBackoffMicroseconds = 10, .maxBackoffMicroseconds = 50 };
+
+    CGEventTapInformation infos[kCount];
+    uint32_t rounds;
+    XCTAssertEqual(WJHEventTapDiscoveryExhausted, WJHEventTapDiscoverMany(&list, requests, kCount, &policy, &bulkCallbacks, infos, &rounds));
+    XCTAssertEqual(3, rounds);
+    XCTAssertEqual(system.creates, system.destroys);
+
+    // Only the taps of other processes remain.
+    XCTAssertEqual(originalCount + system.creates, system.count);
+}
+
+- (void)testDiscoverManyCreateFailureDestroysEveryTap {
+    enum { kCount = 4 };
+    WJHEventTapDiscoveryRequest requests[kCount];
+    for (int i = 0; i < kCount; ++i) {
+        requests[i] = [self requestAtTapPoint:kWJHProcessEventTap eventMask:kCGEventMaskForAllEvents];
+    }
+    system.requests = requests;
+    system.failCreateAt = 2;
+    WJHEventTapBulkDiscoveryCallbacks bulkCallbacks = { fakeBulkCreate, fakeBulkDestroy, fakeSleep, &system };
+
+    CGEventTapInformation infos[kCount];
+    XCTAssertEqual(WJHEventTapDiscoveryCreateFailed, WJHEventTapDiscoverMany(&list, requests, kCount, NULL, &bulkCallbacks, infos, NULL));
+    XCTAssertEqual(2, system.creates);
+    XCTAssertEqual(2, system.destroys);
+}
+
+@end
@@ -0,0 +1,227 @@
+//
+//  WJHEventTapDispatchTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+
+/**
+ These tests drive the tap with synthetic events, through WJHEventTapDispatchEvent, so they do not need a window server, accessibility authorization, or an actual CGEventTap.
+ */
+@interface WJHEventTapDispatchTests : XCTestCase
+@end
+
+/// A delegate that only implements a couple of the per-type methods.
+@interface WJHSparseDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, assign) NSUInteger mouseMovedCount;
+@property (nonatomic, assign) NSUInteger unknownCount;
+@end
+
+@implementation WJHSparseDelegate
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    ++_mouseMovedCount;
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap unknownEvent:(CGEventRef)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    ++_unknownCount;
+    return event;
+}
+@end
+
+
+static NSUInteger const kSyntheticEventCount = 1000;
+static NSUInteger const kBenchmarkIterations = 1000;
+
+/**
+ A representative mix of mouse-heavy synthetic events.  Events are created without an event source, which does not require a connection to the window server.
+ */
+static NSArray *makeSyntheticEvents() {
+    static CGEventType const types[] = {
+        kCGEventMouseMoved, kCGEventMouseMoved, kCGEventMouseMoved, kCGEventMouseMoved,
+        kCGEventLeftMouseDragged, kCGEventLeftMouseDragged,
+        kCGEventLeftMouseDown, kCGEventLeftMouseUp,
+        kCGEventScrollWheel, kCGEventKeyDown, kCGEventKeyUp, kCGEventFlagsChanged,
+    };
+    NSMutableArray *events = [NSMutableArray arrayWithCapacity:kSyntheticEventCount];
+    for (NSUInteger i = 0; i < kSyntheticEventCount; ++i) {
+        CGEventRef event = CGEventCreate(NULL);
+        CGEventSetType(event, types[i % (sizeof(types) / sizeof(*types))]);
+        CGEventSetLocation(event, CGPointMake(i % 1024, i % 768));
+        [events addObject:CFBridgingRelease(event)];
+    }
+    return [events copy];
+}
+
+/**
+ The dispatch algorithm as it was before the dispatch table, kept here as the baseline for the benchmark.
+ */
+static CGEventRef legacyDispatch(WJHEventTap *tap, id<WJHEventTapDelegate> delegate, CGEventType type, CGEventRef event) {
+    if ([delegate respondsToSelector:@selector(eventTap:receivedEvent:type:proxy:)]) {
+        CGEventRef tmpEvent = event;
+        if ([delegate eventTap:tap receivedEvent:&tmpEvent type:type proxy:NULL]) {
+            return tmpEvent;
+        }
+    }
+#define invokeDelegate(_name_) \
+if ([delegate respondsToSelector:@selector(eventTap:_name_:proxy:)]) { \
+return [delegate eventTap:tap _name_:event proxy:NULL]; \
+} break
+    switch (type) {
+        case kCGEventLeftMouseDown:
+            invokeDelegate(leftMouseDownEvent);
+        case kCGEventLeftMouseDragged:
+            invokeDelegate(leftMouseDraggedEvent);
+        case kCGEventLeftMouseUp:
+            invokeDelegate(leftMouseUpEvent);
+        case kCGEventMouseMoved:
+            invokeDelegate(mouseMovedEvent);
+        case kCGEventKeyDown:
+            invokeDelegate(keyDownEvent);
+        case kCGEventKeyUp:
+            invokeDelegate(keyUpEvent);
+        case kCGEventFlagsChanged:
+            invokeDelegate(modifierFlagsChangedEvent);
+        case kCGEventScrollWheel:
+            invokeDelegate(scrollWheelEvent);
+        default:
+            if ([delegate respondsToSelector:@selector(eventTap:unknownEvent:type:proxy:)]) {
+                return [delegate eventTap:tap unknownEvent:event type:type proxy:NULL];
+            }
+            break;
+    }
+#undef invokeDelegate
+    return event;
+}
+
+static double nanosecondsPerEvent(NSUInteger eventCount, void(^block)(void)) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    uint64_t start = mach_absolute_time();
+    block();
+    uint64_t elapsed = mach_absolute_time() - start;
+    return (double)elapsed * timebase.numer / timebase.denom / eventCount;
+}
+
+@implementation WJHEventTapDispatchTests
+
+#pragma mark - Tests
+
+- (void)testDispatchesToImplementedMethod {
+    WJHSparseDelegate *delegate = [WJHSparseDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    CGEventRef event = CGEventCreate(NULL);
+    CGEventSetType(event, kCGEventMouseMoved);
+
+    XCTAssertEqual(event, WJHEventTapDispatchEvent(tap, NULL, kCGEventMouseMoved, event));
+    XCTAssertEqual(1, delegate.mouseMovedCount);
+
+    // Known types without an implementation are not delivered to the unknown handler.
+    XCTAssertEqual(event, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, event));
+    XCTAssertEqual(0, delegate.unknownCount);
+
+    // Types without a dedicated method are.
+    XCTAssertEqual(event, WJHEventTapDispatchEvent(tap, NULL, (CGEventType)29, event));
+    XCTAssertEqual(event, WJHEventTapDispatchEvent(tap, NULL, (CGEventType)1000, event));
+    XCTAssertEqual(2, delegate.unknownCount);
+    CFRelease(event);
+}
+
+- (void)testReceivedEventShortCircuits {
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    __block NSUInteger keyDownCount = 0;
+    delegate.receivedEvent = ^BOOL(WJHEventTap *eventTap, CGEventRef *event, CGEventType type, CGEventTapProxy proxy) {
+        *event = NULL;
+        return type == kCGEventKeyUp;
+    };
+    delegate.keyDownEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        ++keyDownCount;
+        return event;
+    };
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    CGEventRef event = CGEventCreate(NULL);
+
+    XCTAssertEqual(NULL, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyUp, event));
+    XCTAssertEqual(event, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, event));
+    XCTAssertEqual(1, keyDownCount);
+    CFRelease(event);
+}
+
+- (void)testChangingDelegateRebuildsTable {
+    WJHSparseDelegate *first = [WJHSparseDelegate new];
+    WJHSparseDelegate *second = [WJHSparseDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:first];
+    CGEventRef event = CGEventCreate(NULL);
+
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventMouseMoved, event);
+    tap.delegate = second;
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventMouseMoved, event);
+    tap.delegate = nil;
+    XCTAssertEqual(event, WJHEventTapDispatchEvent(tap, NULL, kCGEventMouseMoved, event));
+
+    XCTAssertEqual(1, first.mouseMovedCount);
+    XCTAssertEqual(1, second.mouseMovedCount);
+    CFRelease(event);
+}
+
+
+#pragma mark - Benchmarks
+
+- (void)testPerformanceDispatchTable {
+    NSArray *events = makeSyntheticEvents();
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:[WJHSparseDelegate new]];
+    [self measureBlock:^{
+        for (NSUInteger n = 0; n < kBenchmarkIterations; ++n) {
+            for (id event in events) {
+                CGEventRef e = (__bridge CGEventRef)event;
+                WJHEventTapDispatchEvent(tap, NULL, CGEventGetType(e), e);
+            }
+        }
+    }];
+}
+
+- (void)testPerformanceLegacyDispatch {
+    NSArray *events = makeSyntheticEvents();
+    id<WJHEventTapDelegate> delegate = [WJHSparseDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    [self measureBlock:^{
+        for (NSUInteger n = 0; n < kBenchmarkIterations; ++n) {
+            for (id event in events) {
+                CGEventRef e = (__bridge CGEventRef)event;
+                legacyDispatch(tap, tap.delegate, CGEventGetType(e), e);
+            }
+        }
+    }];
+}
+
+- (void)testDispatchTableNanosecondsPerEvent {
+    NSArray *events = makeSyntheticEvents();
+    NSUInteger const total = kBenchmarkIterations * events.count;
+
+    for (id<WJHEventTapDelegate> delegate in @[[WJHSparseDelegate new], [WJHEventTapDelegate new]]) {
+        WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+        double before = nanosecondsPerEvent(total, ^{
+            for (NSUInteger n = 0; n < kBenchmarkIterations; ++n) {
+                for (id event in events) {
+                    CGEventRef e = (__bridge CGEventRef)event;
+                    legacyDispatch(tap, tap.delegate, CGEventGetType(e), e);
+                }
+            }
+        });
+        double after = nanosecondsPerEvent(total, ^{
+            for (NSUInteger n = 0; n < kBenchmarkIterations; ++n) {
+                for (id event in events) {
+                    CGEventRef e = (__bridge CGEventRef)event;
+                    WJHEventTapDispatchEvent(tap, NULL, CGEventGetType(e), e);
+                }
+            }
+        });
+        NSLog(@"%@: respondsToSelector: dispatch %.1f ns/event, dispatch table %.1f ns/event", [delegate class], before, after);
+    }
+}
+
+@end
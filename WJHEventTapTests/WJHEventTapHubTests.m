@@ -0,0 +1,275 @@
+//
+//  WJHEventTapHubTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHCoreChecks.h"
+
+@interface WJHEventTapHubTests : XCTestCase
+@end
+
+static uint32_t const kBenchmarkEventCount = 1000000;
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+/// A synthetic subscriber, which appends its name to a trace, and does what it is told with the event.
+typedef struct TraceSubscriber {
+    char name;
+    char *trace;
+    void *replacement;
+    bool drop;
+    WJHEventHub *hub;
+    uint64_t removeID;
+    WJHEventHubSubscriber const *add;
+} TraceSubscriber;
+
+static void * traceCallback(void *context, uint32_t type, void *event, void *info) {
+    TraceSubscriber *subscriber = context;
+    size_t length = strlen(subscriber->trace);
+    subscriber->trace[length] = subscriber->name;
+    subscriber->trace[length + 1] = '\0';
+    if (subscriber->removeID) {
+        WJHEventHubRemove(subscriber->hub, subscriber->removeID);
+    }
+    if (subscriber->add) {
+        WJHEventHubAdd(subscriber->hub, subscriber->add);
+    }
+    if (subscriber->drop) {
+        return NULL;
+    }
+    return subscriber->replacement ?: event;
+}
+
+static WJHEventHubSubscriber makeSubscriber(TraceSubscriber *subscriber, uint64_t eventMask, bool beforeOthers) {
+    return (WJHEventHubSubscriber){
+        .eventMask = eventMask,
+        .beforeOthers = beforeOthers,
+        .callback = traceCallback,
+        .context = subscriber,
+    };
+}
+
+/// Records the events it is given, and what it does with them.
+@interface WJHHubDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, assign) NSUInteger count;
+@property (nonatomic, assign) BOOL drop;
+@property (nonatomic, copy) void (^onEvent)(void);
+@end
+
+@implementation WJHHubDelegate
+- (BOOL)eventTap:(WJHEventTap*)eventTap receivedEvent:(CGEventRef*)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    ++_count;
+    if (_onEvent) {
+        _onEvent();
+    }
+    if (_drop) {
+        *event = NULL;
+    }
+    return YES;
+}
+@end
+
+@implementation WJHEventTapHubTests {
+    WJHEventHub *hub;
+    char trace[64];
+}
+
+- (void)setUp {
+    [super setUp];
+    hub = WJHEventHubCreate(false);
+    trace[0] = '\0';
+}
+
+- (void)tearDown {
+    WJHEventHubDestroy(hub);
+    [super tearDown];
+}
+
+- (NSString *)trace {
+    return [NSString stringWithUTF8String:trace];
+}
+
+
+#pragma mark - Hub
+
+- (void)testChainOrder {
+    TraceSubscriber a = { 'a', trace }, b = { 'b', trace }, c = { 'c', trace }, d = { 'd', trace };
+    WJHEventHubSubscriber sa = makeSubscriber(&a, ~0ULL, false), sb = makeSubscriber(&b, ~0ULL, true), sc = makeSubscriber(&c, ~0ULL, false), sd = makeSubscriber(&d, ~0ULL, true);
+    WJHEventHubAdd(hub, &sa);
+    WJHEventHubAdd(hub, &sb);
+    WJHEventHubAdd(hub, &sc);
+    WJHEventHubAdd(hub, &sd);
+    XCTAssertEqual(4, WJHEventHubCount(hub));
+
+    WJHEventHubDispatch(hub, kCGEventKeyDown, trace, NULL);
+    XCTAssertEqualObjects(@"dbac", self.trace);
+}
+
+- (void)testMasks {
+    TraceSubscriber a = { 'a', trace }, b = { 'b', trace };
+    WJHEventHubSubscriber sa = makeSubscriber(&a, CGEventMaskBit(kCGEventKeyDown), false), sb = makeSubscriber(&b, CGEventMaskBit(kCGEventKeyUp), false);
+    XCTAssertEqual(0, WJHEventHubEventMask(hub));
+    uint64_t ida = WJHEventHubAdd(hub, &sa);
+    uint64_t idb = WJHEventHubAdd(hub, &sb);
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyDown) | CGEventMaskBit(kCGEventKeyUp), WJHEventHubEventMask(hub));
+
+    WJHEventHubDispatch(hub, kCGEventKeyUp, trace, NULL);
+    WJHEventHubDispatch(hub, kCGEventMouseMoved, trace, NULL);
+    WJHEventHubDispatch(hub, kCGEventTapDisabledByTimeout, trace, NULL);
+    XCTAssertEqualObjects(@"bab", self.trace);
+
+    XCTAssertTrue(WJHEventHubRemove(hub, ida));
+    XCTAssertFalse(WJHEventHubRemove(hub, ida));
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyUp), WJHEventHubEventMask(hub));
+    XCTAssertTrue(WJHEventHubRemove(hub, idb));
+    XCTAssertEqual(0, WJHEventHubEventMask(hub));
+}
+
+- (void)testModifyAndDrop {
+    int original, replacement;
+    TraceSubscriber a = { 'a', trace, &replacement }, b = { 'b', trace }, c = { 'c', trace };
+    WJHEventHubSubscriber sa = makeSubscriber(&a, ~0ULL, false), sb = makeSubscriber(&b, ~0ULL, false), sc = makeSubscriber(&c, ~0ULL, false);
+    WJHEventHubAdd(hub, &sa);
+    WJHEventHubAdd(hub, &sb);
+    WJHEventHubAdd(hub, &sc);
+
+    XCTAssertEqual(&replacement, WJHEventHubDispatch(hub, kCGEventKeyDown, &original, NULL));
+    b.drop = true;
+    XCTAssertTrue(WJHEventHubDispatch(hub, kCGEventKeyDown, &original, NULL) == NULL);
+    XCTAssertEqualObjects(@"abcab", self.trace);
+}
+
+- (void)testPassiveIgnoresResults {
+    WJHEventHub *passive = WJHEventHubCreate(true);
+    int original, replacement;
+    TraceSubscriber a = { 'a', trace, &replacement }, b = { 'b', trace };
+    b.drop = true;
+    WJHEventHubSubscriber sa = makeSubscriber(&a, ~0ULL, false), sb = makeSubscriber(&b, ~0ULL, false);
+    WJHEventHubAdd(passive, &sb);
+    WJHEventHubAdd(passive, &sa);
+
+    XCTAssertEqual(&original, WJHEventHubDispatch(passive, kCGEventKeyDown, &original, NULL));
+    XCTAssertEqualObjects(@"ba", self.trace);
+    WJHEventHubDestroy(passive);
+}
+
+- (void)testChangesDuringDispatchTakeEffectWithNextEvent {
+    TraceSubscriber a = { 'a', trace }, b = { 'b', trace }, c = { 'c', trace };
+    WJHEventHubSubscriber sa = makeSubscriber(&a, ~0ULL, false), sb = makeSubscriber(&b, ~0ULL, false), sc = makeSubscriber(&c, ~0ULL, true);
+    WJHEventHubAdd(hub, &sa);
+    uint64_t idb = WJHEventHubAdd(hub, &sb);
+    a.hub = hub;
+    a.removeID = idb;
+    a.add = &sc;
+
+    WJHEventHubDispatch(hub, kCGEventKeyDown, trace, NULL);
+    XCTAssertEqualObjects(@"ab", self.trace);
+    a.removeID = 0;
+    a.add = NULL;
+    WJHEventHubDispatch(hub, kCGEventKeyDown, trace, NULL);
+    XCTAssertEqualObjects(@"abca", self.trace);
+}
+
+- (void)testCoreChecks {
+    WJHChecks checks = { .log = stderr };
+    WJHEventHubChecks(&checks);
+    XCTAssertEqual(0, checks.failed);
+}
+
+
+#pragma mark - Subscribers
+
+- (void)testSubscribersShareOneChain {
+    WJHEventTapHub *tapHub = [[WJHEventTapHub alloc] initDetachedWithPassive:NO];
+    WJHHubDelegate *first = [WJHHubDelegate new], *second = [WJHHubDelegate new], *third = [WJHHubDelegate new];
+    WJHEventTap *tail = [tapHub subscribeWithEventMask:CGEventMaskBit(kCGEventKeyDown) beforeOthers:NO delegate:second];
+    WJHEventTap *head = [tapHub subscribeWithEventMask:kCGEventMaskForAllEvents beforeOthers:YES delegate:first];
+    WJHEventTap *keyUp = [tapHub subscribeWithEventMask:CGEventMaskBit(kCGEventKeyUp) beforeOthers:NO delegate:third];
+    XCTAssertEqualObjects((@[head, tail, keyUp]), tapHub.subscribers);
+    XCTAssertEqual(kCGEventMaskForAllEvents, tapHub.eventMask);
+    XCTAssertNil(tapHub.tap);
+    XCTAssertFalse(head.isEnabled);
+
+    CGEventRef event = CGEventCreateKeyboardEvent(NULL, 12, true);
+    WJHEventTapHubDispatchEvent(tapHub, NULL, kCGEventKeyDown, event);
+    XCTAssertEqual(0, first.count + second.count + third.count);
+
+    head.enabled = tail.enabled = keyUp.enabled = YES;
+    XCTAssertEqual(event, WJHEventTapHubDispatchEvent(tapHub, NULL, kCGEventKeyDown, event));
+    XCTAssertEqual(1, first.count);
+    XCTAssertEqual(1, second.count);
+    XCTAssertEqual(0, third.count);
+
+    first.drop = YES;
+    XCTAssertTrue(WJHEventTapHubDispatchEvent(tapHub, NULL, kCGEventKeyDown, event) == NULL);
+    XCTAssertEqual(2, first.count);
+    XCTAssertEqual(1, second.count);
+
+    [tapHub unsubscribe:head];
+    XCTAssertEqual(CGEventMaskBit(kCGEventKeyDown) | CGEventMaskBit(kCGEventKeyUp), tapHub.eventMask);
+    XCTAssertEqual(event, WJHEventTapHubDispatchEvent(tapHub, NULL, kCGEventKeyDown, event));
+    XCTAssertEqual(2, first.count);
+    XCTAssertEqual(2, second.count);
+    CFRelease(event);
+}
+
+- (void)testUnsubscribeFromCallback {
+    WJHEventTapHub *tapHub = [[WJHEventTapHub alloc] initDetachedWithPassive:YES];
+    WJHHubDelegate *first = [WJHHubDelegate new], *second = [WJHHubDelegate new];
+    WJHEventTap *tap = [tapHub subscribeWithEventMask:kCGEventMaskForAllEvents beforeOthers:NO delegate:first];
+    __weak WJHEventTap *weakOther;
+    @autoreleasepool {
+        WJHEventTap *other = [tapHub subscribeWithEventMask:kCGEventMaskForAllEvents beforeOthers:NO delegate:second];
+        tap.enabled = other.enabled = YES;
+        weakOther = other;
+    }
+    __weak WJHEventTapHub *weakHub = tapHub;
+    first.onEvent = ^{
+        [weakHub unsubscribe:weakOther];
+    };
+
+    CGEventRef event = CGEventCreateKeyboardEvent(NULL, 12, true);
+    WJHEventTapHubDispatchEvent(tapHub, NULL, kCGEventKeyDown, event);
+    XCTAssertEqual(1, second.count);
+    XCTAssertNil(weakOther);
+    WJHEventTapHubDispatchEvent(tapHub, NULL, kCGEventKeyDown, event);
+    XCTAssertEqual(2, first.count);
+    XCTAssertEqual(1, second.count);
+    XCTAssertEqualObjects(@[tap], tapHub.subscribers);
+    CFRelease(event);
+}
+
+
+#pragma mark - Benchmarks
+
+- (void)testFanOutBenchmark {
+    WJHEventHub *passive = WJHEventHubCreate(true);
+    TraceSubscriber subscribers[16];
+    char scratch[32];
+    for (int i = 0; i < 16; ++i) {
+        subscribers[i] = (TraceSubscriber){ 'a' + i, scratch };
+        WJHEventHubSubscriber subscriber = makeSubscriber(subscribers + i, ~0ULL, i % 2);
+        WJHEventHubAdd(passive, &subscriber);
+    }
+
+    uint64_t start = mach_absolute_time();
+    for (uint32_t i = 0; i < kBenchmarkEventCount; ++i) {
+        scratch[0] = '\0';
+        WJHEventHubDispatch(passive, kCGEventMouseMoved, scratch, NULL);
+    }
+    double time = nanosecondsSince(start) / kBenchmarkEventCount;
+    WJHEventHubDestroy(passive);
+    NSLog(@"Hub fan-out to 16 subscribers: %.1f ns/event", time);
+}
+
+@end
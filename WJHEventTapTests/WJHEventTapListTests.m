@@ -0,0 +1,151 @@
+//
+//  WJHEventTapListTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <malloc/malloc.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+
+@interface WJHEventTapListTests : XCTestCase
+@end
+
+static NSUInteger const kPollCount = 10000;
+
+static size_t blocksInUse() {
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return stats.blocks_in_use;
+}
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+@implementation WJHEventTapListTests {
+    WJHEventTap *tap;
+}
+
+- (void)setUp {
+    [super setUp];
+    // Make sure there is at least one tap installed.
+    tap = [[WJHEventTap alloc] initWithProcess:nil eventMask:kCGEventMaskForAllEvents beforeOthers:YES passive:YES runLoop:nil delegate:nil];
+}
+
+- (void)tearDown {
+    tap = nil;
+    [super tearDown];
+}
+
+
+#pragma mark - Tests
+
+- (void)testMatchesSystemTaps {
+    WJHEventTapList list;
+    WJHEventTapListInit(&list, NULL, 0);
+    CGEventTapInformation const *taps;
+    uint32_t count;
+    XCTAssertEqual(kCGErrorSuccess, WJHEventTapListRefresh(&list, &taps, &count));
+
+    NSArray *boxed = [WJHEventTap systemTaps];
+    XCTAssertEqual(boxed.count, count);
+    for (NSUInteger i = 0; i < boxed.count && i < count; ++i) {
+        CGEventTapInformation ti = [boxed[i] wjh_CGEventTapInformationValue];
+        XCTAssertEqual(0, memcmp(taps + i, &ti, sizeof(ti)));
+    }
+    WJHEventTapListDestroy(&list);
+}
+
+- (void)testOwnedStorageGrows {
+    WJHEventTapList list;
+    WJHEventTapListInit(&list, NULL, 1);
+    uint32_t count;
+    XCTAssertEqual(kCGErrorSuccess, WJHEventTapListRefresh(&list, NULL, &count));
+    XCTAssertEqual([WJHEventTap systemTapCount], count);
+    XCTAssertFalse(list.truncated);
+    XCTAssertGreaterThan(list.capacity, count);
+    WJHEventTapListDestroy(&list);
+}
+
+- (void)testCallerStorageTruncates {
+    CGEventTapInformation storage[1];
+    WJHEventTapList list;
+    WJHEventTapListInit(&list, storage, 0);
+    uint32_t count;
+    XCTAssertEqual(kCGErrorSuccess, WJHEventTapListRefresh(&list, NULL, &count));
+    XCTAssertEqual(0, count);
+    XCTAssertTrue(list.truncated);
+    XCTAssertEqual(storage, list.taps);
+    WJHEventTapListDestroy(&list);
+}
+
+- (void)testEnumerateStops {
+    __block NSUInteger calls = 0;
+    [WJHEventTap enumerateSystemTapsUsingBlock:^(CGEventTapInformation const *tapInfo, BOOL *stop) {
+        ++calls;
+        *stop = YES;
+    }];
+    XCTAssertEqual(1, calls);
+}
+
+
+#pragma mark - Benchmarks
+
+- (void)testPerformanceBoxedPoll {
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < kPollCount; ++i) {
+            @autoreleasepool {
+                [WJHEventTap systemTaps];
+            }
+        }
+    }];
+}
+
+- (void)testPerformanceReusedListPoll {
+    WJHEventTapList list;
+    WJHEventTapListInit(&list, NULL, 0);
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < kPollCount; ++i) {
+            WJHEventTapListRefresh(&list, NULL, NULL);
+        }
+    }];
+    WJHEventTapListDestroy(&list);
+}
+
+- (void)testAllocationsAndTimePerPoll {
+    WJHEventTapList list;
+    WJHEventTapListInit(&list, NULL, 0);
+    WJHEventTapListRefresh(&list, NULL, NULL);
+
+    size_t boxedBlocks, listBlocks;
+    double boxedTime, listTime;
+    @autoreleasepool {
+        size_t before = blocksInUse();
+        uint64_t start = mach_absolute_time();
+        for (NSUInteger i = 0; i < kPollCount; ++i) {
+            [WJHEventTap systemTaps];
+        }
+        boxedTime = nanosecondsSince(start) / kPollCount;
+        boxedBlocks = blocksInUse() - before;
+    }
+    @autoreleasepool {
+        size_t before = blocksInUse();
+        uint64_t start = mach_absolute_time();
+        for (NSUInteger i = 0; i < kPollCount; ++i) {
+            WJHEventTapListRefresh(&list, NULL, NULL);
+        }
+        listTime = nanosecondsSince(start) / kPollCount;
+        listBlocks = blocksInUse() - before;
+    }
+
+    NSLog(@"Polling %u taps: systemTaps %.0f ns/poll, %.1f live blocks/poll; WJHEventTapList %.0f ns/poll, %.1f live blocks/poll", list.count, boxedTime, (double)boxedBlocks / kPollCount, listTime, (double)listBlocks / kPollCount);
+    XCTAssertEqual(0, listBlocks);
+    WJHEventTapListDestroy(&list);
+}
+
+@end
@@ -0,0 +1,285 @@
+//
+//  WJHEventTapTemplateTests.mm
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#include <WJHEventTap/WJHEventTap.hpp>
+#include <atomic>
+
+@interface WJHEventTapTemplateTests : XCTestCase
+@end
+
+// From <linux/input-event-codes.h>.
+enum {
+    kEvSyn = 0x00,
+    kEvKey = 0x01,
+    kEvRel = 0x02,
+    kRelX = 0x00,
+    kKeyA = 30,
+};
+
+static WJHEvdevInputEvent inputEvent(uint16_t type, uint16_t code, int32_t value) {
+    static int64_t microseconds;
+    ++microseconds;
+    return WJHEvdevInputEvent{ microseconds / 1000000, microseconds % 1000000, type, code, value };
+}
+
+/// A key press, and a mouse move.
+static WJHEvdevInputEvent const kEvents[] = {
+    inputEvent(kEvKey, kKeyA, 1), inputEvent(kEvSyn, 0, 0),
+    inputEvent(kEvKey, kKeyA, 0), inputEvent(kEvSyn, 0, 0),
+    inputEvent(kEvRel, kRelX, 5), inputEvent(kEvSyn, 0, 0),
+};
+
+/// Counts keys, and drops key ups of the A key.
+struct KeyHandler {
+    int downs = 0;
+    int ups = 0;
+
+    void keyDown(WJHEventRecord &record) {
+        ++downs;
+    }
+    bool keyUp(WJHEventRecord &record) {
+        ++ups;
+        return record.keycode != 0x00;
+    }
+};
+
+/// Drops key downs, and counts everything else.
+struct UnknownHandler {
+    int unknown = 0;
+
+    bool keyDown(WJHEventRecord &record) {
+        return false;
+    }
+    void unknownEvent(WJHEventRecord &record) {
+        ++unknown;
+    }
+};
+
+struct EmptyHandler {
+};
+
+/// Its own handler.
+class CountingTap : public wjh::EventTap<CountingTap> {
+public:
+    explicit CountingTap(WJHEvdevOptions const &options) : EventTap(*this, kWJHEvdevBackend, &options, true) {}
+    void mouseMoved(WJHEventRecord &record) {
+        ++moves;
+    }
+    int moves = 0;
+};
+
+struct ThreadHandler {
+    std::atomic<int> ups{0};
+
+    void keyUp(WJHEventRecord &record) {
+        ++ups;
+    }
+};
+
+/// Drops key downs of the A key, and turns key ups into key ups of the S key.
+struct EventHandler {
+    int downs = 0;
+    int ups = 0;
+
+    bool keyDown(CGEventRef &event) {
+        ++downs;
+        return CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode) != 0x00;
+    }
+    void keyUp(CGEventRef &event) {
+        ++ups;
+        CGEventSetIntegerValueField(event, kCGKeyboardEventKeycode, 0x01);
+    }
+};
+
+/// Counts every event it is given.
+@interface WJHTemplateTestDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, assign) NSUInteger count;
+@end
+
+@implementation WJHTemplateTestDelegate
+- (BOOL)eventTap:(WJHEventTap*)eventTap receivedEvent:(CGEventRef*)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    ++_count;
+    return YES;
+}
+@end
+
+static_assert(wjh::eventMaskFor<EventHandler, CGEventRef>() == (CGEventMaskBit(kCGEventKeyDown) | CGEventMaskBit(kCGEventKeyUp)), "the mask is the handled types");
+static_assert(wjh::eventMaskFor<EventHandler>() == 0, "a tap handler handles no records");
+static_assert(wjh::eventMaskFor<KeyHandler>() == ((UINT64_C(1) << kWJHEventTypeKeyDown) | (UINT64_C(1) << kWJHEventTypeKeyUp)), "the mask is the handled types");
+static_assert(wjh::eventMaskFor<UnknownHandler>() == ~UINT64_C(0), "unknownEvent handles everything");
+static_assert(wjh::eventMaskFor<EmptyHandler>() == 0, "nothing is handled");
+
+@implementation WJHEventTapTemplateTests
+
+- (int)pipeWithEvents:(int *)writeFD {
+    int fds[2];
+    XCTAssertEqual(0, pipe(fds));
+    XCTAssertEqual((ssize_t)sizeof(kEvents), write(fds[1], kEvents, sizeof(kEvents)));
+    if (writeFD) {
+        *writeFD = fds[1];
+    } else {
+        close(fds[1]);
+    }
+    return fds[0];
+}
+
+- (void)testDispatchCallsHandlerForType {
+    KeyHandler keys;
+    WJHEventRecord record = {};
+    record.type = kWJHEventTypeKeyDown;
+    XCTAssertTrue(wjh::dispatch(keys, record));
+    XCTAssertEqual(1, keys.downs);
+    record.type = kWJHEventTypeKeyUp;
+    XCTAssertFalse(wjh::dispatch(keys, record));
+    record.keycode = 0x01;
+    XCTAssertTrue(wjh::dispatch(keys, record));
+    XCTAssertEqual(2, keys.ups);
+    record.type = kWJHEventTypeMouseMoved;
+    XCTAssertTrue(wjh::dispatch(keys, record));
+
+    UnknownHandler unknown;
+    record.type = kWJHEventTypeKeyDown;
+    XCTAssertFalse(wjh::dispatch(unknown, record));
+    record.type = kWJHEventTypeTapDisabledByTimeout;
+    XCTAssertTrue(wjh::dispatch(unknown, record));
+    record.type = 200;
+    XCTAssertTrue(wjh::dispatch(unknown, record));
+    XCTAssertEqual(2, unknown.unknown);
+
+    EmptyHandler empty;
+    XCTAssertTrue(wjh::dispatch(empty, record));
+}
+
+- (void)testTapDeliversToHandler {
+    WJHEvdevOptions options = { [self pipeWithEvents:NULL], -1, 0, 0 };
+    KeyHandler keys;
+    wjh::EventTap<KeyHandler> tap(keys, kWJHEvdevBackend, &options, true);
+    XCTAssertTrue(tap);
+    tap.setEnabled(true);
+    XCTAssertTrue(tap.isEnabled());
+    long total = 0, delivered;
+    while ((delivered = tap.deliver()) > 0) {
+        total += delivered;
+    }
+    XCTAssertEqual((long)(sizeof(kEvents) / sizeof(*kEvents)), total);
+    XCTAssertEqual(1, keys.downs);
+    XCTAssertEqual(1, keys.ups);
+
+    wjh::EventTap<KeyHandler> moved(std::move(tap));
+    XCTAssertTrue(moved);
+    XCTAssertFalse(tap);
+    close(options.inputFD);
+}
+
+- (void)testTapCanBeItsOwnHandler {
+    WJHEvdevOptions options = { [self pipeWithEvents:NULL], -1, 0, 0 };
+    CountingTap tap(options);
+    tap.setEnabled(true);
+    while (tap.deliver() > 0) {
+    }
+    XCTAssertEqual(1, tap.moves);
+    close(options.inputFD);
+}
+
+- (void)testThreadDeliversUntilStopped {
+    int writeFD;
+    WJHEvdevOptions options = { [self pipeWithEvents:&writeFD], -1, 0, 0 };
+    ThreadHandler handler;
+    {
+        wjh::EventTapThread<ThreadHandler> thread(handler, kWJHEvdevBackend, options, true);
+        XCTAssertTrue(thread);
+        while (handler.ups == 0) {
+        }
+        // The thread is blocked reading, until the source ends.
+        close(writeFD);
+    }
+    XCTAssertEqual(1, handler.ups);
+    close(options.inputFD);
+
+    WJHEvdevOptions bad = { -1, -1, 0, 0 };
+    wjh::EventTapThread<ThreadHandler> failed(handler, kWJHEvdevBackend, bad, true);
+    XCTAssertFalse(failed);
+    XCTAssertNotEqual(0, failed.error());
+}
+
+- (void)testTapHandlerChangesAndDropsEvents {
+    WJHTemplateTestDelegate *delegate = [[WJHTemplateTestDelegate alloc] init];
+    EventHandler handler;
+    WJHEventTap *eventTap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    eventTap.enabled = YES;
+    CGEventRef aDown = CGEventCreateKeyboardEvent(NULL, 0x00, true);
+    CGEventRef aUp = CGEventCreateKeyboardEvent(NULL, 0x00, false);
+    CGEventRef move = CGEventCreateMouseEvent(NULL, kCGEventMouseMoved, CGPointMake(1, 1), kCGMouseButtonLeft);
+    {
+        wjh::Tap<EventHandler> tap(handler, eventTap);
+        XCTAssertTrue(tap);
+        XCTAssertEqual(eventTap, tap.tap());
+        XCTAssertTrue(WJHEventTapDispatchEvent(eventTap, NULL, kCGEventKeyDown, aDown) == NULL);
+        XCTAssertEqual(aUp, WJHEventTapDispatchEvent(eventTap, NULL, kCGEventKeyUp, aUp));
+        XCTAssertEqual(0x01, CGEventGetIntegerValueField(aUp, kCGKeyboardEventKeycode));
+        XCTAssertEqual(move, WJHEventTapDispatchEvent(eventTap, NULL, kCGEventMouseMoved, move));
+        XCTAssertEqual(1, handler.downs);
+        XCTAssertEqual(1, handler.ups);
+        // The dropped key down never reached the delegate.
+        XCTAssertEqual(2, delegate.count);
+
+        // The handler is part of the tap's own mask.
+        eventTap.delegate = nil;
+        XCTAssertEqual(CGEventMaskBit(kCGEventKeyDown) | CGEventMaskBit(kCGEventKeyUp), eventTap.minimalEventMask);
+    }
+    // The handler is gone with the Tap, and the tap goes on without it.
+    XCTAssertEqual(aDown, WJHEventTapDispatchEvent(eventTap, NULL, kCGEventKeyDown, aDown));
+    XCTAssertEqual(1, handler.downs);
+    CFRelease(aDown);
+    CFRelease(aUp);
+    CFRelease(move);
+}
+
+- (void)testTapHandlerComesAfterHotkeysAndFilter {
+    static WJHHotkeyChord const controlA = { 0x00, kCGEventFlagMaskControl };
+    WJHHotkeyBinding binding = { &controlA, 1, 0 };
+    __block int typed = 0;
+    EventHandler handler;
+    WJHEventTap *eventTap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:nil];
+    eventTap.enabled = YES;
+    wjh::Tap<EventHandler> tap(handler, eventTap);
+    tap.tap().hotkeys = [WJHHotkeys hotkeysWithBindings:&binding count:1 handler:^(NSUInteger index) {
+        ++typed;
+    }];
+
+    CGEventRef controlADown = CGEventCreateKeyboardEvent(NULL, 0x00, true);
+    CGEventSetFlags(controlADown, kCGEventFlagMaskControl);
+    XCTAssertTrue(WJHEventTapDispatchEvent(eventTap, NULL, kCGEventKeyDown, controlADown) == NULL);
+    XCTAssertEqual(1, typed);
+    XCTAssertEqual(0, handler.downs);
+
+    // Key ups do not pass the filter, so they are not changed.
+    WJHEventFilterRule rule = { .typeMask = CGEventMaskBit(kCGEventKeyDown) };
+    tap.tap().filter = [WJHEventFilter filterWithRules:&rule count:1];
+    CGEventRef dUp = CGEventCreateKeyboardEvent(NULL, 0x02, false);
+    XCTAssertEqual(dUp, WJHEventTapDispatchEvent(eventTap, NULL, kCGEventKeyUp, dUp));
+    XCTAssertEqual(0x02, CGEventGetIntegerValueField(dUp, kCGKeyboardEventKeycode));
+    XCTAssertEqual(0, handler.ups);
+    CFRelease(controlADown);
+    CFRelease(dUp);
+}
+
+- (void)testThreadStopsRunLoop {
+    WJHCGEventBackendOptions options = { kCGSessionEventTap, false, NULL };
+    KeyHandler keys;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    {
+        wjh::EventTapThread<KeyHandler> thread(keys, kWJHCGEventBackend, options, true);
+        XCTAssertTrue(thread, @"errno %d", thread.error());
+    }
+    XCTAssertLessThan(CFAbsoluteTimeGetCurrent() - start, 5.0);
+}
+
+@end
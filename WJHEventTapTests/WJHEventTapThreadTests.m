@@ -0,0 +1,199 @@
+//
+//  WJHEventTapThreadTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <Cocoa/Cocoa.h>
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+
+@interface WJHEventTapThreadTests : XCTestCase
+@end
+
+static NSUInteger const kLatencySampleCount = 20;
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+static void busyWait(NSTimeInterval interval) {
+    NSDate *end = [NSDate dateWithTimeIntervalSinceNow:interval];
+    while ([end timeIntervalSinceNow] > 0) {
+    }
+}
+
+/**
+ Log the mean, 99th percentile, and longest of @a latencies, which are in nanoseconds.
+ */
+static void logLatencies(NSString *label, NSArray *latencies) {
+    if (latencies.count == 0) {
+        NSLog(@"%@: no callbacks", label);
+        return;
+    }
+    NSArray *sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    double total = 0;
+    for (NSNumber *latency in sorted) {
+        total += latency.doubleValue;
+    }
+    // The nearest rank, so with few samples the 99th percentile is the longest.
+    NSUInteger rank = (NSUInteger)ceil(0.99 * sorted.count);
+    NSLog(@"%@: %lu callbacks, mean %.1f us, p99 %.1f us, max %.1f us", label, (unsigned long)sorted.count, total / sorted.count / 1e3, [sorted[rank - 1] doubleValue] / 1e3, [sorted.lastObject doubleValue] / 1e3);
+}
+
+@implementation WJHEventTapThreadTests
+
+#pragma mark - Tests
+
+- (void)testTapRunsOnItsThread {
+    WJHEventTapThread *thread = [[WJHEventTapThread alloc] initWithName:@"testTapRunsOnItsThread"];
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Callback"];
+    delegate.otherMouseDownEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        if ([thread isCurrentThread]) {
+            [expectation fulfill];
+            eventTap.delegate = nil;
+        }
+        return event;
+    };
+
+    WJHEventTap *tap = [[WJHEventTap alloc] initWithProcess:nil eventMask:kCGEventMaskForAllEvents beforeOthers:YES passive:YES thread:thread delegate:delegate];
+    XCTAssertEqual(thread, tap.thread);
+    XCTAssertEqual(thread.runLoop, tap.runLoop);
+    tap.enabled = YES;
+
+    [self postOtherMouseDownToProcess:tap.processSerialNumber];
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+- (void)testTapsShareThread {
+    WJHEventTapThread *thread = [WJHEventTapThread new];
+    WJHEventTap *tap1 = [[WJHEventTap alloc] initWithProcess:nil eventMask:kCGEventMaskForAllEvents beforeOthers:YES passive:YES thread:thread delegate:nil];
+    WJHEventTap *tap2 = [[WJHEventTap alloc] initWithProcess:nil eventMask:kCGEventMaskForAllEvents beforeOthers:YES passive:YES thread:thread delegate:nil];
+    XCTAssertEqual(tap1.thread, tap2.thread);
+}
+
+- (void)testNilThreadMeansPrivateThread {
+    WJHEventTap *tap1 = [[WJHEventTap alloc] initWithProcess:nil eventMask:kCGEventMaskForAllEvents beforeOthers:YES passive:YES thread:nil delegate:nil];
+    WJHEventTap *tap2 = [[WJHEventTap alloc] initWithProcess:nil eventMask:kCGEventMaskForAllEvents beforeOthers:YES passive:YES thread:nil delegate:nil];
+    XCTAssertNotNil(tap1.thread);
+    XCTAssertNotNil(tap2.thread);
+    XCTAssertNotEqual(tap1.thread, tap2.thread);
+    XCTAssertNotEqual([NSRunLoop currentRunLoop], tap1.runLoop);
+}
+
+- (void)testRemovalOnDeallocFromTapThread {
+    uint32_t origCount = [WJHEventTap systemTapCount];
+    @autoreleasepool {
+        WJHEventTapThread *thread = [WJHEventTapThread new];
+        __block WJHEventTap *tap = [[WJHEventTap alloc] initWithProcess:nil eventMask:kCGEventMaskForAllEvents beforeOthers:YES passive:YES thread:thread delegate:nil];
+        XCTAssertEqual(origCount + 1, [WJHEventTap systemTapCount]);
+        [thread performBlockAndWait:^{
+            tap = nil;
+        }];
+    }
+    XCTAssertEqual(origCount, [WJHEventTap systemTapCount]);
+}
+
+- (void)testDeallocWaitsForThread {
+    __block BOOL finished = NO;
+    @autoreleasepool {
+        WJHEventTapThread *thread = [WJHEventTapThread new];
+        CFRunLoopRef runLoop = [thread.runLoop getCFRunLoop];
+        dispatch_semaphore_t started = dispatch_semaphore_create(0);
+        CFRunLoopPerformBlock(runLoop, kCFRunLoopDefaultMode, ^{
+            dispatch_semaphore_signal(started);
+            usleep(100000);
+            finished = YES;
+        });
+        CFRunLoopWakeUp(runLoop);
+        dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+    }
+    XCTAssertTrue(finished);
+}
+
+/**
+ Post events while the main thread is busy, and check that they reach taps both on the main run loop and on a dedicated thread.  The latencies of both are logged, for comparison; how long they take depends on the load of the machine, so they are not asserted.
+ */
+- (void)testCallbacksUnderMainThreadLoad {
+    NSTimeInterval const busyInterval = 0.05;
+    NSArray *mainLatencies = [self latenciesWithThread:nil busyInterval:busyInterval];
+    NSArray *threadLatencies = [self latenciesWithThread:[WJHEventTapThread new] busyInterval:busyInterval];
+    logLatencies(@"Main run loop, under load", mainLatencies);
+    logLatencies(@"Dedicated thread, main thread under load", threadLatencies);
+    XCTAssertEqual(kLatencySampleCount, mainLatencies.count);
+    XCTAssertEqual(kLatencySampleCount, threadLatencies.count);
+}
+
+
+#pragma mark - Helpers
+
+- (void)postOtherMouseDownToProcess:(ProcessSerialNumber)psn {
+    CGEventSourceRef source = CGEventSourceCreate(kCGEventSourceStatePrivate);
+    CGEventRef event = CGEventCreateMouseEvent(source, kCGEventOtherMouseDown, CGPointZero, 31);
+    CGEventSetIntegerValueField(event, kCGEventSourceUserData, (int64_t)mach_absolute_time());
+    CGEventPostToPSN(&psn, event);
+    CFRelease(event);
+
+    event = CGEventCreateMouseEvent(source, kCGEventOtherMouseUp, CGPointZero, 31);
+    CGEventPostToPSN(&psn, event);
+    CFRelease(event);
+    CFRelease(source);
+}
+
+/**
+ Collect the callback latency, in nanoseconds, of events posted while the main thread alternates between stalls of @a busyInterval and short trips through its run loop.
+
+ @param thread the thread for the tap, or nil to attach the tap to the main run loop
+ */
+- (NSArray *)latenciesWithThread:(WJHEventTapThread *)thread busyInterval:(NSTimeInterval)busyInterval {
+    NSMutableArray *latencies = [NSMutableArray array];
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    delegate.otherMouseDownEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        uint64_t posted = (uint64_t)CGEventGetIntegerValueField(event, kCGEventSourceUserData);
+        if (posted) {
+            double latency = nanosecondsSince(posted);
+            @synchronized(latencies) {
+                [latencies addObject:@(latency)];
+            }
+        }
+        return event;
+    };
+
+    WJHEventTap *tap;
+    if (thread) {
+        tap = [[WJHEventTap alloc] initWithProcess:nil eventMask:CGEventMaskBit(kCGEventOtherMouseDown) beforeOthers:YES passive:YES thread:thread delegate:delegate];
+    } else {
+        tap = [[WJHEventTap alloc] initWithProcess:nil eventMask:CGEventMaskBit(kCGEventOtherMouseDown) beforeOthers:YES passive:YES runLoop:nil delegate:delegate];
+    }
+    tap.enabled = YES;
+
+    ProcessSerialNumber psn = tap.processSerialNumber;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+        for (NSUInteger i = 0; i < kLatencySampleCount; ++i) {
+            [self postOtherMouseDownToProcess:psn];
+            usleep((useconds_t)(busyInterval * USEC_PER_SEC / 3));
+        }
+    });
+
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+    for (;;) {
+        @synchronized(latencies) {
+            if (latencies.count >= kLatencySampleCount) break;
+        }
+        if ([deadline timeIntervalSinceNow] < 0) break;
+        busyWait(busyInterval);
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+    }
+
+    tap.enabled = NO;
+    @synchronized(latencies) {
+        return [latencies copy];
+    }
+}
+
+@end
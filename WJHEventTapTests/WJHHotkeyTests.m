@@ -0,0 +1,283 @@
+//
+//  WJHHotkeyTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+
+@interface WJHHotkeyTests : XCTestCase
+@end
+
+static NSUInteger const kBenchmarkBindingCount = 10000;
+static uint32_t const kBenchmarkEventCount = 10000000;
+static uint64_t const kModifierMask = kCGEventFlagMaskShift | kCGEventFlagMaskControl | kCGEventFlagMaskAlternate | kCGEventFlagMaskCommand;
+static uint64_t const kSecond = 1000000000;
+
+// Virtual keycodes, from the ANSI layout.
+static uint16_t const kKeyS = 1;
+static uint16_t const kKeyQ = 12;
+static uint16_t const kKeyK = 40;
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+static WJHHotkeyChord const kControlK = { kKeyK, kCGEventFlagMaskControl };
+static WJHHotkeyChord const kControlKThenControlS[] = { { kKeyK, kCGEventFlagMaskControl }, { kKeyS, kCGEventFlagMaskControl } };
+static WJHHotkeyChord const kCommandOptionQ = { kKeyQ, kCGEventFlagMaskCommand | kCGEventFlagMaskAlternate };
+
+static CGEventRef createKeyEvent(uint16_t keycode, bool down, CGEventFlags flags) {
+    CGEventRef event = CGEventCreateKeyboardEvent(NULL, keycode, down);
+    CGEventSetFlags(event, flags);
+    return event;
+}
+
+/// Counts every event it is given.
+@interface WJHHotkeyDelegate : NSObject<WJHEventTapDelegate>
+@property (nonatomic, assign) NSUInteger count;
+@end
+
+@implementation WJHHotkeyDelegate
+- (BOOL)eventTap:(WJHEventTap*)eventTap receivedEvent:(CGEventRef*)event type:(CGEventType)type proxy:(CGEventTapProxy)proxy {
+    ++_count;
+    return YES;
+}
+@end
+
+@implementation WJHHotkeyTests {
+    WJHHotkeyMatcher *matcher;
+}
+
+- (void)setUp {
+    [super setUp];
+    WJHHotkeyBinding bindings[] = {
+        { kControlKThenControlS, 2, kSecond },
+        { &kCommandOptionQ, 1, 0 },
+    };
+    matcher = WJHHotkeyMatcherCreate(bindings, 2, kModifierMask, NULL);
+}
+
+- (void)tearDown {
+    WJHHotkeyMatcherDestroy(matcher);
+    [super tearDown];
+}
+
+
+#pragma mark - Matcher
+
+- (void)testSingleChord {
+    size_t binding = SIZE_MAX;
+    XCTAssertEqual(WJHHotkeyMatched, WJHHotkeyMatcherKeyDown(matcher, kKeyQ, kCGEventFlagMaskCommand | kCGEventFlagMaskAlternate | kCGEventFlagMaskNonCoalesced, 0, &binding));
+    XCTAssertEqual(1, binding);
+    XCTAssertEqual(WJHHotkeyUnmatched, WJHHotkeyMatcherKeyDown(matcher, kKeyQ, kCGEventFlagMaskCommand, 0, &binding));
+    XCTAssertEqual(WJHHotkeyUnmatched, WJHHotkeyMatcherKeyDown(matcher, kKeyQ, kCGEventFlagMaskCommand | kCGEventFlagMaskAlternate | kCGEventFlagMaskShift, 0, &binding));
+}
+
+- (void)testSequence {
+    size_t binding = SIZE_MAX;
+    XCTAssertEqual(WJHHotkeyPending, WJHHotkeyMatcherKeyDown(matcher, kKeyK, kCGEventFlagMaskControl, 0, &binding));
+    XCTAssertTrue(WJHHotkeyMatcherIsPending(matcher));
+    // Only the chord that completes the binding is consumed, so the release of the prefix is not the binding's.
+    XCTAssertFalse(WJHHotkeyMatcherKeyUp(matcher, kKeyK));
+    XCTAssertEqual(WJHHotkeyMatched, WJHHotkeyMatcherKeyDown(matcher, kKeyS, kCGEventFlagMaskControl, kSecond, &binding));
+    XCTAssertEqual(0, binding);
+    XCTAssertFalse(WJHHotkeyMatcherIsPending(matcher));
+    XCTAssertTrue(WJHHotkeyMatcherKeyUp(matcher, kKeyS));
+}
+
+- (void)testSequenceTimesOut {
+    XCTAssertEqual(WJHHotkeyPending, WJHHotkeyMatcherKeyDown(matcher, kKeyK, kCGEventFlagMaskControl, 0, NULL));
+    XCTAssertEqual(WJHHotkeyUnmatched, WJHHotkeyMatcherKeyDown(matcher, kKeyS, kCGEventFlagMaskControl, kSecond + 1, NULL));
+    XCTAssertFalse(WJHHotkeyMatcherIsPending(matcher));
+}
+
+- (void)testBrokenSequenceStartsOver {
+    size_t binding = SIZE_MAX;
+    XCTAssertEqual(WJHHotkeyPending, WJHHotkeyMatcherKeyDown(matcher, kKeyK, kCGEventFlagMaskControl, 0, NULL));
+    XCTAssertEqual(WJHHotkeyMatched, WJHHotkeyMatcherKeyDown(matcher, kKeyQ, kCGEventFlagMaskCommand | kCGEventFlagMaskAlternate, 1, &binding));
+    XCTAssertEqual(1, binding);
+
+    XCTAssertEqual(WJHHotkeyPending, WJHHotkeyMatcherKeyDown(matcher, kKeyK, kCGEventFlagMaskControl, 2, NULL));
+    XCTAssertEqual(WJHHotkeyUnmatched, WJHHotkeyMatcherKeyDown(matcher, kKeyS, 0, 3, NULL));
+    XCTAssertFalse(WJHHotkeyMatcherIsPending(matcher));
+    XCTAssertFalse(WJHHotkeyMatcherKeyUp(matcher, kKeyS));
+
+    XCTAssertEqual(WJHHotkeyPending, WJHHotkeyMatcherKeyDown(matcher, kKeyK, kCGEventFlagMaskControl, 4, NULL));
+    WJHHotkeyMatcherReset(matcher);
+    XCTAssertFalse(WJHHotkeyMatcherIsPending(matcher));
+    XCTAssertFalse(WJHHotkeyMatcherKeyUp(matcher, kKeyK));
+}
+
+- (void)testInvalidBindings {
+    size_t invalid = SIZE_MAX;
+    WJHHotkeyBinding prefix[] = { { kControlKThenControlS, 2, 0 }, { &kControlK, 1, 0 } };
+    XCTAssertTrue(WJHHotkeyMatcherCreate(prefix, 2, kModifierMask, &invalid) == NULL);
+    XCTAssertEqual(1, invalid);
+
+    WJHHotkeyBinding extension[] = { { &kControlK, 1, 0 }, { kControlKThenControlS, 2, 0 } };
+    XCTAssertTrue(WJHHotkeyMatcherCreate(extension, 2, kModifierMask, &invalid) == NULL);
+    XCTAssertEqual(1, invalid);
+
+    WJHHotkeyChord const tooBig = { kWJHHotkeyKeycodeLimit, 0 };
+    WJHHotkeyBinding bad[] = { { &kControlK, 1, 0 }, { &tooBig, 1, 0 } };
+    XCTAssertTrue(WJHHotkeyMatcherCreate(bad, 2, kModifierMask, &invalid) == NULL);
+    XCTAssertEqual(1, invalid);
+
+    WJHHotkeyBinding empty = { NULL, 0, 0 };
+    XCTAssertTrue(WJHHotkeyMatcherCreate(&empty, 1, kModifierMask, &invalid) == NULL);
+    XCTAssertEqual(0, invalid);
+    XCTAssertNil([WJHHotkeys hotkeysWithBindings:&empty count:1 handler:nil]);
+}
+
+
+#pragma mark - Tap
+
+- (void)testActiveTapSwallowsHotkeys {
+    NSMutableArray *fired = [NSMutableArray array];
+    WJHHotkeyBinding bindings[] = { { kControlKThenControlS, 2, 0 } };
+    WJHHotkeys *hotkeys = [WJHHotkeys hotkeysWithBindings:bindings count:1 handler:^(NSUInteger binding) {
+        [fired addObject:@(binding)];
+    }];
+    WJHHotkeyDelegate *delegate = [WJHHotkeyDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    tap.hotkeys = hotkeys;
+
+    CGEventRef kDown = createKeyEvent(kKeyK, true, kCGEventFlagMaskControl);
+    CGEventRef kUp = createKeyEvent(kKeyK, false, kCGEventFlagMaskControl);
+    CGEventRef sDown = createKeyEvent(kKeyS, true, kCGEventFlagMaskControl);
+    CGEventRef qDown = createKeyEvent(kKeyQ, true, 0);
+
+    // The prefix is passed on, and only the completing chord is swallowed.
+    XCTAssertEqual(kDown, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, kDown));
+    XCTAssertEqual(kUp, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyUp, kUp));
+    XCTAssertEqual(0, fired.count);
+    XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, sDown) == NULL);
+    XCTAssertEqualObjects(@[@0], fired);
+    XCTAssertEqual(qDown, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, qDown));
+    XCTAssertEqual(3, delegate.count);
+
+    CFRelease(kDown);
+    CFRelease(kUp);
+    CFRelease(sDown);
+    CFRelease(qDown);
+}
+
+- (void)testAbandonedSequenceLosesNoKeys {
+    __block NSUInteger fired = 0;
+    WJHHotkeyBinding bindings[] = { { kControlKThenControlS, 2, kSecond } };
+    WJHHotkeys *hotkeys = [WJHHotkeys hotkeysWithBindings:bindings count:1 handler:^(NSUInteger binding) {
+        ++fired;
+    }];
+    WJHHotkeyDelegate *delegate = [WJHHotkeyDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    tap.hotkeys = hotkeys;
+
+    CGEventRef kDown = createKeyEvent(kKeyK, true, kCGEventFlagMaskControl);
+    CGEventRef kUp = createKeyEvent(kKeyK, false, kCGEventFlagMaskControl);
+    CGEventRef qDown = createKeyEvent(kKeyQ, true, kCGEventFlagMaskControl);
+    CGEventRef qUp = createKeyEvent(kKeyQ, false, kCGEventFlagMaskControl);
+
+    // Ctrl-K, broken by Ctrl-Q: every key reaches the delegate, and goes on.
+    XCTAssertEqual(kDown, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, kDown));
+    XCTAssertEqual(kUp, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyUp, kUp));
+    XCTAssertEqual(qDown, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, qDown));
+    XCTAssertEqual(qUp, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyUp, qUp));
+    XCTAssertEqual(4, delegate.count);
+
+    // Ctrl-K, never followed by anything: it was passed on when it was typed, so there is nothing to give back when the sequence times out.
+    XCTAssertEqual(kDown, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, kDown));
+    XCTAssertEqual(kUp, WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyUp, kUp));
+    XCTAssertEqual(6, delegate.count);
+    XCTAssertEqual(0, fired);
+
+    CFRelease(kDown);
+    CFRelease(kUp);
+    CFRelease(qDown);
+    CFRelease(qUp);
+}
+
+- (void)testPassiveTapDeliversHotkeys {
+    __block NSUInteger fired = 0;
+    WJHHotkeys *hotkeys = [WJHHotkeys hotkeysWithBindings:(WJHHotkeyBinding[]){ { &kCommandOptionQ, 1, 0 } } count:1 handler:^(NSUInteger binding) {
+        ++fired;
+    }];
+    WJHHotkeyDelegate *delegate = [WJHHotkeyDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    tap.hotkeys = hotkeys;
+
+    CGEventRef event = createKeyEvent(kKeyQ, true, kCGEventFlagMaskCommand | kCGEventFlagMaskAlternate);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, event);
+    XCTAssertEqual(1, fired);
+    XCTAssertEqual(1, delegate.count);
+    CFRelease(event);
+}
+
+
+#pragma mark - Benchmarks
+
+/// Bindings for every chord of 100 keys and 8 modifier combinations, followed by one of 12 keys.
+static WJHHotkeyChord * createBenchmarkChords(void) {
+    uint64_t const modifiers[] = { 0, kCGEventFlagMaskShift, kCGEventFlagMaskControl, kCGEventFlagMaskAlternate, kCGEventFlagMaskCommand, kCGEventFlagMaskControl | kCGEventFlagMaskShift, kCGEventFlagMaskCommand | kCGEventFlagMaskShift, kCGEventFlagMaskCommand | kCGEventFlagMaskAlternate };
+    WJHHotkeyChord *chords = calloc(2 * kBenchmarkBindingCount, sizeof(*chords));
+    for (NSUInteger i = 0; i < kBenchmarkBindingCount; ++i) {
+        chords[2 * i] = (WJHHotkeyChord){ (uint16_t)(i % 100), modifiers[(i / 100) % 8] };
+        chords[2 * i + 1] = (WJHHotkeyChord){ (uint16_t)(100 + i / 800), kCGEventFlagMaskControl };
+    }
+    return chords;
+}
+
+- (void)testMatcherBenchmark {
+    WJHHotkeyChord *chords = createBenchmarkChords();
+    WJHHotkeyBinding *bindings = calloc(kBenchmarkBindingCount, sizeof(*bindings));
+    for (NSUInteger i = 0; i < kBenchmarkBindingCount; ++i) {
+        bindings[i] = (WJHHotkeyBinding){ chords + 2 * i, 2, kSecond };
+    }
+
+    NSMutableString *report = [NSMutableString string];
+    for (NSUInteger count = 10; count <= kBenchmarkBindingCount; count *= 10) {
+        WJHHotkeyMatcher *benchmarkMatcher = WJHHotkeyMatcherCreate(bindings, count, kModifierMask, NULL);
+        XCTAssertTrue(benchmarkMatcher != NULL);
+
+        uint64_t matched = 0;
+        uint64_t start = mach_absolute_time();
+        for (uint32_t i = 0; i < kBenchmarkEventCount; ++i) {
+            uint32_t seed = i * 2654435761u;
+            WJHHotkeyChord const *chord = chords + 2 * (seed % count) + (i & 1);
+            matched += WJHHotkeyMatcherKeyDown(benchmarkMatcher, chord->keycode, chord->modifiers, i, NULL) == WJHHotkeyMatched;
+        }
+        [report appendFormat:@" %lu bindings %.1f ns/event (%llu matched);", (unsigned long)count, nanosecondsSince(start) / kBenchmarkEventCount, matched];
+        WJHHotkeyMatcherDestroy(benchmarkMatcher);
+    }
+    free(bindings);
+    free(chords);
+    NSLog(@"Hotkey matcher:%@", report);
+}
+
+- (void)testPerformanceMatcher {
+    WJHHotkeyChord *chords = createBenchmarkChords();
+    WJHHotkeyBinding *bindings = calloc(kBenchmarkBindingCount, sizeof(*bindings));
+    for (NSUInteger i = 0; i < kBenchmarkBindingCount; ++i) {
+        bindings[i] = (WJHHotkeyBinding){ chords + 2 * i, 2, 0 };
+    }
+    WJHHotkeyMatcher *benchmarkMatcher = WJHHotkeyMatcherCreate(bindings, kBenchmarkBindingCount, kModifierMask, NULL);
+    [self measureBlock:^{
+        uint64_t matched = 0;
+        for (uint32_t i = 0; i < kBenchmarkEventCount; ++i) {
+            WJHHotkeyChord const *chord = chords + 2 * ((i >> 1) % kBenchmarkBindingCount) + (i & 1);
+            matched += WJHHotkeyMatcherKeyDown(benchmarkMatcher, chord->keycode, chord->modifiers, i, NULL) == WJHHotkeyMatched;
+        }
+        XCTAssertEqual((uint64_t)kBenchmarkEventCount / 2, matched);
+    }];
+    WJHHotkeyMatcherDestroy(benchmarkMatcher);
+    free(bindings);
+    free(chords);
+}
+
+@end
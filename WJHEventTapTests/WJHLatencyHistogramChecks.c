@@ -0,0 +1,154 @@
+//
+//  WJHLatencyHistogramChecks.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHCoreChecks.h"
+#include <WJHEventTap/WJHLatencyHistogram.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+static uint64_t const kRecordedWhileReadingCount = 200000;
+
+/**
+ Whether the buckets around @a value are contiguous: @a value is no larger than the maximum of its bucket, and larger than the maximum of the bucket before it.
+ */
+static bool bucketHolds(uint64_t value) {
+    uint32_t bucket = WJHLatencyHistogramBucketIndex(value);
+    if (value > WJHLatencyHistogramBucketMaxValue(bucket)) {
+        return false;
+    }
+    return bucket == 0 || value > WJHLatencyHistogramBucketMaxValue(bucket - 1);
+}
+
+static void checkBuckets(WJHChecks *checks) {
+    // Every small value, one at a time.
+    uint32_t previous = 0;
+    uint64_t misplaced = 0, skipped = 0;
+    for (uint64_t value = 0; value < (1 << 16); ++value) {
+        uint32_t bucket = WJHLatencyHistogramBucketIndex(value);
+        skipped += bucket != previous && bucket != previous + 1;
+        misplaced += !bucketHolds(value);
+        previous = bucket;
+    }
+    WJHCheck(checks, skipped == 0);
+    WJHCheck(checks, misplaced == 0);
+
+    // The edges of every power of two, which is where a log-linear histogram goes wrong.
+    misplaced = 0;
+    for (int bit = kWJHLatencyHistogramSubBucketBits; bit < kWJHLatencyHistogramValueBits; ++bit) {
+        uint64_t power = UINT64_C(1) << bit;
+        misplaced += !bucketHolds(power - 1) + !bucketHolds(power) + !bucketHolds(power + 1);
+    }
+    WJHCheck(checks, misplaced == 0);
+
+    // Each value is reported within 1/16 of itself.
+    uint64_t imprecise = 0;
+    for (int bit = kWJHLatencyHistogramSubBucketBits; bit < kWJHLatencyHistogramValueBits; ++bit) {
+        uint64_t value = (UINT64_C(1) << bit) + 12345;
+        uint64_t reported = WJHLatencyHistogramBucketMaxValue(WJHLatencyHistogramBucketIndex(value));
+        imprecise += reported < value || (double)(reported - value) / value >= 1.0 / 16;
+    }
+    WJHCheck(checks, imprecise == 0);
+
+    uint64_t const limit = UINT64_C(1) << kWJHLatencyHistogramValueBits;
+    WJHCheck(checks, WJHLatencyHistogramBucketIndex(limit - 1) < kWJHLatencyHistogramBucketCount);
+    WJHCheck(checks, WJHLatencyHistogramBucketIndex(limit) == kWJHLatencyHistogramBucketCount - 1);
+    WJHCheck(checks, WJHLatencyHistogramBucketIndex(UINT64_MAX) == kWJHLatencyHistogramBucketCount - 1);
+}
+
+static void checkEmpty(WJHChecks *checks) {
+    WJHLatencyHistogram *histogram = WJHLatencyHistogramCreate();
+    if (!WJHCheck(checks, histogram != NULL)) {
+        return;
+    }
+    WJHLatencyHistogramSnapshot snapshot;
+    WJHLatencyHistogramGetSnapshot(histogram, &snapshot);
+    WJHCheck(checks, snapshot.count == 0);
+    WJHCheck(checks, snapshot.mean == 0);
+    WJHCheck(checks, snapshot.p50 == 0);
+    WJHCheck(checks, snapshot.max == 0);
+    WJHLatencyHistogramDestroy(histogram);
+}
+
+static void checkPercentiles(WJHChecks *checks) {
+    WJHLatencyHistogram *histogram = WJHLatencyHistogramCreate();
+    if (!WJHCheck(checks, histogram != NULL)) {
+        return;
+    }
+    for (uint64_t i = 1; i <= 10000; ++i) {
+        WJHLatencyHistogramRecord(histogram, i * 100);
+    }
+
+    WJHLatencyHistogramSnapshot snapshot;
+    WJHLatencyHistogramGetSnapshot(histogram, &snapshot);
+    WJHCheck(checks, snapshot.count == 10000);
+    WJHCheck(checks, snapshot.mean == 500050);
+    WJHCheck(checks, snapshot.max == 1000000);
+    WJHCheck(checks, snapshot.p50 >= 500000 && snapshot.p50 <= 500000 * 17 / 16);
+    WJHCheck(checks, snapshot.p99 >= 990000 && snapshot.p99 <= snapshot.max);
+    WJHCheck(checks, snapshot.p999 >= 999000 && snapshot.p999 <= snapshot.max);
+    WJHCheck(checks, WJHLatencyHistogramValueAtPercentile(histogram, 100) == snapshot.max);
+    WJHLatencyHistogramDestroy(histogram);
+}
+
+typedef struct Reader {
+    WJHLatencyHistogram *histogram;
+    atomic_bool done;
+    atomic_uint_fast64_t snapshots;
+    uint64_t inconsistent;
+} Reader;
+
+/// Takes snapshots while the histogram is being recorded into, each of which must be in order, whatever it missed.
+static void * readSnapshots(void *context) {
+    Reader *reader = context;
+    while (!atomic_load(&reader->done)) {
+        WJHLatencyHistogramSnapshot snapshot;
+        WJHLatencyHistogramGetSnapshot(reader->histogram, &snapshot);
+        reader->inconsistent += snapshot.p50 > snapshot.p99 || snapshot.p99 > snapshot.p999 || snapshot.p999 > snapshot.max || snapshot.count > kRecordedWhileReadingCount;
+        atomic_fetch_add(&reader->snapshots, 1);
+    }
+    return NULL;
+}
+
+static void checkSnapshotsWhileRecording(WJHChecks *checks) {
+    Reader reader = { .histogram = WJHLatencyHistogramCreate() };
+    if (!WJHCheck(checks, reader.histogram != NULL)) {
+        return;
+    }
+    atomic_init(&reader.done, false);
+    atomic_init(&reader.snapshots, 0);
+    pthread_t thread;
+    if (!WJHCheck(checks, pthread_create(&thread, NULL, readSnapshots, &reader) == 0)) {
+        WJHLatencyHistogramDestroy(reader.histogram);
+        return;
+    }
+
+    for (uint64_t i = 0; i < kRecordedWhileReadingCount; ++i) {
+        WJHLatencyHistogramRecord(reader.histogram, i & 0xffff);
+    }
+    // On a single processor, the recording can be over before the reader has run at all.
+    while (atomic_load(&reader.snapshots) == 0) {
+        sched_yield();
+    }
+    atomic_store(&reader.done, true);
+    pthread_join(thread, NULL);
+
+    WJHLatencyHistogramSnapshot snapshot;
+    WJHLatencyHistogramGetSnapshot(reader.histogram, &snapshot);
+    WJHCheck(checks, snapshot.count == kRecordedWhileReadingCount);
+    WJHCheck(checks, snapshot.max == 0xffff);
+    WJHCheck(checks, reader.inconsistent == 0);
+    WJHLatencyHistogramDestroy(reader.histogram);
+}
+
+void WJHLatencyHistogramChecks(WJHChecks *checks) {
+    checkBuckets(checks);
+    checkEmpty(checks);
+    checkPercentiles(checks);
+    checkSnapshotsWhileRecording(checks);
+}
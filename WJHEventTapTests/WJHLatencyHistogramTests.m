@@ -0,0 +1,227 @@
+//
+//  WJHLatencyHistogramTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <stdatomic.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHCoreChecks.h"
+
+@interface WJHLatencyHistogramTests : XCTestCase
+@end
+
+static uint64_t const kSlowKeyDownNanoseconds = 200000;
+
+static double nanosecondsSince(uint64_t start) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom;
+}
+
+static void spinFor(uint64_t nanoseconds) {
+    uint64_t start = mach_absolute_time();
+    while (nanosecondsSince(start) < nanoseconds) {
+    }
+}
+
+/// Slow to handle key downs, and quick with everything else.
+@interface WJHSlowKeyDelegate : NSObject<WJHEventTapDelegate>
+@end
+
+@implementation WJHSlowKeyDelegate
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap keyDownEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    spinFor(kSlowKeyDownNanoseconds);
+    return event;
+}
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap mouseMovedEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    return event;
+}
+@end
+
+typedef struct {
+    WJHLatencyHistogram *histogram;
+    atomic_bool done;
+    uint64_t snapshots;
+} ReaderState;
+
+static void * snapshotReader(void *context) {
+    ReaderState *state = context;
+    while (!atomic_load(&state->done)) {
+        WJHLatencyHistogramSnapshot snapshot;
+        WJHLatencyHistogramGetSnapshot(state->histogram, &snapshot);
+        ++state->snapshots;
+    }
+    return NULL;
+}
+
+static CGEventRef makeEvent(CGEventType type) {
+    CGEventRef event = CGEventCreate(NULL);
+    CGEventSetType(event, type);
+    return event;
+}
+
+@implementation WJHLatencyHistogramTests
+
+#pragma mark - Histogram
+
+- (void)testBucketsAreContiguous {
+    uint32_t previous = 0;
+    for (uint64_t value = 0; value < (1 << 16); ++value) {
+        uint32_t bucket = WJHLatencyHistogramBucketIndex(value);
+        XCTAssertTrue(bucket == previous || bucket == previous + 1);
+        XCTAssertLessThanOrEqual(value, WJHLatencyHistogramBucketMaxValue(bucket));
+        if (bucket > 0) {
+            XCTAssertGreaterThan(value, WJHLatencyHistogramBucketMaxValue(bucket - 1));
+        }
+        previous = bucket;
+    }
+}
+
+- (void)testBucketPrecision {
+    for (int bit = 4; bit < kWJHLatencyHistogramValueBits; ++bit) {
+        uint64_t value = (UINT64_C(1) << bit) + 12345;
+        uint64_t reported = WJHLatencyHistogramBucketMaxValue(WJHLatencyHistogramBucketIndex(value));
+        XCTAssertGreaterThanOrEqual(reported, value);
+        XCTAssertLessThan((double)(reported - value) / value, 1.0 / 16);
+    }
+    XCTAssertEqual(kWJHLatencyHistogramBucketCount - 1, WJHLatencyHistogramBucketIndex(UINT64_MAX));
+}
+
+- (void)testEmptySnapshot {
+    WJHLatencyHistogram *histogram = WJHLatencyHistogramCreate();
+    WJHLatencyHistogramSnapshot snapshot;
+    WJHLatencyHistogramGetSnapshot(histogram, &snapshot);
+    XCTAssertEqual(0, snapshot.count);
+    XCTAssertEqual(0, snapshot.p50);
+    XCTAssertEqual(0, snapshot.max);
+    WJHLatencyHistogramDestroy(histogram);
+}
+
+- (void)testPercentiles {
+    WJHLatencyHistogram *histogram = WJHLatencyHistogramCreate();
+    for (uint64_t i = 1; i <= 10000; ++i) {
+        WJHLatencyHistogramRecord(histogram, i * 100);
+    }
+
+    WJHLatencyHistogramSnapshot snapshot;
+    WJHLatencyHistogramGetSnapshot(histogram, &snapshot);
+    XCTAssertEqual(10000, snapshot.count);
+    XCTAssertEqual(500050, snapshot.mean);
+    XCTAssertEqual(1000000, snapshot.max);
+    XCTAssertGreaterThanOrEqual(snapshot.p50, 500000);
+    XCTAssertLessThanOrEqual(snapshot.p50, 500000 * 17 / 16);
+    XCTAssertGreaterThanOrEqual(snapshot.p99, 990000);
+    XCTAssertGreaterThanOrEqual(snapshot.p999, 999000);
+    XCTAssertLessThanOrEqual(snapshot.p999, snapshot.max);
+    XCTAssertEqual(snapshot.max, WJHLatencyHistogramValueAtPercentile(histogram, 100));
+    WJHLatencyHistogramDestroy(histogram);
+}
+
+- (void)testSnapshotsWhileRecording {
+    ReaderState state = { .histogram = WJHLatencyHistogramCreate() };
+    pthread_t reader;
+    pthread_create(&reader, NULL, snapshotReader, &state);
+
+    uint64_t const count = 1000000;
+    for (uint64_t i = 0; i < count; ++i) {
+        WJHLatencyHistogramRecord(state.histogram, i & 0xffff);
+    }
+    atomic_store(&state.done, true);
+    pthread_join(reader, NULL);
+
+    WJHLatencyHistogramSnapshot snapshot;
+    WJHLatencyHistogramGetSnapshot(state.histogram, &snapshot);
+    XCTAssertEqual(count, snapshot.count);
+    XCTAssertEqual(0xffff, snapshot.max);
+    XCTAssertGreaterThan(state.snapshots, 0);
+    WJHLatencyHistogramDestroy(state.histogram);
+}
+
+- (void)testCoreChecks {
+    WJHChecks checks = { .log = stderr };
+    WJHLatencyHistogramChecks(&checks);
+    XCTAssertEqual(0, checks.failed);
+}
+
+#pragma mark - Tap
+
+- (void)testTapRecordsLatencyByEventType {
+    WJHSlowKeyDelegate *delegate = [WJHSlowKeyDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    XCTAssertFalse(tap.recordsLatency);
+    XCTAssertEqual(0, [tap latencySnapshotForEventType:kCGEventKeyDown].count);
+    XCTAssertTrue([tap enableLatencyRecording]);
+    XCTAssertTrue(tap.recordsLatency);
+    XCTAssertFalse([tap enableLatencyRecording]);
+
+    CGEventRef keyDown = makeEvent(kCGEventKeyDown);
+    CGEventRef mouseMoved = makeEvent(kCGEventMouseMoved);
+    for (int i = 0; i < 20; ++i) {
+        WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, keyDown);
+        for (int j = 0; j < 10; ++j) {
+            WJHEventTapDispatchEvent(tap, NULL, kCGEventMouseMoved, mouseMoved);
+        }
+    }
+    CFRelease(keyDown);
+    CFRelease(mouseMoved);
+
+    WJHLatencyHistogramSnapshot keys = [tap latencySnapshotForEventType:kCGEventKeyDown];
+    WJHLatencyHistogramSnapshot moves = [tap latencySnapshotForEventType:kCGEventMouseMoved];
+    XCTAssertEqual(20, keys.count);
+    XCTAssertEqual(200, moves.count);
+    XCTAssertEqual(0, [tap latencySnapshotForEventType:kCGEventKeyUp].count);
+    XCTAssertGreaterThanOrEqual(keys.p50, kSlowKeyDownNanoseconds);
+    XCTAssertLessThan(moves.p99, kSlowKeyDownNanoseconds);
+    NSLog(@"keyDown: p50 %llu ns, p99 %llu ns, max %llu ns; mouseMoved: p50 %llu ns, p99 %llu ns, max %llu ns", keys.p50, keys.p99, keys.max, moves.p50, moves.p99, moves.max);
+}
+
+- (void)testRecordingCost {
+    WJHLatencyHistogram *histogram = WJHLatencyHistogramCreate();
+    uint64_t const count = 10000000;
+    uint64_t start = mach_absolute_time();
+    for (uint64_t i = 0; i < count; ++i) {
+        WJHLatencyHistogramRecord(histogram, i & 0xfff);
+    }
+    double recordTime = nanosecondsSince(start) / count;
+    WJHLatencyHistogramDestroy(histogram);
+
+    WJHSlowKeyDelegate *delegate = [WJHSlowKeyDelegate new];
+    WJHEventTap *plainTap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    WJHEventTap *recordingTap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    [recordingTap enableLatencyRecording];
+    CGEventRef event = makeEvent(kCGEventMouseMoved);
+    uint64_t const eventCount = 1000000;
+
+    start = mach_absolute_time();
+    for (uint64_t i = 0; i < eventCount; ++i) {
+        WJHEventTapDispatchEvent(plainTap, NULL, kCGEventMouseMoved, event);
+    }
+    double plainTime = nanosecondsSince(start) / eventCount;
+
+    start = mach_absolute_time();
+    for (uint64_t i = 0; i < eventCount; ++i) {
+        WJHEventTapDispatchEvent(recordingTap, NULL, kCGEventMouseMoved, event);
+    }
+    double recordingTime = nanosecondsSince(start) / eventCount;
+    CFRelease(event);
+
+    NSLog(@"Histogram record %.1f ns; dispatch without recording %.1f ns/event, with recording %.1f ns/event", recordTime, plainTime, recordingTime);
+}
+
+- (void)testPerformanceRecord {
+    WJHLatencyHistogram *histogram = WJHLatencyHistogramCreate();
+    [self measureBlock:^{
+        for (uint64_t i = 0; i < 1000000; ++i) {
+            WJHLatencyHistogramRecord(histogram, i & 0xfff);
+        }
+    }];
+    WJHLatencyHistogramDestroy(histogram);
+}
+
+@end
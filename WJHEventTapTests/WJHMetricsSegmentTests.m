@@ -0,0 +1,226 @@
+//
+//  WJHMetricsSegmentTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHMetricsStress.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+@interface WJHMetricsSegmentTests : XCTestCase
+@end
+
+@implementation WJHMetricsSegmentTests {
+    char name[32];
+}
+
+- (void)setUp {
+    [super setUp];
+    snprintf(name, sizeof(name), "/wjh-test-%d", (int)getpid());
+}
+
+- (void)tearDown {
+    shm_unlink(name);
+    [super tearDown];
+}
+
+- (WJHMetricsSnapshot)readSegment {
+    WJHMetricsSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    WJHMetricsReader *reader;
+    XCTAssertEqual(WJHMetricsOpened, WJHMetricsReaderOpen(name, &reader));
+    if (reader) {
+        XCTAssertTrue(WJHMetricsReaderRead(reader, &snapshot));
+        WJHMetricsReaderClose(reader);
+    }
+    return snapshot;
+}
+
+
+#pragma mark - Segment
+
+- (void)testCountersReadBack {
+    WJHMetricsWriter *writer = WJHMetricsWriterCreate(name, 7);
+    XCTAssertTrue(writer != NULL);
+    WJHMetricsWriterRecordEvent(writer, kCGEventKeyDown, WJHMetricsPassed, 1000);
+    WJHMetricsWriterRecordEvent(writer, kCGEventKeyDown, WJHMetricsDropped, 3000);
+    WJHMetricsWriterRecordEvent(writer, 40, WJHMetricsModified, 0);
+    WJHMetricsWriterRecordDisable(writer, true);
+    WJHMetricsWriterSetRingBufferOverflows(writer, 5);
+    WJHMetricsWriterSetRingBufferOverflows(writer, 5);
+
+    WJHMetricsSnapshot snapshot = [self readSegment];
+    XCTAssertEqual(getpid(), snapshot.pid);
+    XCTAssertEqual(7, snapshot.eventTapID);
+    XCTAssertEqual(2, snapshot.counters.eventsByType[kCGEventKeyDown]);
+    XCTAssertEqual(1, snapshot.counters.otherEvents);
+    XCTAssertEqual(3, WJHMetricsCountersEvents(&snapshot.counters));
+    XCTAssertEqual(1, snapshot.counters.passed);
+    XCTAssertEqual(1, snapshot.counters.modified);
+    XCTAssertEqual(1, snapshot.counters.dropped);
+    XCTAssertEqual(1, snapshot.counters.timeoutDisables);
+    XCTAssertEqual(0, snapshot.counters.userInputDisables);
+    XCTAssertEqual(5, snapshot.counters.ringBufferOverflows);
+    XCTAssertEqual(4000, snapshot.counters.callbackNanoseconds);
+    XCTAssertEqual(1, snapshot.counters.callbackTimes[0]);
+    XCTAssertEqual(1, snapshot.counters.callbackTimes[9]);
+    XCTAssertEqual(1, snapshot.counters.callbackTimes[11]);
+
+    // Readers that already have the segment keep it, but it can no longer be found.
+    WJHMetricsWriterDestroy(writer);
+    WJHMetricsReader *reader;
+    XCTAssertEqual(WJHMetricsNotFound, WJHMetricsReaderOpen(name, &reader));
+}
+
+- (void)testIncompatibleSegment {
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    XCTAssertGreaterThanOrEqual(fd, 0);
+    XCTAssertEqual(0, ftruncate(fd, 4096));
+    uint32_t *header = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    // The right magic number, but a version from the future.
+    header[0] = 0x4D484A57;
+    header[1] = kWJHMetricsVersion + 1;
+    munmap(header, 4096);
+
+    WJHMetricsReader *reader;
+    XCTAssertEqual(WJHMetricsIncompatible, WJHMetricsReaderOpen(name, &reader));
+}
+
+- (void)testEventTapIDReplaced {
+    WJHMetricsWriter *writer = WJHMetricsWriterCreate(name, 7);
+    XCTAssertTrue(writer != NULL);
+    WJHMetricsWriterRecordEvent(writer, kCGEventKeyDown, WJHMetricsPassed, 1000);
+    WJHMetricsWriterSetEventTapID(writer, 9);
+    WJHMetricsWriterRecordEvent(writer, kCGEventKeyDown, WJHMetricsPassed, 1000);
+
+    WJHMetricsSnapshot snapshot = [self readSegment];
+    XCTAssertEqual(9, snapshot.eventTapID);
+    XCTAssertEqual(2, snapshot.counters.eventsByType[kCGEventKeyDown]);
+    WJHMetricsWriterDestroy(writer);
+}
+
+- (void)testSegmentWithMoreCounters {
+    WJHMetricsWriter *writer = WJHMetricsWriterCreate(name, 7);
+    XCTAssertTrue(writer != NULL);
+    WJHMetricsWriterRecordEvent(writer, kCGEventKeyDown, WJHMetricsDropped, 1000);
+
+    // Make it look like a writer of the same version, with two more counters at the end.
+    int fd = shm_open(name, O_RDWR, 0);
+    XCTAssertGreaterThanOrEqual(fd, 0);
+    struct stat status;
+    XCTAssertEqual(0, fstat(fd, &status));
+    XCTAssertEqual(0, ftruncate(fd, status.st_size + 2 * sizeof(uint64_t)));
+    uint32_t *header = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    XCTAssertEqual(sizeof(WJHMetricsCounters), header[3]);
+    header[3] += 2 * sizeof(uint64_t);
+    munmap(header, 4096);
+
+    WJHMetricsSnapshot snapshot = [self readSegment];
+    XCTAssertEqual(1, snapshot.counters.eventsByType[kCGEventKeyDown]);
+    XCTAssertEqual(1, snapshot.counters.dropped);
+    WJHMetricsWriterDestroy(writer);
+}
+
+- (void)testDifferenceAndPercentiles {
+    WJHMetricsCounters earlier, later, delta;
+    memset(&earlier, 0, sizeof(earlier));
+    memset(&later, 0, sizeof(later));
+    XCTAssertEqual(0, WJHMetricsCountersTimePercentile(&later, 50));
+
+    earlier.passed = 10;
+    earlier.callbackTimes[3] = 10;
+    later.passed = 110;
+    later.callbackTimes[3] = 60;
+    later.callbackTimes[10] = 49;
+    later.callbackTimes[kWJHMetricsTimeBucketCount - 1] = 1;
+    WJHMetricsCountersDifference(&delta, &later, &earlier);
+    XCTAssertEqual(100, delta.passed);
+    XCTAssertEqual(50, delta.callbackTimes[3]);
+    XCTAssertEqual(16, WJHMetricsCountersTimePercentile(&delta, 50));
+    XCTAssertEqual(2048, WJHMetricsCountersTimePercentile(&delta, 99));
+    XCTAssertEqual(UINT64_MAX, WJHMetricsCountersTimePercentile(&delta, 100));
+}
+
+- (void)testStress {
+    WJHMetricsStressOptions options = {
+        .name = name,
+        .readers = 4,
+        .events = 2000000,
+    };
+    WJHMetricsStressResult result;
+    XCTAssertTrue(WJHMetricsStressRun(&options, &result));
+    XCTAssertEqual(0, result.corrupted);
+    XCTAssertTrue(result.finalCountsMatch);
+    XCTAssertGreaterThan(result.reads, 0);
+}
+
+- (void)testPerformanceRecordEvent {
+    WJHMetricsWriter *writer = WJHMetricsWriterCreate(name, 0);
+    [self measureBlock:^{
+        for (uint32_t i = 0; i < 10000000; ++i) {
+            WJHMetricsWriterRecordEvent(writer, i & 31, WJHMetricsPassed, i & 4095);
+        }
+    }];
+    WJHMetricsWriterDestroy(writer);
+}
+
+
+#pragma mark - Tap
+
+- (void)testTapPublishesOutcomes {
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    delegate.keyDownEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        return NULL;
+    };
+    __block CGEventRef replacement = CGEventCreateKeyboardEvent(NULL, 1, false);
+    delegate.keyUpEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        return replacement;
+    };
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    XCTAssertFalse(tap.publishesMetrics);
+    XCTAssertTrue([tap enableMetricsWithName:@(name)]);
+    XCTAssertTrue(tap.publishesMetrics);
+    XCTAssertFalse([tap enableMetricsWithName:@(name)]);
+    tap.enabled = YES;
+
+    CGEventRef down = CGEventCreateKeyboardEvent(NULL, 0, true);
+    CGEventRef up = CGEventCreateKeyboardEvent(NULL, 0, false);
+    CGEventRef moved = CGEventCreateMouseEvent(NULL, kCGEventMouseMoved, CGPointMake(10, 10), kCGMouseButtonLeft);
+    for (int i = 0; i < 3; ++i) {
+        XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, down) == NULL);
+    }
+    for (int i = 0; i < 2; ++i) {
+        XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyUp, up) == replacement);
+    }
+    XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventMouseMoved, moved) == moved);
+    // The tap is still enabled, so this notification is stale, and is not counted.
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventTapDisabledByTimeout, NULL);
+
+    WJHMetricsSnapshot snapshot = [self readSegment];
+    XCTAssertEqual(3, snapshot.counters.eventsByType[kCGEventKeyDown]);
+    XCTAssertEqual(2, snapshot.counters.eventsByType[kCGEventKeyUp]);
+    XCTAssertEqual(1, snapshot.counters.eventsByType[kCGEventMouseMoved]);
+    XCTAssertEqual(3, snapshot.counters.dropped);
+    XCTAssertEqual(2, snapshot.counters.modified);
+    XCTAssertEqual(1, snapshot.counters.passed);
+    XCTAssertEqual(0, snapshot.counters.timeoutDisables);
+
+    // Once the tap really is disabled, the notification counts.
+    tap.enabled = NO;
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventTapDisabledByTimeout, NULL);
+    XCTAssertEqual(1, [self readSegment].counters.timeoutDisables);
+
+    CFRelease(down);
+    CFRelease(up);
+    CFRelease(moved);
+    CFRelease(replacement);
+}
+
+@end
@@ -0,0 +1,186 @@
+//
+//  WJHMetricsStress.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHMetricsStress.h"
+#include <WJHEventTap/WJHMetricsSegment.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    /// Synthetic events cycle through more types than are counted one by one, so some are counted as other events.
+    kTypeCycle = kWJHMetricsTypeLimit + 8,
+    kTimeCycle = 4096,
+    kDisableInterval = 1000,
+    kOverflowInterval = 500,
+};
+
+typedef struct Stress {
+    WJHMetricsStressOptions options;
+    atomic_bool writing;
+    atomic_uint_fast64_t reads;
+    atomic_uint_fast64_t busyReads;
+    atomic_uint_fast64_t corrupted;
+} Stress;
+
+// What the writer has counted, once it has counted the first n events.
+
+static uint64_t expectedCount(uint64_t n, uint64_t cycle, uint64_t value) {
+    return n / cycle + (value < n % cycle);
+}
+
+static uint64_t expectedNanoseconds(uint64_t n) {
+    uint64_t const cycles = n / kTimeCycle, rest = n % kTimeCycle;
+    return cycles * (kTimeCycle * (kTimeCycle - 1) / 2) + (rest ? rest * (rest - 1) / 2 : 0);
+}
+
+/// Whether the counters are exactly those of some number of events, counted whole.
+static bool isConsistent(WJHMetricsCounters const *counters) {
+    uint64_t const n = counters->passed + counters->modified + counters->dropped;
+    if (WJHMetricsCountersEvents(counters) != n) {
+        return false;
+    }
+    uint64_t other = 0;
+    for (uint64_t type = 0; type < kTypeCycle; ++type) {
+        if (type < kWJHMetricsTypeLimit) {
+            if (counters->eventsByType[type] != expectedCount(n, kTypeCycle, type)) {
+                return false;
+            }
+        } else {
+            other += expectedCount(n, kTypeCycle, type);
+        }
+    }
+    if (counters->otherEvents != other) {
+        return false;
+    }
+    if (counters->passed != expectedCount(n, 3, WJHMetricsPassed) || counters->modified != expectedCount(n, 3, WJHMetricsModified) || counters->dropped != expectedCount(n, 3, WJHMetricsDropped)) {
+        return false;
+    }
+    uint64_t timed = 0;
+    for (unsigned bucket = 0; bucket < kWJHMetricsTimeBucketCount; ++bucket) {
+        timed += counters->callbackTimes[bucket];
+    }
+    return timed == n && counters->callbackNanoseconds == expectedNanoseconds(n);
+}
+
+static bool isMonotonic(WJHMetricsCounters const *later, WJHMetricsCounters const *earlier) {
+    uint64_t laterWords[sizeof(*later) / sizeof(uint64_t)], earlierWords[sizeof(*earlier) / sizeof(uint64_t)];
+    memcpy(laterWords, later, sizeof(laterWords));
+    memcpy(earlierWords, earlier, sizeof(earlierWords));
+    for (size_t i = 0; i < sizeof(laterWords) / sizeof(laterWords[0]); ++i) {
+        if (laterWords[i] < earlierWords[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void * runReader(void *context) {
+    Stress *stress = context;
+    WJHMetricsReader *reader;
+    if (WJHMetricsReaderOpen(stress->options.name, &reader) != WJHMetricsOpened) {
+        atomic_fetch_add(&stress->corrupted, 1);
+        return NULL;
+    }
+    WJHMetricsSnapshot previous, snapshot;
+    memset(&previous, 0, sizeof(previous));
+    uint64_t reads = 0, busyReads = 0, corrupted = 0;
+    while (atomic_load(&stress->writing)) {
+        if (!WJHMetricsReaderRead(reader, &snapshot)) {
+            ++busyReads;
+            continue;
+        }
+        ++reads;
+        if (!isConsistent(&snapshot.counters) || !isMonotonic(&snapshot.counters, &previous.counters)) {
+            ++corrupted;
+        }
+        previous = snapshot;
+    }
+    WJHMetricsReaderClose(reader);
+    atomic_fetch_add(&stress->reads, reads);
+    atomic_fetch_add(&stress->busyReads, busyReads);
+    atomic_fetch_add(&stress->corrupted, corrupted);
+    return NULL;
+}
+
+static void writeEvents(WJHMetricsWriter *writer, uint64_t count) {
+    for (uint64_t i = 0; i < count; ++i) {
+        WJHMetricsWriterRecordEvent(writer, (uint32_t)(i % kTypeCycle), (WJHMetricsOutcome)(i % 3), i % kTimeCycle);
+        if (i % kDisableInterval == kDisableInterval - 1) {
+            WJHMetricsWriterRecordDisable(writer, (i / kDisableInterval) % 2 == 0);
+        }
+        if (i % kOverflowInterval == kOverflowInterval - 1) {
+            WJHMetricsWriterSetRingBufferOverflows(writer, i / kOverflowInterval + 1);
+        }
+    }
+}
+
+static bool hasFinalCounts(WJHMetricsStressOptions const *options) {
+    WJHMetricsReader *reader;
+    if (WJHMetricsReaderOpen(options->name, &reader) != WJHMetricsOpened) {
+        return false;
+    }
+    WJHMetricsSnapshot snapshot;
+    bool match = WJHMetricsReaderRead(reader, &snapshot) && isConsistent(&snapshot.counters);
+    WJHMetricsReaderClose(reader);
+
+    uint64_t const n = options->events, disables = n / kDisableInterval;
+    uint64_t times[kWJHMetricsTimeBucketCount] = { 0 };
+    for (uint64_t i = 0; i < n && i < kTimeCycle; ++i) {
+        // Every value in the time cycle lands in the same bucket every time around.
+        unsigned bucket = i == 0 ? 0 : 63 - (unsigned)__builtin_clzll(i);
+        times[bucket] += expectedCount(n, kTimeCycle, i);
+    }
+    return match
+        && snapshot.counters.passed + snapshot.counters.modified + snapshot.counters.dropped == n
+        && snapshot.counters.timeoutDisables == (disables + 1) / 2
+        && snapshot.counters.userInputDisables == disables / 2
+        && snapshot.counters.ringBufferOverflows == n / kOverflowInterval
+        && memcmp(times, snapshot.counters.callbackTimes, sizeof(times)) == 0;
+}
+
+bool WJHMetricsStressRun(WJHMetricsStressOptions const *options, WJHMetricsStressResult *result) {
+    memset(result, 0, sizeof(*result));
+    Stress stress;
+    memset(&stress, 0, sizeof(stress));
+    stress.options = *options;
+    atomic_init(&stress.writing, true);
+    atomic_init(&stress.reads, 0);
+    atomic_init(&stress.busyReads, 0);
+    atomic_init(&stress.corrupted, 0);
+
+    WJHMetricsWriter *writer = WJHMetricsWriterCreate(options->name, 42);
+    pthread_t *threads = calloc(options->readers ? options->readers : 1, sizeof(*threads));
+    if (writer == NULL || threads == NULL) {
+        WJHMetricsWriterDestroy(writer);
+        free(threads);
+        return false;
+    }
+
+    unsigned started = 0;
+    for (; started < options->readers; ++started) {
+        if (pthread_create(threads + started, NULL, runReader, &stress) != 0) {
+            break;
+        }
+    }
+    // The writer is this thread, the only one that ever writes, just like a tap callback.
+    writeEvents(writer, options->events);
+    atomic_store(&stress.writing, false);
+    for (unsigned i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    result->finalCountsMatch = hasFinalCounts(options);
+    WJHMetricsWriterDestroy(writer);
+    result->reads = atomic_load(&stress.reads);
+    result->busyReads = atomic_load(&stress.busyReads);
+    result->corrupted = atomic_load(&stress.corrupted);
+    return started == options->readers;
+}
@@ -0,0 +1,54 @@
+//
+//  WJHMetricsStress.h
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTapTests_WJHMetricsStress_h
+#define WJHEventTapTests_WJHMetricsStress_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WJHMetricsStressOptions {
+    /// The name of the shared memory segment, which must not be in use.
+    char const *name;
+
+    /// Threads that each map the segment on their own, and copy it as fast as they can while the writer runs.
+    unsigned readers;
+
+    /// The number of synthetic events the writer counts.
+    uint64_t events;
+} WJHMetricsStressOptions;
+
+typedef struct WJHMetricsStressResult {
+    /// Consistent copies taken by the readers.
+    uint64_t reads;
+
+    /// Copies a reader gave up on, because the writer kept changing the counters.  These are allowed, but should be rare.
+    uint64_t busyReads;
+
+    /// Copies whose counters did not add up, or went backwards.  Anything but zero is a bug.
+    uint64_t corrupted;
+
+    /// Whether a copy taken after the writer finished had exactly the expected counts.
+    bool finalCountsMatch;
+} WJHMetricsStressResult;
+
+/**
+ Count synthetic events into a metrics segment, from one writer thread, while reader threads copy it through mappings of their own, and check that every copy is consistent: that the events by type, by outcome, and by callback time all add up to the same total, that the total time matches that total, and that no counter ever goes backwards.  Uses only C11, POSIX shared memory, and POSIX threads, so it runs on Linux as well as the Mac.
+
+ @return false if the segment could not be created, or a thread could not be started.
+ */
+bool WJHMetricsStressRun(WJHMetricsStressOptions const *options, WJHMetricsStressResult *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+//
+//  WJHMetricsStressMain.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+/*
+ A command line driver for the metrics segment stress test, for running it where there is no XCTest, such as on Linux.  It is not part of the Xcode targets, which run the same test from WJHMetricsSegmentTests.m.  Build it, preferably with a sanitizer, from the root of the repository with:
+
+     cc -O2 -std=c11 -D_GNU_SOURCE -pthread -fsanitize=thread -I. -o wjh-metrics-stress \
+         WJHEventTapTests/WJHMetricsStress.c WJHEventTapTests/WJHMetricsStressMain.c WJHEventTap/WJHMetricsSegment.c -lrt
+
+ Usage: wjh-metrics-stress [--readers N] [--events N] [--name NAME]
+
+ The exit status is 0 if every copy a reader took was consistent, and the final counts were exact.
+ */
+
+#include "WJHMetricsStress.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int usage(char const *program) {
+    fprintf(stderr, "usage: %s [--readers N] [--events N] [--name NAME]\n", program);
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    char name[64];
+    snprintf(name, sizeof(name), "/wjh-metrics-stress-%d", (int)getpid());
+    WJHMetricsStressOptions options = {
+        .name = name,
+        .readers = 4,
+        .events = 10000000,
+    };
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 == argc) {
+            return usage(argv[0]);
+        }
+        char const *option = argv[i], *value = argv[++i];
+        if (strcmp(option, "--readers") == 0) {
+            options.readers = (unsigned)strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--events") == 0) {
+            options.events = strtoull(value, NULL, 10);
+        } else if (strcmp(option, "--name") == 0) {
+            options.name = value;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    WJHMetricsStressResult result;
+    if (!WJHMetricsStressRun(&options, &result)) {
+        fprintf(stderr, "could not start the stress test\n");
+        return 2;
+    }
+    printf("reads %" PRIu64 ", busy reads %" PRIu64 ", corrupted %" PRIu64 ", final counts %s\n", result.reads, result.busyReads, result.corrupted, result.finalCountsMatch ? "match" : "DIFFER");
+    if (result.corrupted != 0 || !result.finalCountsMatch) {
+        fprintf(stderr, "FAILED\n");
+        return 1;
+    }
+    return 0;
+}
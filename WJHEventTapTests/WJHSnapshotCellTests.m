@@ -0,0 +1,159 @@
+//
+//  WJHSnapshotCellTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHSnapshotStress.h"
+
+@interface WJHSnapshotCellTests : XCTestCase
+@end
+
+typedef struct TestSnapshot {
+    WJHSnapshot header;
+    int value;
+} TestSnapshot;
+
+static TestSnapshot * createTestSnapshot(int value) {
+    TestSnapshot *snapshot = calloc(1, sizeof(*snapshot));
+    snapshot->value = value;
+    return snapshot;
+}
+
+static void destroyTestSnapshot(WJHSnapshot *snapshot, void *context) {
+    ++*(int *)context;
+    free(snapshot);
+}
+
+static WJHSnapshot * incrementTestSnapshot(WJHSnapshot const *current, void *context) {
+    return &createTestSnapshot(((TestSnapshot const *)current)->value + 1)->header;
+}
+
+/// Counts the key down events it is given.
+@interface WJHSnapshotDelegate : NSObject<WJHEventTapDelegate>
+@property (atomic, assign) NSUInteger count;
+@end
+
+@implementation WJHSnapshotDelegate
+- (CGEventRef)eventTap:(WJHEventTap*)eventTap keyDownEvent:(CGEventRef)event proxy:(CGEventTapProxy)proxy {
+    ++_count;
+    return event;
+}
+@end
+
+@implementation WJHSnapshotCellTests
+
+#pragma mark - Cell
+
+- (void)testReaderKeepsReplacedSnapshot {
+    int destroyed = 0;
+    WJHSnapshotCell *cell = WJHSnapshotCellCreate(&createTestSnapshot(1)->header, destroyTestSnapshot, &destroyed);
+
+    unsigned token;
+    TestSnapshot const *snapshot = (TestSnapshot const *)WJHSnapshotCellReadBegin(cell, &token);
+    WJHSnapshotCellPublish(cell, &createTestSnapshot(2)->header);
+    WJHSnapshotCellPublish(cell, &createTestSnapshot(3)->header);
+    XCTAssertEqual(1, snapshot->value);
+    XCTAssertEqual(0, destroyed);
+    XCTAssertGreaterThan(WJHSnapshotCellReclaim(cell), 0);
+
+    unsigned innerToken;
+    XCTAssertEqual(3, ((TestSnapshot const *)WJHSnapshotCellReadBegin(cell, &innerToken))->value);
+    WJHSnapshotCellReadEnd(cell, innerToken);
+    WJHSnapshotCellReadEnd(cell, token);
+
+    WJHSnapshotCellSynchronize(cell);
+    XCTAssertEqual(2, destroyed);
+    XCTAssertEqual(0, WJHSnapshotCellReclaim(cell));
+    WJHSnapshotCellDestroy(cell);
+    XCTAssertEqual(3, destroyed);
+}
+
+- (void)testPublishWithoutReadersReclaimsAtOnce {
+    int destroyed = 0;
+    WJHSnapshotCell *cell = WJHSnapshotCellCreate(&createTestSnapshot(1)->header, destroyTestSnapshot, &destroyed);
+    XCTAssertTrue(WJHSnapshotCellUpdate(cell, incrementTestSnapshot, NULL));
+    XCTAssertEqual(1, destroyed);
+
+    unsigned token;
+    XCTAssertEqual(2, ((TestSnapshot const *)WJHSnapshotCellReadBegin(cell, &token))->value);
+    WJHSnapshotCellReadEnd(cell, token);
+    WJHSnapshotCellDestroy(cell);
+    XCTAssertEqual(2, destroyed);
+}
+
+- (void)testStress {
+    WJHSnapshotStressOptions options = {
+        .readers = 4,
+        .writers = 2,
+        .eventsPerReader = 200000,
+        .publishFromReaderInterval = 100,
+    };
+    WJHSnapshotStressResult result;
+    XCTAssertTrue(WJHSnapshotStressRun(&options, &result));
+    XCTAssertEqual(0, result.corrupted);
+    XCTAssertEqual(options.readers * options.eventsPerReader, result.events);
+    XCTAssertEqual(result.published + 1, result.destroyed);
+}
+
+
+#pragma mark - Tap
+
+- (void)testReconfigurationUnderLoad {
+    static NSUInteger const kEventCount = 200000;
+    WJHSnapshotDelegate *delegate = [WJHSnapshotDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    WJHEventFilterRule rule = { .typeMask = CGEventMaskBit(kCGEventKeyDown) };
+    WJHEventFilter *filter = [WJHEventFilter filterWithRules:&rule count:1];
+
+    __block volatile BOOL done = NO;
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        CGEventRef event = CGEventCreateKeyboardEvent(NULL, 0, true);
+        for (NSUInteger i = 0; i < kEventCount; ++i) {
+            WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, event);
+        }
+        CFRelease(event);
+        done = YES;
+    });
+    dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        // Swap every part of the configuration, as fast as possible, for as long as the producer runs.
+        for (NSUInteger i = 0; !done; ++i) {
+            tap.delegate = (i & 1) ? delegate : nil;
+            tap.filter = (i & 2) ? filter : nil;
+            tap.enabled = !!(i & 4);
+        }
+        tap.delegate = delegate;
+    });
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    // Every event went to the delegate, or to no delegate, and none was lost to a torn configuration.
+    XCTAssertLessThanOrEqual(delegate.count, kEventCount);
+    NSUInteger before = delegate.count;
+    CGEventRef event = CGEventCreateKeyboardEvent(NULL, 0, true);
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, event);
+    CFRelease(event);
+    XCTAssertEqual(before + 1, delegate.count);
+    XCTAssertEqual(delegate, tap.delegate);
+}
+
+- (void)testPerformanceDispatchWhileReconfiguring {
+    WJHSnapshotDelegate *delegate = [WJHSnapshotDelegate new];
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:YES delegate:delegate];
+    CGEventRef event = CGEventCreateKeyboardEvent(NULL, 0, true);
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 1000000; ++i) {
+            WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, event);
+            if (i % 1000 == 0) {
+                tap.delegate = delegate;
+            }
+        }
+    }];
+    CFRelease(event);
+}
+
+@end
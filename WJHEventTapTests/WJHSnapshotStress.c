@@ -0,0 +1,187 @@
+//
+//  WJHSnapshotStress.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHSnapshotStress.h"
+#include <WJHEventTap/WJHSnapshotCell.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { kPayloadCount = 8 };
+
+static uint64_t const kPoison = UINT64_C(0xDEADDEADDEADDEAD);
+
+/// Stands in for a tap configuration.  Every payload word is derived from the version, so a torn or recycled snapshot shows.
+typedef struct StressSnapshot {
+    WJHSnapshot header;
+    uint64_t version;
+    uint64_t payload[kPayloadCount];
+} StressSnapshot;
+
+typedef struct Stress {
+    WJHSnapshotCell *cell;
+    WJHSnapshotStressOptions options;
+    atomic_uint_fast64_t nextVersion;
+    atomic_uint_fast64_t published;
+    atomic_uint_fast64_t destroyed;
+    atomic_uint_fast64_t corrupted;
+    atomic_uint_fast64_t events;
+    atomic_size_t maxPending;
+    atomic_uint readersRunning;
+} Stress;
+
+static uint64_t payloadWord(uint64_t version, unsigned i) {
+    return (version + 1) * UINT64_C(0x9E3779B97F4A7C15) + i;
+}
+
+static StressSnapshot * createSnapshot(Stress *stress) {
+    StressSnapshot *snapshot = malloc(sizeof(*snapshot));
+    if (snapshot == NULL) {
+        abort();
+    }
+    snapshot->version = atomic_fetch_add(&stress->nextVersion, 1);
+    for (unsigned i = 0; i < kPayloadCount; ++i) {
+        snapshot->payload[i] = payloadWord(snapshot->version, i);
+    }
+    return snapshot;
+}
+
+static void destroySnapshot(WJHSnapshot *header, void *context) {
+    Stress *stress = context;
+    StressSnapshot *snapshot = (StressSnapshot *)header;
+    // Poison it first, so a reader that still has it, and beats the allocator to the memory, notices.
+    snapshot->version = kPoison;
+    memset(snapshot->payload, 0xDE, sizeof(snapshot->payload));
+    free(snapshot);
+    atomic_fetch_add(&stress->destroyed, 1);
+}
+
+static bool isIntact(StressSnapshot const *snapshot) {
+    uint64_t version = snapshot->version;
+    if (version == kPoison) {
+        return false;
+    }
+    for (unsigned i = 0; i < kPayloadCount; ++i) {
+        if (snapshot->payload[i] != payloadWord(version, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void publish(Stress *stress) {
+    WJHSnapshotCellPublish(stress->cell, &createSnapshot(stress)->header);
+    atomic_fetch_add(&stress->published, 1);
+}
+
+static void noteCorruption(Stress *stress) {
+    atomic_fetch_add(&stress->corrupted, 1);
+}
+
+static void * runReader(void *context) {
+    Stress *stress = context;
+    uint64_t const interval = stress->options.publishFromReaderInterval;
+    for (uint64_t event = 0; event < stress->options.eventsPerReader; ++event) {
+        unsigned token;
+        StressSnapshot const *snapshot = (StressSnapshot const *)WJHSnapshotCellReadBegin(stress->cell, &token);
+        if (!isIntact(snapshot)) {
+            noteCorruption(stress);
+        }
+        if (interval && event % interval == interval - 1) {
+            // Reconfigure from inside the read section, then keep using the snapshot that was replaced.
+            publish(stress);
+        }
+
+        // A nested read, as when a flush delivers to the delegate from inside the callback.
+        unsigned innerToken;
+        StressSnapshot const *inner = (StressSnapshot const *)WJHSnapshotCellReadBegin(stress->cell, &innerToken);
+        if (!isIntact(inner)) {
+            noteCorruption(stress);
+        }
+        WJHSnapshotCellReadEnd(stress->cell, innerToken);
+
+        if (!isIntact(snapshot)) {
+            noteCorruption(stress);
+        }
+        WJHSnapshotCellReadEnd(stress->cell, token);
+    }
+    atomic_fetch_add(&stress->events, stress->options.eventsPerReader);
+    atomic_fetch_sub(&stress->readersRunning, 1);
+    return NULL;
+}
+
+static void * runWriter(void *context) {
+    Stress *stress = context;
+    while (atomic_load(&stress->readersRunning) > 0) {
+        publish(stress);
+        size_t pending = WJHSnapshotCellReclaim(stress->cell);
+        size_t seen = atomic_load(&stress->maxPending);
+        while (pending > seen && !atomic_compare_exchange_weak(&stress->maxPending, &seen, pending)) {
+        }
+    }
+    return NULL;
+}
+
+bool WJHSnapshotStressRun(WJHSnapshotStressOptions const *options, WJHSnapshotStressResult *result) {
+    Stress stress;
+    memset(&stress, 0, sizeof(stress));
+    stress.options = *options;
+    atomic_init(&stress.nextVersion, 0);
+    atomic_init(&stress.published, 0);
+    atomic_init(&stress.destroyed, 0);
+    atomic_init(&stress.corrupted, 0);
+    atomic_init(&stress.events, 0);
+    atomic_init(&stress.maxPending, 0);
+    atomic_init(&stress.readersRunning, options->readers);
+
+    StressSnapshot *initial = createSnapshot(&stress);
+    stress.cell = WJHSnapshotCellCreate(&initial->header, destroySnapshot, &stress);
+    unsigned const threadCount = options->readers + options->writers;
+    pthread_t *threads = calloc(threadCount ? threadCount : 1, sizeof(*threads));
+    if (stress.cell == NULL || threads == NULL) {
+        free(threads);
+        if (stress.cell) {
+            WJHSnapshotCellDestroy(stress.cell);
+        } else {
+            free(initial);
+        }
+        return false;
+    }
+
+    unsigned started = 0;
+    bool ok = true;
+    for (; started < threadCount; ++started) {
+        bool const reader = started < options->readers;
+        if (pthread_create(threads + started, NULL, reader ? runReader : runWriter, &stress) != 0) {
+            ok = false;
+            break;
+        }
+    }
+    if (!ok) {
+        // Readers that never started must not keep the writers going.
+        for (unsigned i = started; i < options->readers; ++i) {
+            atomic_fetch_sub(&stress.readersRunning, 1);
+        }
+    }
+    for (unsigned i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    // With everyone gone, everything retired must now be reclaimable, and destroying the cell takes the current snapshot.
+    WJHSnapshotCellSynchronize(stress.cell);
+    WJHSnapshotCellDestroy(stress.cell);
+
+    result->events = atomic_load(&stress.events);
+    result->published = atomic_load(&stress.published);
+    result->destroyed = atomic_load(&stress.destroyed);
+    result->corrupted = atomic_load(&stress.corrupted);
+    result->maxPending = atomic_load(&stress.maxPending);
+    return ok;
+}
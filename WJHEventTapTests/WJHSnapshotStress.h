@@ -0,0 +1,56 @@
+//
+//  WJHSnapshotStress.h
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTapTests_WJHSnapshotStress_h
+#define WJHEventTapTests_WJHSnapshotStress_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WJHSnapshotStressOptions {
+    /// Threads standing in for tap callbacks, each reading the cell once per synthetic event.
+    unsigned readers;
+
+    /// Threads that do nothing but publish new snapshots.
+    unsigned writers;
+
+    /// The number of events each reader processes.
+    uint64_t eventsPerReader;
+
+    /// Every this many events, a reader also publishes from inside its read section, the way a callback disables its own tap.  Zero never does.
+    uint64_t publishFromReaderInterval;
+} WJHSnapshotStressOptions;
+
+typedef struct WJHSnapshotStressResult {
+    uint64_t events;
+    uint64_t published;
+    uint64_t destroyed;
+
+    /// Snapshots a reader found torn, or already destroyed.  Anything but zero is a bug.
+    uint64_t corrupted;
+
+    /// The most retired snapshots seen waiting at once.
+    size_t maxPending;
+} WJHSnapshotStressResult;
+
+/**
+ Hammer a WJHSnapshotCell with reconfiguration while synthetic producers read it, and check that no reader ever sees a snapshot that is torn or destroyed, and that every snapshot is eventually destroyed exactly once.  Uses only C11 and POSIX threads, so it runs on Linux as well as the Mac.
+
+ @return false if a thread could not be started, or memory allocated.
+ */
+bool WJHSnapshotStressRun(WJHSnapshotStressOptions const *options, WJHSnapshotStressResult *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+//
+//  WJHSnapshotStressMain.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+/*
+ A command line driver for the snapshot stress test, for running it where there is no XCTest, such as on Linux.  It is not part of the Xcode targets, which run the same test from WJHSnapshotCellTests.m.  Build it, preferably with a sanitizer, from the root of the repository with:
+
+     cc -O2 -std=c11 -D_GNU_SOURCE -pthread -fsanitize=thread -I. -o wjh-snapshot-stress \
+         WJHEventTapTests/WJHSnapshotStress.c WJHEventTapTests/WJHSnapshotStressMain.c WJHEventTap/WJHSnapshotCell.c
+
+ Usage: wjh-snapshot-stress [--readers N] [--writers N] [--events N] [--publish-interval N]
+
+ The exit status is 0 if every snapshot a reader saw was intact, and every snapshot published was destroyed exactly once.
+ */
+
+#include "WJHSnapshotStress.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int usage(char const *program) {
+    fprintf(stderr, "usage: %s [--readers N] [--writers N] [--events N] [--publish-interval N]\n", program);
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    WJHSnapshotStressOptions options = {
+        .readers = 4,
+        .writers = 2,
+        .eventsPerReader = 1000000,
+        .publishFromReaderInterval = 1000,
+    };
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 == argc) {
+            return usage(argv[0]);
+        }
+        char const *option = argv[i], *value = argv[++i];
+        if (strcmp(option, "--readers") == 0) {
+            options.readers = (unsigned)strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--writers") == 0) {
+            options.writers = (unsigned)strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--events") == 0) {
+            options.eventsPerReader = strtoull(value, NULL, 10);
+        } else if (strcmp(option, "--publish-interval") == 0) {
+            options.publishFromReaderInterval = strtoull(value, NULL, 10);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    WJHSnapshotStressResult result;
+    if (!WJHSnapshotStressRun(&options, &result)) {
+        fprintf(stderr, "could not start the stress test\n");
+        return 2;
+    }
+    printf("events %" PRIu64 ", published %" PRIu64 ", destroyed %" PRIu64 ", corrupted %" PRIu64 ", max pending %zu\n", result.events, result.published, result.destroyed, result.corrupted, result.maxPending);
+
+    // The initial snapshot was never published, but is destroyed along with the rest.
+    if (result.corrupted != 0 || result.destroyed != result.published + 1) {
+        fprintf(stderr, "FAILED\n");
+        return 1;
+    }
+    return 0;
+}
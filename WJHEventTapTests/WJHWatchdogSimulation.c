@@ -0,0 +1,119 @@
+//
+//  WJHWatchdogSimulation.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#include "WJHWatchdogSimulation.h"
+
+#include <string.h>
+
+typedef struct Simulation {
+    FILE *log;
+    WJHWatchdogLevel level;
+    WJHWatchdogLevel maxLevel;
+    uint64_t changes;
+    bool consistent;
+} Simulation;
+
+static char const * reasonName(WJHWatchdogReason reason) {
+    switch (reason) {
+        case WJHWatchdogReasonOverBudget: return "over budget";
+        case WJHWatchdogReasonSlow: return "slow";
+        case WJHWatchdogReasonTimeout: return "timeout";
+        case WJHWatchdogReasonRecovered: return "recovered";
+    }
+    return "unknown";
+}
+
+static void levelChanged(void *context, WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason, uint64_t now) {
+    Simulation *simulation = context;
+    if (from != simulation->level || (to != from + 1 && to + 1 != from)) {
+        simulation->consistent = false;
+    }
+    simulation->level = to;
+    if (to > simulation->maxLevel) {
+        simulation->maxLevel = to;
+    }
+    ++simulation->changes;
+    if (simulation->log) {
+        fprintf(simulation->log, "%10.3f s  %s -> %s (%s)\n", now / 1e9, WJHWatchdogLevelName(from), WJHWatchdogLevelName(to), reasonName(reason));
+    }
+}
+
+bool WJHWatchdogSimulate(WJHWatchdogSimulationOptions const *options, WJHWatchdogSimulationResult *result) {
+    memset(result, 0, sizeof(*result));
+    if (options->phaseCount > kWJHWatchdogSimulationMaxPhases) {
+        return false;
+    }
+    Simulation simulation = { .log = options->log, .consistent = true };
+    WJHWatchdog *watchdog = WJHWatchdogCreate(&options->policy, levelChanged, &simulation);
+    if (watchdog == NULL) {
+        return false;
+    }
+
+    // The fake clock: the time the callback is free to take the next event.
+    uint64_t now = 0;
+    for (size_t p = 0; p < options->phaseCount; ++p) {
+        WJHWatchdogPhase const *phase = options->phases + p;
+        uint64_t const start = now;
+        for (uint32_t i = 0; i < phase->events; ++i) {
+            uint64_t const arrival = start + i * phase->interval;
+            if (now < arrival) {
+                now = arrival;
+            }
+            bool const motion = phase->motion && i % 4 != 0;
+
+            WJHWatchdogLevel const level = WJHWatchdogBeginEvent(watchdog, now);
+            if (level >= WJHWatchdogLevelPassThrough) {
+                ++result->passedThrough;
+                continue;
+            }
+            if (level >= WJHWatchdogLevelShedMotion && motion) {
+                ++result->shedMotion;
+                continue;
+            }
+
+            uint64_t cost = motion ? phase->motionNanoseconds : phase->keyNanoseconds;
+            if (level >= WJHWatchdogLevelSkipOptional) {
+                ++result->handledWithoutOptional;
+            } else {
+                cost += phase->optionalNanoseconds;
+            }
+            ++result->handled;
+            now += cost;
+            WJHWatchdogRecordCall(watchdog, now, cost);
+            if (cost > options->systemTimeout) {
+                ++result->timeouts;
+                WJHWatchdogRecordTimeout(watchdog, now);
+            }
+        }
+        result->levelAtEndOfPhase[p] = WJHWatchdogGetLevel(watchdog);
+    }
+
+    result->levelChanges = simulation.changes;
+    result->maxLevel = simulation.maxLevel;
+    result->elapsed = now;
+    result->changesConsistent = simulation.consistent && simulation.level == WJHWatchdogGetLevel(watchdog);
+    WJHWatchdogDestroy(watchdog);
+    return true;
+}
+
+size_t WJHWatchdogSimulationDefaultPhases(WJHWatchdogPhase *phases, size_t capacity) {
+    WJHWatchdogPhase const defaults[] = {
+        // Five seconds of ordinary mouse use.
+        { .events = 5000, .interval = 1000000, .motion = true, .keyNanoseconds = 50000, .motionNanoseconds = 20000, .optionalNanoseconds = 10000 },
+        // The motion handler slows to 80 ms an event, most of the budget.
+        { .events = 1000, .interval = 1000000, .motion = true, .keyNanoseconds = 50000, .motionNanoseconds = 80000000, .optionalNanoseconds = 5000000 },
+        // Everything stalls, for longer than the system allows.
+        { .events = 20, .interval = 100000000, .motion = false, .keyNanoseconds = 1500000000 },
+        // A minute of ordinary mouse use.
+        { .events = 60000, .interval = 1000000, .motion = true, .keyNanoseconds = 50000, .motionNanoseconds = 20000, .optionalNanoseconds = 10000 },
+    };
+    size_t const count = sizeof(defaults) / sizeof(*defaults);
+    for (size_t i = 0; i < count && i < capacity; ++i) {
+        phases[i] = defaults[i];
+    }
+    return count;
+}
@@ -0,0 +1,95 @@
+//
+//  WJHWatchdogSimulation.h
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#ifndef WJHEventTapTests_WJHWatchdogSimulation_h
+#define WJHEventTapTests_WJHWatchdogSimulation_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <WJHEventTap/WJHWatchdog.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    kWJHWatchdogSimulationMaxPhases = 16,
+};
+
+/**
+ A stretch of input, and how long the simulated handlers take with it.  All times are in nanoseconds.
+ */
+typedef struct WJHWatchdogPhase {
+    uint32_t events;
+
+    /// The time between events arriving.  Events that arrive while the callback is busy wait for it.
+    uint64_t interval;
+
+    /// Every event but each fourth is a motion event, as in ordinary mouse use.  When a phase has no motion, every event is a key.
+    bool motion;
+
+    /// How long the handler takes with key and motion events.
+    uint64_t keyNanoseconds;
+    uint64_t motionNanoseconds;
+
+    /// The optional work done with every event, until it is shed.
+    uint64_t optionalNanoseconds;
+} WJHWatchdogPhase;
+
+typedef struct WJHWatchdogSimulationOptions {
+    WJHWatchdogPolicy policy;
+
+    /// A callback that takes longer than this is timed out by the simulated system, which the tap re-enables at once.
+    uint64_t systemTimeout;
+
+    WJHWatchdogPhase const *phases;
+    size_t phaseCount;
+
+    /// Where to write each level change, or NULL.
+    FILE *log;
+} WJHWatchdogSimulationOptions;
+
+typedef struct WJHWatchdogSimulationResult {
+    /// Events handled, with and without their optional work, and events passed on without being handled, because they were motion, or everything was.
+    uint64_t handled;
+    uint64_t handledWithoutOptional;
+    uint64_t shedMotion;
+    uint64_t passedThrough;
+
+    uint64_t timeouts;
+    uint64_t levelChanges;
+    WJHWatchdogLevel maxLevel;
+    WJHWatchdogLevel levelAtEndOfPhase[kWJHWatchdogSimulationMaxPhases];
+
+    /// The simulated time the run took.
+    uint64_t elapsed;
+
+    /// Each reported change started at the level the one before it ended at, and moved one level.  Anything but true is a bug.
+    bool changesConsistent;
+} WJHWatchdogSimulationResult;
+
+/**
+ Run a simulated tap, whose handlers take the times the phases give them, through a WJHWatchdog, on a fake clock.  Nothing really waits, so hours of input take milliseconds, and the result is the same on every platform.
+
+ The simulated tap sheds work the way WJHEventTap does: optional work from WJHWatchdogLevelSkipOptional, motion events from WJHWatchdogLevelShedMotion, and everything at WJHWatchdogLevelPassThrough.  Only the events it handles are measured.
+
+ @return false if there are more than kWJHWatchdogSimulationMaxPhases phases, or the watchdog could not be created.
+ */
+bool WJHWatchdogSimulate(WJHWatchdogSimulationOptions const *options, WJHWatchdogSimulationResult *result);
+
+/**
+ A run of ordinary input, then a motion handler that slows down, then a stall on every event, then ordinary input again, for long enough to recover.
+ */
+size_t WJHWatchdogSimulationDefaultPhases(WJHWatchdogPhase *phases, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+//
+//  WJHWatchdogSimulationMain.c
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+/*
+ A command line driver for the watchdog simulation, for running it where there is no XCTest, such as on Linux.  It is not part of the Xcode targets, which run the same simulation from WJHWatchdogTests.m.  Build it from the root of the repository with:
+
+     cc -O2 -std=c11 -D_GNU_SOURCE -I. -o wjh-watchdog-simulation \
+         WJHEventTapTests/WJHWatchdogSimulation.c WJHEventTapTests/WJHWatchdogSimulationMain.c WJHEventTap/WJHWatchdog.c
+
+ Usage: wjh-watchdog-simulation [--budget-ms N] [--hold-ms N] [--timeout-ms N] [--quiet]
+
+ Runs the default phases, printing each level change, and a summary.  The exit status is 0 if the watchdog shed load while the handlers were slow, and recovered to normal by the end.
+ */
+
+#include "WJHWatchdogSimulation.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int usage(char const *program) {
+    fprintf(stderr, "usage: %s [--budget-ms N] [--hold-ms N] [--timeout-ms N] [--quiet]\n", program);
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    WJHWatchdogPhase phases[kWJHWatchdogSimulationMaxPhases];
+    WJHWatchdogSimulationOptions options = {
+        .policy = WJHWatchdogDefaultPolicy(),
+        .systemTimeout = 1000000000,
+        .phases = phases,
+        .phaseCount = WJHWatchdogSimulationDefaultPhases(phases, kWJHWatchdogSimulationMaxPhases),
+        .log = stdout,
+    };
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quiet") == 0) {
+            options.log = NULL;
+            continue;
+        }
+        if (i + 1 == argc) {
+            return usage(argv[0]);
+        }
+        char const *option = argv[i];
+        uint64_t const nanoseconds = strtoull(argv[++i], NULL, 10) * 1000000;
+        if (strcmp(option, "--budget-ms") == 0) {
+            options.policy.budget = nanoseconds;
+        } else if (strcmp(option, "--hold-ms") == 0) {
+            options.policy.holdTime = nanoseconds;
+        } else if (strcmp(option, "--timeout-ms") == 0) {
+            options.systemTimeout = nanoseconds;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    WJHWatchdogSimulationResult result;
+    if (!WJHWatchdogSimulate(&options, &result)) {
+        fprintf(stderr, "invalid policy\n");
+        return 2;
+    }
+    printf("%" PRIu64 " handled (%" PRIu64 " without optional work), %" PRIu64 " motion shed, %" PRIu64 " passed through, %" PRIu64 " timeouts, %" PRIu64 " level changes over %.1f s\n",
+           result.handled, result.handledWithoutOptional, result.shedMotion, result.passedThrough, result.timeouts, result.levelChanges, result.elapsed / 1e9);
+    for (size_t i = 0; i < options.phaseCount; ++i) {
+        printf("phase %zu ended at %s\n", i + 1, WJHWatchdogLevelName(result.levelAtEndOfPhase[i]));
+    }
+    bool const ok = result.changesConsistent && result.maxLevel > WJHWatchdogLevelNormal && result.levelAtEndOfPhase[options.phaseCount - 1] == WJHWatchdogLevelNormal;
+    return ok ? 0 : 1;
+}
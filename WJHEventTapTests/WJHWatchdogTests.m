@@ -0,0 +1,247 @@
+//
+//  WJHWatchdogTests.m
+//  WJHEventTapTests
+//
+//  Copyright (c) 2015 Jody Hagins. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+@import WJHEventTap;
+#import <WJHEventTap/WJHEventTap+Private.h>
+#import "WJHWatchdogSimulation.h"
+
+static uint64_t const kMillisecond = 1000000;
+
+typedef struct LevelChanges {
+    unsigned count;
+    WJHWatchdogLevel from;
+    WJHWatchdogLevel to;
+    WJHWatchdogReason reason;
+} LevelChanges;
+
+static void levelChanged(void *context, WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason, uint64_t now) {
+    LevelChanges *changes = context;
+    ++changes->count;
+    changes->from = from;
+    changes->to = to;
+    changes->reason = reason;
+}
+
+@interface WJHWatchdogTests : XCTestCase
+@end
+
+@implementation WJHWatchdogTests {
+    LevelChanges changes;
+    WJHWatchdog *watchdog;
+}
+
+- (void)setUp {
+    [super setUp];
+    memset(&changes, 0, sizeof(changes));
+    WJHWatchdogPolicy policy = WJHWatchdogDefaultPolicy();
+    watchdog = WJHWatchdogCreate(&policy, levelChanged, &changes);
+}
+
+- (void)tearDown {
+    WJHWatchdogDestroy(watchdog);
+    [super tearDown];
+}
+
+
+#pragma mark - State Machine
+
+- (void)testInvalidPolicy {
+    WJHWatchdogPolicy policy = WJHWatchdogDefaultPolicy();
+    policy.budget = 0;
+    XCTAssertTrue(WJHWatchdogCreate(&policy, NULL, NULL) == NULL);
+    policy = WJHWatchdogDefaultPolicy();
+    policy.recoverPercent = policy.shedPercent + 1;
+    XCTAssertTrue(WJHWatchdogCreate(&policy, NULL, NULL) == NULL);
+    XCTAssertTrue(WJHWatchdogCreate(NULL, NULL, NULL) == NULL);
+}
+
+- (void)testOverBudgetShedsAtOnce {
+    XCTAssertEqual(WJHWatchdogLevelNormal, WJHWatchdogBeginEvent(watchdog, 0));
+    WJHWatchdogRecordCall(watchdog, 100 * kMillisecond, 100 * kMillisecond);
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, WJHWatchdogGetLevel(watchdog));
+    XCTAssertEqual(1, changes.count);
+    XCTAssertEqual(WJHWatchdogLevelNormal, changes.from);
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, changes.to);
+    XCTAssertEqual(WJHWatchdogReasonOverBudget, changes.reason);
+}
+
+- (void)testSlowAverageSheds {
+    // The average is not trusted until enough calls have been made.
+    for (int i = 1; i < 8; ++i) {
+        WJHWatchdogRecordCall(watchdog, i * 60 * kMillisecond, 60 * kMillisecond);
+    }
+    XCTAssertEqual(WJHWatchdogLevelNormal, WJHWatchdogGetLevel(watchdog));
+    WJHWatchdogRecordCall(watchdog, 480 * kMillisecond, 60 * kMillisecond);
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, WJHWatchdogGetLevel(watchdog));
+    XCTAssertEqual(WJHWatchdogReasonSlow, changes.reason);
+
+    WJHWatchdogStatistics statistics = WJHWatchdogGetStatistics(watchdog);
+    XCTAssertEqual(8, statistics.calls);
+    XCTAssertEqual(1, statistics.levelsShed);
+    XCTAssertEqual(0, statistics.averageNanoseconds);
+}
+
+- (void)testRecoversAfterHoldWhenFast {
+    WJHWatchdogRecordCall(watchdog, kMillisecond, 100 * kMillisecond);
+    for (int i = 0; i < 8; ++i) {
+        XCTAssertEqual(WJHWatchdogLevelSkipOptional, WJHWatchdogBeginEvent(watchdog, (100 + i) * kMillisecond));
+        WJHWatchdogRecordCall(watchdog, (100 + i) * kMillisecond, 5 * kMillisecond);
+    }
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, WJHWatchdogBeginEvent(watchdog, 1000 * kMillisecond));
+    XCTAssertEqual(WJHWatchdogLevelNormal, WJHWatchdogBeginEvent(watchdog, 1001 * kMillisecond));
+    XCTAssertEqual(WJHWatchdogReasonRecovered, changes.reason);
+    XCTAssertEqual(1, WJHWatchdogGetStatistics(watchdog).levelsRecovered);
+}
+
+- (void)testDoesNotRecoverWhileModeratelySlow {
+    WJHWatchdogRecordCall(watchdog, 0, 100 * kMillisecond);
+    for (int i = 0; i < 8; ++i) {
+        WJHWatchdogRecordCall(watchdog, (i + 1) * 30 * kMillisecond, 30 * kMillisecond);
+    }
+    // Above the recover threshold, but below the shed threshold.
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, WJHWatchdogBeginEvent(watchdog, 5000 * kMillisecond));
+    XCTAssertEqual(1, changes.count);
+}
+
+- (void)testHoldDoublesWhenShedSoonAfterRecovering {
+    WJHWatchdogRecordCall(watchdog, 0, 100 * kMillisecond);
+    // No calls were made, so there is nothing to say the level is still needed.
+    XCTAssertEqual(WJHWatchdogLevelNormal, WJHWatchdogBeginEvent(watchdog, 1000 * kMillisecond));
+
+    WJHWatchdogRecordCall(watchdog, 1500 * kMillisecond, 100 * kMillisecond);
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, WJHWatchdogBeginEvent(watchdog, 2500 * kMillisecond));
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, WJHWatchdogBeginEvent(watchdog, 3499 * kMillisecond));
+    XCTAssertEqual(WJHWatchdogLevelNormal, WJHWatchdogBeginEvent(watchdog, 3500 * kMillisecond));
+
+    // Long after recovering, the hold is back to the policy's.
+    WJHWatchdogRecordCall(watchdog, 10000 * kMillisecond, 100 * kMillisecond);
+    XCTAssertEqual(WJHWatchdogLevelNormal, WJHWatchdogBeginEvent(watchdog, 11000 * kMillisecond));
+}
+
+- (void)testTimeoutsShedToPassThrough {
+    for (int i = 0; i < 4; ++i) {
+        WJHWatchdogRecordTimeout(watchdog, i * kMillisecond);
+    }
+    XCTAssertEqual(WJHWatchdogLevelPassThrough, WJHWatchdogGetLevel(watchdog));
+    XCTAssertEqual(WJHWatchdogReasonTimeout, changes.reason);
+    WJHWatchdogStatistics statistics = WJHWatchdogGetStatistics(watchdog);
+    XCTAssertEqual(4, statistics.timeouts);
+    XCTAssertEqual(3, statistics.levelsShed);
+    XCTAssertEqual(3, changes.count);
+
+    // Pass through makes no calls, so each hold recovers a level.
+    XCTAssertEqual(WJHWatchdogLevelShedMotion, WJHWatchdogBeginEvent(watchdog, 1003 * kMillisecond));
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, WJHWatchdogBeginEvent(watchdog, 2003 * kMillisecond));
+    XCTAssertEqual(WJHWatchdogLevelNormal, WJHWatchdogBeginEvent(watchdog, 3003 * kMillisecond));
+}
+
+- (void)testSimulation {
+    WJHWatchdogPhase phases[kWJHWatchdogSimulationMaxPhases];
+    WJHWatchdogSimulationOptions options = {
+        .policy = WJHWatchdogDefaultPolicy(),
+        .systemTimeout = 1000 * kMillisecond,
+        .phases = phases,
+        .phaseCount = WJHWatchdogSimulationDefaultPhases(phases, kWJHWatchdogSimulationMaxPhases),
+    };
+    WJHWatchdogSimulationResult result;
+    XCTAssertTrue(WJHWatchdogSimulate(&options, &result));
+    XCTAssertTrue(result.changesConsistent);
+    XCTAssertEqual(WJHWatchdogLevelNormal, result.levelAtEndOfPhase[0]);
+    XCTAssertGreaterThanOrEqual(result.levelAtEndOfPhase[1], WJHWatchdogLevelShedMotion);
+    XCTAssertEqual(WJHWatchdogLevelPassThrough, result.levelAtEndOfPhase[2]);
+    XCTAssertEqual(WJHWatchdogLevelNormal, result.levelAtEndOfPhase[3]);
+    XCTAssertGreaterThan(result.shedMotion, 0);
+    XCTAssertGreaterThan(result.passedThrough, 0);
+}
+
+
+#pragma mark - Tap
+
+- (void)testTapShedsByLevel {
+    __block int keyDowns = 0;
+    __block int moves = 0;
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    delegate.keyDownEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        // Long enough to be measured on any clock.
+        usleep(10);
+        ++keyDowns;
+        return NULL;
+    };
+    delegate.mouseMovedEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        ++moves;
+        return NULL;
+    };
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    XCTAssertFalse(tap.hasWatchdog);
+
+    // Every call is over a budget this small, and nothing recovers within the test.
+    WJHWatchdogPolicy policy = { .budget = 1, .shedPercent = 50, .recoverPercent = 10, .holdTime = UINT64_MAX / 64 };
+    NSMutableArray *levels = [NSMutableArray array];
+    XCTAssertTrue([tap enableWatchdogWithPolicy:&policy queue:nil handler:^(WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason) {
+        XCTAssertEqual(WJHWatchdogReasonOverBudget, reason);
+        [levels addObject:@(to)];
+    }]);
+    XCTAssertTrue(tap.hasWatchdog);
+    XCTAssertFalse([tap enableWatchdogWithPolicy:NULL queue:nil handler:nil]);
+    tap.enabled = YES;
+
+    CGEventRef down = CGEventCreateKeyboardEvent(NULL, 0, true);
+    CGEventRef moved = CGEventCreateMouseEvent(NULL, kCGEventMouseMoved, CGPointMake(10, 10), kCGMouseButtonLeft);
+    XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, down) == NULL);
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, tap.watchdogLevel);
+    XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, down) == NULL);
+    XCTAssertEqual(WJHWatchdogLevelShedMotion, tap.watchdogLevel);
+
+    // Shed events are passed on untouched, and not timed.
+    XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventMouseMoved, moved) == moved);
+    XCTAssertEqual(WJHWatchdogLevelShedMotion, tap.watchdogLevel);
+    XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, down) == NULL);
+    XCTAssertEqual(WJHWatchdogLevelPassThrough, tap.watchdogLevel);
+    XCTAssertTrue(WJHEventTapDispatchEvent(tap, NULL, kCGEventKeyDown, down) == down);
+
+    XCTAssertEqual(3, keyDowns);
+    XCTAssertEqual(0, moves);
+    XCTAssertEqualObjects((@[@(WJHWatchdogLevelSkipOptional), @(WJHWatchdogLevelShedMotion), @(WJHWatchdogLevelPassThrough)]), levels);
+    XCTAssertEqual(3, tap.watchdogStatistics.calls);
+
+    CFRelease(down);
+    CFRelease(moved);
+}
+
+- (void)testTapReenablesAfterTimeout {
+    __block int timeouts = 0;
+    WJHEventTapDelegate *delegate = [WJHEventTapDelegate new];
+    delegate.eventTapDisabledByTimeoutEvent = ^CGEventRef(WJHEventTap *eventTap, CGEventRef event, CGEventTapProxy proxy) {
+        ++timeouts;
+        return event;
+    };
+    WJHEventTap *tap = [[WJHEventTap alloc] initDetachedWithEventMask:kCGEventMaskForAllEvents passive:NO delegate:delegate];
+    XCTestExpectation *shed = [self expectationWithDescription:@"shed"];
+    XCTAssertTrue([tap enableWatchdogWithPolicy:NULL queue:dispatch_get_main_queue() handler:^(WJHWatchdogLevel from, WJHWatchdogLevel to, WJHWatchdogReason reason) {
+        XCTAssertEqual(WJHWatchdogLevelNormal, from);
+        XCTAssertEqual(WJHWatchdogLevelSkipOptional, to);
+        XCTAssertEqual(WJHWatchdogReasonTimeout, reason);
+        [shed fulfill];
+    }]);
+
+    // The tap is disabled, as the system leaves it after a timeout.
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventTapDisabledByTimeout, NULL);
+    XCTAssertTrue(tap.isEnabled);
+    XCTAssertEqual(1, timeouts);
+    XCTAssertEqual(1, tap.watchdogStatistics.timeouts);
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, tap.watchdogLevel);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    // Only the user can undo a disable by user input.
+    tap.enabled = NO;
+    WJHEventTapDispatchEvent(tap, NULL, kCGEventTapDisabledByUserInput, NULL);
+    XCTAssertFalse(tap.isEnabled);
+    XCTAssertEqual(WJHWatchdogLevelSkipOptional, tap.watchdogLevel);
+}
+
+@end